@@ -0,0 +1,211 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/consistent_hashing/consistent_hashing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/casts.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "src/farmhash.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The count of fingerprints processed together in HashBatch. The values of a
+// block stay in L1 cache while all the choices are evaluated.
+constexpr size_t kBlockSize = 256;
+
+// 2^64 - 1, which the notebook divides the fingerprints by.
+constexpr double kMaxUint64 =
+    static_cast<double>(std::numeric_limits<uint64_t>::max());
+
+// The finalizer of SplitMix64, which maps each 64-bit value to a 64-bit value
+// with good avalanche.
+inline uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// Returns -log(u) for the uniform value u = (@bits + 0.5) / 2^64, which is in
+// (0, 1).
+// Unlike log from libm, this has no branch or function call, so it can be
+// inlined into the loop of HashBatch and vectorized. u is written as
+// 2^exponent * m with m in [sqrt(0.5), sqrt(2)), and
+//   log(m) = 2 * atanh(t) = 2 * (t + t^3 / 3 + t^5 / 5 + ...)
+// with t = (m - 1) / (m + 1), |t| < 0.172. The series is truncated after t^13,
+// which gives a relative error below 1e-11.
+inline double NegativeLogOfUniform(const uint64_t bits) {
+  // The top 53 bits, which is the precision of double.
+  double uniform = (static_cast<double>(bits >> 11) + 0.5) *
+                   (1.0 / 9007199254740992.0);
+  uint64_t uniform_bits = absl::bit_cast<uint64_t>(uniform);
+  int64_t exponent = static_cast<int64_t>(uniform_bits >> 52) - 1023;
+  // Replaces the exponent with 0 to get m in [1, 2).
+  double m = absl::bit_cast<double>((uniform_bits & 0x000fffffffffffff) |
+                                    0x3ff0000000000000);
+  bool is_large = m > 1.4142135623730951;
+  m = is_large ? m * 0.5 : m;
+  exponent = is_large ? exponent + 1 : exponent;
+  double t = (m - 1.0) / (m + 1.0);
+  double t2 = t * t;
+  double series =
+      1.0 +
+      t2 * (1.0 / 3 +
+            t2 * (1.0 / 5 +
+                  t2 * (1.0 / 7 +
+                        t2 * (1.0 / 9 + t2 * (1.0 / 11 + t2 * (1.0 / 13))))));
+  return -(static_cast<double>(exponent) * 0.6931471805599453 +
+           2.0 * t * series);
+}
+
+// Returns -log(u(@fingerprint, choice)) / probability, where @salt is the salt
+// of the choice, and @inverse_probability is 1 / probability.
+inline double GetExponentialHash(const uint64_t fingerprint,
+                                 const uint64_t salt,
+                                 const double inverse_probability) {
+  return NegativeLogOfUniform(Mix(fingerprint ^ salt)) * inverse_probability;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<ConsistentHashing>> ConsistentHashing::Build(
+    const std::vector<DistributionChoice>& distribution) {
+  if (distribution.empty()) {
+    return absl::InvalidArgumentError("The distribution is empty.");
+  }
+  absl::flat_hash_set<int32_t> seen_choice_ids;
+  double total = 0.0;
+  for (const DistributionChoice& choice : distribution) {
+    if (!seen_choice_ids.insert(choice.choice_id).second) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Duplicate choice_id: ", choice.choice_id));
+    }
+    if (!(choice.probability >= 0.0)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Negative probability ", choice.probability,
+                       " for choice_id ", choice.choice_id));
+    }
+    total += choice.probability;
+  }
+  if (!(total > 0.0)) {
+    return absl::InvalidArgumentError(
+        "The sum of the probabilities must be positive.");
+  }
+
+  std::vector<int32_t> choice_ids;
+  std::vector<uint64_t> salts;
+  std::vector<double> inverse_probabilities;
+  for (const DistributionChoice& choice : distribution) {
+    if (choice.probability == 0.0) {
+      continue;
+    }
+    choice_ids.push_back(choice.choice_id);
+    salts.push_back(util::Fingerprint64(
+        absl::StrCat("consistent-hashing-", choice.choice_id)));
+    inverse_probabilities.push_back(total / choice.probability);
+  }
+  return absl::WrapUnique(
+      new ConsistentHashing(std::move(choice_ids), std::move(salts),
+                            std::move(inverse_probabilities)));
+}
+
+ConsistentHashing::ConsistentHashing(std::vector<int32_t> choice_ids,
+                                     std::vector<uint64_t> salts,
+                                     std::vector<double> inverse_probabilities)
+    : choice_ids_(std::move(choice_ids)),
+      salts_(std::move(salts)),
+      inverse_probabilities_(std::move(inverse_probabilities)) {}
+
+int32_t ConsistentHashing::Hash(const uint64_t fingerprint) const {
+  size_t selected = 0;
+  double min_value = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < choice_ids_.size(); ++i) {
+    double value =
+        GetExponentialHash(fingerprint, salts_[i], inverse_probabilities_[i]);
+    if (value < min_value) {
+      min_value = value;
+      selected = i;
+    }
+  }
+  return choice_ids_[selected];
+}
+
+int32_t ConsistentHashing::Hash(const absl::string_view id) const {
+  // The key of each choice is "consistent-hashing-<id>-<choice_id>", so the
+  // prefix is built once.
+  std::string key = absl::StrCat("consistent-hashing-", id, "-");
+  const size_t prefix_size = key.size();
+  size_t selected = 0;
+  double min_value = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < choice_ids_.size(); ++i) {
+    key.resize(prefix_size);
+    absl::StrAppend(&key, choice_ids_[i]);
+    // The uniform value is the fingerprint divided by 2^64 - 1, as in the
+    // notebook, with the log from libm.
+    const double uniform =
+        static_cast<double>(util::Fingerprint64(key)) / kMaxUint64;
+    const double value = -std::log(uniform) * inverse_probabilities_[i];
+    if (value < min_value) {
+      min_value = value;
+      selected = i;
+    }
+  }
+  return choice_ids_[selected];
+}
+
+void ConsistentHashing::HashBatch(const absl::Span<const uint64_t> fingerprints,
+                                  const absl::Span<int32_t> output) const {
+  CHECK(fingerprints.size() == output.size())
+      << "The sizes of fingerprints and output do not match.";
+  double min_values[kBlockSize];
+  int32_t selected[kBlockSize];
+  for (size_t begin = 0; begin < fingerprints.size(); begin += kBlockSize) {
+    size_t size = std::min(kBlockSize, fingerprints.size() - begin);
+    const uint64_t* block = fingerprints.data() + begin;
+    std::fill_n(min_values, size, std::numeric_limits<double>::infinity());
+    std::fill_n(selected, size, 0);
+    for (size_t i = 0; i < choice_ids_.size(); ++i) {
+      uint64_t salt = salts_[i];
+      double inverse_probability = inverse_probabilities_[i];
+      int32_t choice_index = static_cast<int32_t>(i);
+      for (size_t j = 0; j < size; ++j) {
+        double value = GetExponentialHash(block[j], salt, inverse_probability);
+        bool is_less = value < min_values[j];
+        min_values[j] = is_less ? value : min_values[j];
+        selected[j] = is_less ? choice_index : selected[j];
+      }
+    }
+    for (size_t j = 0; j < size; ++j) {
+      output[begin + j] = choice_ids_[selected[j]];
+    }
+  }
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,103 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CONSISTENT_HASHING_CONSISTENT_HASHING_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CONSISTENT_HASHING_CONSISTENT_HASHING_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace wfa_virtual_people {
+
+struct DistributionChoice {
+  // The id of the choice, which is returned when the choice is selected. The
+  // ids must be unique.
+  int32_t choice_id;
+  // The chance to select the choice. Must be non-negative. The probabilities
+  // of all choices are normalized, so they do not need to sum up to 1.
+  double probability;
+};
+
+// ConsistentHashing selects a choice for each id from a probability
+// distribution, with the method of notebooks/Consistent_Hashing.ipynb. For
+// each choice c with probability p, the id is hashed to an exponentially
+// distributed value
+//   -log(u(id, c)) / p
+// where u(id, c) is a uniform hash in (0, 1), and the choice with the smallest
+// value is selected. The minimum of independent exponential variables falls on
+// each of them with chance proportional to its rate, so the choices follow the
+// distribution. When the distribution changes slightly, the values of most ids
+// do not change order, so only a small fraction of ids change their choices.
+//
+// There are two uniform hashes, which select different choices for the same
+// id, so the two are NOT interchangeable:
+// - Hash(absl::string_view id) is the hash of the notebook,
+//     u(id, c) = Fingerprint64("consistent-hashing-<id>-<c>") / (2^64 - 1)
+//   where <c> is the choice_id. It selects the same choices as the notebook
+//   and the reference labeler, and costs one fingerprint per choice.
+// - Hash(uint64_t fingerprint) and HashBatch take a precomputed 64-bit
+//   fingerprint of the id, and u(id, c) mixes it with a salt derived from the
+//   choice_id. This is much faster, and has the same distribution and
+//   stability, but its choices match neither the notebook nor the string
+//   overload.
+// In both, the selected choice depends only on the id and the (choice_id,
+// probability) pairs, not on the order of the choices.
+//
+// ConsistentHashing is immutable after Build, and is thread-safe.
+class ConsistentHashing {
+ public:
+  // Returns error status if @distribution is empty, has duplicate choice_id,
+  // has any negative probability, or has no positive probability.
+  static absl::StatusOr<std::unique_ptr<ConsistentHashing>> Build(
+      const std::vector<DistributionChoice>& distribution);
+
+  // Returns the choice_id selected for @fingerprint, with the salted
+  // fingerprint hash. See the class comment.
+  int32_t Hash(uint64_t fingerprint) const;
+
+  // Returns the choice_id selected for @id, with the hash of the notebook.
+  // This is not the same as Hash(Fingerprint64(@id)). See the class comment.
+  int32_t Hash(absl::string_view id) const;
+
+  // Writes the choice_id selected for each of @fingerprints to the same index
+  // of @output. The size of @output must be the same as @fingerprints.
+  // The output is the same as calling Hash for each fingerprint, but the
+  // fingerprints are processed in blocks, with the choices in the outer loop
+  // and the fingerprints in the branch-free inner loop. The inner loop is
+  // vectorized when the target has 64-bit vector multiplication, like
+  // AVX-512DQ, e.g. with --copt=-O3 --copt=-march=native.
+  void HashBatch(absl::Span<const uint64_t> fingerprints,
+                 absl::Span<int32_t> output) const;
+
+ private:
+  ConsistentHashing(std::vector<int32_t> choice_ids,
+                    std::vector<uint64_t> salts,
+                    std::vector<double> inverse_probabilities);
+
+  // The choices with positive probability. The choices with 0 probability are
+  // never selected, so they are dropped.
+  std::vector<int32_t> choice_ids_;
+  // The salt mixed with the fingerprint for each choice.
+  std::vector<uint64_t> salts_;
+  // 1 / probability of each choice, after normalization.
+  std::vector<double> inverse_probabilities_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CONSISTENT_HASHING_CONSISTENT_HASHING_H_
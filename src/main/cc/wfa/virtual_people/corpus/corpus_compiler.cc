@@ -0,0 +1,318 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/corpus/corpus_compiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/text_format.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The count of files read and parsed together. The records of a batch are
+// written after all of its files are parsed.
+constexpr size_t kFilesPerBatch = 1024;
+
+// A piece of textproto parsed by one task.
+struct ParseTask {
+  // The index of the file in the batch.
+  size_t file;
+  absl::string_view text;
+};
+
+// Calls @fn(begin, end) for consecutive ranges of [0, @size), each in its own
+// thread. The count of ranges is @threads, or less when @size is small.
+void ParallelFor(const int threads, const size_t size,
+                 const std::function<void(size_t, size_t)>& fn) {
+  int range_count = static_cast<int>(
+      std::max<size_t>(1, std::min<size_t>(threads, size)));
+  if (range_count == 1) {
+    fn(0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int i = 0; i < range_count; ++i) {
+    workers.emplace_back(fn, size * i / range_count,
+                         size * (i + 1) / range_count);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+absl::StatusOr<std::string> ReadFile(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Unable to open file: ", path));
+  }
+  std::stringstream content;
+  content << input.rdbuf();
+  return content.str();
+}
+
+bool ParseText(absl::string_view text, google::protobuf::Message& message) {
+  google::protobuf::io::ArrayInputStream input(text.data(), text.size());
+  return google::protobuf::TextFormat::Parse(&input, &message);
+}
+
+// Parses @text as @input_type, and appends the binary records to @records.
+bool ParseRecords(const CorpusInputType input_type, absl::string_view text,
+                  std::vector<std::string>& records) {
+  switch (input_type) {
+    case CorpusInputType::kLabelerEvent: {
+      LabelerEvent event;
+      if (!ParseText(text, event)) {
+        return false;
+      }
+      records.push_back(event.SerializeAsString());
+      return true;
+    }
+    case CorpusInputType::kDataProviderEvent: {
+      DataProviderEvent event;
+      if (!ParseText(text, event)) {
+        return false;
+      }
+      records.push_back(event.SerializeAsString());
+      return true;
+    }
+    case CorpusInputType::kLabelerInputList: {
+      LabelerInputList inputs;
+      if (!ParseText(text, inputs)) {
+        return false;
+      }
+      for (const LabelerInput& input : inputs.inputs()) {
+        records.push_back(input.SerializeAsString());
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads, parses and writes the files at @paths.
+absl::Status CompileBatch(absl::Span<const std::string> paths,
+                          const CorpusInputType input_type, const int threads,
+                          IndexedRecordWriter& writer) {
+  std::vector<std::string> contents(paths.size());
+  std::vector<ParseTask> tasks;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    absl::StatusOr<std::string> content = ReadFile(paths[i]);
+    if (!content.ok()) {
+      return content.status();
+    }
+    contents[i] = *std::move(content);
+    if (input_type != CorpusInputType::kLabelerInputList) {
+      tasks.push_back({.file = i, .text = contents[i]});
+      continue;
+    }
+    absl::StatusOr<std::vector<absl::string_view>> chunks =
+        SplitTopLevelFields(contents[i]);
+    if (!chunks.ok()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(paths[i], ": ", chunks.status().message()));
+    }
+    for (absl::string_view chunk : *chunks) {
+      tasks.push_back({.file = i, .text = chunk});
+    }
+  }
+
+  std::vector<std::vector<std::string>> records(tasks.size());
+  std::vector<char> parsed(tasks.size(), false);
+  ParallelFor(threads, tasks.size(), [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      parsed[i] = ParseRecords(input_type, tasks[i].text, records[i]);
+    }
+  });
+
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    if (!parsed[i]) {
+      const std::string& content = contents[tasks[i].file];
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unable to parse textproto file: ", paths[tasks[i].file],
+          ", at byte ", tasks[i].text.data() - content.data()));
+    }
+    for (const std::string& record : records[i]) {
+      absl::Status status = writer.Write(record);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<CorpusInputType> ParseCorpusInputType(absl::string_view name) {
+  if (name == "labeler_event") {
+    return CorpusInputType::kLabelerEvent;
+  }
+  if (name == "data_provider_event") {
+    return CorpusInputType::kDataProviderEvent;
+  }
+  if (name == "labeler_input_list") {
+    return CorpusInputType::kLabelerInputList;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown corpus input type: ", name));
+}
+
+absl::StatusOr<std::vector<absl::string_view>> SplitTopLevelFields(
+    absl::string_view textproto) {
+  std::vector<absl::string_view> chunks;
+  int depth = 0;
+  // The start of the current chunk, and the end of its last token.
+  size_t start = absl::string_view::npos;
+  size_t end = 0;
+  // The last character that is not whitespace or comment.
+  char previous = '\0';
+  for (size_t i = 0; i < textproto.size(); ++i) {
+    const char c = textproto[i];
+    if (c == '#') {
+      while (i < textproto.size() && textproto[i] != '\n') {
+        ++i;
+      }
+      continue;
+    }
+    if (absl::ascii_isspace(static_cast<unsigned char>(c))) {
+      continue;
+    }
+    if (start == absl::string_view::npos) {
+      start = i;
+    }
+    if (c == '"' || c == '\'') {
+      // Skips the string, with its escaped characters.
+      size_t j = i + 1;
+      while (j < textproto.size() && textproto[j] != c) {
+        j += textproto[j] == '\\' ? 2 : 1;
+      }
+      if (j >= textproto.size()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Unterminated string at byte ", i));
+      }
+      i = j;
+    } else if (c == '[' && depth == 0 &&
+               (start == i || previous == '}' || previous == '>' ||
+                previous == ']' || previous == ',' || previous == ';')) {
+      // The name of an extension field, like [package.extension], which
+      // starts a field. Otherwise '[' starts a list value.
+      size_t j = textproto.find(']', i);
+      if (j == absl::string_view::npos) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Unterminated extension name at byte ", i));
+      }
+      i = j;
+    } else if (c == '{' || c == '<' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == '>' || c == ']') {
+      if (--depth < 0) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Unbalanced '", std::string(1, c), "' at byte ", i));
+      }
+      if (depth == 0) {
+        chunks.push_back(textproto.substr(start, i + 1 - start));
+        start = absl::string_view::npos;
+      }
+    }
+    previous = textproto[i];
+    end = i + 1;
+  }
+  if (depth != 0) {
+    return absl::InvalidArgumentError("Unbalanced brackets at the end.");
+  }
+  if (start != absl::string_view::npos) {
+    chunks.push_back(textproto.substr(start, end - start));
+  }
+  return chunks;
+}
+
+absl::Status ParseLabelerInputList(absl::string_view textproto,
+                                   const int threads,
+                                   LabelerInputList& output) {
+  absl::StatusOr<std::vector<absl::string_view>> chunks =
+      SplitTopLevelFields(textproto);
+  if (!chunks.ok()) {
+    return chunks.status();
+  }
+  std::vector<LabelerInputList> chunk_inputs(chunks->size());
+  std::vector<char> parsed(chunks->size(), false);
+  ParallelFor(std::max(threads, 1), chunks->size(),
+              [&](const size_t begin, const size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                  parsed[i] = ParseText((*chunks)[i], chunk_inputs[i]);
+                }
+              });
+
+  output.Clear();
+  size_t count = 0;
+  for (size_t i = 0; i < chunks->size(); ++i) {
+    if (!parsed[i]) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unable to parse LabelerInputList textproto at byte ",
+                       (*chunks)[i].data() - textproto.data()));
+    }
+    count += chunk_inputs[i].inputs_size();
+  }
+  output.mutable_inputs()->Reserve(count);
+  for (LabelerInputList& inputs : chunk_inputs) {
+    for (LabelerInput& input : *inputs.mutable_inputs()) {
+      *output.add_inputs() = std::move(input);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CompileCorpus(const std::vector<std::string>& input_paths,
+                           const CorpusInputType input_type,
+                           absl::string_view output_path, const int threads) {
+  absl::StatusOr<std::unique_ptr<IndexedRecordWriter>> writer =
+      IndexedRecordWriter::Open(output_path);
+  if (!writer.ok()) {
+    return writer.status();
+  }
+  absl::Span<const std::string> paths = absl::MakeConstSpan(input_paths);
+  for (size_t begin = 0; begin < paths.size(); begin += kFilesPerBatch) {
+    absl::Status status = CompileBatch(paths.subspan(begin, kFilesPerBatch),
+                                       input_type, std::max(threads, 1),
+                                       **writer);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return (*writer)->Close();
+}
+
+}  // namespace wfa_virtual_people
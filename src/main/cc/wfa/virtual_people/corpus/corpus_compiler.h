@@ -0,0 +1,71 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_CORPUS_COMPILER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_CORPUS_COMPILER_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+// The type of the textproto input files of a corpus.
+enum class CorpusInputType {
+  // Each file is a LabelerEvent, which is one record.
+  kLabelerEvent = 0,
+  // Each file is a DataProviderEvent, which is one record.
+  kDataProviderEvent = 1,
+  // Each file is a LabelerInputList, and each of its LabelerInput is one
+  // record.
+  kLabelerInputList = 2,
+};
+
+// Returns the input type of @name, which is one of "labeler_event",
+// "data_provider_event" and "labeler_input_list".
+absl::StatusOr<CorpusInputType> ParseCorpusInputType(absl::string_view name);
+
+// Splits @textproto, the text format of a message, into consecutive chunks,
+// each of which is the text format of some of the top-level fields. A chunk
+// ends after each top-level field of message or list value, so each element
+// of a repeated message field is in its own chunk. Comments and whitespace
+// between the fields are dropped.
+// Returns error status if the brackets are not balanced.
+absl::StatusOr<std::vector<absl::string_view>> SplitTopLevelFields(
+    absl::string_view textproto);
+
+// Parses @textproto as a LabelerInputList to @output, with the chunks of
+// SplitTopLevelFields parsed on @threads threads. The inputs are in the same
+// order as in @textproto, so @output is the same as parsing @textproto on one
+// thread.
+// Returns error status if @textproto cannot be parsed.
+absl::Status ParseLabelerInputList(absl::string_view textproto, int threads,
+                                   LabelerInputList& output);
+
+// Parses the textproto files at @input_paths as @input_type, and writes the
+// binary records in order to an indexed record file at @output_path.
+// The files, or for kLabelerInputList the chunks of SplitTopLevelFields, are
+// parsed on @threads threads.
+// Returns error status if any file cannot be read or parsed.
+absl::Status CompileCorpus(const std::vector<std::string>& input_paths,
+                           CorpusInputType input_type,
+                           absl::string_view output_path, int threads);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_CORPUS_COMPILER_H_
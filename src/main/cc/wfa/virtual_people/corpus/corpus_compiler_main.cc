@@ -0,0 +1,84 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This is a tool to compile textproto files to an indexed record file of
+// binary protos, which is much faster to read, and can be split by record
+// index. See indexed_record_file.h for the format.
+//
+// Example usage:
+//
+// To compile LabelerEvent files, one record per file
+//   bazel run -c opt \
+//   //src/main/cc/wfa/virtual_people/corpus:corpus_compiler_main -- \
+//   --input_paths=/tmp/event_1.textproto,/tmp/event_2.textproto \
+//   --input_type=labeler_event --output_path=/tmp/labeler_events.idx
+//
+// To compile the model_applier input, one record per LabelerInput
+//   bazel run -c opt \
+//   //src/main/cc/wfa/virtual_people/corpus:corpus_compiler_main -- \
+//   --input_paths=/tmp/model_applier/example_input.textproto \
+//   --input_type=labeler_input_list --output_path=/tmp/labeler_inputs.idx \
+//   --threads=8
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/corpus/corpus_compiler.h"
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
+
+ABSL_FLAG(std::string, input_paths, "",
+          "Comma separated paths to the textproto files.");
+ABSL_FLAG(std::string, input_type, "",
+          "The type of the textproto files, one of [labeler_event, "
+          "data_provider_event, labeler_input_list]. Each labeler_event or "
+          "data_provider_event file is one record, and each LabelerInput in "
+          "a labeler_input_list file is one record.");
+ABSL_FLAG(std::string, output_path, "", "Path to the output record file.");
+ABSL_FLAG(uint32_t, threads, 1, "The count of threads to parse the input.");
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<std::string> input_paths = absl::StrSplit(
+      absl::GetFlag(FLAGS_input_paths), ',', absl::SkipWhitespace());
+  CHECK(!input_paths.empty()) << "input_paths is not set.";
+  std::string output_path = absl::GetFlag(FLAGS_output_path);
+  CHECK(!output_path.empty()) << "output_path is not set.";
+  absl::StatusOr<wfa_virtual_people::CorpusInputType> input_type =
+      wfa_virtual_people::ParseCorpusInputType(absl::GetFlag(FLAGS_input_type));
+  CHECK(input_type.ok()) << input_type.status();
+
+  absl::Time start = absl::Now();
+  absl::Status status = wfa_virtual_people::CompileCorpus(
+      input_paths, *input_type, output_path,
+      static_cast<int>(absl::GetFlag(FLAGS_threads)));
+  CHECK(status.ok()) << "Compiling failed with status: " << status;
+
+  absl::StatusOr<std::unique_ptr<wfa_virtual_people::IndexedRecordReader>>
+      reader = wfa_virtual_people::IndexedRecordReader::Open(output_path);
+  CHECK(reader.ok()) << reader.status();
+  LOG(INFO) << "Compiled " << (*reader)->size() << " records from "
+            << input_paths.size() << " files in "
+            << absl::FormatDuration(absl::Now() - start);
+  return 0;
+}
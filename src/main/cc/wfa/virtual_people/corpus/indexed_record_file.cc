@@ -0,0 +1,236 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+constexpr char kMagic[] = "VPRIDX01";
+constexpr size_t kMagicSize = 8;
+// The index offset, the record count and the magic.
+constexpr size_t kFooterSize = 16 + kMagicSize;
+// The buffered bytes are written to the file when reaching this size.
+constexpr size_t kFlushSize = 1 << 20;
+
+void AppendUint64(const uint64_t value, std::string& output) {
+  for (int i = 0; i < 8; ++i) {
+    output.push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint64_t LoadUint64(const char* input) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(input[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+bool WriteFully(const int fd, absl::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written <= 0) {
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+
+bool ReadFully(const int fd, uint64_t offset, size_t size, char* output) {
+  while (size > 0) {
+    ssize_t read = pread(fd, output, size, offset);
+    if (read <= 0) {
+      return false;
+    }
+    offset += read;
+    output += read;
+    size -= read;
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<IndexedRecordWriter>> IndexedRecordWriter::Open(
+    absl::string_view path) {
+  int fd = open(std::string(path).c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+                S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unable to create file: ", path));
+  }
+  return std::unique_ptr<IndexedRecordWriter>(
+      new IndexedRecordWriter(fd, path));
+}
+
+IndexedRecordWriter::IndexedRecordWriter(const int fd, absl::string_view path)
+    : fd_(fd), path_(path), buffer_(kMagic, kMagicSize),
+      end_offset_(kMagicSize) {}
+
+IndexedRecordWriter::~IndexedRecordWriter() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+absl::Status IndexedRecordWriter::Write(absl::string_view record) {
+  if (fd_ < 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Writing to closed file: ", path_));
+  }
+  offsets_.push_back(end_offset_);
+  end_offset_ += record.size();
+  buffer_.append(record.data(), record.size());
+  if (buffer_.size() >= kFlushSize) {
+    return Flush();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IndexedRecordWriter::Flush() {
+  if (!WriteFully(fd_, buffer_)) {
+    return absl::InternalError(absl::StrCat("Unable to write file: ", path_));
+  }
+  buffer_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status IndexedRecordWriter::Close() {
+  if (fd_ < 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("File is already closed: ", path_));
+  }
+  const uint64_t index_offset = end_offset_;
+  for (const uint64_t offset : offsets_) {
+    AppendUint64(offset, buffer_);
+  }
+  AppendUint64(end_offset_, buffer_);
+  AppendUint64(index_offset, buffer_);
+  AppendUint64(offsets_.size(), buffer_);
+  buffer_.append(kMagic, kMagicSize);
+  absl::Status status = Flush();
+  if (close(fd_) != 0 && status.ok()) {
+    status = absl::InternalError(absl::StrCat("Unable to close file: ", path_));
+  }
+  fd_ = -1;
+  return status;
+}
+
+absl::StatusOr<std::unique_ptr<IndexedRecordReader>> IndexedRecordReader::Open(
+    absl::string_view path) {
+  int fd = open(std::string(path).c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("Unable to open file: ", path));
+  }
+  // Owns fd until the reader is created.
+  std::unique_ptr<IndexedRecordReader> reader(
+      new IndexedRecordReader(fd, path, {}));
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    return absl::InternalError(absl::StrCat("Unable to stat file: ", path));
+  }
+  const uint64_t file_size = file_stat.st_size;
+  char magic[kMagicSize];
+  char footer[kFooterSize];
+  if (file_size < kMagicSize + 8 + kFooterSize ||
+      !ReadFully(fd, 0, kMagicSize, magic) ||
+      !ReadFully(fd, file_size - kFooterSize, kFooterSize, footer) ||
+      absl::string_view(magic, kMagicSize) != kMagic ||
+      absl::string_view(footer + 16, kMagicSize) != kMagic) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not an indexed record file: ", path));
+  }
+  const uint64_t index_offset = LoadUint64(footer);
+  const uint64_t count = LoadUint64(footer + 8);
+  // The index has count + 1 offsets, and ends at the footer.
+  if (index_offset < kMagicSize ||
+      index_offset > file_size - kFooterSize ||
+      (file_size - kFooterSize - index_offset) / 8 != count + 1 ||
+      (file_size - kFooterSize - index_offset) % 8 != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid index in indexed record file: ", path));
+  }
+  std::string index((count + 1) * 8, '\0');
+  if (!ReadFully(fd, index_offset, index.size(), index.data())) {
+    return absl::InternalError(absl::StrCat("Unable to read file: ", path));
+  }
+  std::vector<uint64_t> offsets(count + 1);
+  uint64_t previous = kMagicSize;
+  for (uint64_t i = 0; i <= count; ++i) {
+    offsets[i] = LoadUint64(&index[i * 8]);
+    if (offsets[i] < previous || offsets[i] > index_offset) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid index in indexed record file: ", path));
+    }
+    previous = offsets[i];
+  }
+  reader->offsets_ = std::move(offsets);
+  return reader;
+}
+
+IndexedRecordReader::IndexedRecordReader(const int fd, absl::string_view path,
+                                         std::vector<uint64_t> offsets)
+    : fd_(fd), path_(path), offsets_(std::move(offsets)) {}
+
+IndexedRecordReader::~IndexedRecordReader() { close(fd_); }
+
+absl::StatusOr<std::string> IndexedRecordReader::Read(
+    const size_t index) const {
+  if (index >= size()) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Record ", index, " is out of range in ", path_));
+  }
+  std::string record(offsets_[index + 1] - offsets_[index], '\0');
+  if (!ReadFully(fd_, offsets_[index], record.size(), record.data())) {
+    return absl::InternalError(absl::StrCat("Unable to read file: ", path_));
+  }
+  return record;
+}
+
+absl::Status IndexedRecordReader::ReadMessage(
+    const size_t index, google::protobuf::Message& message) const {
+  absl::StatusOr<std::string> record = Read(index);
+  if (!record.ok()) {
+    return record.status();
+  }
+  if (!message.ParseFromString(*record)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unable to parse record ", index, " in ", path_, " as ",
+        message.GetTypeName()));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,110 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_INDEXED_RECORD_FILE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_INDEXED_RECORD_FILE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message.h"
+
+namespace wfa_virtual_people {
+
+// An indexed record file stores a sequence of records, e.g. serialized
+// protos, with an index of the record offsets at the end, so that any record
+// can be read without scanning the ones before it. The layout is
+//   <magic>
+//   <record 0><record 1>...<record n-1>
+//   <offset of record 0>...<offset of record n-1><end offset of record n-1>
+//   <offset of the index><n><magic>
+// where the offsets and n are 64-bit little-endian, and the magic is the 8
+// bytes "VPRIDX01".
+
+// Writes the records in order. The file is only valid after Close.
+class IndexedRecordWriter {
+ public:
+  // Returns error status if @path cannot be created.
+  static absl::StatusOr<std::unique_ptr<IndexedRecordWriter>> Open(
+      absl::string_view path);
+
+  ~IndexedRecordWriter();
+
+  IndexedRecordWriter(const IndexedRecordWriter&) = delete;
+  IndexedRecordWriter& operator=(const IndexedRecordWriter&) = delete;
+
+  absl::Status Write(absl::string_view record);
+
+  // Writes the index, and closes the file.
+  absl::Status Close();
+
+ private:
+  IndexedRecordWriter(int fd, absl::string_view path);
+
+  // Writes the buffered bytes to the file.
+  absl::Status Flush();
+
+  int fd_;
+  std::string path_;
+  // The bytes not written to the file yet.
+  std::string buffer_;
+  // The offset of each record.
+  std::vector<uint64_t> offsets_;
+  // The offset of the end of the last record.
+  uint64_t end_offset_;
+};
+
+// Reads the records of an indexed record file. The index is loaded by Open,
+// and each record is read by one positioned read, so Read is thread-safe, and
+// readers can split the records by index.
+class IndexedRecordReader {
+ public:
+  // Returns error status if @path cannot be opened, or is not a valid
+  // indexed record file.
+  static absl::StatusOr<std::unique_ptr<IndexedRecordReader>> Open(
+      absl::string_view path);
+
+  ~IndexedRecordReader();
+
+  IndexedRecordReader(const IndexedRecordReader&) = delete;
+  IndexedRecordReader& operator=(const IndexedRecordReader&) = delete;
+
+  // The count of records.
+  size_t size() const { return offsets_.size() - 1; }
+
+  // Returns the record at @index, which must be less than size().
+  absl::StatusOr<std::string> Read(size_t index) const;
+
+  // Parses the record at @index to @message.
+  absl::Status ReadMessage(size_t index,
+                           google::protobuf::Message& message) const;
+
+ private:
+  IndexedRecordReader(int fd, absl::string_view path,
+                      std::vector<uint64_t> offsets);
+
+  int fd_;
+  std::string path_;
+  // The offset of each record, followed by the end offset of the last record.
+  std::vector<uint64_t> offsets_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_CORPUS_INDEXED_RECORD_FILE_H_
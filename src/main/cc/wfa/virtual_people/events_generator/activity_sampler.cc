@@ -0,0 +1,214 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+absl::StatusOr<double> ParseNonNegativeDouble(absl::string_view value) {
+  double output;
+  if (!absl::SimpleAtod(value, &output) || !(output >= 0.0)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expect a non-negative number, got: ", value));
+  }
+  return output;
+}
+
+}  // namespace
+
+absl::StatusOr<ActivityDistribution> ParseActivityDistribution(
+    absl::string_view spec) {
+  std::vector<absl::string_view> parts =
+      absl::StrSplit(spec, absl::MaxSplits(':', 1));
+  ActivityDistribution distribution;
+  if (parts[0] == "uniform" && parts.size() == 1) {
+    distribution.type = ActivityDistributionType::kUniform;
+    return distribution;
+  }
+  if (parts.size() != 2) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid activity distribution: ", spec));
+  }
+  if (parts[0] == "zipf") {
+    absl::StatusOr<double> exponent = ParseNonNegativeDouble(parts[1]);
+    if (!exponent.ok()) return exponent.status();
+    distribution.type = ActivityDistributionType::kZipf;
+    distribution.zipf_exponent = *exponent;
+    return distribution;
+  }
+  if (parts[0] == "log_normal") {
+    absl::StatusOr<double> sigma = ParseNonNegativeDouble(parts[1]);
+    if (!sigma.ok()) return sigma.status();
+    distribution.type = ActivityDistributionType::kLogNormal;
+    distribution.log_normal_sigma = *sigma;
+    return distribution;
+  }
+  if (parts[0] == "empirical") {
+    distribution.type = ActivityDistributionType::kEmpirical;
+    double total = 0.0;
+    for (absl::string_view value : absl::StrSplit(parts[1], ',')) {
+      absl::StatusOr<double> weight = ParseNonNegativeDouble(value);
+      if (!weight.ok()) return weight.status();
+      distribution.empirical_histogram.push_back(*weight);
+      total += *weight;
+    }
+    if (total <= 0.0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Empirical histogram has no positive weight: ", spec));
+    }
+    return distribution;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Invalid activity distribution: ", spec));
+}
+
+std::vector<double> GetActivityWeights(const ActivityDistribution& distribution,
+                                       const uint32_t size,
+                                       RandomGenerator& random_generator) {
+  CHECK(size > 0) << "size must be a positive integer.";
+  std::vector<double> weights(size, 1.0);
+  switch (distribution.type) {
+    case ActivityDistributionType::kUniform:
+      break;
+    case ActivityDistributionType::kZipf:
+      CHECK(distribution.zipf_exponent >= 0.0)
+          << "zipf_exponent must be non-negative.";
+      for (uint32_t i = 0; i < size; ++i) {
+        weights[i] = pow(i + 1.0, -distribution.zipf_exponent);
+      }
+      break;
+    case ActivityDistributionType::kLogNormal:
+      CHECK(distribution.log_normal_sigma >= 0.0)
+          << "log_normal_sigma must be non-negative.";
+      for (uint32_t i = 0; i < size; ++i) {
+        weights[i] = exp(random_generator.GetGaussian(
+            0.0, distribution.log_normal_sigma));
+      }
+      break;
+    case ActivityDistributionType::kEmpirical: {
+      const std::vector<double>& histogram = distribution.empirical_histogram;
+      CHECK(!histogram.empty()) << "empirical_histogram must not be empty.";
+      // On a line of length histogram.size() * size, entry i covers
+      // [i * histogram.size(), (i + 1) * histogram.size()), and bucket k
+      // covers [k * size, (k + 1) * size). The weight of each entry is the
+      // average of the buckets it covers, by the length of the overlap, so
+      // no mass is lost when there are fewer entries than buckets.
+      const uint64_t bucket_count = histogram.size();
+      for (uint32_t i = 0; i < size; ++i) {
+        const uint64_t begin = i * bucket_count;
+        const uint64_t end = begin + bucket_count;
+        double weight = 0.0;
+        for (uint64_t k = begin / size; k * size < end; ++k) {
+          const uint64_t overlap =
+              std::min(end, (k + 1) * size) - std::max(begin, k * size);
+          weight += histogram[k] * overlap;
+        }
+        weights[i] = weight / bucket_count;
+      }
+      break;
+    }
+  }
+  return weights;
+}
+
+ActivitySampler::ActivitySampler(const ActivityDistribution& distribution,
+                                  const uint32_t size,
+                                  RandomGenerator& random_generator)
+    : size_(size),
+      uniform_(distribution.type == ActivityDistributionType::kUniform) {
+  CHECK(size > 0) << "size must be a positive integer.";
+  if (!uniform_) {
+    BuildAliasTable(GetActivityWeights(distribution, size, random_generator));
+  }
+}
+
+ActivitySampler::ActivitySampler(const std::vector<double>& weights)
+    : size_(weights.size()), uniform_(false) {
+  CHECK(!weights.empty()) << "weights must not be empty.";
+  BuildAliasTable(weights);
+}
+
+// Builds the alias table using Vose's method. Each column i is split between
+// index i with chance probabilities_[i], and index aliases_[i] otherwise, so
+// that every column carries the same total chance.
+void ActivitySampler::BuildAliasTable(const std::vector<double>& weights) {
+  double total = 0.0;
+  for (double weight : weights) {
+    CHECK(weight >= 0.0) << "Weights must be non-negative.";
+    total += weight;
+  }
+  CHECK(total > 0.0) << "At least one weight must be positive.";
+
+  probabilities_.resize(size_);
+  aliases_.resize(size_);
+  std::vector<double> scaled(size_);
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  for (uint32_t i = 0; i < size_; ++i) {
+    scaled[i] = weights[i] * size_ / total;
+    if (scaled[i] < 1.0) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t less = small.back();
+    small.pop_back();
+    uint32_t more = large.back();
+    probabilities_[less] = scaled[less];
+    aliases_[less] = more;
+    scaled[more] -= 1.0 - scaled[less];
+    if (scaled[more] < 1.0) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+  // The remaining columns are full, up to the floating point error.
+  for (uint32_t i : large) {
+    probabilities_[i] = 1.0;
+    aliases_[i] = i;
+  }
+  for (uint32_t i : small) {
+    probabilities_[i] = 1.0;
+    aliases_[i] = i;
+  }
+}
+
+uint32_t ActivitySampler::Sample(RandomGenerator& random_generator) const {
+  uint32_t index = random_generator.GetInteger(0, size_ - 1);
+  if (uniform_ || random_generator.GetBool(probabilities_[index])) {
+    return index;
+  }
+  return aliases_[index];
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,103 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ACTIVITY_SAMPLER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ACTIVITY_SAMPLER_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+enum class ActivityDistributionType {
+  // All entries are equally active.
+  kUniform,
+  // The activity of the entry with rank i (starting from 1) is proportional to
+  // 1 / i^@zipf_exponent.
+  kZipf,
+  // The activity of each entry is drawn from a log-normal distribution with
+  // mu = 0 and sigma = @log_normal_sigma.
+  kLogNormal,
+  // The activity follows @empirical_histogram. The entries are split by rank
+  // into as many equal-sized buckets as the histogram has, and the entries in
+  // the k-th bucket have activity proportional to @empirical_histogram[k]. An
+  // entry covering parts of several buckets, e.g. when there are fewer entries
+  // than buckets, has the average activity of what it covers.
+  kEmpirical,
+};
+
+// Describes how the activity is distributed among the entries of a pool.
+struct ActivityDistribution {
+  ActivityDistributionType type = ActivityDistributionType::kUniform;
+  // Only used by kZipf. Must be non-negative.
+  double zipf_exponent = 1.0;
+  // Only used by kLogNormal. Must be non-negative.
+  double log_normal_sigma = 1.0;
+  // Only used by kEmpirical. The values must be non-negative, and at least one
+  // of them must be positive.
+  std::vector<double> empirical_histogram;
+};
+
+// Parses ActivityDistribution from @spec, which is one of
+// * uniform
+// * zipf:<zipf_exponent>
+// * log_normal:<log_normal_sigma>
+// * empirical:<weight_1>,<weight_2>,...
+absl::StatusOr<ActivityDistribution> ParseActivityDistribution(
+    absl::string_view spec);
+
+// Returns the relative activity of each of the @size entries, following
+// @distribution. @random_generator is only used by kLogNormal.
+std::vector<double> GetActivityWeights(const ActivityDistribution& distribution,
+                                       uint32_t size,
+                                       RandomGenerator& random_generator);
+
+// ActivitySampler selects the index of an entry in a pool, with the chance of
+// each entry following the given activity distribution.
+// The non-uniform distributions are sampled in O(1) time using a Walker alias
+// table, which is built once in the constructor.
+class ActivitySampler {
+ public:
+  // Builds the sampler for a pool with @size entries. @random_generator is
+  // only used to build the weights of kLogNormal.
+  ActivitySampler(const ActivityDistribution& distribution, uint32_t size,
+                  RandomGenerator& random_generator);
+
+  // Builds the sampler from the relative activity of each entry.
+  explicit ActivitySampler(const std::vector<double>& weights);
+
+  // Returns an index between 0 and (size - 1) inclusively.
+  uint32_t Sample(RandomGenerator& random_generator) const;
+
+  uint32_t size() const { return size_; }
+
+ private:
+  void BuildAliasTable(const std::vector<double>& weights);
+
+  uint32_t size_;
+  // When true, the alias table is not built, and the index is selected
+  // uniformly.
+  bool uniform_;
+  // The chance to keep the selected column in the alias table.
+  std::vector<double> probabilities_;
+  // The index to use when the selected column is not kept.
+  std::vector<uint32_t> aliases_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ACTIVITY_SAMPLER_H_
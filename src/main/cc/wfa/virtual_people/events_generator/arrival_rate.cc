@@ -0,0 +1,224 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/arrival_rate.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// 3600 * 1000 * 1000
+constexpr uint64_t kMicrosecPerHour = 3600000000;
+
+// 1970-01-01 is a Thursday, which is day 3 when starting from Monday.
+constexpr uint64_t kEpochDayOfWeek = 3;
+
+absl::StatusOr<double> ParseNonNegativeDouble(absl::string_view value) {
+  double output;
+  if (!absl::SimpleAtod(value, &output) || !(output >= 0.0)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expect a non-negative number, got: ", value));
+  }
+  return output;
+}
+
+void CheckWeights(const std::vector<double>& weights, const size_t size,
+                  absl::string_view name) {
+  CHECK(weights.empty() || weights.size() == size)
+      << name << " must be empty or have " << size << " values.";
+  for (double weight : weights) {
+    CHECK(weight >= 0.0) << name << " must be non-negative.";
+  }
+}
+
+// Returns the arrival rate at @timestamp_usec, without normalization.
+double GetRate(const ArrivalRateOptions& options,
+               const uint64_t timestamp_usec) {
+  uint64_t hours = timestamp_usec / kMicrosecPerHour;
+  double rate = 1.0;
+  if (!options.hourly_weights.empty()) {
+    rate *= options.hourly_weights[hours % kHoursPerDay];
+  }
+  if (!options.daily_weights.empty()) {
+    uint64_t days = hours / kHoursPerDay;
+    rate *= options.daily_weights[(days + kEpochDayOfWeek) % kDaysPerWeek];
+  }
+  for (const ArrivalBurst& burst : options.bursts) {
+    if (burst.start_timestamp_usec <= timestamp_usec &&
+        timestamp_usec < burst.end_timestamp_usec) {
+      rate *= burst.multiplier;
+    }
+  }
+  return rate;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<double>> ParseArrivalWeights(absl::string_view spec,
+                                                        const int size) {
+  std::vector<double> weights;
+  if (spec.empty()) {
+    return weights;
+  }
+  for (absl::string_view value : absl::StrSplit(spec, ',')) {
+    absl::StatusOr<double> weight = ParseNonNegativeDouble(value);
+    if (!weight.ok()) return weight.status();
+    weights.push_back(*weight);
+  }
+  if (weights.size() != static_cast<size_t>(size)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expect ", size, " arrival weights, got ", weights.size(), ": ", spec));
+  }
+  return weights;
+}
+
+absl::StatusOr<std::vector<ArrivalBurst>> ParseArrivalBursts(
+    absl::string_view spec, const uint64_t current_timestamp_usec) {
+  std::vector<ArrivalBurst> bursts;
+  if (spec.empty()) {
+    return bursts;
+  }
+  for (absl::string_view burst_spec : absl::StrSplit(spec, ',')) {
+    std::vector<absl::string_view> parts = absl::StrSplit(burst_spec, ':');
+    if (parts.size() != 3) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid arrival burst: ", burst_spec));
+    }
+    absl::StatusOr<double> start_hours_ago = ParseNonNegativeDouble(parts[0]);
+    if (!start_hours_ago.ok()) return start_hours_ago.status();
+    absl::StatusOr<double> duration_hours = ParseNonNegativeDouble(parts[1]);
+    if (!duration_hours.ok()) return duration_hours.status();
+    absl::StatusOr<double> multiplier = ParseNonNegativeDouble(parts[2]);
+    if (!multiplier.ok()) return multiplier.status();
+
+    uint64_t start_usec_ago =
+        static_cast<uint64_t>(*start_hours_ago * kMicrosecPerHour);
+    ArrivalBurst burst;
+    burst.start_timestamp_usec = current_timestamp_usec > start_usec_ago
+                                     ? current_timestamp_usec - start_usec_ago
+                                     : 0;
+    burst.end_timestamp_usec =
+        burst.start_timestamp_usec +
+        static_cast<uint64_t>(*duration_hours * kMicrosecPerHour);
+    burst.multiplier = *multiplier;
+    bursts.push_back(burst);
+  }
+  return bursts;
+}
+
+ArrivalRateCurve::ArrivalRateCurve(const ArrivalRateOptions& options,
+                                   const uint64_t start_timestamp_usec,
+                                   const uint64_t end_timestamp_usec)
+    : start_timestamp_usec_(start_timestamp_usec),
+      end_timestamp_usec_(end_timestamp_usec) {
+  CHECK(start_timestamp_usec < end_timestamp_usec)
+      << "end_timestamp_usec must be larger than start_timestamp_usec.";
+  CheckWeights(options.hourly_weights, kHoursPerDay, "hourly_weights");
+  CheckWeights(options.daily_weights, kDaysPerWeek, "daily_weights");
+
+  // The rate only changes at the start of each hour, and the boundaries of
+  // each burst.
+  segment_starts_.push_back(start_timestamp_usec);
+  for (uint64_t hour_start =
+           (start_timestamp_usec / kMicrosecPerHour + 1) * kMicrosecPerHour;
+       hour_start < end_timestamp_usec; hour_start += kMicrosecPerHour) {
+    segment_starts_.push_back(hour_start);
+  }
+  for (const ArrivalBurst& burst : options.bursts) {
+    CHECK(burst.multiplier >= 0.0) << "Burst multiplier must be non-negative.";
+    for (uint64_t boundary :
+         {burst.start_timestamp_usec, burst.end_timestamp_usec}) {
+      if (start_timestamp_usec < boundary && boundary < end_timestamp_usec) {
+        segment_starts_.push_back(boundary);
+      }
+    }
+  }
+  std::sort(segment_starts_.begin(), segment_starts_.end());
+  segment_starts_.erase(
+      std::unique(segment_starts_.begin(), segment_starts_.end()),
+      segment_starts_.end());
+
+  segment_rates_.reserve(segment_starts_.size());
+  cumulative_chances_.reserve(segment_starts_.size());
+  double total = 0.0;
+  for (size_t i = 0; i < segment_starts_.size(); ++i) {
+    uint64_t segment_end = i + 1 < segment_starts_.size()
+                               ? segment_starts_[i + 1]
+                               : end_timestamp_usec;
+    double rate = GetRate(options, segment_starts_[i]);
+    segment_rates_.push_back(rate);
+    total += rate * (segment_end - segment_starts_[i]);
+    cumulative_chances_.push_back(total);
+  }
+  CHECK(total > 0.0) << "The total arrival rate must be positive.";
+  for (size_t i = 0; i < segment_starts_.size(); ++i) {
+    segment_rates_[i] /= total;
+    cumulative_chances_[i] /= total;
+  }
+  // Removes the floating point error, so that every quantile below 1 is in a
+  // segment.
+  cumulative_chances_.back() = 1.0;
+}
+
+uint64_t ArrivalRateCurve::GetTimestampUsec(const double quantile) const {
+  CHECK(quantile >= 0.0 && quantile <= 1.0)
+      << "quantile must be between 0 and 1.";
+  // Finds the first segment which ends after @quantile. The segments with 0
+  // rate are never selected.
+  size_t index = std::upper_bound(cumulative_chances_.begin(),
+                                  cumulative_chances_.end(), quantile) -
+                 cumulative_chances_.begin();
+  if (index == cumulative_chances_.size()) {
+    return end_timestamp_usec_;
+  }
+  double previous = index > 0 ? cumulative_chances_[index - 1] : 0.0;
+  uint64_t segment_end = index + 1 < segment_starts_.size()
+                             ? segment_starts_[index + 1]
+                             : end_timestamp_usec_;
+  uint64_t timestamp_usec =
+      segment_starts_[index] +
+      static_cast<uint64_t>((quantile - previous) / segment_rates_[index]);
+  return std::min(timestamp_usec, segment_end);
+}
+
+OrderedArrivalStream::OrderedArrivalStream(const ArrivalRateCurve& curve,
+                                           const uint64_t count)
+    : curve_(curve), remaining_(count) {}
+
+uint64_t OrderedArrivalStream::Next(RandomGenerator& random_generator) {
+  CHECK(remaining_ > 0) << "All arrival times are generated.";
+  // Between 0 exclusively and 1 inclusively, so that the log is finite.
+  double uniform = 1.0 - random_generator.GetDouble(0.0, 1.0);
+  // 1 - V^(1/r), computed with expm1 to keep the precision when r is large.
+  double step = -expm1(log(uniform) / remaining_);
+  quantile_ = std::min(1.0, quantile_ + (1.0 - quantile_) * step);
+  --remaining_;
+  return curve_.GetTimestampUsec(quantile_);
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,129 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ARRIVAL_RATE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ARRIVAL_RATE_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+// The count of hours in a day, and days in a week.
+constexpr int kHoursPerDay = 24;
+constexpr int kDaysPerWeek = 7;
+
+// A period in which the arrival rate is multiplied by @multiplier.
+struct ArrivalBurst {
+  // The start of the period in microseconds, inclusive.
+  uint64_t start_timestamp_usec;
+  // The end of the period in microseconds, exclusive.
+  uint64_t end_timestamp_usec;
+  // Must be non-negative.
+  double multiplier;
+};
+
+// Describes how the arrival rate of events changes over time. The rate at a
+// given time is
+//   hourly_weights[hour of day] * daily_weights[day of week] *
+//   (multipliers of all the bursts covering the time).
+// Hours and days are in UTC.
+struct ArrivalRateOptions {
+  // The relative arrival rate of each hour of the day. Must be empty, or have
+  // kHoursPerDay non-negative values. Empty means the same rate for all hours.
+  std::vector<double> hourly_weights;
+  // The relative arrival rate of each day of the week, starting from Monday.
+  // Must be empty, or have kDaysPerWeek non-negative values. Empty means the
+  // same rate for all days.
+  std::vector<double> daily_weights;
+  std::vector<ArrivalBurst> bursts;
+};
+
+// Parses the weights from @spec, which is a comma separated list of exactly
+// @size non-negative numbers. An empty @spec returns an empty list.
+absl::StatusOr<std::vector<double>> ParseArrivalWeights(absl::string_view spec,
+                                                        int size);
+
+// Parses the bursts from @spec, which is a comma separated list of
+// <start_hours_ago>:<duration_hours>:<multiplier>
+// The start of each burst is @start_hours_ago hours before
+// @current_timestamp_usec. An empty @spec returns an empty list.
+absl::StatusOr<std::vector<ArrivalBurst>> ParseArrivalBursts(
+    absl::string_view spec, uint64_t current_timestamp_usec);
+
+// ArrivalRateCurve is the cumulative distribution of the arrival time between
+// @start_timestamp_usec and @end_timestamp_usec, following ArrivalRateOptions.
+// The rate is constant within each hour, and within each burst, so the curve is
+// built as a list of segments with constant rate. For 30 days, there are about
+// 720 segments.
+class ArrivalRateCurve {
+ public:
+  // CHECK-fails if @options is invalid, or the total arrival rate between
+  // @start_timestamp_usec and @end_timestamp_usec is 0.
+  ArrivalRateCurve(const ArrivalRateOptions& options,
+                   uint64_t start_timestamp_usec, uint64_t end_timestamp_usec);
+
+  // Returns the timestamp in microseconds, before which the chance of arrival
+  // is @quantile. @quantile must be between 0 and 1. The output is
+  // non-decreasing in @quantile.
+  uint64_t GetTimestampUsec(double quantile) const;
+
+  uint64_t start_timestamp_usec() const { return start_timestamp_usec_; }
+  uint64_t end_timestamp_usec() const { return end_timestamp_usec_; }
+
+ private:
+  uint64_t start_timestamp_usec_;
+  uint64_t end_timestamp_usec_;
+  // The start of each segment. The end of each segment is the start of the
+  // next one, or @end_timestamp_usec_ for the last one.
+  std::vector<uint64_t> segment_starts_;
+  // The arrival rate of each segment, normalized so that the total is 1.
+  std::vector<double> segment_rates_;
+  // The cumulative chance of arrival at the end of each segment.
+  std::vector<double> cumulative_chances_;
+};
+
+// OrderedArrivalStream generates the arrival times of @count events following
+// an ArrivalRateCurve, in non-decreasing order.
+// The arrival times are generated one at a time without buffering or sorting,
+// using the sequential order statistics of uniform distribution: given the
+// previous quantile q, and r events remaining, the next quantile is the minimum
+// of r uniform values between q and 1, which is
+//   q + (1 - q) * (1 - V^(1/r))
+// for a uniform V between 0 and 1. The quantiles are then mapped to timestamps
+// by the curve, which keeps the order.
+class OrderedArrivalStream {
+ public:
+  // @curve must outlive this stream.
+  OrderedArrivalStream(const ArrivalRateCurve& curve, uint64_t count);
+
+  // Returns the next arrival time in microseconds. CHECK-fails if all the
+  // @count arrival times are generated.
+  uint64_t Next(RandomGenerator& random_generator);
+
+  // The count of arrival times not generated yet.
+  uint64_t remaining() const { return remaining_; }
+
+ private:
+  const ArrivalRateCurve& curve_;
+  uint64_t remaining_;
+  double quantile_ = 0.0;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_ARRIVAL_RATE_H_
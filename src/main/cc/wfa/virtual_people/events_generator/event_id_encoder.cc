@@ -0,0 +1,74 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/event_id_encoder.h"
+
+#include <string>
+
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// Each half of the id has 8 digits.
+constexpr uint64_t kHalfRange = 100000000;
+constexpr int kIdLength = 16;
+
+// The finalizer of SplitMix64, which mixes all the bits of @value.
+uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+}  // namespace
+
+EventIdEncoder::EventIdEncoder(RandomGenerator& random_generator) {
+  for (uint64_t& key : round_keys_) {
+    // Combines 2 integers to get 62 random bits.
+    uint64_t high = random_generator.GetInteger(0, 0x7fffffff);
+    uint64_t low = random_generator.GetInteger(0, 0x7fffffff);
+    key = (high << 31) | low;
+  }
+}
+
+uint64_t EventIdEncoder::Encode(const uint64_t ordinal) const {
+  CHECK(ordinal < kMaxOrdinal) << "ordinal must be less than 10^16.";
+  uint64_t left = ordinal / kHalfRange;
+  uint64_t right = ordinal % kHalfRange;
+  // Each round maps (left, right) to (right, left + F(right)), which can be
+  // reversed by left = (new right - F(new left)), so the whole network is a
+  // permutation.
+  for (uint64_t key : round_keys_) {
+    uint64_t next_right = (left + Mix(right ^ key) % kHalfRange) % kHalfRange;
+    left = right;
+    right = next_right;
+  }
+  return left * kHalfRange + right;
+}
+
+void EventIdEncoder::AppendId(const uint64_t ordinal,
+                              std::string& output) const {
+  uint64_t id = Encode(ordinal);
+  size_t start = output.size();
+  output.resize(start + kIdLength);
+  for (int i = kIdLength - 1; i >= 0; --i) {
+    output[start + i] = '0' + id % 10;
+    id /= 10;
+  }
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,54 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENT_ID_ENCODER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENT_ID_ENCODER_H_
+
+#include <array>
+#include <string>
+
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+// EventIdEncoder maps the ordinal of an event to an event_id.id composed of 16
+// digits. The mapping is a permutation of [0, 10^16) built as a 4-round
+// Feistel network on the upper and lower 8 digits, with the round keys drawn
+// from a RandomGenerator. So different ordinals always get different ids,
+// without keeping any of the generated ids, and the ids of consecutive
+// ordinals look random.
+class EventIdEncoder {
+ public:
+  // The count of distinct ids, which is 10^16. The ordinal must be less than
+  // this.
+  static constexpr uint64_t kMaxOrdinal = 10000000000000000;
+
+  // Draws the round keys from @random_generator.
+  explicit EventIdEncoder(RandomGenerator& random_generator);
+
+  // Returns the id of @ordinal, as an integer in [0, kMaxOrdinal).
+  uint64_t Encode(uint64_t ordinal) const;
+
+  // Appends the id of @ordinal to @output, as 16 digits with leading zeros.
+  void AppendId(uint64_t ordinal, std::string& output) const;
+
+ private:
+  static constexpr int kRounds = 4;
+
+  std::array<uint64_t, kRounds> round_keys_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENT_ID_ENCODER_H_
@@ -14,21 +14,31 @@
 
 #include "wfa/virtual_people/events_generator/events_generator.h"
 
+#include <algorithm>
+#include <memory>
+#include <numeric>
 #include <string>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "absl/container/fixed_array.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/civil_time.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
+#include "src/farmhash.h"
 #include "wfa/virtual_people/common/demographic.pb.h"
 #include "wfa/virtual_people/common/event.pb.h"
 #include "wfa/virtual_people/common/geo_location.pb.h"
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+#include "wfa/virtual_people/events_generator/event_id_encoder.h"
 #include "wfa/virtual_people/events_generator/random_generator.h"
+#include "wfa/virtual_people/events_generator/string_arena.h"
 
 namespace wfa_virtual_people {
 
@@ -46,6 +56,15 @@ uint64_t ConvertToTimestampUsec(absl::CivilDay day) {
   return absl::ToUnixMicros(t);
 }
 
+// Returns the Fingerprint64 of each string in @pool.
+std::vector<uint64_t> GetFingerprints(const StringArena& pool) {
+  std::vector<uint64_t> fingerprints(pool.size());
+  for (size_t i = 0; i < pool.size(); ++i) {
+    fingerprints[i] = util::Fingerprint64(pool[i]);
+  }
+  return fingerprints;
+}
+
 DemoInfo GetUserInfoDemo(RandomGenerator& random_generator,
                          absl::string_view seed_prefix) {
   DemoInfo demo;
@@ -78,26 +97,18 @@ DemoInfo GetUserInfoDemo(RandomGenerator& random_generator,
 }
 
 GeoLocation GetHomeGeo(RandomGenerator& random_generator,
-                       const uint32_t total_countries,
-                       const uint32_t regions_per_country,
-                       const uint32_t cities_per_region,
+                       const GenerationPlan& plan,
                        absl::string_view seed_prefix) {
-  CHECK(total_countries >= 1 && total_countries <= 900)
-      << "total_countries must be between 1 and 900.";
-  CHECK(regions_per_country >= 1 && regions_per_country <= 1000)
-      << "regions_per_country must be between 1 and 1000.";
-  CHECK(cities_per_region >= 1 && cities_per_region <= 1000)
-      << "cities_per_region must be between 1 and 1000.";
   int32_t country_id = random_generator.GetIntegerWithSeed(
-      100, 99 + total_countries,
+      100, plan.max_country_id(),
       absl::StrCat(seed_prefix, "_home_geo_country"));
   int32_t region_id =
       country_id * 1000 + random_generator.GetIntegerWithSeed(
-                              0, regions_per_country - 1,
+                              0, plan.max_region_suffix(),
                               absl::StrCat(seed_prefix, "_home_geo_region"));
   int32_t city_id =
       region_id * 1000 + random_generator.GetIntegerWithSeed(
-                             0, cities_per_region - 1,
+                             0, plan.max_city_suffix(),
                              absl::StrCat(seed_prefix, "_home_geo_city"));
   GeoLocation geo;
   geo.set_country_id(country_id);
@@ -106,23 +117,19 @@ GeoLocation GetHomeGeo(RandomGenerator& random_generator,
   return geo;
 }
 
-UserInfo GetUserInfo(RandomGenerator& random_generator,
-                     const std::vector<std::string>& user_id_pool,
-                     absl::CivilDay current_day,
-                     const uint32_t profile_version_days,
-                     const uint32_t total_countries,
-                     const uint32_t regions_per_country,
-                     const uint32_t cities_per_region) {
+// Builds the UserInfo of @user_id, with the profile_version of @days_ago days
+// before current date. All the fields are decided by the value of @user_id and
+// profile_version.
+UserInfo BuildUserInfo(RandomGenerator& random_generator,
+                       absl::string_view user_id, const GenerationPlan& plan,
+                       const uint32_t days_ago) {
   UserInfo user_info;
 
   // Sets user_id.
-  int32_t index = random_generator.GetInteger(0, user_id_pool.size() - 1);
-  user_info.set_user_id(user_id_pool.at(index));
+  user_info.set_user_id(std::string(user_id));
 
   // Sets profile_version.
-  absl::CivilDay profile_version =
-      random_generator.GetDateInNDays(current_day, profile_version_days);
-  user_info.set_profile_version(absl::FormatCivilTime(profile_version));
+  user_info.set_profile_version(plan.profile_version(days_ago));
 
   std::string seed_prefix =
       absl::StrCat(user_info.user_id(), "_", user_info.profile_version());
@@ -132,23 +139,114 @@ UserInfo GetUserInfo(RandomGenerator& random_generator,
 
   // Sets home_geo.
   *user_info.mutable_home_geo() =
-      GetHomeGeo(random_generator, total_countries, regions_per_country,
-                 cities_per_region, seed_prefix);
+      GetHomeGeo(random_generator, plan, seed_prefix);
 
   // Sets creation_time_usec.
   uint64_t creation_time_usec =
       random_generator.GetTimestampUsecInNDaysWithSeed(
-          ConvertToTimestampUsec(profile_version), 1000,
+          plan.profile_version_timestamp_usec(days_ago), 1000,
           absl::StrCat(seed_prefix, "_creation_time"));
   user_info.set_creation_time_usec(creation_time_usec);
 
   return user_info;
 }
 
+// Splits @total into counts proportional to @weights, using the largest
+// remainder method. Ties are broken in favor of the smaller index.
+std::vector<uint32_t> SplitByWeights(const uint32_t total,
+                                     const std::vector<double>& weights) {
+  double total_weight = std::accumulate(weights.begin(), weights.end(), 0.0);
+  std::vector<uint32_t> counts(weights.size());
+  std::vector<double> remainders(weights.size());
+  uint32_t assigned = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    double quota = total * weights[i] / total_weight;
+    counts[i] = static_cast<uint32_t>(quota);
+    remainders[i] = quota - counts[i];
+    assigned += counts[i];
+  }
+  std::vector<size_t> order(weights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&remainders](size_t a, size_t b) {
+                     return remainders[a] > remainders[b];
+                   });
+  for (size_t i = 0; assigned < total; i = (i + 1) % order.size()) {
+    ++counts[order[i]];
+    ++assigned;
+  }
+  return counts;
+}
+
 }  // namespace
 
-void EventsGenerator::BuildEventIdPool(const uint32_t total_publishers,
-                                       const uint32_t total_events) {
+GenerationPlan::GenerationPlan(const EventOptions& options,
+                               absl::CivilDay current_day)
+    : options_(options) {
+  CHECK(options.unknown_device_ratio >= 0.0 &&
+        options.unknown_device_ratio <= 1.0)
+      << "unknown_device_ratio must be between 0 and 1.";
+  CHECK(options.total_countries >= 1 && options.total_countries <= 900)
+      << "total_countries must be between 1 and 900.";
+  CHECK(options.regions_per_country >= 1 &&
+        options.regions_per_country <= 1000)
+      << "regions_per_country must be between 1 and 1000.";
+  CHECK(options.cities_per_region >= 1 && options.cities_per_region <= 1000)
+      << "cities_per_region must be between 1 and 1000.";
+  CHECK(options.email_events_ratio >= 0.0 && options.email_events_ratio <= 1.0)
+      << "email_events_ratio must be between 0 and 1.";
+  CHECK(options.phone_events_ratio >= 0.0 && options.phone_events_ratio <= 1.0)
+      << "phone_events_ratio must be between 0 and 1.";
+  CHECK(options.proprietary_id_space_1_events_ratio >= 0.0 &&
+        options.proprietary_id_space_1_events_ratio <= 1.0)
+      << "proprietary_id_space_1_events_ratio must be between 0 and 1.";
+  CHECK(options.profile_version_days <= kMaxProfileVersionDays)
+      << "profile_version_days must be no larger than "
+      << kMaxProfileVersionDays << ".";
+
+  unknown_device_threshold_ =
+      RandomGenerator::GetBoolThreshold(options.unknown_device_ratio);
+  email_threshold_ =
+      RandomGenerator::GetBoolThreshold(options.email_events_ratio);
+  phone_threshold_ =
+      RandomGenerator::GetBoolThreshold(options.phone_events_ratio);
+  proprietary_id_space_1_threshold_ = RandomGenerator::GetBoolThreshold(
+      options.proprietary_id_space_1_events_ratio);
+
+  max_country_id_ = 99 + options.total_countries;
+  max_region_suffix_ = options.regions_per_country - 1;
+  max_city_suffix_ = options.cities_per_region - 1;
+
+  for (uint32_t days_ago = 0; days_ago <= options.profile_version_days;
+       ++days_ago) {
+    absl::CivilDay profile_version = current_day - days_ago;
+    profile_versions_.push_back(absl::FormatCivilTime(profile_version));
+    profile_version_timestamps_usec_.push_back(
+        ConvertToTimestampUsec(profile_version));
+  }
+}
+
+bool GenerationPlan::IsCompiledFrom(const EventOptions& options) const {
+  return options.unknown_device_ratio == options_.unknown_device_ratio &&
+         options.total_countries == options_.total_countries &&
+         options.regions_per_country == options_.regions_per_country &&
+         options.cities_per_region == options_.cities_per_region &&
+         options.email_events_ratio == options_.email_events_ratio &&
+         options.phone_events_ratio == options_.phone_events_ratio &&
+         options.proprietary_id_space_1_events_ratio ==
+             options_.proprietary_id_space_1_events_ratio &&
+         options.profile_version_days == options_.profile_version_days;
+}
+
+bool GenerationPlan::HasSameGeo(const GenerationPlan& other) const {
+  return max_country_id_ == other.max_country_id_ &&
+         max_region_suffix_ == other.max_region_suffix_ &&
+         max_city_suffix_ == other.max_city_suffix_;
+}
+
+void EventsGenerator::BuildEventIdPool(
+    const uint32_t total_publishers, const uint32_t total_events,
+    const ActivityDistribution& publisher_activity) {
   CHECK(total_publishers > 0 && total_publishers <= 100)
       << "total_publishers must be a positive integer no larger than 100.";
   CHECK(total_events > 0 && total_events <= 1000000)
@@ -157,24 +255,61 @@ void EventsGenerator::BuildEventIdPool(const uint32_t total_publishers,
   absl::flat_hash_set<std::string> publishers;
   // A set of existing ids.
   absl::flat_hash_set<std::string> ids;
+  // The total count of events for each publisher.
+  std::vector<uint32_t> events_per_publisher = SplitByWeights(
+      total_events, GetActivityWeights(publisher_activity, total_publishers,
+                                       random_generator_));
+  publisher_pool_.Reserve(total_publishers, total_publishers * 8);
+  event_id_pool_.Reserve(total_events, total_events * 16);
+  event_id_publishers_.reserve(total_events);
+  std::string publisher;
+  // The buffer of generated ids. Each id is composed of 16 digits.
+  std::string id_buffer;
   while (publishers.size() < total_publishers) {
-    std::string publisher = random_generator_.GetDigits(8);
+    publisher.clear();
+    random_generator_.AppendDigits(8, publisher);
     auto [publisher_itr, publisher_inserted] = publishers.insert(publisher);
     if (!publisher_inserted) continue;
-    // Gets the total count of events for this publisher.
-    uint32_t events_for_publisher = total_events / total_publishers;
-    if (publishers.size() <= total_events % total_publishers) {
-      ++events_for_publisher;
-    }
+    publisher_pool_.Append(publisher);
+    uint32_t events_for_publisher = events_per_publisher[publishers.size() - 1];
     uint32_t event_count = 0;
     while (event_count < events_for_publisher) {
-      std::string id = random_generator_.GetDigits(16);
-      auto [id_itr, id_inserted] = ids.insert(id);
-      if (!id_inserted) continue;
-      ++event_count;
-      event_id_pool_.push_back(PublisherEventId({publisher, id}));
+      uint32_t batch_size = events_for_publisher - event_count;
+      id_buffer.clear();
+      random_generator_.AppendDigitsBatch(16, batch_size, id_buffer);
+      for (uint32_t i = 0; i < batch_size; ++i) {
+        absl::string_view id = absl::string_view(id_buffer).substr(i * 16, 16);
+        auto [id_itr, id_inserted] = ids.emplace(id);
+        if (!id_inserted) continue;
+        ++event_count;
+        event_id_pool_.Append(*id_itr);
+        event_id_publishers_.push_back(publisher_pool_.size() - 1);
+      }
     }
   }
+  event_ids_left_ = event_id_pool_.size();
+}
+
+void EventsGenerator::BuildPublisherPool(
+    const uint32_t total_publishers,
+    const ActivityDistribution& publisher_activity) {
+  CHECK(total_publishers > 0 && total_publishers <= 100)
+      << "total_publishers must be a positive integer no larger than 100.";
+  absl::flat_hash_set<std::string> publishers;
+  publisher_pool_.Reserve(total_publishers, total_publishers * 8);
+  std::string publisher;
+  while (publishers.size() < total_publishers) {
+    publisher.clear();
+    random_generator_.AppendDigits(8, publisher);
+    auto [itr, inserted] = publishers.insert(publisher);
+    if (!inserted) continue;
+    publisher_pool_.Append(publisher);
+  }
+  if (publisher_activity.type != ActivityDistributionType::kUniform) {
+    publisher_sampler_ = std::make_unique<ActivitySampler>(
+        publisher_activity, total_publishers, random_generator_);
+  }
+  event_id_encoder_ = std::make_unique<EventIdEncoder>(random_generator_);
 }
 
 void EventsGenerator::BuildUnknownDevicePool(
@@ -183,11 +318,20 @@ void EventsGenerator::BuildUnknownDevicePool(
       << "unknown_device_count must be a positive integer no larger than "
          "10000.";
   absl::flat_hash_set<std::string> unknown_devices;
+  unknown_device_pool_.Reserve(unknown_device_count, unknown_device_count * 10);
+  // The buffer of generated unknown devices. Each unknown device is composed
+  // of 10 lower case letters.
+  std::string buffer;
   while (unknown_devices.size() < unknown_device_count) {
-    std::string unknown_device = random_generator_.GetLowerLetters(10);
-    auto [itr, inserted] = unknown_devices.insert(unknown_device);
-    if (!inserted) continue;
-    unknown_device_pool_.push_back(unknown_device);
+    uint32_t batch_size = unknown_device_count - unknown_devices.size();
+    buffer.clear();
+    random_generator_.AppendLowerLettersBatch(10, batch_size, buffer);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      auto [itr, inserted] =
+          unknown_devices.emplace(absl::string_view(buffer).substr(i * 10, 10));
+      if (!inserted) continue;
+      unknown_device_pool_.Append(*itr);
+    }
   }
 }
 
@@ -195,13 +339,18 @@ void EventsGenerator::BuildEmailPool(const uint32_t email_users_count) {
   CHECK(email_users_count > 0 && email_users_count <= 10000)
       << "email_users_count must be a positive integer no larger than 10000.";
   absl::flat_hash_set<std::string> emails;
+  // Each email has at most 10 + 1 + 8 + 12 characters.
+  email_pool_.Reserve(email_users_count, email_users_count * 31);
+  std::string email;
   while (emails.size() < email_users_count) {
-    std::string email =
-        absl::StrCat(random_generator_.GetLowerLetters(1, 10), "@",
-                     random_generator_.GetLowerLetters(4, 8), ".example.com");
+    email.clear();
+    random_generator_.AppendLowerLetters(1, 10, email);
+    email.push_back('@');
+    random_generator_.AppendLowerLetters(4, 8, email);
+    email.append(".example.com");
     auto [itr, inserted] = emails.insert(email);
     if (!inserted) continue;
-    email_pool_.push_back(email);
+    email_pool_.Append(email);
   }
 }
 
@@ -209,12 +358,17 @@ void EventsGenerator::BuildPhonePool(const uint32_t phone_users_count) {
   CHECK(phone_users_count > 0 && phone_users_count <= 10000)
       << "phone_users_count must be a positive integer no larger than 10000.";
   absl::flat_hash_set<std::string> phones;
+  // Each phone is composed of 14 characters.
+  phone_pool_.Reserve(phone_users_count, phone_users_count * 14);
+  std::string phone;
   while (phones.size() < phone_users_count) {
-    std::string phone = absl::StrCat("+(555)", random_generator_.GetDigits(3),
-                                     "-", random_generator_.GetDigits(4));
+    phone.assign("+(555)");
+    random_generator_.AppendDigits(3, phone);
+    phone.push_back('-');
+    random_generator_.AppendDigits(4, phone);
     auto [itr, inserted] = phones.insert(phone);
     if (!inserted) continue;
-    phone_pool_.push_back(phone);
+    phone_pool_.Append(phone);
   }
 }
 
@@ -225,34 +379,64 @@ void EventsGenerator::BuildProprietaryIdSpace1Pool(
       << "proprietary_id_space_1_users_count must be a positive integer no "
          "larger than 10000.";
   absl::flat_hash_set<std::string> proprietary_id_space_1s;
+  proprietary_id_space_1_pool_.Reserve(proprietary_id_space_1_users_count,
+                                       proprietary_id_space_1_users_count * 16);
+  // The buffer of generated ids. Each id is composed of 16 digits.
+  std::string buffer;
   while (proprietary_id_space_1s.size() < proprietary_id_space_1_users_count) {
-    std::string proprietary_id_space_1 = random_generator_.GetDigits(16);
-    auto [itr, inserted] =
-        proprietary_id_space_1s.insert(proprietary_id_space_1);
-    if (!inserted) continue;
-    proprietary_id_space_1_pool_.push_back(proprietary_id_space_1);
+    uint32_t batch_size =
+        proprietary_id_space_1_users_count - proprietary_id_space_1s.size();
+    buffer.clear();
+    random_generator_.AppendDigitsBatch(16, batch_size, buffer);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      auto [itr, inserted] = proprietary_id_space_1s.emplace(
+          absl::string_view(buffer).substr(i * 16, 16));
+      if (!inserted) continue;
+      proprietary_id_space_1_pool_.Append(*itr);
+    }
   }
 }
 
-void EventsGenerator::Initialize(
-    const uint32_t total_publishers, const uint32_t total_events,
-    const uint32_t unknown_device_count, const uint32_t email_users_count,
-    const uint32_t phone_users_count,
-    const uint32_t proprietary_id_space_1_users_count) {
-  BuildEventIdPool(total_publishers, total_events);
-  BuildUnknownDevicePool(unknown_device_count);
-  BuildEmailPool(email_users_count);
-  BuildPhonePool(phone_users_count);
-  BuildProprietaryIdSpace1Pool(proprietary_id_space_1_users_count);
+void EventsGenerator::Initialize(const EventsGeneratorOptions& options) {
+  if (options.streaming_event_ids) {
+    BuildPublisherPool(options.total_publishers, options.publisher_activity);
+  } else {
+    BuildEventIdPool(options.total_publishers, options.total_events,
+                     options.publisher_activity);
+  }
+  BuildUnknownDevicePool(options.unknown_device_count);
+  BuildEmailPool(options.email_users_count);
+  BuildPhonePool(options.phone_users_count);
+  BuildProprietaryIdSpace1Pool(options.proprietary_id_space_1_users_count);
+  email_user_info_cache_.reserve(email_pool_.size());
+  phone_user_info_cache_.reserve(phone_pool_.size());
+  proprietary_id_space_1_user_info_cache_.reserve(
+      proprietary_id_space_1_pool_.size());
+  set_fingerprints_ = options.set_fingerprints;
+  if (set_fingerprints_) {
+    event_id_fingerprints_ = GetFingerprints(event_id_pool_);
+    email_fingerprints_ = GetFingerprints(email_pool_);
+    phone_fingerprints_ = GetFingerprints(phone_pool_);
+    proprietary_id_space_1_fingerprints_ =
+        GetFingerprints(proprietary_id_space_1_pool_);
+  }
+
+  unknown_device_sampler_ = std::make_unique<ActivitySampler>(
+      options.unknown_device_activity, unknown_device_pool_.size(),
+      random_generator_);
+  email_sampler_ = std::make_unique<ActivitySampler>(
+      options.user_activity, email_pool_.size(), random_generator_);
+  phone_sampler_ = std::make_unique<ActivitySampler>(
+      options.user_activity, phone_pool_.size(), random_generator_);
+  proprietary_id_space_1_sampler_ = std::make_unique<ActivitySampler>(
+      options.user_activity, proprietary_id_space_1_pool_.size(),
+      random_generator_);
 }
 
 EventsGenerator::EventsGenerator(const EventsGeneratorOptions& options)
     : current_timestamp_(options.current_timestamp),
       current_day_(ConvertToDay(options.current_timestamp)) {
-  Initialize(options.total_publishers, options.total_events,
-             options.unknown_device_count, options.email_users_count,
-             options.phone_users_count,
-             options.proprietary_id_space_1_users_count);
+  Initialize(options);
 }
 
 EventsGenerator::EventsGenerator(const EventsGeneratorOptions& options,
@@ -260,48 +444,72 @@ EventsGenerator::EventsGenerator(const EventsGeneratorOptions& options,
     : random_generator_(seed),
       current_timestamp_(options.current_timestamp),
       current_day_(ConvertToDay(options.current_timestamp)) {
-  Initialize(options.total_publishers, options.total_events,
-             options.unknown_device_count, options.email_users_count,
-             options.phone_users_count,
-             options.proprietary_id_space_1_users_count);
+  Initialize(options);
 }
 
 EventId EventsGenerator::GetEventId() {
-  CHECK(!event_id_pool_.empty()) << "All event ids are used.";
-  PublisherEventId event_id = event_id_pool_.back();
-  event_id_pool_.pop_back();
+  if (event_id_encoder_) {
+    uint64_t ordinal = next_event_ordinal_++;
+    uint32_t publisher_index =
+        publisher_sampler_ ? publisher_sampler_->Sample(random_generator_)
+                           : ordinal % publisher_pool_.size();
+    EventId output;
+    absl::string_view publisher = publisher_pool_[publisher_index];
+    output.set_publisher(publisher.data(), publisher.size());
+    event_id_encoder_->AppendId(ordinal, *output.mutable_id());
+    // The streamed ids are not pooled, so the fingerprint is computed for
+    // each event.
+    if (set_fingerprints_) {
+      output.set_id_fingerprint(util::Fingerprint64(output.id()));
+    }
+    return output;
+  }
+  CHECK(event_ids_left_ > 0) << "All event ids are used.";
+  uint32_t index = --event_ids_left_;
+  absl::string_view publisher = publisher_pool_[event_id_publishers_[index]];
+  absl::string_view id = event_id_pool_[index];
   EventId output;
-  output.set_publisher(event_id.publisher);
-  output.set_id(event_id.id);
+  output.set_publisher(publisher.data(), publisher.size());
+  output.set_id(id.data(), id.size());
+  if (set_fingerprints_) {
+    output.set_id_fingerprint(event_id_fingerprints_[index]);
+  }
   return output;
 }
 
-std::string EventsGenerator::GetDevice(const double unknown_device_ratio) {
-  CHECK(unknown_device_ratio >= 0.0 && unknown_device_ratio <= 1.0)
-      << "unknown_device_ratio must be between 0 and 1.";
-  bool is_unknown = random_generator_.GetBool(unknown_device_ratio);
-  if (is_unknown) {
-    int index =
-        random_generator_.GetInteger(0, unknown_device_pool_.size() - 1);
-    return unknown_device_pool_.at(index);
+const GenerationPlan& EventsGenerator::GetPlan(const EventOptions& options) {
+  if (plan_ && plan_->IsCompiledFrom(options)) {
+    return *plan_;
+  }
+  auto plan = std::make_unique<GenerationPlan>(options, current_day_);
+  // The cached UserInfo depend on the geo options, so the caches are only
+  // valid when the geo options do not change.
+  if (!plan_ || !plan_->HasSameGeo(*plan)) {
+    email_user_info_cache_.clear();
+    phone_user_info_cache_.clear();
+    proprietary_id_space_1_user_info_cache_.clear();
   }
-  return std::to_string(random_generator_.GetInteger(0, 99));
+  plan_ = std::move(plan);
+  return *plan_;
 }
 
-GeoLocation EventsGenerator::GetGeo(const uint32_t total_countries,
-                                    const uint32_t regions_per_country,
-                                    const uint32_t cities_per_region) {
-  CHECK(total_countries >= 1 && total_countries <= 900)
-      << "total_countries must be between 1 and 900.";
-  CHECK(regions_per_country >= 1 && regions_per_country <= 1000)
-      << "regions_per_country must be between 1 and 1000.";
-  CHECK(cities_per_region >= 1 && cities_per_region <= 1000)
-      << "cities_per_region must be between 1 and 1000.";
-  int32_t country_id = random_generator_.GetInteger(100, 99 + total_countries);
+void EventsGenerator::AppendDevice(const GenerationPlan& plan,
+                                   std::string& output) {
+  if (random_generator_.GetBoolWithThreshold(plan.unknown_device_threshold())) {
+    uint32_t index = unknown_device_sampler_->Sample(random_generator_);
+    absl::string_view device = unknown_device_pool_[index];
+    output.append(device.data(), device.size());
+  } else {
+    absl::StrAppend(&output, random_generator_.GetInteger(0, 99));
+  }
+}
+
+GeoLocation EventsGenerator::GetGeo(const GenerationPlan& plan) {
+  int32_t country_id = random_generator_.GetInteger(100, plan.max_country_id());
   int32_t region_id = country_id * 1000 +
-                      random_generator_.GetInteger(0, regions_per_country - 1);
-  int32_t city_id =
-      region_id * 1000 + random_generator_.GetInteger(0, cities_per_region - 1);
+                      random_generator_.GetInteger(0, plan.max_region_suffix());
+  int32_t city_id = region_id * 1000 +
+                    random_generator_.GetInteger(0, plan.max_city_suffix());
   GeoLocation geo;
   geo.set_country_id(country_id);
   geo.set_region_id(region_id);
@@ -309,62 +517,178 @@ GeoLocation EventsGenerator::GetGeo(const uint32_t total_countries,
   return geo;
 }
 
-ProfileInfo EventsGenerator::GetProfileInfo(const ProfileInfoOptions& options) {
-  CHECK(options.email_events_ratio >= 0.0 && options.email_events_ratio <= 1.0)
-      << "email_events_ratio must be between 0 and 1.";
-  CHECK(options.phone_events_ratio >= 0.0 && options.phone_events_ratio <= 1.0)
-      << "phone_events_ratio must be between 0 and 1.";
-  CHECK(options.proprietary_id_space_1_events_ratio >= 0.0 &&
-        options.proprietary_id_space_1_events_ratio <= 1.0)
-      << "proprietary_id_space_1_events_ratio must be between 0 and 1.";
-  CHECK(options.profile_version_days <= 3)
-      << "profile_version_days must be no larger than 3.";
+UserInfo EventsGenerator::GetUserInfo(
+    const StringArena& user_id_pool,
+    const std::vector<uint64_t>& user_id_fingerprints,
+    const ActivitySampler& user_sampler, UserInfoCache& user_info_cache,
+    const GenerationPlan& plan) {
+  uint32_t index = user_sampler.Sample(random_generator_);
+  uint32_t days_ago =
+      random_generator_.GetInteger(0, plan.options().profile_version_days);
+
+  uint64_t key =
+      static_cast<uint64_t>(index) * (kMaxProfileVersionDays + 1) + days_ago;
+  auto [itr, inserted] = user_info_cache.try_emplace(key);
+  if (inserted) {
+    itr->second = BuildUserInfo(random_generator_, user_id_pool[index],
+                                plan, days_ago);
+    if (!user_id_fingerprints.empty()) {
+      itr->second.set_user_id_fingerprint(user_id_fingerprints[index]);
+    }
+  }
+  return itr->second;
+}
 
+ProfileInfo EventsGenerator::GetProfileInfo(const GenerationPlan& plan) {
   ProfileInfo profile_info;
-  if (random_generator_.GetBool(options.email_events_ratio)) {
-    *profile_info.mutable_email_user_info() =
-        GetUserInfo(random_generator_, email_pool_, current_day_,
-                    options.profile_version_days, options.total_countries,
-                    options.regions_per_country, options.cities_per_region);
+  if (random_generator_.GetBoolWithThreshold(plan.email_threshold())) {
+    *profile_info.mutable_email_user_info() = GetUserInfo(
+        email_pool_, email_fingerprints_, *email_sampler_,
+        email_user_info_cache_, plan);
   }
-  if (random_generator_.GetBool(options.phone_events_ratio)) {
-    *profile_info.mutable_phone_user_info() =
-        GetUserInfo(random_generator_, phone_pool_, current_day_,
-                    options.profile_version_days, options.total_countries,
-                    options.regions_per_country, options.cities_per_region);
+  if (random_generator_.GetBoolWithThreshold(plan.phone_threshold())) {
+    *profile_info.mutable_phone_user_info() = GetUserInfo(
+        phone_pool_, phone_fingerprints_, *phone_sampler_,
+        phone_user_info_cache_, plan);
   }
-  if (random_generator_.GetBool(options.proprietary_id_space_1_events_ratio)) {
-    *profile_info.mutable_proprietary_id_space_1_user_info() = GetUserInfo(
-        random_generator_, proprietary_id_space_1_pool_, current_day_,
-        options.profile_version_days, options.total_countries,
-        options.regions_per_country, options.cities_per_region);
+  if (random_generator_.GetBoolWithThreshold(
+          plan.proprietary_id_space_1_threshold())) {
+    *profile_info.mutable_proprietary_id_space_1_user_info() =
+        GetUserInfo(proprietary_id_space_1_pool_,
+                    proprietary_id_space_1_fingerprints_,
+                    *proprietary_id_space_1_sampler_,
+                    proprietary_id_space_1_user_info_cache_, plan);
   }
   return profile_info;
 }
 
 DataProviderEvent EventsGenerator::GetEvent(const EventOptions& options) {
+  return GetEventAt(
+      random_generator_.GetTimestampUsecInNDays(current_timestamp_,
+                                                kEventWindowDays),
+      options);
+}
+
+DataProviderEvent EventsGenerator::GetEventAt(const uint64_t timestamp_usec,
+                                              const EventOptions& options) {
+  const GenerationPlan& plan = GetPlan(options);
+
   DataProviderEvent event;
   LabelerInput* labeler_input =
       event.mutable_log_event()->mutable_labeler_input();
 
   *labeler_input->mutable_event_id() = GetEventId();
 
-  labeler_input->set_timestamp_usec(
-      random_generator_.GetTimestampUsecInNDays(current_timestamp_, 30));
+  labeler_input->set_timestamp_usec(timestamp_usec);
 
-  labeler_input->set_user_agent(GetDevice(options.unknown_device_ratio));
+  AppendDevice(plan, *labeler_input->mutable_user_agent());
 
-  *labeler_input->mutable_geo() =
-      GetGeo(options.total_countries, options.regions_per_country,
-             options.cities_per_region);
+  *labeler_input->mutable_geo() = GetGeo(plan);
 
-  *labeler_input->mutable_profile_info() =
-      GetProfileInfo({options.email_events_ratio, options.phone_events_ratio,
-                      options.proprietary_id_space_1_events_ratio,
-                      options.profile_version_days, options.total_countries,
-                      options.regions_per_country, options.cities_per_region});
+  *labeler_input->mutable_profile_info() = GetProfileInfo(plan);
 
   return event;
 }
 
+std::vector<DataProviderEvent> EventsGenerator::GetEvents(
+    const uint32_t n, const EventOptions& options) {
+  std::vector<DataProviderEvent> events(n);
+  std::vector<LabelerInput*> outputs;
+  outputs.reserve(n);
+  for (DataProviderEvent& event : events) {
+    outputs.push_back(event.mutable_log_event()->mutable_labeler_input());
+  }
+  FillLabelerInputs(options, outputs);
+  return events;
+}
+
+void EventsGenerator::AppendLabelerInputs(
+    const uint32_t n, const EventOptions& options,
+    google::protobuf::RepeatedPtrField<LabelerInput>& output) {
+  output.Reserve(output.size() + n);
+  std::vector<LabelerInput*> outputs;
+  outputs.reserve(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    outputs.push_back(output.Add());
+  }
+  FillLabelerInputs(options, outputs);
+}
+
+void EventsGenerator::FillLabelerInputs(
+    const EventOptions& options, absl::Span<LabelerInput* const> outputs) {
+  const uint32_t n = outputs.size();
+  CHECK(event_id_encoder_ || n <= event_ids_left_)
+      << "Not enough event ids left.";
+  const GenerationPlan& plan = GetPlan(options);
+
+  // Generates each field for all the events at once.
+  absl::FixedArray<uint64_t> timestamps(n);
+  random_generator_.GetTimestampsUsecInNDays(
+      current_timestamp_, kEventWindowDays, absl::MakeSpan(timestamps));
+  absl::FixedArray<bool> is_unknown_device(n);
+  random_generator_.GetBools(options.unknown_device_ratio,
+                             absl::MakeSpan(is_unknown_device));
+  absl::FixedArray<int32_t> known_devices(n);
+  random_generator_.GetIntegers(0, 99, absl::MakeSpan(known_devices));
+  absl::FixedArray<int32_t> country_ids(n);
+  random_generator_.GetIntegers(100, plan.max_country_id(),
+                                absl::MakeSpan(country_ids));
+  absl::FixedArray<int32_t> region_suffixes(n);
+  random_generator_.GetIntegers(0, plan.max_region_suffix(),
+                                absl::MakeSpan(region_suffixes));
+  absl::FixedArray<int32_t> city_suffixes(n);
+  random_generator_.GetIntegers(0, plan.max_city_suffix(),
+                                absl::MakeSpan(city_suffixes));
+  absl::FixedArray<bool> has_email(n);
+  random_generator_.GetBools(options.email_events_ratio,
+                             absl::MakeSpan(has_email));
+  absl::FixedArray<bool> has_phone(n);
+  random_generator_.GetBools(options.phone_events_ratio,
+                             absl::MakeSpan(has_phone));
+  absl::FixedArray<bool> has_proprietary_id_space_1(n);
+  random_generator_.GetBools(options.proprietary_id_space_1_events_ratio,
+                             absl::MakeSpan(has_proprietary_id_space_1));
+
+  for (uint32_t i = 0; i < n; ++i) {
+    LabelerInput* labeler_input = outputs[i];
+
+    *labeler_input->mutable_event_id() = GetEventId();
+
+    labeler_input->set_timestamp_usec(timestamps[i]);
+
+    if (is_unknown_device[i]) {
+      uint32_t index = unknown_device_sampler_->Sample(random_generator_);
+      absl::string_view device = unknown_device_pool_[index];
+      labeler_input->set_user_agent(device.data(), device.size());
+    } else {
+      absl::StrAppend(labeler_input->mutable_user_agent(), known_devices[i]);
+    }
+
+    GeoLocation* geo = labeler_input->mutable_geo();
+    int32_t region_id = country_ids[i] * 1000 + region_suffixes[i];
+    geo->set_country_id(country_ids[i]);
+    geo->set_region_id(region_id);
+    geo->set_city_id(region_id * 1000 + city_suffixes[i]);
+
+    ProfileInfo* profile_info = labeler_input->mutable_profile_info();
+    if (has_email[i]) {
+      *profile_info->mutable_email_user_info() = GetUserInfo(
+          email_pool_, email_fingerprints_, *email_sampler_,
+          email_user_info_cache_, plan);
+    }
+    if (has_phone[i]) {
+      *profile_info->mutable_phone_user_info() = GetUserInfo(
+          phone_pool_, phone_fingerprints_, *phone_sampler_,
+          phone_user_info_cache_, plan);
+    }
+    if (has_proprietary_id_space_1[i]) {
+      *profile_info->mutable_proprietary_id_space_1_user_info() =
+          GetUserInfo(proprietary_id_space_1_pool_,
+                      proprietary_id_space_1_fingerprints_,
+                      *proprietary_id_space_1_sampler_,
+                      proprietary_id_space_1_user_info_cache_, plan);
+    }
+  }
+}
+
 }  // namespace wfa_virtual_people
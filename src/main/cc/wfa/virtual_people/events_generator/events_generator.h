@@ -15,26 +15,36 @@
 #ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENTS_GENERATOR_H_
 #define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENTS_GENERATOR_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/time/civil_time.h"
+#include "absl/types/span.h"
+#include "google/protobuf/repeated_field.h"
 #include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+#include "wfa/virtual_people/events_generator/event_id_encoder.h"
 #include "wfa/virtual_people/events_generator/random_generator.h"
+#include "wfa/virtual_people/events_generator/string_arena.h"
 
 namespace wfa_virtual_people {
 
-struct PublisherEventId {
-  std::string publisher;
-  std::string id;
-};
+// The max allowed value of profile_version_days in EventOptions.
+constexpr uint32_t kMaxProfileVersionDays = 3;
+
+// GetEvent and GetEvents draw the timestamps of the events from the window of
+// this many days ending at EventsGeneratorOptions.current_timestamp.
+constexpr uint32_t kEventWindowDays = 30;
 
 struct EventsGeneratorOptions {
   // The current timestamp in microseconds.
   uint64_t current_timestamp;
   // The count of unique event_id.publisher.
   uint32_t total_publishers;
-  // The count of unique event_id.id.
+  // The count of unique event_id.id. Ignored when @streaming_event_ids is
+  // true.
   uint32_t total_events;
   // The count of unique user_agent when it represents unknown device.
   uint32_t unknown_device_count;
@@ -44,6 +54,22 @@ struct EventsGeneratorOptions {
   uint32_t phone_users_count;
   // The count of unique profile_info.proprietary_id_space_1_user_info.user_id.
   uint32_t proprietary_id_space_1_users_count;
+  // How the events are split among publishers.
+  ActivityDistribution publisher_activity;
+  // How often each unknown device is selected.
+  ActivityDistribution unknown_device_activity;
+  // How often each user is selected, applied to each of the email, phone and
+  // proprietary_id_space_1 user pools.
+  ActivityDistribution user_activity;
+  // If true, the event ids are not built in a pool at construction, but
+  // computed from the ordinal of each event when it is generated. The count of
+  // events is then not limited by @total_events, and the memory does not grow
+  // with the count of events.
+  bool streaming_event_ids = false;
+  // If true, event_id.id_fingerprint and the user_id_fingerprint in each user
+  // info are set to the Fingerprint64 of event_id.id and user_id. The
+  // fingerprints are computed once for each entry of the pools.
+  bool set_fingerprints = false;
 };
 
 struct EventOptions {
@@ -69,35 +95,82 @@ struct EventOptions {
   uint32_t profile_version_days;
 };
 
-struct ProfileInfoOptions {
-  // The chance that profile_info.email_user_info is set.
-  double email_events_ratio;
-  // The chance that profile_info.phone_user_info is set.
-  double phone_events_ratio;
-  // The chance that profile_info.proprietary_id_space_1_user_info is set.
-  double proprietary_id_space_1_events_ratio;
-  // Decides the range of profile_version. The value of profile_version is
-  // between @profile_version_days ago to current date.
-  uint32_t profile_version_days;
-  // The count of possible country_ids. The value of geo.country_id is between
-  // 100 and (99 + @total_countries).
-  uint32_t total_countries;
-  // The count of possible region_ids for each country_id. The value of last 3
-  // digits of geo.region_id is between 000 to (@regions_per_country - 1).
-  uint32_t regions_per_country;
-  // The count of possible city_ids for each region_id. The value of last 3
-  // digits of geo.city_id is between 000 to (@cities_per_region - 1).
-  uint32_t cities_per_region;
+// GenerationPlan holds the EventOptions after validation, together with the
+// values derived from them, so that they are computed once instead of for
+// every event.
+class GenerationPlan {
+ public:
+  // CHECK-fails if @options is invalid. The profile_versions are formatted
+  // relative to @current_day.
+  GenerationPlan(const EventOptions& options, absl::CivilDay current_day);
+
+  const EventOptions& options() const { return options_; }
+
+  // Returns whether this plan is compiled from @options.
+  bool IsCompiledFrom(const EventOptions& options) const;
+
+  // Returns whether the geo options are the same as in @other.
+  bool HasSameGeo(const GenerationPlan& other) const;
+
+  // The thresholds of the chances, used by
+  // RandomGenerator::GetBoolWithThreshold.
+  uint64_t unknown_device_threshold() const {
+    return unknown_device_threshold_;
+  }
+  uint64_t email_threshold() const { return email_threshold_; }
+  uint64_t phone_threshold() const { return phone_threshold_; }
+  uint64_t proprietary_id_space_1_threshold() const {
+    return proprietary_id_space_1_threshold_;
+  }
+
+  // The max values of geo.country_id, and the last 3 digits of geo.region_id
+  // and geo.city_id.
+  int32_t max_country_id() const { return max_country_id_; }
+  int32_t max_region_suffix() const { return max_region_suffix_; }
+  int32_t max_city_suffix() const { return max_city_suffix_; }
+
+  // Returns the profile_version of @days_ago days before current date, in
+  // YYYY-MM-DD format. @days_ago must be no larger than
+  // options().profile_version_days.
+  const std::string& profile_version(uint32_t days_ago) const {
+    return profile_versions_[days_ago];
+  }
+  // Returns the start of the profile_version above, in microseconds.
+  uint64_t profile_version_timestamp_usec(uint32_t days_ago) const {
+    return profile_version_timestamps_usec_[days_ago];
+  }
+
+ private:
+  EventOptions options_;
+  uint64_t unknown_device_threshold_;
+  uint64_t email_threshold_;
+  uint64_t phone_threshold_;
+  uint64_t proprietary_id_space_1_threshold_;
+  int32_t max_country_id_;
+  int32_t max_region_suffix_;
+  int32_t max_city_suffix_;
+  std::vector<std::string> profile_versions_;
+  std::vector<uint64_t> profile_version_timestamps_usec_;
 };
 
 // EventsGenerator is used to generate random DataProviderEvents. For fields in
 // log_event.labeler_input
 // * event_id.publisher is composed of 8 digits.
 // * event_id.id is composed of 16 digits.
-// * timestamp_usec is a timestamp between 30 days ago to current timestamp in
-//   microsecond.
+// * The count of events of each publisher follows
+//   EventsGeneratorOptions.publisher_activity. With
+//   EventsGeneratorOptions.streaming_event_ids, the publishers are assigned in
+//   round-robin for uniform activity, or selected randomly by the weights
+//   otherwise, and event_id.id is encoded from the ordinal of the event by
+//   EventIdEncoder.
+// * event_id.id_fingerprint is set only with
+//   EventsGeneratorOptions.set_fingerprints.
+// * timestamp_usec is a timestamp between kEventWindowDays days ago to current
+//   timestamp in microsecond.
 // * user_agent is an integer between 0 and 99 when representing known device,
 //   or composed of 10 lower case letters when representing unknown device.
+//   The unknown devices are selected following
+//   EventsGeneratorOptions.unknown_device_activity.
 // * geo.country_id is a 3-digit integer.
 // * geo.region_id is a 6-digit integer, and the first 3-digit is same as
 //   geo.country_id.
@@ -110,6 +183,8 @@ struct ProfileInfoOptions {
 // * profile_info.phone_user_info.user_id is composed of 10 digits.
 // * profile_info.proprietary_id_space_1_user_info.user_id is composed of 16
 //   digits.
+// * The user_id in each user info is selected following
+//   EventsGeneratorOptions.user_activity.
 // * For profile_info.email_user_info.profile_version,
 //   profile_info.phone_user_info.profile_version, and
 //   profile_info.proprietary_id_space_1_user_info.profile_version, the format
@@ -123,8 +198,10 @@ struct ProfileInfoOptions {
 //     than demo.demo_bucket.age.min_age.
 // *** demo.confidence is between 0.0 and 1.0.
 // *** home_geo has the same pattern as the geo field above.
-// *** creation_time_usec is a timestamp between 100 days ago to profile_version
-//     in microsecond.
+// *** creation_time_usec is a timestamp between 1000 days ago to
+//     profile_version in microsecond.
+// *** user_id_fingerprint is set only with
+//     EventsGeneratorOptions.set_fingerprints.
 class EventsGenerator {
  public:
   // Initialzies the pseudo-random number generator with default seed.
@@ -138,31 +215,102 @@ class EventsGenerator {
   // log_event.labeler_input are set.
   DataProviderEvent GetEvent(const EventOptions& options);
 
+  // Same as GetEvent, but timestamp_usec is set to @timestamp_usec. This is
+  // used to generate events following a given order of arrival times, like
+  // the ones from OrderedArrivalStream.
+  DataProviderEvent GetEventAt(uint64_t timestamp_usec,
+                               const EventOptions& options);
+
+  // Generates @n random DataProviderEvents. Same as calling GetEvent @n times,
+  // but each field is generated for all the events at once using the batch
+  // methods of RandomGenerator. The output is different from GetEvent for the
+  // same seed.
+  std::vector<DataProviderEvent> GetEvents(uint32_t n,
+                                           const EventOptions& options);
+
+  // Same as GetEvents, but appends the labeler inputs of the @n events to
+  // @output directly, without building the DataProviderEvents. The output is
+  // the same as GetEvents for the same seed.
+  void AppendLabelerInputs(
+      uint32_t n, const EventOptions& options,
+      google::protobuf::RepeatedPtrField<LabelerInput>& output);
+
  private:
-  void BuildEventIdPool(uint32_t total_publishers, uint32_t total_events);
+  void BuildEventIdPool(uint32_t total_publishers, uint32_t total_events,
+                        const ActivityDistribution& publisher_activity);
+  // Only builds the publishers, used when the event ids are streamed.
+  void BuildPublisherPool(uint32_t total_publishers,
+                          const ActivityDistribution& publisher_activity);
   void BuildUnknownDevicePool(uint32_t unknown_device_count);
   void BuildEmailPool(uint32_t email_users_count);
   void BuildPhonePool(uint32_t phone_users_count);
   void BuildProprietaryIdSpace1Pool(
       uint32_t proprietary_id_space_1_users_count);
-  void Initialize(uint32_t total_publishers, uint32_t total_events,
-                  uint32_t unknown_device_count, uint32_t email_users_count,
-                  uint32_t phone_users_count,
-                  uint32_t proprietary_id_space_1_users_count);
+  void Initialize(const EventsGeneratorOptions& options);
   EventId GetEventId();
-  std::string GetDevice(double unknown_device_ratio);
-  GeoLocation GetGeo(uint32_t total_countries, uint32_t regions_per_country,
-                     uint32_t cities_per_region);
-  ProfileInfo GetProfileInfo(const ProfileInfoOptions& options);
+  // Generates the labeler inputs of GetEvents into @outputs, one event for
+  // each of them.
+  void FillLabelerInputs(const EventOptions& options,
+                         absl::Span<LabelerInput* const> outputs);
+  // Returns the plan compiled from @options. The plan is only compiled again
+  // when @options is different from the last call.
+  const GenerationPlan& GetPlan(const EventOptions& options);
+  // Appends the user_agent to @output.
+  void AppendDevice(const GenerationPlan& plan, std::string& output);
+  GeoLocation GetGeo(const GenerationPlan& plan);
+  // The UserInfo of a user is decided only by the user_id and profile_version,
+  // so it is built once and cached. The key is
+  // (index in user pool) * (kMaxProfileVersionDays + 1) +
+  // (days from profile_version to current day), so the cache holds at most
+  // (kMaxProfileVersionDays + 1) entries for each user.
+  using UserInfoCache = absl::flat_hash_map<uint64_t, UserInfo>;
+
+  // @user_id_fingerprints is empty when the fingerprints are not set.
+  UserInfo GetUserInfo(const StringArena& user_id_pool,
+                       const std::vector<uint64_t>& user_id_fingerprints,
+                       const ActivitySampler& user_sampler,
+                       UserInfoCache& user_info_cache,
+                       const GenerationPlan& plan);
+  ProfileInfo GetProfileInfo(const GenerationPlan& plan);
 
   RandomGenerator random_generator_;
   uint64_t current_timestamp_;
   absl::CivilDay current_day_;
-  std::vector<PublisherEventId> event_id_pool_;
-  std::vector<std::string> unknown_device_pool_;
-  std::vector<std::string> email_pool_;
-  std::vector<std::string> phone_pool_;
-  std::vector<std::string> proprietary_id_space_1_pool_;
+  // The pools below are stored in StringArenas, which keep the strings of each
+  // pool contiguous in memory.
+  StringArena publisher_pool_;
+  // The pool of event ids, and the index in publisher_pool_ of the publisher
+  // of each event id. The event ids are used from the back, and
+  // event_ids_left_ is the count of unused ones.
+  StringArena event_id_pool_;
+  std::vector<uint8_t> event_id_publishers_;
+  uint32_t event_ids_left_ = 0;
+  bool set_fingerprints_ = false;
+  // The Fingerprint64 of each entry in the pools with the same prefix. Only
+  // built when set_fingerprints_ is true.
+  std::vector<uint64_t> event_id_fingerprints_;
+  std::vector<uint64_t> email_fingerprints_;
+  std::vector<uint64_t> phone_fingerprints_;
+  std::vector<uint64_t> proprietary_id_space_1_fingerprints_;
+  // The states below are only used when the event ids are streamed.
+  // Set only when the publisher activity is not uniform.
+  std::unique_ptr<ActivitySampler> publisher_sampler_;
+  std::unique_ptr<EventIdEncoder> event_id_encoder_;
+  uint64_t next_event_ordinal_ = 0;
+  StringArena unknown_device_pool_;
+  StringArena email_pool_;
+  StringArena phone_pool_;
+  StringArena proprietary_id_space_1_pool_;
+  std::unique_ptr<ActivitySampler> unknown_device_sampler_;
+  std::unique_ptr<ActivitySampler> email_sampler_;
+  std::unique_ptr<ActivitySampler> phone_sampler_;
+  std::unique_ptr<ActivitySampler> proprietary_id_space_1_sampler_;
+  UserInfoCache email_user_info_cache_;
+  UserInfoCache phone_user_info_cache_;
+  UserInfoCache proprietary_id_space_1_user_info_cache_;
+  // The plan of the last EventOptions. The cached UserInfo are built with the
+  // geo options of this plan.
+  std::unique_ptr<GenerationPlan> plan_;
 };
 
 }  // namespace wfa_virtual_people
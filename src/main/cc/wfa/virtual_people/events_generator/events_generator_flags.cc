@@ -0,0 +1,168 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/events_generator_flags.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+#include "wfa/virtual_people/events_generator/arrival_rate.h"
+#include "wfa/virtual_people/events_generator/events_generator.h"
+
+ABSL_FLAG(uint32_t, total_publishers, 10, "The count of unique publishers.");
+ABSL_FLAG(uint64_t, total_events, 1000,
+          "The count of unique event ids. It can exceed the uint32_t range "
+          "only with --streaming_event_ids.");
+ABSL_FLAG(double, unknown_device_ratio, 0.5,
+          "The chance of device to be unknown.");
+ABSL_FLAG(uint32_t, unknown_device_count, 1000,
+          "The count of possible unknown device values.");
+ABSL_FLAG(uint32_t, total_countries, 10, "The count of possible countries.");
+ABSL_FLAG(uint32_t, regions_per_country, 10,
+          "The count of possible regions per country.");
+ABSL_FLAG(uint32_t, cities_per_region, 10,
+          "The count of possible cities per region.");
+ABSL_FLAG(double, email_events_ratio, 0.5,
+          "The chance of each event to have email user info.");
+ABSL_FLAG(double, phone_events_ratio, 0.5,
+          "The chance of each event to have phone user info.");
+ABSL_FLAG(double, proprietary_id_space_1_events_ratio, 0.5,
+          "The chance of each event to have proprietary id space 1 user info.");
+ABSL_FLAG(uint32_t, email_users_count, 100,
+          "The count of possible email users.");
+ABSL_FLAG(uint32_t, phone_users_count, 100,
+          "The count of possible phone users.");
+ABSL_FLAG(uint32_t, proprietary_id_space_1_users_count, 100,
+          "The count of possible proprietary id space 1 users.");
+ABSL_FLAG(uint32_t, profile_version_days, 1,
+          "The allowed profile version is in "
+          "[today - profile_version_days, today].");
+ABSL_FLAG(std::string, publisher_activity, "uniform",
+          "How the events are split among publishers. One of uniform, "
+          "zipf:<exponent>, log_normal:<sigma>, or "
+          "empirical:<weight_1>,<weight_2>,...");
+ABSL_FLAG(std::string, unknown_device_activity, "uniform",
+          "How often each unknown device is selected. Same format as "
+          "--publisher_activity.");
+ABSL_FLAG(std::string, user_activity, "uniform",
+          "How often each user is selected in each id space. Same format as "
+          "--publisher_activity.");
+ABSL_FLAG(bool, streaming_event_ids, false,
+          "If true, the event ids are computed from the ordinal of each event "
+          "instead of built in a pool at start, so total_events is not "
+          "limited to 1000000.");
+ABSL_FLAG(bool, set_fingerprints, false,
+          "If true, event_id.id_fingerprint and user_id_fingerprint of each "
+          "user info are set to the fingerprints of the ids.");
+ABSL_FLAG(std::string, hourly_arrival_weights, "",
+          "The relative arrival rate of each hour of the day in UTC, as 24 "
+          "comma separated numbers. Empty means the same rate for all hours. "
+          "Only used when generating events in time order.");
+ABSL_FLAG(std::string, daily_arrival_weights, "",
+          "The relative arrival rate of each day of the week in UTC, starting "
+          "from Monday, as 7 comma separated numbers. Empty means the same "
+          "rate for all days. Only used when generating events in time order.");
+ABSL_FLAG(std::string, arrival_bursts, "",
+          "The periods with multiplied arrival rate, as comma separated "
+          "<start_hours_ago>:<duration_hours>:<multiplier>. Only used when "
+          "generating events in time order.");
+
+namespace wfa_virtual_people {
+
+namespace {
+
+ActivityDistribution GetActivityDistribution(absl::string_view spec) {
+  absl::StatusOr<ActivityDistribution> distribution =
+      ParseActivityDistribution(spec);
+  CHECK(distribution.ok()) << distribution.status();
+  return *distribution;
+}
+
+std::vector<double> GetArrivalWeights(absl::string_view spec, const int size) {
+  absl::StatusOr<std::vector<double>> weights = ParseArrivalWeights(spec, size);
+  CHECK(weights.ok()) << weights.status();
+  return *std::move(weights);
+}
+
+}  // namespace
+
+EventsGeneratorOptions GetEventsGeneratorOptionsFromFlags() {
+  // The event ids are built in a pool of at most uint32_t entries, unless
+  // streamed, in which case total_events is not used by the generator.
+  const uint64_t total_events = absl::GetFlag(FLAGS_total_events);
+  const bool streaming_event_ids = absl::GetFlag(FLAGS_streaming_event_ids);
+  CHECK(streaming_event_ids ||
+        total_events <= std::numeric_limits<uint32_t>::max())
+      << "total_events can exceed the uint32_t range only with "
+         "--streaming_event_ids.";
+  EventsGeneratorOptions options = {
+      .current_timestamp =
+          static_cast<uint64_t>(absl::ToUnixMicros(absl::Now())),
+      .total_publishers = absl::GetFlag(FLAGS_total_publishers),
+      .total_events = static_cast<uint32_t>(std::min<uint64_t>(
+          total_events, std::numeric_limits<uint32_t>::max())),
+      .unknown_device_count = absl::GetFlag(FLAGS_unknown_device_count),
+      .email_users_count = absl::GetFlag(FLAGS_email_users_count),
+      .phone_users_count = absl::GetFlag(FLAGS_phone_users_count),
+      .proprietary_id_space_1_users_count =
+          absl::GetFlag(FLAGS_proprietary_id_space_1_users_count),
+      .publisher_activity =
+          GetActivityDistribution(absl::GetFlag(FLAGS_publisher_activity)),
+      .unknown_device_activity = GetActivityDistribution(
+          absl::GetFlag(FLAGS_unknown_device_activity)),
+      .user_activity =
+          GetActivityDistribution(absl::GetFlag(FLAGS_user_activity)),
+      .streaming_event_ids = streaming_event_ids,
+      .set_fingerprints = absl::GetFlag(FLAGS_set_fingerprints)};
+  return options;
+}
+
+EventOptions GetEventOptionsFromFlags() {
+  EventOptions options = {
+      .unknown_device_ratio = absl::GetFlag(FLAGS_unknown_device_ratio),
+      .total_countries = absl::GetFlag(FLAGS_total_countries),
+      .regions_per_country = absl::GetFlag(FLAGS_regions_per_country),
+      .cities_per_region = absl::GetFlag(FLAGS_cities_per_region),
+      .email_events_ratio = absl::GetFlag(FLAGS_email_events_ratio),
+      .phone_events_ratio = absl::GetFlag(FLAGS_phone_events_ratio),
+      .proprietary_id_space_1_events_ratio =
+          absl::GetFlag(FLAGS_proprietary_id_space_1_events_ratio),
+      .profile_version_days = absl::GetFlag(FLAGS_profile_version_days)};
+  return options;
+}
+
+ArrivalRateOptions GetArrivalRateOptionsFromFlags(
+    const uint64_t current_timestamp_usec) {
+  absl::StatusOr<std::vector<ArrivalBurst>> bursts = ParseArrivalBursts(
+      absl::GetFlag(FLAGS_arrival_bursts), current_timestamp_usec);
+  CHECK(bursts.ok()) << bursts.status();
+  ArrivalRateOptions options = {
+      .hourly_weights = GetArrivalWeights(
+          absl::GetFlag(FLAGS_hourly_arrival_weights), kHoursPerDay),
+      .daily_weights = GetArrivalWeights(
+          absl::GetFlag(FLAGS_daily_arrival_weights), kDaysPerWeek),
+      .bursts = *std::move(bursts)};
+  return options;
+}
+
+}  // namespace wfa_virtual_people
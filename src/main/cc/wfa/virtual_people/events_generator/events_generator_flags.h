@@ -0,0 +1,42 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENTS_GENERATOR_FLAGS_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENTS_GENERATOR_FLAGS_H_
+
+#include "absl/flags/declare.h"
+#include "wfa/virtual_people/events_generator/arrival_rate.h"
+#include "wfa/virtual_people/events_generator/events_generator.h"
+
+// The flags to configure EventsGenerator. They are shared by all the tools
+// that generate events, so that the same flags give the same events.
+ABSL_DECLARE_FLAG(uint64_t, total_events);
+
+namespace wfa_virtual_people {
+
+// Returns the EventsGeneratorOptions set by the flags. The current_timestamp is
+// set to now.
+EventsGeneratorOptions GetEventsGeneratorOptionsFromFlags();
+
+// Returns the EventOptions set by the flags.
+EventOptions GetEventOptionsFromFlags();
+
+// Returns the ArrivalRateOptions set by the flags. The bursts are relative to
+// @current_timestamp_usec.
+ArrivalRateOptions GetArrivalRateOptionsFromFlags(
+    uint64_t current_timestamp_usec);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_EVENTS_GENERATOR_FLAGS_H_
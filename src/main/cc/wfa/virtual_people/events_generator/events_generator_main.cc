@@ -19,6 +19,11 @@
 // bazel-bin/src/main/cc/wfa/virtual_people/events_generator/\
 // events_generator_main \
 // --output_dir=/tmp/events_generator
+//
+// With --time_ordered, the events are generated in the order of
+// timestamp_usec, following the arrival rate set by --hourly_arrival_weights,
+// --daily_arrival_weights and --arrival_bursts. The events are numbered in this
+// order.
 
 #include <fcntl.h>
 
@@ -39,38 +44,18 @@
 #include "google/protobuf/message.h"
 #include "google/protobuf/text_format.h"
 #include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/events_generator/arrival_rate.h"
 #include "wfa/virtual_people/events_generator/events_generator.h"
+#include "wfa/virtual_people/events_generator/events_generator_flags.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
 
-ABSL_FLAG(uint32_t, total_publishers, 10, "The count of unique publishers.");
-ABSL_FLAG(uint32_t, total_events, 1000, "The count of unique event ids.");
-ABSL_FLAG(double, unknown_device_ratio, 0.5,
-          "The chance of device to be unknown.");
-ABSL_FLAG(uint32_t, unknown_device_count, 1000,
-          "The count of possible unknown device values.");
-ABSL_FLAG(uint32_t, total_countries, 10, "The count of possible countries.");
-ABSL_FLAG(uint32_t, regions_per_country, 10,
-          "The count of possible regions per country.");
-ABSL_FLAG(uint32_t, cities_per_region, 10,
-          "The count of possible cities per region.");
-ABSL_FLAG(double, email_events_ratio, 0.5,
-          "The chance of each event to have email user info.");
-ABSL_FLAG(double, phone_events_ratio, 0.5,
-          "The chance of each event to have phone user info.");
-ABSL_FLAG(double, proprietary_id_space_1_events_ratio, 0.5,
-          "The chance of each event to have proprietary id space 1 user info.");
-ABSL_FLAG(uint32_t, email_users_count, 100,
-          "The count of possible email users.");
-ABSL_FLAG(uint32_t, phone_users_count, 100,
-          "The count of possible phone users.");
-ABSL_FLAG(uint32_t, proprietary_id_space_1_users_count, 100,
-          "The count of possible proprietary id space 1 users.");
-ABSL_FLAG(uint32_t, profile_version_days, 1,
-          "The allowed profile version is in "
-          "[today - profile_version_days, today].");
 ABSL_FLAG(std::string, output_dir, "",
           "Path to directory to output the events.");
 ABSL_FLAG(bool, textproto, true, "If true, writes textproto files");
 ABSL_FLAG(bool, binary, false, "If true, writes binary proto files");
+ABSL_FLAG(bool, time_ordered, false,
+          "If true, the events are generated in non-decreasing order of "
+          "timestamp_usec.");
 
 absl::Status WriteBinaryProtoFile(absl::string_view filename,
                                   const google::protobuf::Message& message) {
@@ -95,33 +80,35 @@ int main(int argc, char** argv) {
   CHECK(absl::GetFlag(FLAGS_textproto) || absl::GetFlag(FLAGS_binary))
       << "At least one of --textproto and --binary is required";
 
-  wfa_virtual_people::EventsGeneratorOptions event_generator_options = {
-      .current_timestamp =
-          static_cast<uint64_t>(absl::ToUnixMicros(absl::Now())),
-      .total_publishers = absl::GetFlag(FLAGS_total_publishers),
-      .total_events = absl::GetFlag(FLAGS_total_events),
-      .unknown_device_count = absl::GetFlag(FLAGS_unknown_device_count),
-      .email_users_count = absl::GetFlag(FLAGS_email_users_count),
-      .phone_users_count = absl::GetFlag(FLAGS_phone_users_count),
-      .proprietary_id_space_1_users_count =
-          absl::GetFlag(FLAGS_proprietary_id_space_1_users_count)};
-
-  wfa_virtual_people::EventOptions event_options = {
-      .unknown_device_ratio = absl::GetFlag(FLAGS_unknown_device_ratio),
-      .total_countries = absl::GetFlag(FLAGS_total_countries),
-      .regions_per_country = absl::GetFlag(FLAGS_regions_per_country),
-      .cities_per_region = absl::GetFlag(FLAGS_cities_per_region),
-      .email_events_ratio = absl::GetFlag(FLAGS_email_events_ratio),
-      .phone_events_ratio = absl::GetFlag(FLAGS_phone_events_ratio),
-      .proprietary_id_space_1_events_ratio =
-          absl::GetFlag(FLAGS_proprietary_id_space_1_events_ratio),
-      .profile_version_days = absl::GetFlag(FLAGS_profile_version_days)};
+  wfa_virtual_people::EventsGeneratorOptions event_generator_options =
+      wfa_virtual_people::GetEventsGeneratorOptionsFromFlags();
+
+  wfa_virtual_people::EventOptions event_options =
+      wfa_virtual_people::GetEventOptionsFromFlags();
 
   wfa_virtual_people::EventsGenerator generator(event_generator_options);
 
-  for (int i = 0; i < absl::GetFlag(FLAGS_total_events); ++i) {
+  // The arrival times are in the same window as the timestamps of GetEvent,
+  // which is the last kEventWindowDays days before the current timestamp.
+  absl::Duration window =
+      absl::Hours(24) * wfa_virtual_people::kEventWindowDays;
+  uint64_t end_timestamp_usec = event_generator_options.current_timestamp;
+  uint64_t start_timestamp_usec = static_cast<uint64_t>(absl::ToUnixMicros(
+      absl::FromUnixMicros(end_timestamp_usec) - window));
+  wfa_virtual_people::ArrivalRateCurve arrival_rate_curve(
+      wfa_virtual_people::GetArrivalRateOptionsFromFlags(end_timestamp_usec),
+      start_timestamp_usec, end_timestamp_usec);
+  const uint64_t total_events = absl::GetFlag(FLAGS_total_events);
+  wfa_virtual_people::OrderedArrivalStream arrival_stream(arrival_rate_curve,
+                                                          total_events);
+  wfa_virtual_people::RandomGenerator arrival_random_generator;
+
+  for (uint64_t i = 0; i < total_events; ++i) {
     wfa_virtual_people::DataProviderEvent event =
-        generator.GetEvent(event_options);
+        absl::GetFlag(FLAGS_time_ordered)
+            ? generator.GetEventAt(
+                  arrival_stream.Next(arrival_random_generator), event_options)
+            : generator.GetEvent(event_options);
 
     std::string prefix = absl::StrCat(output_dir, "/event-", i + 1);
 
@@ -16,12 +16,15 @@
 
 #include <math.h>
 
+#include <limits>
 #include <random>
 #include <string>
 
+#include "absl/numeric/int128.h"
 #include "absl/random/distributions.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/civil_time.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
 #include "src/farmhash.h"
 
@@ -29,8 +32,8 @@ namespace wfa_virtual_people {
 
 namespace {
 
-// 24 * 3600 * 1000
-constexpr uint64_t kMicrosecPerDay = 86400000;
+// 24 * 3600 * 1000 * 1000
+constexpr uint64_t kMicrosecPerDay = 86400000000;
 
 // Returns power(base, exp).
 // We have to do the naive power to avoid overflow.
@@ -42,8 +45,71 @@ uint64_t int_pow(uint32_t base, uint32_t exp) {
   return result;
 }
 
+// The finalizer of SplitMix64, which maps each 64-bit value to a 64-bit value
+// with good avalanche.
+uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// Fills @output with uniform random values in [@min, @min + @range), using
+// Lemire's nearly divisionless method. A 64-bit random value x is mapped to
+// (x * @range) >> 64, and only when the low 64 bits of the product fall below
+// @range, the rejection threshold (2^64 - @range) % @range is computed to
+// decide whether x must be redrawn. @range must be positive.
+template <typename T>
+void FillBounded(std::mt19937_64& generator, const T min, const uint64_t range,
+                 absl::Span<T> output) {
+  uint64_t threshold = 0;
+  bool has_threshold = false;
+  for (T& value : output) {
+    absl::uint128 product = absl::uint128(generator()) * range;
+    while (absl::Uint128Low64(product) < range) {
+      if (!has_threshold) {
+        threshold = (0 - range) % range;
+        has_threshold = true;
+      }
+      if (absl::Uint128Low64(product) >= threshold) break;
+      product = absl::uint128(generator()) * range;
+    }
+    value = static_cast<T>(min + absl::Uint128High64(product));
+  }
+}
+
+// A URBG which always returns the same value, to find the output of a
+// distribution for each value of the generator.
+class FixedBitGenerator {
+ public:
+  using result_type = uint64_t;
+
+  explicit FixedBitGenerator(const uint64_t value) : value_(value) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  result_type operator()() { return value_; }
+
+ private:
+  const uint64_t value_;
+};
+
+// Returns the value in [0, 1] drawn by GetBool when the generator returns
+// @bits.
+double GetBoolUniform(const uint64_t bits) {
+  FixedBitGenerator generator(bits);
+  return absl::Uniform(absl::IntervalClosed, generator, 0.0, 1.0);
+}
+
 }  // namespace
 
+RandomGenerator::RandomGenerator(const uint64_t seed, const uint64_t stream)
+    // Hashes (@seed, @stream) to the 64-bit seed of the generator. Seeding with
+    // one value only takes a pass over the 312 words of the state, which is
+    // several times faster than seeding with a std::seed_seq.
+    : generator_(Mix(Mix(seed) ^ stream)) {}
+
 bool RandomGenerator::GetBool(const double true_chance) {
   CHECK(true_chance >= 0.0 && true_chance <= 1.0)
       << "True chance must be between 0 and 1.";
@@ -51,24 +117,68 @@ bool RandomGenerator::GetBool(const double true_chance) {
   return random < true_chance;
 }
 
+bool RandomGenerator::GetBoolWithThreshold(const uint64_t threshold) {
+  // A random 64-bit value x gives true when x < threshold. The max threshold
+  // represents the chance 1, which is always true.
+  return threshold == std::numeric_limits<uint64_t>::max() ||
+         generator_() < threshold;
+}
+
+uint64_t RandomGenerator::GetBoolThreshold(const double true_chance) {
+  CHECK(true_chance >= 0.0 && true_chance <= 1.0)
+      << "True chance must be between 0 and 1.";
+  // GetBool draws one 64-bit value x, and returns GetBoolUniform(x) <
+  // @true_chance. GetBoolUniform does not decrease with x, so this is the same
+  // as x < the smallest x with GetBoolUniform(x) >= @true_chance, which is
+  // found by binary search. GetBoolWithThreshold then gives the same outputs
+  // as GetBool for the same draws.
+  uint64_t high = std::numeric_limits<uint64_t>::max();
+  if (GetBoolUniform(high) < true_chance) {
+    return high;
+  }
+  uint64_t low = 0;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if (GetBoolUniform(middle) >= true_chance) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
 std::string RandomGenerator::GetDigits(const uint32_t length) {
-  CHECK(length <= 18) << "The max length is 18.";
-  uint64_t min = int_pow(10, length - 1);
-  uint64_t max = int_pow(10, length) - 1;
-  uint64_t random = absl::Uniform(absl::IntervalClosed, generator_, min, max);
-  return std::to_string(random);
+  std::string output;
+  AppendDigits(length, output);
+  return output;
 }
 
 std::string RandomGenerator::GetLowerLetters(const uint32_t length) {
-  std::string output(length, ' ');
-  for (int i = 0; i < length; ++i) {
-    output[i] = absl::Uniform<char>(absl::IntervalClosed, generator_, 'a', 'z');
-  }
-  return std::string(output);
+  std::string output;
+  AppendLowerLetters(length, output);
+  return output;
 }
 
 std::string RandomGenerator::GetLowerLetters(const uint32_t length_min,
                                              const uint32_t length_max) {
+  std::string output;
+  AppendLowerLetters(length_min, length_max, output);
+  return output;
+}
+
+void RandomGenerator::AppendDigits(const uint32_t length, std::string& output) {
+  AppendDigitsBatch(length, 1, output);
+}
+
+void RandomGenerator::AppendLowerLetters(const uint32_t length,
+                                         std::string& output) {
+  AppendLowerLettersBatch(length, 1, output);
+}
+
+void RandomGenerator::AppendLowerLetters(const uint32_t length_min,
+                                         const uint32_t length_max,
+                                         std::string& output) {
   CHECK(length_min <= length_max)
       << "length_max cannot be less than length_min.";
   double mean = (length_min + length_max + 1.0) / 2.0;
@@ -77,7 +187,39 @@ std::string RandomGenerator::GetLowerLetters(const uint32_t length_min,
   int32_t length = static_cast<int32_t>(random);
   if (length < length_min) length = length_min;
   if (length > length_max) length = length_max;
-  return GetLowerLetters(length);
+  AppendLowerLetters(length, output);
+}
+
+void RandomGenerator::AppendDigitsBatch(const uint32_t length,
+                                        const uint32_t count,
+                                        std::string& output) {
+  CHECK(length >= 1 && length <= 18) << "The length must be between 1 and 18.";
+  uint64_t min = int_pow(10, length - 1);
+  uint64_t max = int_pow(10, length) - 1;
+  size_t offset = output.size();
+  output.resize(offset + static_cast<size_t>(length) * count);
+  char* begin = &output[offset];
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t random = absl::Uniform(absl::IntervalClosed, generator_, min, max);
+    // The value has exactly @length digits, so write them from the back.
+    char* digit = begin + static_cast<size_t>(length) * (i + 1);
+    for (uint32_t j = 0; j < length; ++j) {
+      *--digit = '0' + random % 10;
+      random /= 10;
+    }
+  }
+}
+
+void RandomGenerator::AppendLowerLettersBatch(const uint32_t length,
+                                              const uint32_t count,
+                                              std::string& output) {
+  size_t offset = output.size();
+  size_t total_length = static_cast<size_t>(length) * count;
+  output.resize(offset + total_length);
+  char* begin = &output[offset];
+  for (size_t i = 0; i < total_length; ++i) {
+    begin[i] = absl::Uniform<char>(absl::IntervalClosed, generator_, 'a', 'z');
+  }
 }
 
 int32_t RandomGenerator::GetInteger(const int32_t min, const int32_t max) {
@@ -101,6 +243,40 @@ absl::CivilDay RandomGenerator::GetDateInNDays(absl::CivilDay current_date,
   return current_date - days;
 }
 
+double RandomGenerator::GetGaussian(const double mean, const double stddev) {
+  CHECK(stddev >= 0.0) << "stddev must be non-negative.";
+  return absl::Gaussian(generator_, mean, stddev);
+}
+
+double RandomGenerator::GetDouble(const double min, const double max) {
+  CHECK(min < max) << "max must be larger than min.";
+  return absl::Uniform<double>(generator_, min, max);
+}
+
+void RandomGenerator::GetBools(const double true_chance,
+                               absl::Span<bool> output) {
+  uint64_t threshold = GetBoolThreshold(true_chance);
+  for (bool& value : output) {
+    value = GetBoolWithThreshold(threshold);
+  }
+}
+
+void RandomGenerator::GetIntegers(const int32_t min, const int32_t max,
+                                  absl::Span<int32_t> output) {
+  CHECK(min <= max) << "max must be no less than min.";
+  uint64_t range = static_cast<int64_t>(max) - min + 1;
+  FillBounded<int32_t>(generator_, min, range, output);
+}
+
+void RandomGenerator::GetTimestampsUsecInNDays(const uint64_t current_timestamp,
+                                               const uint32_t n,
+                                               absl::Span<uint64_t> output) {
+  CHECK(n <= 10000) << "N should be at most 10000.";
+  uint64_t range = n * kMicrosecPerDay + 1;
+  FillBounded<uint64_t>(generator_, current_timestamp - n * kMicrosecPerDay,
+                        range, output);
+}
+
 uint64_t RandomGenerator::GetTimestampUsecInNDaysWithSeed(
     const uint64_t current_timestamp, const uint32_t n,
     absl::string_view seed) const {
@@ -117,6 +293,19 @@ int32_t RandomGenerator::GetIntegerWithSeed(const int32_t min,
   return min + fingerprint % (max - min + 1);
 }
 
+void RandomGenerator::GetIntegersWithSeeds(
+    const int32_t min, const int32_t max,
+    absl::Span<const absl::string_view> seeds,
+    absl::Span<int32_t> output) const {
+  CHECK(min <= max) << "max must be no less than min.";
+  CHECK(seeds.size() == output.size())
+      << "seeds and output must have the same size.";
+  uint64_t range = static_cast<int64_t>(max) - min + 1;
+  for (size_t i = 0; i < seeds.size(); ++i) {
+    output[i] = min + util::Fingerprint64(seeds[i]) % range;
+  }
+}
+
 double RandomGenerator::GetDoubleWithSeed(const double min, const double max,
                                           absl::string_view seed) const {
   CHECK(min <= max) << "max must be no less than min.";
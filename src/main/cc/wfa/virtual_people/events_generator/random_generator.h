@@ -20,6 +20,7 @@
 
 #include "absl/strings/string_view.h"
 #include "absl/time/civil_time.h"
+#include "absl/types/span.h"
 
 namespace wfa_virtual_people {
 
@@ -35,12 +36,22 @@ class RandomGenerator {
   // Initializes the pseudo-random number generator to set the seed.
   explicit RandomGenerator(uint32_t seed) : generator_(seed) {}
 
+  // Initializes the pseudo-random number generator to the independent stream
+  // @stream of @seed. The values only depend on (@seed, @stream), so e.g. the
+  // replicates of a simulation can each use the stream of its index, and get
+  // the same values in whichever thread or order they run.
+  RandomGenerator(uint64_t seed, uint64_t stream);
+
   // The methods below use the pseudo-random number generator to generate the
   // values.
   //
   // Generates a true/false value.
   // @true_chance is the chance that the output is true.
   bool GetBool(double true_chance);
+  // Same as GetBool, but takes the @threshold returned by GetBoolThreshold, so
+  // that the chance is checked and converted only once. The output is the same
+  // as GetBool for the same state of the generator.
+  bool GetBoolWithThreshold(uint64_t threshold);
   // Generates a string composed of digits with the given @length.
   std::string GetDigits(uint32_t length);
   // Generates a string composed of lower case letters with the given @length.
@@ -49,6 +60,20 @@ class RandomGenerator {
   // @length_min and @length_max inclusively.
   // The length is selected randomly with Gaussian distribution.
   std::string GetLowerLetters(uint32_t length_min, uint32_t length_max);
+  // Same as GetDigits and GetLowerLetters above, but appends the generated
+  // string to @output instead of allocating a new one.
+  void AppendDigits(uint32_t length, std::string& output);
+  void AppendLowerLetters(uint32_t length, std::string& output);
+  void AppendLowerLetters(uint32_t length_min, uint32_t length_max,
+                          std::string& output);
+  // Generates @count strings, each composed of digits with the given
+  // @length, and appends them to @output back to back. The i-th string starts
+  // at offset (@length * i) of the appended part.
+  // The generated strings are the same as calling AppendDigits @count times.
+  void AppendDigitsBatch(uint32_t length, uint32_t count, std::string& output);
+  // Same as above, but the strings are composed of lower case letters.
+  void AppendLowerLettersBatch(uint32_t length, uint32_t count,
+                               std::string& output);
   // Generates an integer with value between @min and @max inclusively.
   int32_t GetInteger(int32_t min, int32_t max);
   // Generates a timestamp in microseconds, with value between @n days ago to
@@ -58,6 +83,29 @@ class RandomGenerator {
   // Generates a date, with value between @n days ago to @current_date
   // inclusively.
   absl::CivilDay GetDateInNDays(absl::CivilDay current_date, uint32_t n);
+  // Generates a value from the Gaussian distribution with the given @mean and
+  // @stddev.
+  double GetGaussian(double mean, double stddev);
+  // Generates a value uniformly between @min inclusively and @max exclusively.
+  double GetDouble(double min, double max);
+
+  // The batch methods below fill each element of @output with an independent
+  // value, and are equivalent in distribution to calling the corresponding
+  // single value method for each element. The arguments are checked once per
+  // call, and the bounded integers are generated by Lemire's multiply-shift
+  // method, which rarely needs a division.
+  //
+  // Same as GetBool.
+  void GetBools(double true_chance, absl::Span<bool> output);
+  // Same as GetInteger.
+  void GetIntegers(int32_t min, int32_t max, absl::Span<int32_t> output);
+  // Same as GetTimestampUsecInNDays.
+  void GetTimestampsUsecInNDays(uint64_t current_timestamp, uint32_t n,
+                                absl::Span<uint64_t> output);
+
+  // Converts @true_chance, which must be between 0 and 1, to the threshold
+  // used by GetBoolWithThreshold.
+  static uint64_t GetBoolThreshold(double true_chance);
 
   // The methods below use the farmhash to generate the values. The outputs are
   // the same when using the same @seed.
@@ -73,6 +121,11 @@ class RandomGenerator {
                              absl::string_view seed) const;
   double GetDoubleWithSeed(double min, double max,
                            absl::string_view seed) const;
+  // Same as calling GetIntegerWithSeed with each of @seeds. The i-th element of
+  // @output is set using the i-th element of @seeds.
+  void GetIntegersWithSeeds(int32_t min, int32_t max,
+                            absl::Span<const absl::string_view> seeds,
+                            absl::Span<int32_t> output) const;
 
  private:
   std::mt19937_64 generator_;
@@ -0,0 +1,36 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/string_arena.h"
+
+#include <limits>
+
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+
+namespace wfa_virtual_people {
+
+void StringArena::Reserve(const size_t count, const size_t total_bytes) {
+  ends_.reserve(count);
+  buffer_.reserve(total_bytes);
+}
+
+void StringArena::Append(const absl::string_view value) {
+  CHECK(buffer_.size() + value.size() <= std::numeric_limits<uint32_t>::max())
+      << "The total size of the strings exceeds the limit of StringArena.";
+  buffer_.append(value.data(), value.size());
+  ends_.push_back(static_cast<uint32_t>(buffer_.size()));
+}
+
+}  // namespace wfa_virtual_people
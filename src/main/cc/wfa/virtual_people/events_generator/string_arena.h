@@ -0,0 +1,64 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_STRING_ARENA_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_STRING_ARENA_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace wfa_virtual_people {
+
+// StringArena stores a list of strings in one contiguous char buffer, with the
+// end offset of each string in another buffer. Compared to a
+// std::vector<std::string>, there is no per-string allocation or header, so a
+// large pool of short strings uses far less memory, and accessing random
+// entries touches fewer cache lines.
+// The returned string_views are invalidated by Append.
+class StringArena {
+ public:
+  StringArena() = default;
+
+  // Reserves the memory for @count strings of @total_bytes in total.
+  void Reserve(size_t count, size_t total_bytes);
+
+  // Appends a copy of @value. CHECK-fails if the total size of the strings
+  // exceeds 4 GiB.
+  void Append(absl::string_view value);
+
+  // Returns the string at @index. @index must be less than size().
+  absl::string_view operator[](size_t index) const {
+    size_t begin = index == 0 ? 0 : ends_[index - 1];
+    return absl::string_view(buffer_.data() + begin, ends_[index] - begin);
+  }
+
+  // The count of strings.
+  size_t size() const { return ends_.size(); }
+  bool empty() const { return ends_.empty(); }
+
+  // The total size of the strings in bytes.
+  size_t byte_size() const { return buffer_.size(); }
+
+ private:
+  std::string buffer_;
+  // The end offset of each string in buffer_. The begin offset is the end
+  // offset of the previous string, or 0 for the first string.
+  std::vector<uint32_t> ends_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_EVENTS_GENERATOR_STRING_ARENA_H_
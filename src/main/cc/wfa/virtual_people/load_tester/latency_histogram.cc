@@ -0,0 +1,142 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/load_tester/latency_histogram.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The count of buckets needed to cover the values below 2^63, which are all
+// the non-negative int64_t nanoseconds passed by Record. The values below
+// 2 * kSubBucketCount have one bucket each, and each of the remaining power of
+// 2 ranges has kSubBucketCount buckets.
+constexpr int kBucketCount =
+    (64 - LatencyHistogram::kSubBucketBits) * LatencyHistogram::kSubBucketCount;
+
+constexpr double kSummaryPercentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : counts_(kBucketCount, 0) {}
+
+int LatencyHistogram::GetBucketIndex(const uint64_t nanos) {
+  if (nanos < kSubBucketCount) {
+    return static_cast<int>(nanos);
+  }
+  int msb = 63 - absl::countl_zero(nanos);
+  int shift = msb - kSubBucketBits;
+  // The top kSubBucketBits + 1 bits of @nanos, which is between
+  // kSubBucketCount and (2 * kSubBucketCount - 1).
+  int sub_bucket = static_cast<int>(nanos >> shift);
+  return shift * kSubBucketCount + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(const int index) {
+  int shift = std::max(index / kSubBucketCount - 1, 0);
+  uint64_t sub_bucket = index - shift * kSubBucketCount;
+  return sub_bucket << shift;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(const int index) {
+  int shift = std::max(index / kSubBucketCount - 1, 0);
+  return GetBucketLowerBound(index) + ((uint64_t{1} << shift) - 1);
+}
+
+void LatencyHistogram::Record(const absl::Duration latency) {
+  int64_t signed_nanos = absl::ToInt64Nanoseconds(latency);
+  uint64_t nanos = signed_nanos > 0 ? static_cast<uint64_t>(signed_nanos) : 0;
+  ++counts_[GetBucketIndex(nanos)];
+  min_nanos_ = count_ == 0 ? nanos : std::min(min_nanos_, nanos);
+  max_nanos_ = std::max(max_nanos_, nanos);
+  sum_nanos_ += nanos;
+  ++count_;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  for (int i = 0; i < kBucketCount; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  min_nanos_ = count_ == 0 ? other.min_nanos_
+                           : std::min(min_nanos_, other.min_nanos_);
+  max_nanos_ = std::max(max_nanos_, other.max_nanos_);
+  sum_nanos_ += other.sum_nanos_;
+  count_ += other.count_;
+}
+
+absl::Duration LatencyHistogram::Percentile(const double percentile) const {
+  CHECK(percentile >= 0.0 && percentile <= 100.0)
+      << "percentile must be between 0 and 100.";
+  if (count_ == 0) {
+    return absl::ZeroDuration();
+  }
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(ceil(percentile / 100.0 * count_)));
+  uint64_t cumulative = 0;
+  for (int i = 0; i < kBucketCount; ++i) {
+    cumulative += counts_[i];
+    if (cumulative >= rank) {
+      uint64_t nanos = std::min(GetBucketUpperBound(i), max_nanos_);
+      return absl::Nanoseconds(std::max(nanos, min_nanos_));
+    }
+  }
+  return max();
+}
+
+absl::Duration LatencyHistogram::mean() const {
+  if (count_ == 0) {
+    return absl::ZeroDuration();
+  }
+  return absl::Nanoseconds(static_cast<double>(sum_nanos_ / count_));
+}
+
+std::string LatencyHistogram::ToString() const {
+  std::string output =
+      absl::StrCat("count: ", count_, " mean: ", absl::FormatDuration(mean()),
+                   " min: ", absl::FormatDuration(min()));
+  for (double percentile : kSummaryPercentiles) {
+    absl::StrAppend(&output, " p", percentile, ": ",
+                    absl::FormatDuration(Percentile(percentile)));
+  }
+  absl::StrAppend(&output, " max: ", absl::FormatDuration(max()), "\n");
+  uint64_t cumulative = 0;
+  for (int i = 0; i < kBucketCount; ++i) {
+    if (counts_[i] == 0) {
+      continue;
+    }
+    cumulative += counts_[i];
+    absl::StrAppend(
+        &output,
+        absl::FormatDuration(absl::Nanoseconds(GetBucketLowerBound(i))), " ",
+        absl::FormatDuration(absl::Nanoseconds(GetBucketUpperBound(i))), " ",
+        counts_[i], " ", 100.0 * cumulative / count_, "\n");
+  }
+  return output;
+}
+
+}  // namespace wfa_virtual_people
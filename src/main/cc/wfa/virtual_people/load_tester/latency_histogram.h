@@ -0,0 +1,75 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_LATENCY_HISTOGRAM_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_LATENCY_HISTOGRAM_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+
+namespace wfa_virtual_people {
+
+// LatencyHistogram records latencies in log-linear buckets: the latencies are
+// in nanoseconds, and each power of 2 range is split into kSubBucketCount
+// buckets of the same width. The relative error of each bucket is no more than
+// 1 / kSubBucketCount, and the memory is fixed no matter how many latencies
+// are recorded.
+// LatencyHistogram is not thread-safe. Use one histogram per thread, and
+// Merge them at the end.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+
+  LatencyHistogram();
+
+  // Records @latency. Negative latency is recorded as 0.
+  void Record(absl::Duration latency);
+
+  // Adds all the latencies recorded in @other to this histogram.
+  void Merge(const LatencyHistogram& other);
+
+  // Returns the smallest latency which is no less than @percentile percent of
+  // the recorded latencies, up to the bucket width. @percentile must be between
+  // 0 and 100. Returns 0 if no latency is recorded.
+  absl::Duration Percentile(double percentile) const;
+
+  uint64_t count() const { return count_; }
+  absl::Duration min() const { return absl::Nanoseconds(min_nanos_); }
+  absl::Duration max() const { return absl::Nanoseconds(max_nanos_); }
+  absl::Duration mean() const;
+
+  // Returns a summary of the percentiles, followed by one line for each
+  // non-empty bucket, in format
+  //   <lower bound> <upper bound> <count> <cumulative percent>
+  std::string ToString() const;
+
+ private:
+  static int GetBucketIndex(uint64_t nanos);
+  static uint64_t GetBucketLowerBound(int index);
+  static uint64_t GetBucketUpperBound(int index);
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t min_nanos_ = 0;
+  uint64_t max_nanos_ = 0;
+  // Stored in long double to avoid overflow of the sum of large latencies.
+  long double sum_nanos_ = 0;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_LATENCY_HISTOGRAM_H_
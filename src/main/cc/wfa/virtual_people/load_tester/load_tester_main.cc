@@ -0,0 +1,294 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This is a tool to replay a set of input events to Virtual People Labeler at
+// a controlled rate, and report the throughput and latency histograms of each
+// phase.
+//
+// The requests are sent open-loop: each request has an intended send time
+// decided by the phases only, and its latency is measured from this time. So
+// the time a request waits behind slow requests is counted in its latency.
+// The input events are loaded in memory before the replay, and are replayed
+// repeatedly when the phases need more requests than the input events.
+//
+// Example usage:
+//
+// To replay the events from events_generator_main at 1000 QPS for 30 seconds,
+// then ramp from 1000 to 5000 QPS in 60 seconds
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/load_tester -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_dir=/tmp/events_generator \
+//   --phases=1000:30,1000-5000:60 --threads=8
+//
+// To replay a LabelerInputList textproto
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/load_tester -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --phases=1000:30
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/core/labeler/labeler.h"
+#include "wfa/virtual_people/load_tester/latency_histogram.h"
+#include "wfa/virtual_people/load_tester/replay_schedule.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/model_loader.h"
+
+ABSL_FLAG(std::string, model_node_path, "",
+          "Path to the virtual people model file, contains textproto of "
+          "CompiledNode. Same as in model_applier.");
+ABSL_FLAG(std::string, model_nodes_path, "",
+          "Path to the virtual people model file, contains textproto of "
+          "CompiledNodeList. Same as in model_applier.");
+ABSL_FLAG(std::string, model_riegeli_path, "",
+          "Path to the virtual people model file, contains a list of "
+          "CompiledNode using Riegeli format. Same as in model_applier.");
+ABSL_FLAG(std::string, input_path, "",
+          "Path to the input events, contains textproto of LabelerInputList. "
+          "Exactly one of [input_path, input_dir] must be set.");
+ABSL_FLAG(std::string, input_dir, "",
+          "Path to the directory of input events written by "
+          "events_generator_main, as event-<N>.pb or event-<N>.textproto "
+          "files of DataProviderEvent. When both exist for the same N, the "
+          "binary one is used. "
+          "Exactly one of [input_path, input_dir] must be set.");
+ABSL_FLAG(std::string, phases, "1000:10",
+          "The phases of the replay, as a comma separated list of "
+          "<qps>:<seconds> for a fixed rate, or "
+          "<start_qps>-<end_qps>:<seconds> for a rate ramping linearly.");
+ABSL_FLAG(uint32_t, threads, 4,
+          "The count of threads sending the requests. When all the threads are "
+          "busy, the requests are delayed, and the delay is counted in their "
+          "latency.");
+
+namespace wfa_virtual_people {
+
+constexpr absl::string_view kEventFilePrefix = "event-";
+constexpr absl::string_view kBinaryProtoSuffix = ".pb";
+constexpr absl::string_view kTextProtoSuffix = ".textproto";
+
+// The measurement of a phase by a single thread.
+struct PhaseResult {
+  // From the intended send time to the completion of each request.
+  LatencyHistogram latency;
+  // From the actual send time to the completion of each request.
+  LatencyHistogram service_time;
+  // The completion time of the last request.
+  absl::Time last_completion = absl::InfinitePast();
+};
+
+void ReadBinaryProtoFile(absl::string_view path,
+                         google::protobuf::Message& message) {
+  int fd = open(path.data(), O_RDONLY);
+  CHECK(fd > 0) << "Unable to open file: " << path;
+  google::protobuf::io::FileInputStream file_input(fd);
+  file_input.SetCloseOnDelete(true);
+  CHECK(message.ParseFromZeroCopyStream(&file_input))
+      << "Unable to parse binary proto file: " << path;
+}
+
+// Read the DataProviderEvents written by events_generator_main in @input_dir,
+// ordered by the event number.
+std::vector<LabelerInput> ReadInputDir(absl::string_view input_dir) {
+  // Map from the event number to the file path.
+  std::map<uint64_t, std::string> paths;
+  for (const std::filesystem::directory_entry& entry :
+       std::filesystem::directory_iterator(std::string(input_dir))) {
+    std::string filename = entry.path().filename().string();
+    absl::string_view name = filename;
+    if (!absl::ConsumePrefix(&name, kEventFilePrefix)) {
+      continue;
+    }
+    bool is_binary = absl::ConsumeSuffix(&name, kBinaryProtoSuffix);
+    if (!is_binary && !absl::ConsumeSuffix(&name, kTextProtoSuffix)) {
+      continue;
+    }
+    uint64_t number;
+    if (!absl::SimpleAtoi(name, &number)) {
+      continue;
+    }
+    if (is_binary || paths.find(number) == paths.end()) {
+      paths[number] = entry.path().string();
+    }
+  }
+
+  std::vector<LabelerInput> inputs;
+  inputs.reserve(paths.size());
+  for (const auto& [number, path] : paths) {
+    DataProviderEvent event;
+    if (absl::EndsWith(path, kBinaryProtoSuffix)) {
+      ReadBinaryProtoFile(path, event);
+    } else {
+      ReadTextProtoFile(path, event);
+    }
+    inputs.push_back(
+        std::move(*event.mutable_log_event()->mutable_labeler_input()));
+  }
+  return inputs;
+}
+
+std::vector<LabelerInput> ReadInputs(absl::string_view input_path,
+                                     absl::string_view input_dir) {
+  CHECK(input_path.empty() != input_dir.empty())
+      << "Exactly one of [input_path, input_dir] must be set.";
+  if (!input_dir.empty()) {
+    return ReadInputDir(input_dir);
+  }
+  LabelerInputList labeler_inputs;
+  ReadTextProtoFile(input_path, labeler_inputs);
+  return std::vector<LabelerInput>(labeler_inputs.inputs().begin(),
+                                   labeler_inputs.inputs().end());
+}
+
+// Sends the requests in the order of their indexes, each at its intended send
+// time, until all the requests in @schedule are sent. The next request index
+// is shared by all the threads through @next_request.
+void SendRequests(const Labeler& labeler,
+                  const std::vector<LabelerInput>& inputs,
+                  const ReplaySchedule& schedule, const absl::Time start,
+                  std::atomic<uint64_t>& next_request,
+                  std::vector<PhaseResult>& results) {
+  while (true) {
+    uint64_t request_index = next_request.fetch_add(1);
+    if (request_index >= schedule.total_requests()) {
+      return;
+    }
+    absl::Time intended = start + schedule.GetIntendedSendTime(request_index);
+    absl::Time now = absl::Now();
+    if (intended > now) {
+      absl::SleepFor(intended - now);
+      now = absl::Now();
+    }
+
+    LabelerOutput output;
+    absl::Status status =
+        labeler.Label(inputs[request_index % inputs.size()], output);
+    CHECK(status.ok()) << "Labeling failed with status: " << status;
+    absl::Time completion = absl::Now();
+
+    PhaseResult& result = results[schedule.GetPhaseIndex(request_index)];
+    result.latency.Record(completion - intended);
+    result.service_time.Record(completion - now);
+    result.last_completion = std::max(result.last_completion, completion);
+  }
+}
+
+// Writes the throughput and latency histograms of each phase to stdout.
+void PrintResults(const ReplaySchedule& schedule, const absl::Time start,
+                  const std::vector<PhaseResult>& results) {
+  for (size_t i = 0; i < results.size(); ++i) {
+    const ReplayPhase& phase = schedule.phases()[i];
+    const PhaseResult& result = results[i];
+    std::cout << "Phase " << i << ": " << phase.start_qps << "-"
+              << phase.end_qps << " QPS for " << phase.duration << "\n";
+    if (result.latency.count() == 0) {
+      std::cout << "No request.\n\n";
+      continue;
+    }
+    // The phase is measured until its last request completes, so the
+    // throughput drops below the target when the requests fall behind.
+    absl::Duration elapsed =
+        result.last_completion - (start + schedule.GetPhaseStart(i));
+    std::cout << "Throughput: "
+              << result.latency.count() / absl::ToDoubleSeconds(elapsed)
+              << " QPS, target "
+              << schedule.GetPhaseRequests(i) /
+                     absl::ToDoubleSeconds(phase.duration)
+              << " QPS\n";
+    std::cout << "Latency: " << result.latency.ToString();
+    std::cout << "Service time: " << result.service_time.ToString() << "\n";
+  }
+}
+
+}  // namespace wfa_virtual_people
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  std::unique_ptr<wfa_virtual_people::Labeler> labeler =
+      wfa_virtual_people::GetLabeler(absl::GetFlag(FLAGS_model_node_path),
+                                     absl::GetFlag(FLAGS_model_nodes_path),
+                                     absl::GetFlag(FLAGS_model_riegeli_path));
+
+  std::vector<wfa_virtual_people::LabelerInput> inputs =
+      wfa_virtual_people::ReadInputs(absl::GetFlag(FLAGS_input_path),
+                                     absl::GetFlag(FLAGS_input_dir));
+  CHECK(!inputs.empty()) << "No input event is found.";
+
+  absl::StatusOr<std::vector<wfa_virtual_people::ReplayPhase>> phases =
+      wfa_virtual_people::ParseReplayPhases(absl::GetFlag(FLAGS_phases));
+  CHECK(phases.ok()) << phases.status();
+  wfa_virtual_people::ReplaySchedule schedule(*phases);
+
+  uint32_t thread_count = absl::GetFlag(FLAGS_threads);
+  CHECK(thread_count > 0) << "threads must be positive.";
+  LOG(INFO) << "Replaying " << schedule.total_requests() << " requests from "
+            << inputs.size() << " input events with " << thread_count
+            << " threads.";
+
+  // Each thread has its own results, which are merged after the replay.
+  std::vector<std::vector<wfa_virtual_people::PhaseResult>> thread_results(
+      thread_count,
+      std::vector<wfa_virtual_people::PhaseResult>(phases->size()));
+  std::atomic<uint64_t> next_request(0);
+  absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back(wfa_virtual_people::SendRequests, std::cref(*labeler),
+                         std::cref(inputs), std::cref(schedule), start,
+                         std::ref(next_request), std::ref(thread_results[i]));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<wfa_virtual_people::PhaseResult> results(phases->size());
+  for (const auto& thread_result : thread_results) {
+    for (size_t i = 0; i < results.size(); ++i) {
+      results[i].latency.Merge(thread_result[i].latency);
+      results[i].service_time.Merge(thread_result[i].service_time);
+      results[i].last_completion = std::max(results[i].last_completion,
+                                            thread_result[i].last_completion);
+    }
+  }
+  wfa_virtual_people::PrintResults(schedule, start, results);
+
+  return 0;
+}
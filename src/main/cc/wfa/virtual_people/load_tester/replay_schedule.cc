@@ -0,0 +1,136 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/load_tester/replay_schedule.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+absl::StatusOr<double> ParseNonNegativeDouble(absl::string_view value) {
+  double output;
+  if (!absl::SimpleAtod(value, &output) || !(output >= 0.0)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expect a non-negative number, got: ", value));
+  }
+  return output;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<ReplayPhase>> ParseReplayPhases(
+    absl::string_view spec) {
+  std::vector<ReplayPhase> phases;
+  for (absl::string_view phase_spec : absl::StrSplit(spec, ',')) {
+    std::vector<absl::string_view> parts = absl::StrSplit(phase_spec, ':');
+    if (parts.size() != 2) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid replay phase: ", phase_spec));
+    }
+    std::vector<absl::string_view> rates = absl::StrSplit(parts[0], '-');
+    if (rates.size() > 2) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid replay phase: ", phase_spec));
+    }
+    absl::StatusOr<double> start_qps = ParseNonNegativeDouble(rates.front());
+    if (!start_qps.ok()) return start_qps.status();
+    absl::StatusOr<double> end_qps = ParseNonNegativeDouble(rates.back());
+    if (!end_qps.ok()) return end_qps.status();
+    absl::StatusOr<double> seconds = ParseNonNegativeDouble(parts[1]);
+    if (!seconds.ok()) return seconds.status();
+    if (*seconds == 0.0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Replay phase must have positive duration: ",
+                       phase_spec));
+    }
+    phases.push_back({.start_qps = *start_qps,
+                      .end_qps = *end_qps,
+                      .duration = absl::Seconds(*seconds)});
+  }
+  return phases;
+}
+
+ReplaySchedule::ReplaySchedule(const std::vector<ReplayPhase>& phases)
+    : phases_(phases) {
+  CHECK(!phases.empty()) << "At least one replay phase is required.";
+  uint64_t first_request = 0;
+  absl::Duration start = absl::ZeroDuration();
+  for (const ReplayPhase& phase : phases) {
+    CHECK(phase.start_qps >= 0.0 && phase.end_qps >= 0.0)
+        << "qps must be non-negative.";
+    CHECK(phase.duration > absl::ZeroDuration())
+        << "duration must be positive.";
+    phase_first_requests_.push_back(first_request);
+    phase_starts_.push_back(start);
+    // The count of requests is the integral of the rate over the phase.
+    first_request += static_cast<uint64_t>(
+        (phase.start_qps + phase.end_qps) / 2.0 *
+        absl::ToDoubleSeconds(phase.duration));
+    start += phase.duration;
+  }
+  phase_first_requests_.push_back(first_request);
+}
+
+uint64_t ReplaySchedule::GetPhaseRequests(const int phase_index) const {
+  return phase_first_requests_[phase_index + 1] -
+         phase_first_requests_[phase_index];
+}
+
+int ReplaySchedule::GetPhaseIndex(const uint64_t request_index) const {
+  CHECK(request_index < total_requests()) << "request_index out of range.";
+  // The phases with no request are skipped, as the first request of the next
+  // phase has the same index.
+  return std::upper_bound(phase_first_requests_.begin(),
+                          phase_first_requests_.end(), request_index) -
+         phase_first_requests_.begin() - 1;
+}
+
+absl::Duration ReplaySchedule::GetIntendedSendTime(
+    const uint64_t request_index) const {
+  int phase_index = GetPhaseIndex(request_index);
+  const ReplayPhase& phase = phases_[phase_index];
+  double k = request_index - phase_first_requests_[phase_index];
+  if (k == 0) {
+    return phase_starts_[phase_index];
+  }
+  // The count of requests sent t seconds into the phase is
+  //   start_qps * t + acceleration * t^2 / 2
+  // Solving it for k requests gives
+  //   t = 2k / (start_qps + sqrt(start_qps^2 + 2 * acceleration * k))
+  // which is also stable when acceleration is 0.
+  double acceleration = (phase.end_qps - phase.start_qps) /
+                        absl::ToDoubleSeconds(phase.duration);
+  double seconds =
+      2.0 * k /
+      (phase.start_qps +
+       sqrt(std::max(0.0, phase.start_qps * phase.start_qps +
+                              2.0 * acceleration * k)));
+  return phase_starts_[phase_index] + absl::Seconds(seconds);
+}
+
+}  // namespace wfa_virtual_people
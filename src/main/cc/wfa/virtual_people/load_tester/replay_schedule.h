@@ -0,0 +1,80 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_REPLAY_SCHEDULE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_REPLAY_SCHEDULE_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace wfa_virtual_people {
+
+// A phase of the replay, in which the request rate changes linearly from
+// @start_qps to @end_qps. The rate is fixed when @start_qps equals @end_qps.
+struct ReplayPhase {
+  double start_qps;
+  double end_qps;
+  absl::Duration duration;
+};
+
+// Parses the phases from @spec, which is a comma separated list of
+// * <qps>:<seconds> for a fixed rate, or
+// * <start_qps>-<end_qps>:<seconds> for a ramping rate.
+absl::StatusOr<std::vector<ReplayPhase>> ParseReplayPhases(
+    absl::string_view spec);
+
+// ReplaySchedule decides when each request should be sent, independent of
+// when the previous requests complete. The latency measured from this intended
+// time includes the time the request waits behind slow requests, which avoids
+// the coordinated omission of closed-loop load testers.
+class ReplaySchedule {
+ public:
+  // CHECK-fails if any phase has negative rate or non-positive duration.
+  explicit ReplaySchedule(const std::vector<ReplayPhase>& phases);
+
+  const std::vector<ReplayPhase>& phases() const { return phases_; }
+
+  // The count of requests in all phases.
+  uint64_t total_requests() const { return phase_first_requests_.back(); }
+
+  // The count of requests in phase @phase_index.
+  uint64_t GetPhaseRequests(int phase_index) const;
+
+  // The start of phase @phase_index, relative to the start of the replay.
+  absl::Duration GetPhaseStart(int phase_index) const {
+    return phase_starts_[phase_index];
+  }
+
+  // Returns the index of the phase that request @request_index belongs to.
+  // @request_index must be less than total_requests().
+  int GetPhaseIndex(uint64_t request_index) const;
+
+  // Returns the time to send request @request_index, relative to the start of
+  // the replay. The output is non-decreasing in @request_index.
+  absl::Duration GetIntendedSendTime(uint64_t request_index) const;
+
+ private:
+  std::vector<ReplayPhase> phases_;
+  // The index of the first request of each phase, followed by
+  // total_requests().
+  std::vector<uint64_t> phase_first_requests_;
+  std::vector<absl::Duration> phase_starts_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_LOAD_TESTER_REPLAY_SCHEDULE_H_
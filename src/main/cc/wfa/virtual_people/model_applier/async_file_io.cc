@@ -0,0 +1,662 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WFA_VIRTUAL_PEOPLE_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace wfa_virtual_people {
+
+#ifdef WFA_VIRTUAL_PEOPLE_HAS_IO_URING
+
+// The submission and completion queues shared with the kernel. liburing is not
+// a dependency, so the rings are set up with the raw system calls.
+struct AsyncFileIo::Ring {
+  ~Ring() {
+    if (sqes != nullptr) {
+      munmap(sqes, sqes_size);
+    }
+    if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+      munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr != nullptr) {
+      munmap(sq_ptr, sq_size);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  int fd = -1;
+  void* sq_ptr = nullptr;
+  size_t sq_size = 0;
+  void* cq_ptr = nullptr;
+  size_t cq_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_mask = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+};
+
+namespace {
+
+int IoUringSetup(const unsigned entries, io_uring_params& params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int IoUringEnter(const int fd, const unsigned to_submit,
+                 const unsigned min_complete, const unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int IoUringRegister(const int fd, const unsigned opcode, const void* arg,
+                    const unsigned nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+void* MapRing(const int fd, const size_t size, const off_t offset) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+template <typename T>
+T* RingField(void* ring, const uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<AsyncFileIo::Ring>> AsyncFileIo::CreateRing(
+    const int queue_depth) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  auto ring = std::make_unique<Ring>();
+  ring->fd = IoUringSetup(queue_depth, params);
+  if (ring->fd < 0) {
+    return nullptr;
+  }
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+  }
+  ring->sq_ptr = MapRing(ring->fd, ring->sq_size, IORING_OFF_SQ_RING);
+  ring->cq_ptr = single_mmap
+                     ? ring->sq_ptr
+                     : MapRing(ring->fd, ring->cq_size, IORING_OFF_CQ_RING);
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes = static_cast<io_uring_sqe*>(
+      MapRing(ring->fd, ring->sqes_size, IORING_OFF_SQES));
+  if (ring->sq_ptr == nullptr || ring->cq_ptr == nullptr ||
+      ring->sqes == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("Unable to map io_uring: ", std::strerror(errno)));
+  }
+  ring->sq_tail = RingField<unsigned>(ring->sq_ptr, params.sq_off.tail);
+  ring->sq_mask = RingField<unsigned>(ring->sq_ptr, params.sq_off.ring_mask);
+  ring->sq_array = RingField<unsigned>(ring->sq_ptr, params.sq_off.array);
+  ring->cq_head = RingField<unsigned>(ring->cq_ptr, params.cq_off.head);
+  ring->cq_tail = RingField<unsigned>(ring->cq_ptr, params.cq_off.tail);
+  ring->cq_mask = RingField<unsigned>(ring->cq_ptr, params.cq_off.ring_mask);
+  ring->cqes = RingField<io_uring_cqe>(ring->cq_ptr, params.cq_off.cqes);
+  return ring;
+}
+
+#else
+
+struct AsyncFileIo::Ring {};
+
+absl::StatusOr<std::unique_ptr<AsyncFileIo::Ring>> AsyncFileIo::CreateRing(
+    const int queue_depth) {
+  return nullptr;
+}
+
+#endif  // WFA_VIRTUAL_PEOPLE_HAS_IO_URING
+
+absl::StatusOr<std::unique_ptr<AsyncFileIo>> AsyncFileIo::Create(
+    const int fd, const int queue_depth, const bool use_io_uring) {
+  if (queue_depth <= 0) {
+    return absl::InvalidArgumentError("queue_depth must be positive.");
+  }
+  std::unique_ptr<Ring> ring;
+  if (use_io_uring) {
+    absl::StatusOr<std::unique_ptr<Ring>> created = CreateRing(queue_depth);
+    if (!created.ok()) {
+      return created.status();
+    }
+    ring = *std::move(created);
+  }
+  return std::unique_ptr<AsyncFileIo>(
+      new AsyncFileIo(fd, queue_depth, std::move(ring)));
+}
+
+AsyncFileIo::AsyncFileIo(const int fd, const int queue_depth,
+                         std::unique_ptr<Ring> ring)
+    : fd_(fd), queue_depth_(queue_depth), in_flight_(0),
+      ring_(std::move(ring)), buffers_registered_(false) {
+  if (ring_ != nullptr) {
+    slots_.resize(queue_depth);
+    for (int slot = queue_depth - 1; slot >= 0; --slot) {
+      free_slots_.push_back(slot);
+    }
+  }
+}
+
+AsyncFileIo::~AsyncFileIo() = default;
+
+absl::Status AsyncFileIo::RegisterBuffers(
+    absl::Span<const absl::Span<char>> buffers) {
+#ifdef WFA_VIRTUAL_PEOPLE_HAS_IO_URING
+  if (ring_ == nullptr) {
+    return absl::OkStatus();
+  }
+  std::vector<struct iovec> iovecs;
+  for (const absl::Span<char> buffer : buffers) {
+    iovecs.push_back({buffer.data(), buffer.size()});
+  }
+  if (IoUringRegister(ring_->fd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                      iovecs.size()) < 0) {
+    // The buffers cannot be locked in memory, which is only an optimization.
+    if (errno == ENOMEM || errno == EPERM) {
+      return absl::OkStatus();
+    }
+    return absl::InternalError(absl::StrCat(
+        "Unable to register io_uring buffers: ", std::strerror(errno)));
+  }
+  buffers_registered_ = true;
+#endif
+  return absl::OkStatus();
+}
+
+absl::Status AsyncFileIo::SubmitRead(const uint64_t tag,
+                                     absl::Span<char> output,
+                                     const uint64_t offset,
+                                     const int buffer_index) {
+  return Submit({tag, false, output.data(), output.size(), offset,
+                 buffer_index, 0, {}});
+}
+
+absl::Status AsyncFileIo::SubmitWrite(const uint64_t tag,
+                                      absl::string_view data,
+                                      const uint64_t offset,
+                                      const int buffer_index) {
+  return Submit({tag, true, const_cast<char*>(data.data()), data.size(),
+                 offset, buffer_index, 0, {}});
+}
+
+absl::Status AsyncFileIo::Submit(Request request) {
+  if (in_flight_ >= queue_depth_) {
+    return absl::FailedPreconditionError(
+        "Submitting more requests than the queue depth.");
+  }
+  ++in_flight_;
+  if (ring_ == nullptr) {
+    requests_.push_back(request);
+    return absl::OkStatus();
+  }
+  const int slot = free_slots_.back();
+  free_slots_.pop_back();
+  slots_[slot] = request;
+  return SubmitToRing(slot);
+}
+
+absl::Status AsyncFileIo::SubmitToRing(const int slot) {
+#ifdef WFA_VIRTUAL_PEOPLE_HAS_IO_URING
+  Request& request = slots_[slot];
+  const unsigned tail = *ring_->sq_tail;
+  const unsigned index = tail & *ring_->sq_mask;
+  io_uring_sqe& sqe = ring_->sqes[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.fd = fd_;
+  sqe.off = request.offset + request.done;
+  sqe.user_data = slot;
+  char* data = request.data + request.done;
+  const size_t size = request.size - request.done;
+  if (request.buffer_index >= 0 && buffers_registered_) {
+    sqe.opcode =
+        request.is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = size;
+    sqe.buf_index = request.buffer_index;
+  } else {
+    // The iovec must stay valid until the kernel consumes the submission.
+    request.iov = {data, size};
+    sqe.opcode = request.is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe.addr = reinterpret_cast<uint64_t>(&request.iov);
+    sqe.len = 1;
+  }
+  ring_->sq_array[index] = index;
+  __atomic_store_n(ring_->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  int submitted;
+  do {
+    submitted = IoUringEnter(ring_->fd, 1, 0, 0);
+  } while (submitted < 0 && errno == EINTR);
+  if (submitted < 0) {
+    return absl::InternalError(
+        absl::StrCat("Unable to submit to io_uring: ", std::strerror(errno)));
+  }
+#endif
+  return absl::OkStatus();
+}
+
+int64_t AsyncFileIo::RunBlocking(Request& request) {
+  while (request.done < request.size) {
+    char* data = request.data + request.done;
+    const size_t size = request.size - request.done;
+    const off_t offset = request.offset + request.done;
+    const ssize_t result = request.is_write ? pwrite(fd_, data, size, offset)
+                                            : pread(fd_, data, size, offset);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      return -errno;
+    }
+    if (result == 0) {
+      break;
+    }
+    request.done += result;
+  }
+  return request.done;
+}
+
+absl::StatusOr<AsyncFileIo::Completion> AsyncFileIo::Wait() {
+  if (in_flight_ == 0) {
+    return absl::FailedPreconditionError("No request in flight.");
+  }
+  if (ring_ == nullptr) {
+    Request request = requests_.front();
+    requests_.pop_front();
+    --in_flight_;
+    return Completion{request.tag, RunBlocking(request)};
+  }
+#ifdef WFA_VIRTUAL_PEOPLE_HAS_IO_URING
+  while (true) {
+    const unsigned head = *ring_->cq_head;
+    if (head == __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE)) {
+      if (IoUringEnter(ring_->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+          errno != EINTR) {
+        return absl::InternalError(absl::StrCat(
+            "Unable to wait for io_uring: ", std::strerror(errno)));
+      }
+      continue;
+    }
+    const io_uring_cqe& cqe = ring_->cqes[head & *ring_->cq_mask];
+    const int slot = static_cast<int>(cqe.user_data);
+    const int32_t result = cqe.res;
+    __atomic_store_n(ring_->cq_head, head + 1, __ATOMIC_RELEASE);
+    Request& request = slots_[slot];
+    if (result > 0) {
+      request.done += result;
+    }
+    if (result > 0 && request.done < request.size) {
+      absl::Status status = SubmitToRing(slot);
+      if (!status.ok()) {
+        return status;
+      }
+      continue;
+    }
+    free_slots_.push_back(slot);
+    --in_flight_;
+    return Completion{request.tag,
+                      result < 0 ? result : static_cast<int64_t>(request.done)};
+  }
+#endif
+  return absl::InternalError("io_uring is not supported.");
+}
+
+absl::StatusOr<std::unique_ptr<AsyncFileInputStream>>
+AsyncFileInputStream::Open(absl::string_view path, const int block_size,
+                           const int queue_depth, const bool use_io_uring) {
+  int fd = open(std::string(path).c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unable to open file: ", path));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return absl::InternalError(absl::StrCat("Unable to stat file: ", path));
+  }
+  absl::StatusOr<std::unique_ptr<AsyncFileIo>> io =
+      AsyncFileIo::Create(fd, queue_depth, use_io_uring);
+  if (!io.ok()) {
+    close(fd);
+    return io.status();
+  }
+  std::unique_ptr<AsyncFileInputStream> input(new AsyncFileInputStream(
+      fd, file_stat.st_size, block_size, *std::move(io)));
+  std::vector<absl::Span<char>> buffers;
+  for (int i = 0; i < queue_depth; ++i) {
+    buffers.emplace_back(input->buffers_.get() + i * block_size, block_size);
+  }
+  absl::Status status = input->io_->RegisterBuffers(buffers);
+  if (!status.ok()) {
+    return status;
+  }
+  input->SubmitReads();
+  return input;
+}
+
+AsyncFileInputStream::AsyncFileInputStream(const int fd,
+                                           const uint64_t file_size,
+                                           const int block_size,
+                                           std::unique_ptr<AsyncFileIo> io)
+    : fd_(fd),
+      file_size_(file_size),
+      block_size_(block_size),
+      io_(std::move(io)),
+      next_read_block_(0),
+      next_consumed_block_(0),
+      current_(nullptr),
+      current_size_(0),
+      last_returned_size_(0),
+      byte_count_(0) {
+  const int queue_depth = io_->GetQueueDepth();
+  buffers_ = std::make_unique<char[]>(
+      static_cast<size_t>(queue_depth) * block_size);
+  block_sizes_.resize(queue_depth, 0);
+  is_ready_.resize(queue_depth, false);
+}
+
+AsyncFileInputStream::~AsyncFileInputStream() {
+  // The kernel may still write to the buffers of the reads in flight.
+  while (io_->GetInFlightCount() > 0) {
+    if (!io_->Wait().ok()) {
+      // The buffers are leaked, as the reads may never complete.
+      static_cast<void>(buffers_.release());
+      break;
+    }
+  }
+  close(fd_);
+}
+
+void AsyncFileInputStream::SubmitReads() {
+  const uint64_t block_count = (file_size_ + block_size_ - 1) / block_size_;
+  const int queue_depth = io_->GetQueueDepth();
+  while (status_.ok() && next_read_block_ < block_count &&
+         next_read_block_ - next_consumed_block_ <
+             static_cast<uint64_t>(queue_depth)) {
+    const int buffer = next_read_block_ % queue_depth;
+    const uint64_t offset = next_read_block_ * block_size_;
+    const size_t size = std::min<uint64_t>(block_size_, file_size_ - offset);
+    block_sizes_[buffer] = size;
+    status_ = io_->SubmitRead(
+        next_read_block_,
+        absl::MakeSpan(buffers_.get() + buffer * block_size_, size), offset,
+        buffer);
+    ++next_read_block_;
+  }
+}
+
+bool AsyncFileInputStream::Next(const void** data, int* size) {
+  if (current_size_ == 0) {
+    if (current_ != nullptr) {
+      // All bytes of the current block are returned, so its buffer is free.
+      current_ = nullptr;
+      ++next_consumed_block_;
+      SubmitReads();
+    }
+    if (!status_.ok() || next_consumed_block_ == next_read_block_) {
+      return false;
+    }
+    const int queue_depth = io_->GetQueueDepth();
+    const int buffer = next_consumed_block_ % queue_depth;
+    while (!is_ready_[buffer]) {
+      absl::StatusOr<AsyncFileIo::Completion> completion = io_->Wait();
+      if (!completion.ok()) {
+        status_ = completion.status();
+        return false;
+      }
+      const int completed = completion->tag % queue_depth;
+      if (completion->result != block_sizes_[completed]) {
+        status_ = absl::InternalError(
+            completion->result < 0
+                ? absl::StrCat("Unable to read: ",
+                               std::strerror(-completion->result))
+                : "The file is truncated while reading.");
+        return false;
+      }
+      is_ready_[completed] = true;
+    }
+    is_ready_[buffer] = false;
+    current_ = buffers_.get() + buffer * block_size_;
+    current_size_ = block_sizes_[buffer];
+  }
+  *data = current_;
+  *size = current_size_;
+  last_returned_size_ = current_size_;
+  byte_count_ += current_size_;
+  current_ += current_size_;
+  current_size_ = 0;
+  return true;
+}
+
+void AsyncFileInputStream::BackUp(const int count) {
+  current_ -= count;
+  current_size_ += count;
+  byte_count_ -= count;
+  last_returned_size_ -= count;
+}
+
+bool AsyncFileInputStream::Skip(int count) {
+  const void* data;
+  int size;
+  while (count > 0) {
+    if (!Next(&data, &size)) {
+      return false;
+    }
+    if (size > count) {
+      BackUp(size - count);
+      return true;
+    }
+    count -= size;
+  }
+  return true;
+}
+
+absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>>
+AsyncFileOutputStream::Create(const int fd, const int block_size,
+                              const int queue_depth, const bool use_io_uring,
+                              const uint64_t offset) {
+  absl::StatusOr<std::unique_ptr<AsyncFileIo>> io =
+      AsyncFileIo::Create(fd, queue_depth, use_io_uring);
+  if (!io.ok()) {
+    close(fd);
+    return io.status();
+  }
+  std::unique_ptr<AsyncFileOutputStream> output(new AsyncFileOutputStream(
+      fd, block_size, queue_depth, offset, *std::move(io)));
+  std::vector<absl::Span<char>> buffers;
+  for (int i = 0; i < queue_depth; ++i) {
+    buffers.emplace_back(output->buffers_.get() + i * block_size, block_size);
+  }
+  absl::Status status = output->io_->RegisterBuffers(buffers);
+  if (!status.ok()) {
+    return status;
+  }
+  return output;
+}
+
+AsyncFileOutputStream::AsyncFileOutputStream(const int fd, const int block_size,
+                                             const int queue_depth,
+                                             const uint64_t offset,
+                                             std::unique_ptr<AsyncFileIo> io)
+    : fd_(fd),
+      block_size_(block_size),
+      io_(std::move(io)),
+      buffers_(std::make_unique<char[]>(static_cast<size_t>(queue_depth) *
+                                        block_size)),
+      submitted_sizes_(queue_depth, 0),
+      current_(-1),
+      current_used_(0),
+      offset_(offset),
+      submitted_bytes_(0) {
+  for (int i = queue_depth - 1; i >= 0; --i) {
+    free_buffers_.push_back(i);
+  }
+}
+
+AsyncFileOutputStream::~AsyncFileOutputStream() {
+  if (fd_ >= 0) {
+    Close().IgnoreError();
+  }
+}
+
+bool AsyncFileOutputStream::Next(void** data, int* size) {
+  if (fd_ < 0 || !status_.ok()) {
+    return false;
+  }
+  if (current_ >= 0 && current_used_ == block_size_ && !SubmitCurrent()) {
+    return false;
+  }
+  if (current_ < 0) {
+    if (free_buffers_.empty() && !WaitOne()) {
+      return false;
+    }
+    current_ = free_buffers_.back();
+    free_buffers_.pop_back();
+    current_used_ = 0;
+  }
+  *data = buffers_.get() + current_ * block_size_ + current_used_;
+  *size = block_size_ - current_used_;
+  current_used_ = block_size_;
+  return true;
+}
+
+void AsyncFileOutputStream::BackUp(const int count) { current_used_ -= count; }
+
+int64_t AsyncFileOutputStream::ByteCount() const {
+  return submitted_bytes_ + (current_ >= 0 ? current_used_ : 0);
+}
+
+bool AsyncFileOutputStream::SubmitCurrent() {
+  submitted_sizes_[current_] = current_used_;
+  status_ = io_->SubmitWrite(
+      current_,
+      absl::string_view(buffers_.get() + current_ * block_size_,
+                        current_used_),
+      offset_ + submitted_bytes_, current_);
+  submitted_bytes_ += current_used_;
+  current_ = -1;
+  return status_.ok();
+}
+
+bool AsyncFileOutputStream::WaitOne() {
+  absl::StatusOr<AsyncFileIo::Completion> completion = io_->Wait();
+  if (!completion.ok()) {
+    status_ = completion.status();
+    return false;
+  }
+  free_buffers_.push_back(completion->tag);
+  status_ = GetWriteStatus(*completion);
+  return status_.ok();
+}
+
+absl::Status AsyncFileOutputStream::GetWriteStatus(
+    const AsyncFileIo::Completion& completion) const {
+  if (completion.result < 0) {
+    return absl::InternalError(absl::StrCat(
+        "Unable to write: ", std::strerror(-completion.result)));
+  }
+  const int submitted_size = submitted_sizes_[completion.tag];
+  if (completion.result != submitted_size) {
+    return absl::DataLossError(absl::StrCat("Only ", completion.result, " of ",
+                                            submitted_size,
+                                            " bytes are written."));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AsyncFileOutputStream::Flush() {
+  if (fd_ < 0) {
+    return absl::FailedPreconditionError("File is already closed.");
+  }
+  if (status_.ok() && current_ >= 0 && current_used_ > 0) {
+    SubmitCurrent();
+  }
+  while (status_.ok() && io_->GetInFlightCount() > 0) {
+    WaitOne();
+  }
+  if (status_.ok() && fdatasync(fd_) != 0) {
+    status_ = absl::InternalError(
+        absl::StrCat("Unable to sync file: ", std::strerror(errno)));
+  }
+  return status_;
+}
+
+absl::Status AsyncFileOutputStream::Close() {
+  if (fd_ < 0) {
+    return absl::FailedPreconditionError("File is already closed.");
+  }
+  if (status_.ok() && current_ >= 0 && current_used_ > 0) {
+    SubmitCurrent();
+  }
+  while (io_->GetInFlightCount() > 0) {
+    absl::StatusOr<AsyncFileIo::Completion> completion = io_->Wait();
+    if (!completion.ok()) {
+      // The kernel may still write from the buffers, so they are leaked.
+      static_cast<void>(buffers_.release());
+      status_ = completion.status();
+      break;
+    }
+    if (status_.ok()) {
+      status_ = GetWriteStatus(*completion);
+    }
+  }
+  if (close(fd_) != 0 && status_.ok()) {
+    status_ = absl::InternalError("Unable to close file.");
+  }
+  fd_ = -1;
+  return status_;
+}
+
+}  // namespace wfa_virtual_people
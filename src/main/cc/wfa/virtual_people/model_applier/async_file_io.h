@@ -0,0 +1,239 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_FILE_IO_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_FILE_IO_H_
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace wfa_virtual_people {
+
+// Reads and writes a file with several requests in flight. On Linux, the
+// requests are submitted to an io_uring, and run in the kernel while the
+// caller does other work. If io_uring is not supported, at compile time or
+// at runtime, each request is a blocking pread or pwrite run by Wait.
+//
+// Not thread-safe.
+class AsyncFileIo {
+ public:
+  struct Completion {
+    uint64_t tag;
+    // The count of bytes read or written, or the negative errno.
+    int64_t result;
+  };
+
+  // Returns error status if @use_io_uring is true, and io_uring is supported,
+  // but setting it up fails.
+  // At most @queue_depth requests can be in flight. @fd is not owned.
+  static absl::StatusOr<std::unique_ptr<AsyncFileIo>> Create(int fd,
+                                                             int queue_depth,
+                                                             bool use_io_uring);
+
+  ~AsyncFileIo();
+
+  AsyncFileIo(const AsyncFileIo&) = delete;
+  AsyncFileIo& operator=(const AsyncFileIo&) = delete;
+
+  // Registers @buffers with the kernel, so that the requests on them skip
+  // mapping the pages on every request. @buffer_index in SubmitRead and
+  // SubmitWrite is the index in @buffers.
+  // The registered buffers are locked in memory. If that is not allowed, e.g.
+  // the buffers are over RLIMIT_MEMLOCK, the buffers are not registered, and
+  // the requests on them are submitted like those on any other memory.
+  absl::Status RegisterBuffers(absl::Span<const absl::Span<char>> buffers);
+
+  // Starts reading @output.size() bytes at @offset to @output. @buffer_index
+  // is the index of the registered buffer containing @output, or -1.
+  absl::Status SubmitRead(uint64_t tag, absl::Span<char> output,
+                          uint64_t offset, int buffer_index);
+
+  // Starts writing @data at @offset.
+  absl::Status SubmitWrite(uint64_t tag, absl::string_view data,
+                           uint64_t offset, int buffer_index);
+
+  // Waits for a submitted request to complete.
+  absl::StatusOr<Completion> Wait();
+
+  int GetQueueDepth() const { return queue_depth_; }
+  int GetInFlightCount() const { return in_flight_; }
+  bool UsesIoUring() const { return ring_ != nullptr; }
+  bool UsesRegisteredBuffers() const { return buffers_registered_; }
+
+ private:
+  struct Ring;
+
+  struct Request {
+    uint64_t tag;
+    bool is_write;
+    char* data;
+    size_t size;
+    uint64_t offset;
+    int buffer_index;
+    // The bytes transferred by the previous submissions of this request.
+    // Short reads and writes are submitted again for the rest.
+    size_t done;
+    struct iovec iov;
+  };
+
+  AsyncFileIo(int fd, int queue_depth, std::unique_ptr<Ring> ring);
+
+  // Returns nullptr if io_uring is not supported, e.g. on kernels before 5.1
+  // or when blocked by seccomp. Returns error status if it is supported, but
+  // the rings cannot be mapped.
+  static absl::StatusOr<std::unique_ptr<Ring>> CreateRing(int queue_depth);
+
+  absl::Status Submit(Request request);
+  // Submits the rest of @slots_[@slot] to the ring.
+  absl::Status SubmitToRing(int slot);
+  // Runs @request with blocking pread or pwrite.
+  int64_t RunBlocking(Request& request);
+
+  const int fd_;
+  const int queue_depth_;
+  int in_flight_;
+  // Null if the requests are run by Wait.
+  std::unique_ptr<Ring> ring_;
+  bool buffers_registered_;
+  // The requests in the ring, indexed by the user data of the submissions.
+  std::vector<Request> slots_;
+  std::vector<int> free_slots_;
+  // The requests to run by Wait, without io_uring.
+  std::deque<Request> requests_;
+};
+
+// A ZeroCopyInputStream reading a file ahead in blocks, with @queue_depth
+// blocks in flight. The blocks are registered buffers, and Next returns
+// pointers into them, so the bytes are parsed where the kernel put them.
+class AsyncFileInputStream : public google::protobuf::io::ZeroCopyInputStream {
+ public:
+  // Returns error status if @path cannot be opened.
+  static absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> Open(
+      absl::string_view path, int block_size, int queue_depth,
+      bool use_io_uring);
+
+  ~AsyncFileInputStream() override;
+
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64_t ByteCount() const override { return byte_count_; }
+
+  // Returns the error of the reads, if any.
+  absl::Status status() const { return status_; }
+
+ private:
+  AsyncFileInputStream(int fd, uint64_t file_size, int block_size,
+                       std::unique_ptr<AsyncFileIo> io);
+
+  // Submits reads for the free blocks, up to the end of the file.
+  void SubmitReads();
+
+  const int fd_;
+  const uint64_t file_size_;
+  const int block_size_;
+  std::unique_ptr<AsyncFileIo> io_;
+  // The blocks, and the bytes read to each block.
+  std::unique_ptr<char[]> buffers_;
+  std::vector<int> block_sizes_;
+  std::vector<bool> is_ready_;
+  // The blocks are read in order, round-robin over the buffers. Block i of
+  // the file is read to buffer i % queue_depth.
+  uint64_t next_read_block_;
+  uint64_t next_consumed_block_;
+  // The bytes of the current block not returned by Next yet.
+  const char* current_;
+  int current_size_;
+  // The size of the last chunk returned by Next, which can be backed up.
+  int last_returned_size_;
+  int64_t byte_count_;
+  absl::Status status_;
+};
+
+// A ZeroCopyOutputStream writing a file behind in blocks, with @queue_depth
+// blocks in flight. Next returns the registered buffers, which are written by
+// the kernel once filled.
+class AsyncFileOutputStream
+    : public google::protobuf::io::ZeroCopyOutputStream {
+ public:
+  // @fd is owned, and closed by Close. The stream is written to the file from
+  // @offset.
+  static absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>> Create(
+      int fd, int block_size, int queue_depth, bool use_io_uring,
+      uint64_t offset = 0);
+
+  // Closes the file if it is not closed, ignoring the errors.
+  ~AsyncFileOutputStream() override;
+
+  bool Next(void** data, int* size) override;
+  void BackUp(int count) override;
+  int64_t ByteCount() const override;
+
+  // Writes the current block, waits for all writes, and syncs the file, so
+  // that all the bytes written so far are durable. Writing can continue after.
+  absl::Status Flush();
+
+  // Writes the remaining blocks, waits for all writes, and closes the file.
+  absl::Status Close();
+
+  // Returns the error of the writes completed so far, if any.
+  absl::Status status() const { return status_; }
+
+ private:
+  AsyncFileOutputStream(int fd, int block_size, int queue_depth,
+                        uint64_t offset, std::unique_ptr<AsyncFileIo> io);
+
+  // Submits the write of the current block, first waiting for a free buffer
+  // if all are in flight.
+  bool SubmitCurrent();
+
+  // Waits for one write, and makes its buffer free.
+  bool WaitOne();
+
+  // Returns the error of @completion, which is a write on one of the buffers.
+  // A write of less bytes than submitted is an error.
+  absl::Status GetWriteStatus(const AsyncFileIo::Completion& completion) const;
+
+  int fd_;
+  const int block_size_;
+  std::unique_ptr<AsyncFileIo> io_;
+  std::unique_ptr<char[]> buffers_;
+  // The bytes submitted to be written from each buffer in flight.
+  std::vector<int> submitted_sizes_;
+  std::vector<int> free_buffers_;
+  // The buffer being filled, or -1, and the count of its bytes returned by
+  // Next and not backed up.
+  int current_;
+  int current_used_;
+  // The file offset of the first byte of the stream.
+  const uint64_t offset_;
+  uint64_t submitted_bytes_;
+  absl::Status status_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_FILE_IO_H_
@@ -0,0 +1,329 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/async_output_stream.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The size of the buffers returned by Next.
+constexpr int kBufferSize = 1 << 20;
+// Next blocks when this many buffers are waiting for the background thread.
+constexpr size_t kMaxPendingBuffers = 4;
+// Textproto compresses several-fold already at the fastest level, and higher
+// levels are much slower.
+constexpr int kGzipCompressionLevel = 1;
+
+// Copies @data to @output.
+bool WriteToStream(absl::string_view data,
+                   google::protobuf::io::ZeroCopyOutputStream& output) {
+  while (!data.empty()) {
+    void* buffer;
+    int size;
+    if (!output.Next(&buffer, &size)) {
+      return false;
+    }
+    int copied = std::min<size_t>(size, data.size());
+    std::memcpy(buffer, data.data(), copied);
+    output.BackUp(size - copied);
+    data.remove_prefix(copied);
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::StatusOr<OutputCompression> ParseOutputCompression(
+    absl::string_view name) {
+  if (name == "none") {
+    return OutputCompression::kNone;
+  }
+  if (name == "gzip") {
+    return OutputCompression::kGzip;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown output compression: ", name));
+}
+
+absl::string_view GetOutputCompressionExtension(
+    const OutputCompression compression) {
+  switch (compression) {
+    case OutputCompression::kNone:
+      return "";
+    case OutputCompression::kGzip:
+      return ".gz";
+  }
+  return "";
+}
+
+absl::StatusOr<std::unique_ptr<AsyncOutputStream>> AsyncOutputStream::Open(
+    absl::string_view path, const OutputCompression compression,
+    const bool use_io_uring) {
+  // The output file is only accessible by owner.
+  int fd = open(std::string(path).c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+                S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unable to create file: ", path));
+  }
+  return std::unique_ptr<AsyncOutputStream>(
+      new AsyncOutputStream(fd, path, compression, use_io_uring, 0));
+}
+
+absl::StatusOr<std::unique_ptr<AsyncOutputStream>> AsyncOutputStream::Resume(
+    absl::string_view path, const OutputCompression compression,
+    const bool use_io_uring, const int64_t offset) {
+  int fd = open(std::string(path).c_str(), O_WRONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("Unable to open file: ", path));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < offset ||
+      ftruncate(fd, offset) != 0) {
+    close(fd);
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Unable to resume file: ", path, " at offset ", offset));
+  }
+  return std::unique_ptr<AsyncOutputStream>(
+      new AsyncOutputStream(fd, path, compression, use_io_uring, offset));
+}
+
+AsyncOutputStream::AsyncOutputStream(const int fd, absl::string_view path,
+                                     const OutputCompression compression,
+                                     const bool use_io_uring,
+                                     const int64_t offset)
+    : fd_(fd),
+      path_(path),
+      compression_(compression),
+      use_io_uring_(use_io_uring),
+      offset_(offset),
+      buffer_used_(0),
+      submitted_bytes_(0),
+      closed_(false),
+      closing_(false),
+      flush_requested_(false),
+      flushed_size_(offset) {
+  buffer_.resize(kBufferSize);
+  writer_ = std::thread([this]() { WriteLoop(); });
+}
+
+AsyncOutputStream::~AsyncOutputStream() {
+  if (!closed_) {
+    Close().IgnoreError();
+  }
+}
+
+bool AsyncOutputStream::Next(void** data, int* size) {
+  if (closed_) {
+    return false;
+  }
+  if (buffer_used_ == kBufferSize && !Submit()) {
+    return false;
+  }
+  *data = buffer_.data() + buffer_used_;
+  *size = kBufferSize - buffer_used_;
+  buffer_used_ = kBufferSize;
+  return true;
+}
+
+void AsyncOutputStream::BackUp(const int count) { buffer_used_ -= count; }
+
+int64_t AsyncOutputStream::ByteCount() const {
+  return submitted_bytes_ + buffer_used_;
+}
+
+bool AsyncOutputStream::Write(absl::string_view data) {
+  return WriteToStream(data, *this);
+}
+
+bool AsyncOutputStream::CanSubmit() const {
+  return pending_.size() < kMaxPendingBuffers || !status_.ok();
+}
+
+bool AsyncOutputStream::HasWork() const {
+  return !pending_.empty() || closing_ || flush_requested_;
+}
+
+bool AsyncOutputStream::IsFlushed() const {
+  return !flush_requested_ || !status_.ok();
+}
+
+bool AsyncOutputStream::Submit() {
+  buffer_.resize(buffer_used_);
+  submitted_bytes_ += buffer_used_;
+  buffer_used_ = 0;
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(this, &AsyncOutputStream::CanSubmit));
+  if (!status_.ok()) {
+    buffer_.resize(kBufferSize);
+    return false;
+  }
+  pending_.push_back(std::move(buffer_));
+  if (free_.empty()) {
+    buffer_ = std::string();
+  } else {
+    buffer_ = std::move(free_.back());
+    free_.pop_back();
+  }
+  buffer_.resize(kBufferSize);
+  return true;
+}
+
+void AsyncOutputStream::WriteLoop() {
+  absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>> file_output =
+      AsyncFileOutputStream::Create(fd_, kBufferSize, kMaxPendingBuffers,
+                                    use_io_uring_, offset_);
+  absl::Status status = file_output.status();
+  std::unique_ptr<google::protobuf::io::GzipOutputStream> gzip_output;
+  google::protobuf::io::ZeroCopyOutputStream* output = nullptr;
+  // Starts a gzip member at the current end of the file.
+  auto start_gzip = [&]() {
+    google::protobuf::io::GzipOutputStream::Options options;
+    options.compression_level = kGzipCompressionLevel;
+    gzip_output = std::make_unique<google::protobuf::io::GzipOutputStream>(
+        file_output->get(), options);
+    output = gzip_output.get();
+  };
+  if (status.ok()) {
+    output = file_output->get();
+    if (compression_ == OutputCompression::kGzip) {
+      start_gzip();
+    }
+  }
+  while (true) {
+    std::string buffer;
+    bool flush = false;
+    {
+      absl::MutexLock lock(&mutex_);
+      if (!status.ok() && status_.ok()) {
+        status_ = absl::InternalError(absl::StrCat(
+            "Unable to write file: ", path_, ", ", status.message()));
+      }
+      mutex_.Await(absl::Condition(this, &AsyncOutputStream::HasWork));
+      if (pending_.empty()) {
+        if (!flush_requested_) {
+          break;
+        }
+        flush = true;
+      } else {
+        buffer = std::move(pending_.front());
+        pending_.pop_front();
+      }
+    }
+    if (flush) {
+      // Ends the gzip member if anything is written to it, then waits for the
+      // writes and syncs the file.
+      if (status.ok() && gzip_output != nullptr &&
+          gzip_output->ByteCount() > 0) {
+        if (gzip_output->Close()) {
+          start_gzip();
+        } else {
+          status = absl::InternalError("Compression failed.");
+        }
+      }
+      if (status.ok()) {
+        status = (*file_output)->Flush();
+      }
+      absl::MutexLock lock(&mutex_);
+      if (!status.ok() && status_.ok()) {
+        status_ = absl::InternalError(absl::StrCat(
+            "Unable to write file: ", path_, ", ", status.message()));
+      }
+      if (file_output.ok()) {
+        flushed_size_ = offset_ + (*file_output)->ByteCount();
+      }
+      flush_requested_ = false;
+      continue;
+    }
+    if (status.ok() && !WriteToStream(buffer, *output)) {
+      status = (*file_output)->status();
+      if (status.ok()) {
+        status = absl::InternalError("Compression failed.");
+      }
+    }
+    absl::MutexLock lock(&mutex_);
+    free_.push_back(std::move(buffer));
+  }
+  // Flushes the compressor, then waits for the writes to the file.
+  if (status.ok() && gzip_output != nullptr && !gzip_output->Close()) {
+    status = absl::InternalError("Compression failed.");
+  }
+  if (file_output.ok() && status.ok()) {
+    status = (*file_output)->Close();
+  }
+  absl::MutexLock lock(&mutex_);
+  if (!status.ok() && status_.ok()) {
+    status_ = absl::InternalError(absl::StrCat("Unable to write file: ", path_,
+                                               ", ", status.message()));
+  }
+}
+
+absl::StatusOr<int64_t> AsyncOutputStream::Flush() {
+  if (closed_) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("File is already closed: ", path_));
+  }
+  if (buffer_used_ > 0) {
+    Submit();
+  }
+  absl::MutexLock lock(&mutex_);
+  flush_requested_ = true;
+  mutex_.Await(absl::Condition(this, &AsyncOutputStream::IsFlushed));
+  flush_requested_ = false;
+  if (!status_.ok()) {
+    return status_;
+  }
+  return flushed_size_;
+}
+
+absl::Status AsyncOutputStream::Close() {
+  if (closed_) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("File is already closed: ", path_));
+  }
+  if (buffer_used_ > 0) {
+    Submit();
+  }
+  closed_ = true;
+  {
+    absl::MutexLock lock(&mutex_);
+    closing_ = true;
+  }
+  writer_.join();
+  absl::MutexLock lock(&mutex_);
+  return status_;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,143 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_OUTPUT_STREAM_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_OUTPUT_STREAM_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace wfa_virtual_people {
+
+enum class OutputCompression {
+  kNone,
+  kGzip,
+};
+
+// Parses "none" or "gzip".
+absl::StatusOr<OutputCompression> ParseOutputCompression(
+    absl::string_view name);
+
+// Returns the extension of the files written with @compression, e.g. ".gz".
+absl::string_view GetOutputCompressionExtension(OutputCompression compression);
+
+// A ZeroCopyOutputStream to a file, which returns in-memory buffers to the
+// caller, and compresses and writes the filled buffers on a background thread.
+// So printing a textproto to the stream only costs copying the bytes to
+// memory on the calling thread. At most a few buffers are pending, and Next
+// blocks when the background thread falls behind. The background thread
+// writes with AsyncFileOutputStream, so several writes are in flight.
+//
+// Next returns false after the background thread fails to write. The error is
+// returned by Close.
+class AsyncOutputStream : public google::protobuf::io::ZeroCopyOutputStream {
+ public:
+  // Returns error status if @path cannot be created.
+  // If @use_io_uring is true, the writes are submitted to an io_uring when
+  // supported.
+  static absl::StatusOr<std::unique_ptr<AsyncOutputStream>> Open(
+      absl::string_view path, OutputCompression compression,
+      bool use_io_uring);
+
+  // Opens the existing file @path to continue writing at @offset, and drops
+  // the bytes after it. @offset should be a size returned by Flush, so that
+  // the bytes before it are complete. Returns error status if @path cannot be
+  // opened, or is shorter than @offset.
+  static absl::StatusOr<std::unique_ptr<AsyncOutputStream>> Resume(
+      absl::string_view path, OutputCompression compression, bool use_io_uring,
+      int64_t offset);
+
+  // Closes the stream if it is not closed, ignoring the errors.
+  ~AsyncOutputStream() override;
+
+  AsyncOutputStream(const AsyncOutputStream&) = delete;
+  AsyncOutputStream& operator=(const AsyncOutputStream&) = delete;
+
+  bool Next(void** data, int* size) override;
+  void BackUp(int count) override;
+  int64_t ByteCount() const override;
+
+  // Copies @data to the stream. Returns false if the background thread has
+  // failed.
+  bool Write(absl::string_view data);
+
+  // Writes and syncs all the bytes so far, and returns the size of the file.
+  // The file up to that size is complete: with gzip compression, the
+  // compressed stream is ended there, and the bytes written after start a new
+  // gzip member, which gzip decompresses as one stream. So a later Resume from
+  // that size writes the same uncompressed bytes. Writing can continue after.
+  absl::StatusOr<int64_t> Flush();
+
+  // Writes the remaining bytes, and closes the file.
+  absl::Status Close();
+
+ private:
+  AsyncOutputStream(int fd, absl::string_view path,
+                    OutputCompression compression, bool use_io_uring,
+                    int64_t offset);
+
+  // Hands @buffer_ to the background thread, waiting if too many buffers are
+  // pending. Returns false if the background thread has failed.
+  bool Submit();
+
+  // Compresses and writes the pending buffers until the stream is closed.
+  void WriteLoop();
+
+  bool CanSubmit() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool IsFlushed() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const int fd_;
+  const std::string path_;
+  const OutputCompression compression_;
+  const bool use_io_uring_;
+  // The file offset where the stream starts.
+  const int64_t offset_;
+
+  // The buffer being filled by the caller, and the count of its bytes
+  // returned by Next and not backed up.
+  std::string buffer_;
+  int buffer_used_;
+  // The bytes in the submitted buffers.
+  int64_t submitted_bytes_;
+  bool closed_;
+
+  absl::Mutex mutex_;
+  std::deque<std::string> pending_ ABSL_GUARDED_BY(mutex_);
+  // The written buffers, reused by Submit to avoid allocations.
+  std::vector<std::string> free_ ABSL_GUARDED_BY(mutex_);
+  bool closing_ ABSL_GUARDED_BY(mutex_);
+  // Set by Flush, and cleared by the background thread once the pending
+  // buffers are written and synced, with the file size in flushed_size_.
+  bool flush_requested_ ABSL_GUARDED_BY(mutex_);
+  int64_t flushed_size_ ABSL_GUARDED_BY(mutex_);
+  absl::Status status_ ABSL_GUARDED_BY(mutex_);
+
+  std::thread writer_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_ASYNC_OUTPUT_STREAM_H_
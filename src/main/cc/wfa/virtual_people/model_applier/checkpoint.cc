@@ -0,0 +1,250 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+#include "wfa/virtual_people/model_applier/async_output_stream.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+constexpr char kCheckpointFilename[] = "checkpoint.textproto";
+constexpr char kJournalFilename[] = "checkpoint_journal";
+// The journal is replayed in blocks of this size, with this many reads in
+// flight.
+constexpr int kReplayBlockSize = 4 << 20;
+constexpr int kReplayQueueDepth = 4;
+
+std::string GetCheckpointPath(absl::string_view dir) {
+  return absl::StrCat(dir, "/", kCheckpointFilename);
+}
+
+std::string GetJournalPath(absl::string_view dir) {
+  return absl::StrCat(dir, "/", kJournalFilename);
+}
+
+absl::Status ErrnoToStatus(absl::string_view message, absl::string_view path) {
+  return absl::InternalError(
+      absl::StrCat(message, ": ", path, ", ", std::strerror(errno)));
+}
+
+// Writes @content to @path, and syncs it.
+absl::Status WriteAndSyncFile(const std::string& path,
+                              absl::string_view content) {
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return ErrnoToStatus("Unable to create file", path);
+  }
+  while (!content.empty()) {
+    ssize_t written = write(fd, content.data(), content.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      absl::Status status = ErrnoToStatus("Unable to write file", path);
+      close(fd);
+      return status;
+    }
+    content.remove_prefix(written);
+  }
+  if (fsync(fd) != 0) {
+    absl::Status status = ErrnoToStatus("Unable to sync file", path);
+    close(fd);
+    return status;
+  }
+  if (close(fd) != 0) {
+    return ErrnoToStatus("Unable to close file", path);
+  }
+  return absl::OkStatus();
+}
+
+// Syncs the directory @dir, so that the files renamed in it are durable.
+absl::Status SyncDirectory(const std::string& dir) {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return ErrnoToStatus("Unable to open directory", dir);
+  }
+  absl::Status status;
+  if (fsync(fd) != 0) {
+    status = ErrnoToStatus("Unable to sync directory", dir);
+  }
+  close(fd);
+  return status;
+}
+
+// Removes @path, unless it does not exist.
+absl::Status RemoveFile(const std::string& path) {
+  if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+    return ErrnoToStatus("Unable to remove file", path);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<ModelApplierCheckpoint> ReadCheckpoint(absl::string_view dir) {
+  const std::string path = GetCheckpointPath(dir);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("No checkpoint in ", dir));
+  }
+  google::protobuf::io::FileInputStream input(fd);
+  input.SetCloseOnDelete(true);
+  ModelApplierCheckpoint checkpoint;
+  if (!google::protobuf::TextFormat::Parse(&input, &checkpoint)) {
+    return absl::DataLossError(
+        absl::StrCat("Unable to parse the checkpoint: ", path));
+  }
+  return checkpoint;
+}
+
+absl::Status WriteCheckpoint(absl::string_view dir,
+                             const ModelApplierCheckpoint& checkpoint) {
+  std::string content;
+  if (!google::protobuf::TextFormat::PrintToString(checkpoint, &content)) {
+    return absl::InternalError("Unable to print the checkpoint.");
+  }
+  // The checkpoint is written to a temporary file, and renamed over the
+  // previous one.
+  const std::string path = GetCheckpointPath(dir);
+  const std::string temp_path = absl::StrCat(path, ".tmp");
+  absl::Status status = WriteAndSyncFile(temp_path, content);
+  if (!status.ok()) {
+    return status;
+  }
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    return ErrnoToStatus("Unable to rename file", temp_path);
+  }
+  return SyncDirectory(std::string(dir));
+}
+
+absl::Status RemoveCheckpoint(absl::string_view dir) {
+  // The checkpoint is removed first, so that the journal is never missing
+  // while a checkpoint refers to it.
+  absl::Status status = RemoveFile(GetCheckpointPath(dir));
+  if (!status.ok()) {
+    return status;
+  }
+  status = RemoveFile(absl::StrCat(GetCheckpointPath(dir), ".tmp"));
+  if (!status.ok()) {
+    return status;
+  }
+  return RemoveFile(GetJournalPath(dir));
+}
+
+absl::StatusOr<std::unique_ptr<AggregationJournal>> AggregationJournal::Open(
+    absl::string_view dir, const bool use_io_uring) {
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(GetJournalPath(dir), OutputCompression::kNone,
+                              use_io_uring);
+  if (!output.ok()) {
+    return output.status();
+  }
+  return std::unique_ptr<AggregationJournal>(
+      new AggregationJournal(*std::move(output)));
+}
+
+absl::StatusOr<std::unique_ptr<AggregationJournal>> AggregationJournal::Resume(
+    absl::string_view dir, const bool use_io_uring, const int64_t size) {
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Resume(GetJournalPath(dir), OutputCompression::kNone,
+                                use_io_uring, size);
+  if (!output.ok()) {
+    return output.status();
+  }
+  return std::unique_ptr<AggregationJournal>(
+      new AggregationJournal(*std::move(output)));
+}
+
+AggregationJournal::AggregationJournal(
+    std::unique_ptr<AsyncOutputStream> output)
+    : output_(std::move(output)) {}
+
+bool AggregationJournal::Add(const LabelerOutput& output) {
+  // Only the fields read by ReportAggregator are kept. The people of
+  // entry_ are cleared and not deleted, so that they are reused.
+  entry_.mutable_people()->Clear();
+  for (const VirtualPersonActivity& person : output.people()) {
+    VirtualPersonActivity* entry_person = entry_.add_people();
+    entry_person->set_virtual_person_id(person.virtual_person_id());
+    if (person.has_label()) {
+      *entry_person->mutable_label() = person.label();
+    }
+  }
+  return google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+      entry_, output_.get());
+}
+
+absl::StatusOr<int64_t> AggregationJournal::Flush() {
+  return output_->Flush();
+}
+
+absl::Status AggregationJournal::Close() { return output_->Close(); }
+
+absl::Status ReplayAggregationJournal(absl::string_view dir,
+                                      const int64_t size,
+                                      const bool use_io_uring,
+                                      ReportAggregator& aggregator) {
+  const std::string path = GetJournalPath(dir);
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> file_input =
+      AsyncFileInputStream::Open(path, kReplayBlockSize, kReplayQueueDepth,
+                                 use_io_uring);
+  if (!file_input.ok()) {
+    return file_input.status();
+  }
+  google::protobuf::io::LimitingInputStream input(file_input->get(), size);
+  LabelerOutput output;
+  while (input.ByteCount() < size) {
+    // Parsing merges into @output.
+    output.Clear();
+    bool clean_eof;
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &output, &input, &clean_eof)) {
+      if (!(*file_input)->status().ok()) {
+        return (*file_input)->status();
+      }
+      return absl::DataLossError(absl::StrCat(
+          "The aggregation journal is corrupt or shorter than ", size,
+          " bytes: ", path));
+    }
+    aggregator.Add(output);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace wfa_virtual_people
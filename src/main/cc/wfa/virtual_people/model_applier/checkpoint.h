@@ -0,0 +1,92 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_CHECKPOINT_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_CHECKPOINT_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/model_applier/async_output_stream.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+namespace wfa_virtual_people {
+
+// The checkpoint of a model_applier run is checkpoint.textproto, and the
+// aggregation journal, in the output directory of the run.
+//
+// The aggregation state is not snapshotted, as it grows with the virtual
+// people. Instead the journal appends the virtual people of each labeler
+// output as it is aggregated, so each checkpoint only syncs what was
+// appended since the previous one. A resumed run rebuilds the aggregation by
+// replaying the journal, which is much faster than labeling again.
+
+// Returns the checkpoint in @dir. Returns NotFound status if there is none.
+absl::StatusOr<ModelApplierCheckpoint> ReadCheckpoint(absl::string_view dir);
+
+// Writes @checkpoint to @dir. The previous checkpoint is replaced atomically,
+// so a run stopped at any time leaves either of them.
+absl::Status WriteCheckpoint(absl::string_view dir,
+                             const ModelApplierCheckpoint& checkpoint);
+
+// Removes the checkpoint and the aggregation journal in @dir, if any.
+absl::Status RemoveCheckpoint(absl::string_view dir);
+
+// Appends the virtual people of the labeler outputs to the aggregation
+// journal, a file of length-delimited LabelerOutput with only the
+// virtual_person_id and the label of the people. The journal is written on
+// the background thread of an AsyncOutputStream.
+class AggregationJournal {
+ public:
+  // Creates an empty journal in @dir.
+  static absl::StatusOr<std::unique_ptr<AggregationJournal>> Open(
+      absl::string_view dir, bool use_io_uring);
+
+  // Opens the journal in @dir to append after its first @size bytes, which is
+  // a size returned by Flush.
+  static absl::StatusOr<std::unique_ptr<AggregationJournal>> Resume(
+      absl::string_view dir, bool use_io_uring, int64_t size);
+
+  // Appends the virtual people of @output. Returns false if writing failed.
+  bool Add(const LabelerOutput& output);
+
+  // Writes and syncs the appended outputs, and returns the size of the
+  // journal.
+  absl::StatusOr<int64_t> Flush();
+
+  absl::Status Close();
+
+ private:
+  explicit AggregationJournal(std::unique_ptr<AsyncOutputStream> output);
+
+  std::unique_ptr<AsyncOutputStream> output_;
+  // Reused for each output to avoid allocations.
+  LabelerOutput entry_;
+};
+
+// Adds the outputs in the first @size bytes of the aggregation journal in
+// @dir to @aggregator. Returns error status if the journal is shorter than
+// @size or corrupt.
+absl::Status ReplayAggregationJournal(absl::string_view dir, int64_t size,
+                                      bool use_io_uring,
+                                      ReportAggregator& aggregator);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_CHECKPOINT_H_
@@ -0,0 +1,166 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/labeling_cost_profile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/load_tester/latency_histogram.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The names of the user infos, in the order of the bits of the user info mask.
+constexpr const char* kUserInfoNames[] = {"email", "phone",
+                                          "proprietary_id_space_1"};
+
+int GetUserInfoMask(const ProfileInfo& profile_info) {
+  return (profile_info.has_email_user_info() ? 1 : 0) |
+         (profile_info.has_phone_user_info() ? 2 : 0) |
+         (profile_info.has_proprietary_id_space_1_user_info() ? 4 : 0);
+}
+
+std::string GetUserInfoName(const int mask) {
+  std::vector<const char*> names;
+  for (size_t i = 0; i < std::size(kUserInfoNames); ++i) {
+    if (mask & (1 << i)) {
+      names.push_back(kUserInfoNames[i]);
+    }
+  }
+  return names.empty() ? "none" : absl::StrJoin(names, "+");
+}
+
+// Quotes @value if it contains a comma or a quote.
+std::string EscapeCsv(absl::string_view value) {
+  if (value.find_first_of(",\"") == absl::string_view::npos) {
+    return std::string(value);
+  }
+  return absl::StrCat("\"", absl::StrReplaceAll(value, {{"\"", "\"\""}}),
+                      "\"");
+}
+
+struct Slice {
+  std::string value;
+  const LatencyHistogram* histogram;
+};
+
+double GetTotalMillis(const LatencyHistogram& histogram) {
+  return absl::ToDoubleMilliseconds(histogram.mean()) * histogram.count();
+}
+
+void AppendRow(absl::string_view dimension, absl::string_view value,
+               const LatencyHistogram& histogram, const double all_millis,
+               std::string& output) {
+  const double total_millis = GetTotalMillis(histogram);
+  absl::StrAppendFormat(
+      &output, "%s,%s,%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", dimension,
+      EscapeCsv(value), histogram.count(), total_millis,
+      all_millis > 0 ? total_millis / all_millis : 0.0,
+      absl::ToDoubleMicroseconds(histogram.mean()),
+      absl::ToDoubleMicroseconds(histogram.Percentile(50)),
+      absl::ToDoubleMicroseconds(histogram.Percentile(90)),
+      absl::ToDoubleMicroseconds(histogram.Percentile(99)),
+      absl::ToDoubleMicroseconds(histogram.max()));
+}
+
+// Appends the non-empty @slices of @dimension, the most costly first. Slices of
+// the same cost are ordered by value, so the output does not depend on the
+// iteration order of the hash maps.
+void AppendRows(absl::string_view dimension, std::vector<Slice> slices,
+                const double all_millis, std::string& output) {
+  slices.erase(std::remove_if(slices.begin(), slices.end(),
+                              [](const Slice& slice) {
+                                return slice.histogram->count() == 0;
+                              }),
+               slices.end());
+  std::sort(slices.begin(), slices.end(),
+            [](const Slice& a, const Slice& b) {
+              const double a_millis = GetTotalMillis(*a.histogram);
+              const double b_millis = GetTotalMillis(*b.histogram);
+              if (a_millis != b_millis) {
+                return a_millis > b_millis;
+              }
+              return a.value < b.value;
+            });
+  for (const Slice& slice : slices) {
+    AppendRow(dimension, slice.value, *slice.histogram, all_millis, output);
+  }
+}
+
+}  // namespace
+
+LabelingCostProfile::LabelingCostProfile() = default;
+
+void LabelingCostProfile::Record(const LabelerInput& input,
+                                 const absl::Duration cost) {
+  total_.Record(cost);
+  user_info_[GetUserInfoMask(input.profile_info())].Record(cost);
+  publishers_[input.event_id().publisher()].Record(cost);
+  countries_[input.geo().country_id()].Record(cost);
+}
+
+void LabelingCostProfile::Merge(const LabelingCostProfile& other) {
+  total_.Merge(other.total_);
+  for (size_t i = 0; i < user_info_.size(); ++i) {
+    user_info_[i].Merge(other.user_info_[i]);
+  }
+  for (const auto& [publisher, histogram] : other.publishers_) {
+    publishers_[publisher].Merge(histogram);
+  }
+  for (const auto& [country, histogram] : other.countries_) {
+    countries_[country].Merge(histogram);
+  }
+}
+
+std::string LabelingCostProfile::ToCsv() const {
+  std::string output =
+      "dimension,value,events,total_ms,cost_share,mean_us,p50_us,p90_us,"
+      "p99_us,max_us\n";
+  const double all_millis = GetTotalMillis(total_);
+  AppendRow("all", "all", total_, all_millis, output);
+
+  std::vector<Slice> slices;
+  for (size_t mask = 0; mask < user_info_.size(); ++mask) {
+    slices.push_back({GetUserInfoName(mask), &user_info_[mask]});
+  }
+  AppendRows("user_info", std::move(slices), all_millis, output);
+
+  slices.clear();
+  for (const auto& [publisher, histogram] : publishers_) {
+    slices.push_back({publisher, &histogram});
+  }
+  AppendRows("publisher", std::move(slices), all_millis, output);
+
+  slices.clear();
+  for (const auto& [country, histogram] : countries_) {
+    slices.push_back({absl::StrCat(country), &histogram});
+  }
+  AppendRows("country", std::move(slices), all_millis, output);
+  return output;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,71 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LABELING_COST_PROFILE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LABELING_COST_PROFILE_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/load_tester/latency_histogram.h"
+
+namespace wfa_virtual_people {
+
+// LabelingCostProfile records the labeling time of each event, sliced by the
+// features of its input:
+//   user_info: which of the email, phone and proprietary_id_space_1 user infos
+//     are set in profile_info, e.g. "email+phone", or "none".
+//   publisher: event_id.publisher.
+//   country: geo.country_id.
+// Each slice keeps a LatencyHistogram, so the memory is fixed per slice, and
+// recording an event costs a few hash lookups.
+// LabelingCostProfile is not thread-safe. Use one profile per thread, and
+// Merge them at the end.
+class LabelingCostProfile {
+ public:
+  LabelingCostProfile();
+
+  // Records that labeling @input took @cost.
+  void Record(const LabelerInput& input, absl::Duration cost);
+
+  // Adds all the costs recorded in @other to this profile.
+  void Merge(const LabelingCostProfile& other);
+
+  uint64_t count() const { return total_.count(); }
+
+  // Returns the cost breakdown in CSV, with header
+  //   dimension,value,events,total_ms,cost_share,mean_us,p50_us,p90_us,
+  //   p99_us,max_us
+  // where cost_share is the fraction of the total labeling time spent on the
+  // slice. The first row is the "all" dimension, followed by the rows of each
+  // dimension, sorted by total_ms in descending order, then by value.
+  std::string ToCsv() const;
+
+ private:
+  static constexpr int kUserInfoCount = 3;
+
+  LatencyHistogram total_;
+  // Indexed by the bit mask of the set user infos.
+  std::array<LatencyHistogram, 1 << kUserInfoCount> user_info_;
+  absl::flat_hash_map<std::string, LatencyHistogram> publishers_;
+  absl::flat_hash_map<int32_t, LatencyHistogram> countries_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LABELING_COST_PROFILE_H_
@@ -0,0 +1,256 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "src/farmhash.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The finalizer of SplitMix64, which maps each 64-bit value to a 64-bit value
+// with good avalanche.
+inline uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// The exponential integral E1(x) = -Ei(-x), for x > 0.
+double ExponentialIntegralE1(const double x) { return -std::expint(-x); }
+
+// The expected count of active registers for @cardinality ids.
+double GetExpectedActiveRegisterCount(const LiquidLegionsConfig& config,
+                                      const double cardinality) {
+  if (cardinality <= 0.0) {
+    return 0.0;
+  }
+  const double a = config.decay_rate;
+  const double m = config.size;
+  const double c = cardinality * a / (m * -std::expm1(-a));
+  return m * (1.0 - (ExponentialIntegralE1(c * std::exp(-a)) -
+                     ExponentialIntegralE1(c)) /
+                        a);
+}
+
+uint64_t GetSalt(const LiquidLegionsConfig& config) {
+  return util::Fingerprint64(
+      absl::StrCat("liquid-legions-", config.random_seed));
+}
+
+// Returns the register of @virtual_person_id, with @salt from GetSalt.
+int32_t GetRegister(const LiquidLegionsConfig& config, const uint64_t salt,
+                    const int64_t virtual_person_id) {
+  const uint64_t bits = Mix(static_cast<uint64_t>(virtual_person_id) ^ salt);
+  // The top 53 bits, as a uniform value in (0, 1).
+  const double uniform = (static_cast<double>(bits >> 11) + 0.5) *
+                         (1.0 / 9007199254740992.0);
+  // Inverts the truncated exponential distribution function
+  //   F(t) = (1 - exp(-a * t)) / (1 - exp(-a)),  t in [0, 1).
+  const double a = config.decay_rate;
+  const double t = -std::log1p(-uniform * -std::expm1(-a)) / a;
+  const int32_t index = static_cast<int32_t>(t * config.size);
+  return std::min(index, config.size - 1);
+}
+
+bool SameConfig(const LiquidLegionsConfig& config,
+                const LiquidLegionsSketch& sketch) {
+  return sketch.decay_rate() == config.decay_rate &&
+         sketch.size() == config.size &&
+         sketch.random_seed() == config.random_seed;
+}
+
+}  // namespace
+
+int32_t GetLiquidLegionsRegister(const LiquidLegionsConfig& config,
+                                 const int64_t virtual_person_id) {
+  return GetRegister(config, GetSalt(config), virtual_person_id);
+}
+
+double EstimateLiquidLegionsCardinality(const LiquidLegionsConfig& config,
+                                        const int64_t active_register_count) {
+  if (active_register_count <= 0) {
+    return 0.0;
+  }
+  if (active_register_count >= config.size) {
+    return std::numeric_limits<double>::infinity();
+  }
+  const double target = static_cast<double>(active_register_count);
+  // The expected count is increasing in the cardinality, so the inverse is
+  // found by bisection.
+  double low = 0.0;
+  double high = target;
+  while (GetExpectedActiveRegisterCount(config, high) < target) {
+    low = high;
+    high *= 2.0;
+  }
+  for (int i = 0; i < 100 && high - low > 1e-6 * high; ++i) {
+    const double middle = (low + high) / 2.0;
+    if (GetExpectedActiveRegisterCount(config, middle) < target) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (low + high) / 2.0;
+}
+
+LiquidLegionsSketchBuilder::LiquidLegionsSketchBuilder(
+    const LiquidLegionsConfig& config, const int32_t deep_register_begin)
+    : config_(config),
+      deep_register_begin_(deep_register_begin),
+      salt_(GetSalt(config)),
+      active_((config.size + 63) / 64, 0) {
+  CHECK(config.decay_rate > 0.0) << "decay_rate must be positive.";
+  CHECK(config.size > 0) << "size must be positive.";
+  CHECK(deep_register_begin >= 0 && deep_register_begin <= config.size)
+      << "deep_register_begin must be in [0, size].";
+}
+
+void LiquidLegionsSketchBuilder::Add(const int64_t virtual_person_id) {
+  const int32_t index = GetRegister(config_, salt_, virtual_person_id);
+  active_[index >> 6] |= uint64_t{1} << (index & 63);
+  if (index >= deep_register_begin_) {
+    deep_ids_[index].insert(virtual_person_id);
+  }
+}
+
+void LiquidLegionsSketchBuilder::Merge(
+    const LiquidLegionsSketchBuilder& other) {
+  CHECK(other.config_.decay_rate == config_.decay_rate &&
+        other.config_.size == config_.size &&
+        other.config_.random_seed == config_.random_seed)
+      << "Cannot merge LiquidLegions sketches with different parameters.";
+  RaiseDeepRegisterBegin(other.deep_register_begin_);
+  for (size_t i = 0; i < active_.size(); ++i) {
+    active_[i] |= other.active_[i];
+  }
+  for (const auto& [index, ids] : other.deep_ids_) {
+    if (index >= deep_register_begin_) {
+      deep_ids_[index].insert(ids.begin(), ids.end());
+    }
+  }
+}
+
+absl::Status LiquidLegionsSketchBuilder::Merge(
+    const LiquidLegionsSketch& sketch) {
+  if (!SameConfig(config_, sketch)) {
+    return absl::InvalidArgumentError(
+        "Cannot merge LiquidLegions sketches with different parameters.");
+  }
+  const int32_t sketch_deep_register_begin = sketch.deep_register_begin();
+  if (sketch_deep_register_begin < 0 ||
+      sketch_deep_register_begin > config_.size) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid deep_register_begin: ", sketch_deep_register_begin));
+  }
+  for (const int32_t index : sketch.shallow_registers()) {
+    if (index < 0 || index >= sketch_deep_register_begin) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid shallow register: ", index));
+    }
+  }
+  for (const LiquidLegionsSketch::DeepRegister& deep :
+       sketch.deep_registers()) {
+    if (deep.index() < sketch_deep_register_begin ||
+        deep.index() >= config_.size || deep.virtual_person_ids().empty()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid deep register: ", deep.index()));
+    }
+  }
+
+  RaiseDeepRegisterBegin(sketch_deep_register_begin);
+  for (const int32_t index : sketch.shallow_registers()) {
+    active_[index >> 6] |= uint64_t{1} << (index & 63);
+  }
+  for (const LiquidLegionsSketch::DeepRegister& deep :
+       sketch.deep_registers()) {
+    const int32_t index = deep.index();
+    active_[index >> 6] |= uint64_t{1} << (index & 63);
+    if (index >= deep_register_begin_) {
+      deep_ids_[index].insert(deep.virtual_person_ids().begin(),
+                              deep.virtual_person_ids().end());
+    }
+  }
+  return absl::OkStatus();
+}
+
+void LiquidLegionsSketchBuilder::RaiseDeepRegisterBegin(
+    const int32_t deep_register_begin) {
+  if (deep_register_begin <= deep_register_begin_) {
+    return;
+  }
+  deep_register_begin_ = deep_register_begin;
+  // The registers below the new begin stay active, as shallow registers.
+  absl::erase_if(deep_ids_, [deep_register_begin](const auto& deep) {
+    return deep.first < deep_register_begin;
+  });
+}
+
+int64_t LiquidLegionsSketchBuilder::GetActiveRegisterCount() const {
+  int64_t count = 0;
+  for (const uint64_t word : active_) {
+    count += __builtin_popcountll(word);
+  }
+  return count;
+}
+
+int32_t LiquidLegionsSketchBuilder::GetFirstInactiveRegister() const {
+  for (size_t i = 0; i < active_.size(); ++i) {
+    if (~active_[i] != 0) {
+      const int32_t index = i * 64 + __builtin_ctzll(~active_[i]);
+      return std::min(index, config_.size);
+    }
+  }
+  return config_.size;
+}
+
+LiquidLegionsSketch LiquidLegionsSketchBuilder::ToProto() const {
+  LiquidLegionsSketch sketch;
+  sketch.set_decay_rate(config_.decay_rate);
+  sketch.set_size(config_.size);
+  sketch.set_random_seed(config_.random_seed);
+  sketch.set_deep_register_begin(deep_register_begin_);
+  for (int32_t index = 0; index < config_.size; ++index) {
+    if (!IsActive(index)) {
+      continue;
+    }
+    if (index < deep_register_begin_) {
+      sketch.add_shallow_registers(index);
+      continue;
+    }
+    const absl::flat_hash_set<int64_t>& ids = deep_ids_.at(index);
+    std::vector<int64_t> sorted_ids(ids.begin(), ids.end());
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    LiquidLegionsSketch::DeepRegister* deep = sketch.add_deep_registers();
+    deep->set_index(index);
+    deep->mutable_virtual_person_ids()->Add(sorted_ids.begin(),
+                                            sorted_ids.end());
+  }
+  return sketch;
+}
+
+}  // namespace wfa_virtual_people
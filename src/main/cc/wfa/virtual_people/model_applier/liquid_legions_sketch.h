@@ -0,0 +1,113 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LIQUID_LEGIONS_SKETCH_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LIQUID_LEGIONS_SKETCH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+// The parameters of LiquidLegions sketches. Only sketches with the same
+// parameters can be merged. The deep_register_begin of the sketches is not a
+// parameter: sketches with different values merge at the larger one.
+struct LiquidLegionsConfig {
+  // The decay rate a of the register distribution. Register t of m registers
+  // is activated by each id with probability proportional to exp(-a * t / m).
+  double decay_rate = 20.0;
+  // The count of registers m.
+  int32_t size = 300000;
+  // The seed of the hash from virtual person id to register.
+  uint64_t random_seed = 0;
+};
+
+// Returns the register activated by @virtual_person_id, in [0, @config.size).
+int32_t GetLiquidLegionsRegister(const LiquidLegionsConfig& config,
+                                 int64_t virtual_person_id);
+
+// Returns the estimated count of distinct ids that activate
+// @active_register_count registers, by inverting the expected count of active
+// registers
+//   m * (1 - (E1(c * exp(-a)) - E1(c)) / a),  c = n * a / (m * (1 - exp(-a)))
+// for n ids, where E1 is the exponential integral. Returns infinity if all
+// registers are active.
+double EstimateLiquidLegionsCardinality(const LiquidLegionsConfig& config,
+                                        int64_t active_register_count);
+
+// Builds the LiquidLegions sketch of a stream of virtual person ids, as
+// described in notebooks/DeepLiquidSampling.ipynb.
+// The registers with index at least @deep_register_begin are deep: they are
+// activated by few ids, and keep the ids, so that the ids of the deep
+// registers can be sampled later, e.g. to map them to panelists. The other
+// registers are shallow, and only keep whether they are active.
+//
+// Adding an id is O(1), and the memory is one bit per register plus the ids
+// of the deep registers.
+class LiquidLegionsSketchBuilder {
+ public:
+  LiquidLegionsSketchBuilder(const LiquidLegionsConfig& config,
+                             int32_t deep_register_begin);
+
+  void Add(int64_t virtual_person_id);
+
+  // Adds all the ids of @other, which must have the same parameters.
+  // If @other has a larger deep_register_begin, this sketch takes it, and the
+  // registers below it become shallow and drop their ids. So the sketches of
+  // different runs, e.g. of different publishers, which each choose the
+  // deep_register_begin from their own ids, can always be merged.
+  void Merge(const LiquidLegionsSketchBuilder& other);
+
+  // Adds all the ids of @sketch, with the same deep_register_begin rule as
+  // above. Returns error status if @sketch does not have the same parameters,
+  // or has invalid registers.
+  absl::Status Merge(const LiquidLegionsSketch& sketch);
+
+  int64_t GetActiveRegisterCount() const;
+
+  // Returns the smallest index of the inactive registers, or size if all
+  // registers are active. For the sketch of all virtual people, this is the
+  // smallest deep_register_begin that keeps the saturated registers shallow,
+  // which is RequiredAntidepth in notebooks/DeepLiquidSampling.ipynb.
+  int32_t GetFirstInactiveRegister() const;
+
+  LiquidLegionsSketch ToProto() const;
+
+ private:
+  // Sets deep_register_begin_ to @deep_register_begin if it is larger, and
+  // drops the ids of the registers that become shallow.
+  void RaiseDeepRegisterBegin(int32_t deep_register_begin);
+
+  bool IsActive(int32_t index) const {
+    return (active_[index >> 6] >> (index & 63)) & 1;
+  }
+
+  LiquidLegionsConfig config_;
+  int32_t deep_register_begin_;
+  // The salt of the register hash, derived from config_.random_seed.
+  uint64_t salt_;
+  // One bit per register, set if the register is active.
+  std::vector<uint64_t> active_;
+  // The ids of each active deep register.
+  absl::flat_hash_map<int32_t, absl::flat_hash_set<int64_t>> deep_ids_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_LIQUID_LEGIONS_SKETCH_H_
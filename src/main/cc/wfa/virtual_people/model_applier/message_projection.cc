@@ -0,0 +1,111 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/message_projection.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+namespace wfa_virtual_people {
+
+absl::StatusOr<MessageProjection> MessageProjection::Create(
+    const google::protobuf::Descriptor& descriptor,
+    absl::Span<const std::string> paths) {
+  std::vector<Field> fields;
+  for (const std::string& path : paths) {
+    const google::protobuf::Descriptor* message = &descriptor;
+    std::vector<Field>* siblings = &fields;
+    std::vector<absl::string_view> names = absl::StrSplit(path, '.');
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (message == nullptr) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Field in path ", path, " is not a message."));
+      }
+      const google::protobuf::FieldDescriptor* field =
+          message->FindFieldByName(std::string(names[i]));
+      if (field == nullptr) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "No field ", names[i], " in ", message->full_name(), "."));
+      }
+      Field* kept = nullptr;
+      for (Field& sibling : *siblings) {
+        if (sibling.descriptor == field) {
+          kept = &sibling;
+        }
+      }
+      const bool is_last = i + 1 == names.size();
+      if (kept == nullptr) {
+        siblings->push_back({field, {}});
+        kept = &siblings->back();
+      } else if (kept->children.empty()) {
+        // The whole field is already kept.
+        break;
+      }
+      if (is_last) {
+        kept->children.clear();
+        break;
+      }
+      message = field->message_type();
+      siblings = &kept->children;
+    }
+  }
+  return MessageProjection(std::move(fields));
+}
+
+void MessageProjection::Apply(google::protobuf::Message& message) const {
+  Apply(fields_, message);
+}
+
+void MessageProjection::Apply(const std::vector<Field>& fields,
+                              google::protobuf::Message& message) {
+  const google::protobuf::Reflection* reflection = message.GetReflection();
+  std::vector<const google::protobuf::FieldDescriptor*> set_fields;
+  reflection->ListFields(message, &set_fields);
+  for (const google::protobuf::FieldDescriptor* set_field : set_fields) {
+    const Field* kept = nullptr;
+    for (const Field& field : fields) {
+      if (field.descriptor == set_field) {
+        kept = &field;
+      }
+    }
+    if (kept == nullptr) {
+      reflection->ClearField(&message, set_field);
+      continue;
+    }
+    if (kept->children.empty()) {
+      continue;
+    }
+    if (set_field->is_repeated()) {
+      const int size = reflection->FieldSize(message, set_field);
+      for (int i = 0; i < size; ++i) {
+        Apply(kept->children,
+              *reflection->MutableRepeatedMessage(&message, set_field, i));
+      }
+    } else {
+      Apply(kept->children, *reflection->MutableMessage(&message, set_field));
+    }
+  }
+}
+
+}  // namespace wfa_virtual_people
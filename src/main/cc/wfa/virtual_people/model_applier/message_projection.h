@@ -0,0 +1,63 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MESSAGE_PROJECTION_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MESSAGE_PROJECTION_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+
+namespace wfa_virtual_people {
+
+// Keeps only some fields of messages, given by paths of dot separated field
+// names, like "people.virtual_person_id". Unlike FieldMask, a path can go
+// through a repeated message field, and then applies to every element.
+class MessageProjection {
+ public:
+  // Returns error status if any of @paths is not a path of fields of
+  // @descriptor.
+  static absl::StatusOr<MessageProjection> Create(
+      const google::protobuf::Descriptor& descriptor,
+      absl::Span<const std::string> paths);
+
+  // Clears the fields of @message not in the paths. @message must be of the
+  // type of the descriptor passed to Create.
+  void Apply(google::protobuf::Message& message) const;
+
+ private:
+  // A kept field. If @children is empty, the whole field is kept. Otherwise
+  // only the children are kept in the field.
+  struct Field {
+    const google::protobuf::FieldDescriptor* descriptor;
+    std::vector<Field> children;
+  };
+
+  explicit MessageProjection(std::vector<Field> fields)
+      : fields_(std::move(fields)) {}
+
+  static void Apply(const std::vector<Field>& fields,
+                    google::protobuf::Message& message);
+
+  std::vector<Field> fields_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MESSAGE_PROJECTION_H_
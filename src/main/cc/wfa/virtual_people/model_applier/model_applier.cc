@@ -34,23 +34,120 @@
 //   --model_riegeli_path=/tmp/model_applier/model_riegeli \
 //   --input_path=/tmp/model_applier/example_input.textproto \
 //   --output_dir=/tmp/model_applier
+//
+// To parse a large input textproto on 8 threads
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/large_input.textproto \
+//   --input_threads=8 \
+//   --output_dir=/tmp/model_applier
+//
+// To apply a model to events generated in process, configured by the same
+// flags as events_generator_main
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --synthetic_input --total_events=1000000 \
+//   --output_dir=/tmp/model_applier
+//
+// To also add a LiquidLegions sketch of the virtual person ids to each row of
+// the aggregated report
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --liquid_legions_sketch \
+//   --output_dir=/tmp/model_applier
+//
+// To also add the reach at each frequency from 1+ to 10+ to each row of the
+// aggregated report
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --frequency_cap=10 \
+//   --output_dir=/tmp/model_applier
+//
+// To aggregate many events by radix sorting on 8 threads instead of hash sets
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/large_input.textproto \
+//   --aggregation_engine=sort --aggregation_threads=8 \
+//   --output_dir=/tmp/model_applier
+//
+// To write gzip compressed output_events.txt.gz and output_reports.txt.gz
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --output_compression=gzip \
+//   --output_dir=/tmp/model_applier
+//
+// To write only the aggregated report, without the per-event outputs
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --output_events=false \
+//   --output_dir=/tmp/model_applier
+//
+// To write the virtual person ids of 1% of the events, selected by the hash of
+// the event ids
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --output_events_sample_rate=0.01 \
+//   --output_event_fields=people.virtual_person_id \
+//   --output_dir=/tmp/model_applier
+//
+// To also write labeling_cost.csv, the labeling time sliced by the input
+// features
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/example_input.textproto \
+//   --labeling_cost_profile \
+//   --output_dir=/tmp/model_applier
+//
+// To write a checkpoint every 10 seconds, and continue from the last
+// checkpoint if a previous run with the same flags stopped
+//   bazel run -c opt //src/main/cc/wfa/virtual_people/model_applier -- \
+//   --model_node_path=/tmp/model_applier/model.textproto \
+//   --input_path=/tmp/model_applier/large_input.textproto \
+//   --checkpoint_interval=10s --resume \
+//   --output_dir=/tmp/model_applier
 
-#include <fcntl.h>
-
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
-#include "absl/container/flat_hash_map.h"
-#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
-#include "common_cpp/protobuf_util/riegeli_io.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "glog/logging.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/message.h"
 #include "google/protobuf/text_format.h"
+#include "src/farmhash.h"
+#include "wfa/virtual_people/common/event.pb.h"
 #include "wfa/virtual_people/common/model.pb.h"
 #include "wfa/virtual_people/core/labeler/labeler.h"
+#include "wfa/virtual_people/corpus/corpus_compiler.h"
+#include "wfa/virtual_people/events_generator/events_generator.h"
+#include "wfa/virtual_people/events_generator/events_generator_flags.h"
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+#include "wfa/virtual_people/model_applier/async_output_stream.h"
+#include "wfa/virtual_people/model_applier/checkpoint.h"
+#include "wfa/virtual_people/model_applier/labeling_cost_profile.h"
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+#include "wfa/virtual_people/model_applier/message_projection.h"
 #include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/model_loader.h"
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
 
 ABSL_FLAG(std::string, model_node_path, "",
           "Path to the virtual people model file, contains textproto of "
@@ -73,169 +170,436 @@ ABSL_FLAG(std::string, model_riegeli_path, "",
           "model_riegeli_path] must be set.");
 ABSL_FLAG(std::string, input_path, "",
           "Path to the input events, contains textproto of LabelerInputList.");
+ABSL_FLAG(uint32_t, input_threads, 1,
+          "The count of threads to parse the textproto at input_path. If more "
+          "than 1, the top-level inputs are parsed in parallel, with the same "
+          "result as parsing on one thread.");
+ABSL_FLAG(bool, synthetic_input, false,
+          "If true, input_path is ignored, and the input events are generated "
+          "in process by EventsGenerator, configured by the same flags as "
+          "events_generator_main, like --total_events. The generated events "
+          "are labeled directly without serialization.");
 ABSL_FLAG(std::string, output_dir, "", "Path to the output directory.");
+ABSL_FLAG(std::string, output_compression, "none",
+          "Compression of the output files, one of [none, gzip]. The output "
+          "files are compressed and written on a background thread, and get "
+          "the .gz extension with gzip.");
+ABSL_FLAG(bool, io_uring, true,
+          "If true, the input and output files are read and written with "
+          "several requests in flight through io_uring, when the kernel "
+          "supports it. Otherwise, or if not supported, the requests are "
+          "blocking reads and writes.");
+ABSL_FLAG(bool, output_events, true,
+          "If false, output_events.txt is not written, and only the "
+          "aggregated report is. The outputs are aggregated as they are "
+          "labeled, and are never kept in memory.");
+ABSL_FLAG(double, output_events_sample_rate, 1.0,
+          "The fraction of the events written to output_events.txt. The "
+          "events are selected by the fingerprint of the event id, so the "
+          "same events are selected in every run. The report always "
+          "aggregates all events.");
+ABSL_FLAG(std::string, output_event_fields, "",
+          "Comma separated paths of LabelerOutput fields, e.g. "
+          "people.virtual_person_id,people.label. Only these fields are "
+          "written to output_events.txt, and a path through the repeated "
+          "people applies to every person. If empty, all fields are "
+          "written.");
+ABSL_FLAG(bool, labeling_cost_profile, false,
+          "If true, the time of labeling each event is measured, and "
+          "labeling_cost.csv in output_dir breaks down the labeling time by "
+          "the user infos set in the profile, the publisher, and the "
+          "country of the inputs.");
+ABSL_FLAG(std::string, aggregation_engine, "hash",
+          "How the outputs are aggregated to the report, one of hash and "
+          "sort. hash keeps a hash set of virtual person ids for each label, "
+          "and sort appends the label and virtual person id pairs to a flat "
+          "buffer and radix sorts them, which has better locality and "
+          "predictable memory when there are many virtual people. Both "
+          "produce the same report.");
+ABSL_FLAG(uint32_t, aggregation_threads, 1,
+          "The count of threads sorting the pairs of the sort "
+          "aggregation_engine.");
+ABSL_FLAG(int32_t, frequency_cap, 0,
+          "If positive, the reach of the virtual people with frequency 1+, "
+          "2+, ..., up to this value, is added to each row of the aggregated "
+          "report. Must be no more than 255.");
+ABSL_FLAG(absl::Duration, checkpoint_interval, absl::ZeroDuration(),
+          "If positive, a checkpoint is written to output_dir at this "
+          "interval while labeling, with the count of inputs labeled, the "
+          "size of output_events.txt, and a journal of the aggregated virtual "
+          "people. Each checkpoint only syncs what was written since the "
+          "previous one. The checkpoint is removed when the run completes.");
+ABSL_FLAG(bool, resume, false,
+          "If true, and output_dir has a checkpoint of a run with the same "
+          "flags and inputs that stopped, the run continues from the "
+          "checkpoint, and writes the same outputs as a run that did not "
+          "stop. Otherwise the run starts from the first input. The labeling "
+          "cost profile only covers the inputs labeled after resuming.");
+ABSL_FLAG(bool, liquid_legions_sketch, false,
+          "If true, a LiquidLegions sketch of the virtual person ids is added "
+          "to each row of the aggregated report.");
+ABSL_FLAG(double, liquid_legions_decay_rate, 20.0,
+          "The decay rate of the LiquidLegions sketches.");
+ABSL_FLAG(int32_t, liquid_legions_size, 300000,
+          "The count of registers of the LiquidLegions sketches.");
+ABSL_FLAG(uint64_t, liquid_legions_random_seed, 0,
+          "The seed of the register hash of the LiquidLegions sketches.");
+ABSL_FLAG(int32_t, liquid_legions_deep_register, -1,
+          "The registers with index at least this value are deep, and keep "
+          "the virtual person ids that activate them. If negative, the first "
+          "inactive register of the sketch of all virtual people is used, so "
+          "only the registers after the saturated ones are deep. Sketches "
+          "with different values, e.g. from the runs of different "
+          "publishers, merge at the larger one.");
 
 constexpr char kOutputEventsFilename[] = "output_events.txt";
 constexpr char kOutputReportFilename[] = "output_reports.txt";
+constexpr char kLabelingCostFilename[] = "labeling_cost.csv";
+// The input is read in blocks of this size, with this many reads in flight.
+constexpr int kInputBlockSize = 4 << 20;
+constexpr int kInputQueueDepth = 4;
+// The time for a checkpoint is checked after this many inputs.
+constexpr int kCheckpointCheckInputs = 256;
 
 namespace wfa_virtual_people {
 
-// Read textproto from file
-void ReadTextProtoFile(absl::string_view path,
-                       google::protobuf::Message& message) {
-  int fd = open(path.data(), O_RDONLY);
-  CHECK(fd > 0) << "Unable to open file: " << path;
-  google::protobuf::io::FileInputStream file_input(fd);
-  file_input.SetCloseOnDelete(true);
-  CHECK(google::protobuf::TextFormat::Parse(&file_input, &message))
-      << "Unable to parse textproto file: " << path;
+// Create @output_dir if not exists.
+void CreateOutputDir(absl::string_view output_dir) {
+  CHECK(!output_dir.empty()) << "output_dir is not set.";
+  if (!std::filesystem::exists(output_dir)) {
+    CHECK(std::filesystem::create_directory(output_dir))
+        << "Failed to create directory: " << output_dir;
+  }
+}
+
+// Returns the compression set by --output_compression.
+OutputCompression GetOutputCompressionFromFlags() {
+  absl::StatusOr<OutputCompression> compression =
+      ParseOutputCompression(absl::GetFlag(FLAGS_output_compression));
+  CHECK(compression.ok()) << compression.status();
+  return *compression;
 }
 
-// Write textproto to file
-void WriteTextProtoFile(absl::string_view path,
-                        const google::protobuf::Message& message) {
-  // The output file is only accessible by owner.
-  int fd = open(path.data(), O_CREAT | O_WRONLY, S_IRWXU);
-  CHECK(fd > 0) << "Unable to create file: " << path;
-  google::protobuf::io::FileOutputStream file_output(fd);
-  file_output.SetCloseOnDelete(true);
-  CHECK(google::protobuf::TextFormat::Print(message, &file_output))
-      << "Unable to write textproto file: " << path;
+// Returns @filename with the extension of --output_compression.
+std::string GetOutputFilename(absl::string_view filename) {
+  return absl::StrCat(filename, GetOutputCompressionExtension(
+                                    GetOutputCompressionFromFlags()));
 }
 
-// Create Labeler from the given model.
-// If model_node_path is set, the model is represented as the single root node,
-// in CompiledNode textproto.
-// If model_nodes_path is set, the model is represented as a list of nodes, in
-// CompiledNodeList textproto.
-// If model_riegeli_path is set, the model is represented as a list of nodes,
-// in Riegeli format.
-std::unique_ptr<Labeler> GetLabeler(absl::string_view model_node_path,
-                                    absl::string_view model_nodes_path,
-                                    absl::string_view model_riegeli_path) {
-  if (!model_node_path.empty()) {
-    CompiledNode root;
-    ReadTextProtoFile(model_node_path, root);
-    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(root);
-    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
-                        << labeler.status();
-    return *std::move(labeler);
-  }
-  if (!model_nodes_path.empty()) {
-    CompiledNodeList node_list;
-    ReadTextProtoFile(model_nodes_path, node_list);
-    std::vector<CompiledNode> nodes(node_list.nodes().begin(),
-                                    node_list.nodes().end());
-    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(nodes);
-    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
-                        << labeler.status();
-    return *std::move(labeler);
-  }
-  if (!model_riegeli_path.empty()) {
-    std::vector<CompiledNode> nodes;
-    absl::Status read_status = wfa::ReadRiegeliFile(model_riegeli_path, nodes);
-    CHECK(read_status.ok())
-        << "ReadRiegeliFile failed with status: " << read_status;
-    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(nodes);
-    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
-                        << labeler.status();
-    return *std::move(labeler);
-  }
-  LOG(FATAL) << "None of [model_node_path, model_nodes_path, "
-                "model_riegeli_path] is set.";
+// Open the file @filename in @output_dir, compressed as set by
+// --output_compression.
+std::unique_ptr<AsyncOutputStream> OpenOutputFile(absl::string_view output_dir,
+                                                  absl::string_view filename) {
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(
+          absl::StrCat(output_dir, "/", GetOutputFilename(filename)),
+          GetOutputCompressionFromFlags(), absl::GetFlag(FLAGS_io_uring));
+  CHECK(output.ok()) << output.status();
+  return *std::move(output);
+}
+
+// Open the file @filename in @output_dir, written by a stopped run, to
+// continue writing after its first @size bytes.
+std::unique_ptr<AsyncOutputStream> ResumeOutputFile(
+    absl::string_view output_dir, absl::string_view filename,
+    const int64_t size) {
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Resume(
+          absl::StrCat(output_dir, "/", GetOutputFilename(filename)),
+          GetOutputCompressionFromFlags(), absl::GetFlag(FLAGS_io_uring),
+          size);
+  CHECK(output.ok()) << output.status();
+  return *std::move(output);
+}
+
+// Write the remaining bytes of @output, and close it.
+void CloseOutputFile(AsyncOutputStream& output) {
+  absl::Status status = output.Close();
+  CHECK(status.ok()) << status;
 }
 
 // Read a list of input events, in LabelerInputList textproto.
-LabelerInputList GetInputEvents(absl::string_view input_path) {
+// The file is read ahead in large blocks, with several reads in flight, and
+// the blocks are parsed in place.
+// If @threads is more than 1, the inputs are parsed on @threads threads.
+LabelerInputList GetInputEvents(absl::string_view input_path,
+                                const uint32_t threads) {
   CHECK(!input_path.empty()) << "input_path is not set.";
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(input_path, kInputBlockSize,
+                                 kInputQueueDepth,
+                                 absl::GetFlag(FLAGS_io_uring));
+  CHECK(input.ok()) << input.status();
   LabelerInputList labeler_inputs;
-  ReadTextProtoFile(input_path, labeler_inputs);
+  if (threads <= 1) {
+    CHECK(google::protobuf::TextFormat::Parse(input->get(), &labeler_inputs))
+        << "Unable to parse textproto file: " << input_path << ", "
+        << (*input)->status();
+    return labeler_inputs;
+  }
+  std::string textproto;
+  const void* data;
+  int size;
+  while ((*input)->Next(&data, &size)) {
+    textproto.append(static_cast<const char*>(data), size);
+  }
+  CHECK((*input)->status().ok()) << (*input)->status();
+  absl::Status status =
+      ParseLabelerInputList(textproto, threads, labeler_inputs);
+  CHECK(status.ok()) << "Unable to parse textproto file: " << input_path
+                     << ", " << status;
   return labeler_inputs;
 }
 
-LabelerOutputList ApplyLabeler(const Labeler& labeler,
-                               const LabelerInputList& labeler_inputs) {
-  LabelerOutputList labeler_outputs;
-  for (const LabelerInput& input : labeler_inputs.inputs()) {
-    absl::Status status = labeler.Label(input, *labeler_outputs.add_outputs());
-    CHECK(status.ok()) << "Labeling failed with status: " << status;
-  }
-  return labeler_outputs;
+// Generate a list of input events by EventsGenerator, configured by the
+// events_generator flags.
+LabelerInputList GetSyntheticInputEvents() {
+  // The inputs are all held in memory, in a list indexed by int.
+  const uint64_t total_events = absl::GetFlag(FLAGS_total_events);
+  CHECK(total_events <= std::numeric_limits<int>::max())
+      << "total_events is too large for --synthetic_input.";
+  EventsGenerator generator(GetEventsGeneratorOptionsFromFlags());
+  LabelerInputList labeler_inputs;
+  generator.AppendLabelerInputs(total_events, GetEventOptionsFromFlags(),
+                                *labeler_inputs.mutable_inputs());
+  return labeler_inputs;
 }
 
-// Represent a row in aggregated report.
-// @count represents the number of added virtual person.
-// @virtual_person_ids represents the set of unique virtual person ids.
-class AggregatedRow {
+// Selects the labeler outputs printed to output_events.txt, and the fields
+// kept in them, as set by the output_events flags.
+class EventOutputFilter {
  public:
-  AggregatedRow() : count_(0) {}
-
-  int64_t GetCount() const { return count_; }
+  EventOutputFilter() {
+    const double sample_rate = absl::GetFlag(FLAGS_output_events_sample_rate);
+    CHECK(sample_rate >= 0.0 && sample_rate <= 1.0)
+        << "output_events_sample_rate must be in [0, 1].";
+    sample_all_ = sample_rate == 1.0;
+    threshold_ = static_cast<uint64_t>(std::ldexp(sample_rate, 64));
+    const std::string fields = absl::GetFlag(FLAGS_output_event_fields);
+    if (!fields.empty()) {
+      std::vector<std::string> paths = absl::StrSplit(fields, ',');
+      absl::StatusOr<MessageProjection> projection = MessageProjection::Create(
+          *LabelerOutput::descriptor(), paths);
+      CHECK(projection.ok()) << "Invalid output_event_fields: "
+                             << projection.status();
+      projection_ = *std::move(projection);
+    }
+  }
 
-  int64_t GetUniqueVirtualPeopleCount() const {
-    return virtual_person_ids_.size();
+  // An event is selected if the fingerprint of its id is below the
+  // threshold, so the same events are selected in every run.
+  bool IsSelected(const LabelerInput& input) const {
+    if (sample_all_) {
+      return true;
+    }
+    const EventId& event_id = input.event_id();
+    const uint64_t fingerprint = event_id.id().empty()
+                                     ? event_id.id_fingerprint()
+                                     : util::Fingerprint64(event_id.id());
+    return fingerprint < threshold_;
   }
 
-  void AddVirtualPeople(const int64_t virtual_person_id) {
-    ++count_;
-    virtual_person_ids_.insert(virtual_person_id);
+  // Clear the fields of @output not in output_event_fields.
+  void Project(LabelerOutput& output) const {
+    if (projection_.has_value()) {
+      projection_->Apply(output);
+    }
   }
 
  private:
-  int64_t count_;
-  absl::flat_hash_set<int64_t> virtual_person_ids_;
+  bool sample_all_;
+  uint64_t threshold_;
+  std::optional<MessageProjection> projection_;
 };
 
-// Aggregate the output virtual people to total impressions/reach, and
-// impressions/reach by label.
-AggregatedReport AggregateOutput(const LabelerOutputList& labeler_outputs) {
-  // Map from PersonLabelAttributes to count and virtual person ids set.
-  // Key is the serialized string of PersonLabelAttributes.
-  absl::flat_hash_map<std::string, AggregatedRow> label_rows;
-  // The aggregated counts and virtual person ids set for all virtual people.
-  AggregatedRow total;
-  for (const LabelerOutput& output : labeler_outputs.outputs()) {
-    for (const VirtualPersonActivity& person : output.people()) {
-      if (person.has_label()) {
-        std::string label = person.label().SerializeAsString();
-        label_rows[label].AddVirtualPeople(person.virtual_person_id());
-      }
-      total.AddVirtualPeople(person.virtual_person_id());
-    }
-  }
+// Returns the LiquidLegions parameters set by the flags.
+LiquidLegionsConfig GetLiquidLegionsConfigFromFlags() {
+  LiquidLegionsConfig config;
+  config.decay_rate = absl::GetFlag(FLAGS_liquid_legions_decay_rate);
+  config.size = absl::GetFlag(FLAGS_liquid_legions_size);
+  config.random_seed = absl::GetFlag(FLAGS_liquid_legions_random_seed);
+  return config;
+}
 
-  AggregatedReport report;
-  AggregatedReport::Row* total_row = report.add_rows();
-  total_row->set_impressions(total.GetCount());
-  total_row->set_reach(total.GetUniqueVirtualPeopleCount());
-  for (const auto& label_row : label_rows) {
-    AggregatedReport::Row* row = report.add_rows();
-    CHECK(row->mutable_attrs()->ParseFromString(label_row.first))
-        << "Unable to parse string to PersonLabelAttributes: "
-        << label_row.first;
-    row->set_impressions(label_row.second.GetCount());
-    row->set_reach(label_row.second.GetUniqueVirtualPeopleCount());
+// Returns the ReportAggregator set by the aggregation, frequency and
+// LiquidLegions flags.
+std::unique_ptr<ReportAggregator> CreateReportAggregatorFromFlags() {
+  ReportAggregatorOptions options;
+  absl::StatusOr<AggregationEngine> engine =
+      ParseAggregationEngine(absl::GetFlag(FLAGS_aggregation_engine));
+  CHECK(engine.ok()) << engine.status();
+  options.engine = *engine;
+  options.threads = absl::GetFlag(FLAGS_aggregation_threads);
+  options.frequency_cap = absl::GetFlag(FLAGS_frequency_cap);
+  if (absl::GetFlag(FLAGS_liquid_legions_sketch)) {
+    options.sketch_config = GetLiquidLegionsConfigFromFlags();
   }
+  options.deep_register_begin =
+      absl::GetFlag(FLAGS_liquid_legions_deep_register);
+  absl::StatusOr<std::unique_ptr<ReportAggregator>> aggregator =
+      ReportAggregator::Create(options);
+  CHECK(aggregator.ok()) << aggregator.status();
+  return *std::move(aggregator);
+}
 
-  return report;
+// Returns the checkpoint in @output_dir to resume from, if any. CHECKs that
+// the checkpoint is of a run with the inputs and the output events file in
+// @run.
+std::optional<ModelApplierCheckpoint> ReadResumeCheckpoint(
+    absl::string_view output_dir, const ModelApplierCheckpoint& run) {
+  absl::StatusOr<ModelApplierCheckpoint> checkpoint =
+      ReadCheckpoint(output_dir);
+  if (absl::IsNotFound(checkpoint.status())) {
+    LOG(INFO) << "No checkpoint to resume from in " << output_dir;
+    return std::nullopt;
+  }
+  CHECK(checkpoint.ok()) << checkpoint.status();
+  CHECK(checkpoint->input_path() == run.input_path() &&
+        checkpoint->input_count() == run.input_count())
+      << "The checkpoint is of a run with different inputs: "
+      << checkpoint->input_path() << " with " << checkpoint->input_count()
+      << " inputs.";
+  CHECK(checkpoint->events_filename() == run.events_filename())
+      << "The checkpoint is of a run with different output events: "
+      << checkpoint->events_filename();
+  CHECK(checkpoint->labeled_inputs() <= checkpoint->input_count())
+      << "Invalid checkpoint: " << checkpoint->ShortDebugString();
+  return *std::move(checkpoint);
 }
 
-// Write the labeler output and aggregated report to @output_dir.
-// Create the directory if not exists.
-void WriteOutput(absl::string_view output_dir,
-                 const LabelerOutputList& labeler_outputs,
-                 const AggregatedReport& report) {
-  CHECK(!output_dir.empty()) << "output_dir is not set.";
+// Writes a checkpoint to the output directory after an input is labeled,
+// when the interval has passed since the previous one. The virtual people of
+// the outputs are appended to the aggregation journal as they are aggregated,
+// and a checkpoint flushes the journal and the output events, and records
+// their sizes with the count of labeled inputs.
+class Checkpointer {
+ public:
+  // @run has the inputs of the run. If @resumed is set, the journal is
+  // continued from it.
+  Checkpointer(absl::string_view output_dir, const absl::Duration interval,
+               const ModelApplierCheckpoint& run,
+               const std::optional<ModelApplierCheckpoint>& resumed,
+               AsyncOutputStream* events_output)
+      : output_dir_(output_dir),
+        interval_(interval),
+        checkpoint_(run),
+        events_output_(events_output),
+        last_checkpoint_time_(absl::Now()) {
+    const bool use_io_uring = absl::GetFlag(FLAGS_io_uring);
+    absl::StatusOr<std::unique_ptr<AggregationJournal>> journal =
+        resumed.has_value()
+            ? AggregationJournal::Resume(output_dir, use_io_uring,
+                                         resumed->journal_size())
+            : AggregationJournal::Open(output_dir, use_io_uring);
+    CHECK(journal.ok()) << journal.status();
+    journal_ = *std::move(journal);
+  }
 
-  if (!std::filesystem::exists(output_dir)) {
-    CHECK(std::filesystem::create_directory(output_dir))
-        << "Failed to create directory: " << output_dir;
+  // Appends the virtual people of @output to the journal.
+  void Add(const LabelerOutput& output) {
+    CHECK(journal_->Add(output)) << "Unable to write the journal.";
   }
 
-  WriteTextProtoFile(absl::StrCat(output_dir, "/", kOutputEventsFilename),
-                     labeler_outputs);
-  WriteTextProtoFile(absl::StrCat(output_dir, "/", kOutputReportFilename),
-                     report);
+  // Writes a checkpoint if the interval has passed, where @labeled_inputs is
+  // the count of inputs whose outputs are added and written.
+  void MaybeWrite(const int64_t labeled_inputs) {
+    if (labeled_inputs % kCheckpointCheckInputs != 0 ||
+        absl::Now() - last_checkpoint_time_ < interval_) {
+      return;
+    }
+    if (events_output_ != nullptr) {
+      absl::StatusOr<int64_t> events_size = events_output_->Flush();
+      CHECK(events_size.ok()) << events_size.status();
+      checkpoint_.set_events_size(*events_size);
+    }
+    absl::StatusOr<int64_t> journal_size = journal_->Flush();
+    CHECK(journal_size.ok()) << journal_size.status();
+    checkpoint_.set_journal_size(*journal_size);
+    checkpoint_.set_labeled_inputs(labeled_inputs);
+    absl::Status status = WriteCheckpoint(output_dir_, checkpoint_);
+    CHECK(status.ok()) << status;
+    last_checkpoint_time_ = absl::Now();
+  }
+
+  void Close() {
+    absl::Status status = journal_->Close();
+    CHECK(status.ok()) << status;
+  }
+
+ private:
+  const std::string output_dir_;
+  const absl::Duration interval_;
+  ModelApplierCheckpoint checkpoint_;
+  AsyncOutputStream* events_output_;
+  std::unique_ptr<AggregationJournal> journal_;
+  absl::Time last_checkpoint_time_;
+};
+
+// Label each input from @first_input, and add each output to @aggregator.
+// If @events_output is not null, the outputs selected by @filter are
+// projected and printed to it as soon as they are labeled, so that the
+// compression and the writes on the background thread of @events_output
+// overlap with labeling. With every output selected and no projection, the
+// printed text is the same as printing the LabelerOutputList of all outputs.
+// If @cost_profile is not null, the time of each Label call is recorded in it.
+// If @checkpointer is not null, each output is added to it, and it is given
+// the chance to write a checkpoint after each input.
+void ApplyLabeler(const Labeler& labeler,
+                  const LabelerInputList& labeler_inputs,
+                  const int first_input, const EventOutputFilter& filter,
+                  ReportAggregator& aggregator,
+                  AsyncOutputStream* events_output,
+                  LabelingCostProfile* cost_profile,
+                  Checkpointer* checkpointer) {
+  google::protobuf::TextFormat::Printer printer;
+  printer.SetInitialIndentLevel(1);
+  LabelerOutput output;
+  for (int i = first_input; i < labeler_inputs.inputs_size(); ++i) {
+    const LabelerInput& input = labeler_inputs.inputs(i);
+    output.Clear();
+    absl::Status status;
+    if (cost_profile == nullptr) {
+      status = labeler.Label(input, output);
+    } else {
+      absl::Time start = absl::Now();
+      status = labeler.Label(input, output);
+      cost_profile->Record(input, absl::Now() - start);
+    }
+    CHECK(status.ok()) << "Labeling failed with status: " << status;
+    aggregator.Add(output);
+    if (checkpointer != nullptr) {
+      checkpointer->Add(output);
+    }
+    if (events_output != nullptr && filter.IsSelected(input)) {
+      filter.Project(output);
+      CHECK(events_output->Write("outputs {\n") &&
+            printer.Print(output, events_output) &&
+            events_output->Write("}\n"))
+          << "Unable to write the output events.";
+    }
+    if (checkpointer != nullptr) {
+      checkpointer->MaybeWrite(i + 1);
+    }
+  }
+}
+
+// Write the labeling cost breakdown to @output_dir.
+void WriteLabelingCost(absl::string_view output_dir,
+                       const LabelingCostProfile& cost_profile) {
+  std::unique_ptr<AsyncOutputStream> output =
+      OpenOutputFile(output_dir, kLabelingCostFilename);
+  CHECK(output->Write(cost_profile.ToCsv()))
+      << "Unable to write the labeling cost.";
+  CloseOutputFile(*output);
+}
+
+// Write the aggregated report to @output_dir.
+void WriteReport(absl::string_view output_dir, const AggregatedReport& report) {
+  std::unique_ptr<AsyncOutputStream> output =
+      OpenOutputFile(output_dir, kOutputReportFilename);
+  CHECK(google::protobuf::TextFormat::Print(report, output.get()))
+      << "Unable to write the aggregated report.";
+  CloseOutputFile(*output);
 }
 
 }  // namespace wfa_virtual_people
@@ -250,16 +614,93 @@ int main(int argc, char** argv) {
                                      absl::GetFlag(FLAGS_model_riegeli_path));
 
   wfa_virtual_people::LabelerInputList labeler_inputs =
-      wfa_virtual_people::GetInputEvents(absl::GetFlag(FLAGS_input_path));
+      absl::GetFlag(FLAGS_synthetic_input)
+          ? wfa_virtual_people::GetSyntheticInputEvents()
+          : wfa_virtual_people::GetInputEvents(
+                absl::GetFlag(FLAGS_input_path),
+                absl::GetFlag(FLAGS_input_threads));
+
+  const std::string output_dir = absl::GetFlag(FLAGS_output_dir);
+  wfa_virtual_people::CreateOutputDir(output_dir);
+
+  // The inputs and the outputs of the run, which a checkpoint to resume from
+  // must match.
+  wfa_virtual_people::ModelApplierCheckpoint run;
+  if (!absl::GetFlag(FLAGS_synthetic_input)) {
+    run.set_input_path(absl::GetFlag(FLAGS_input_path));
+  }
+  run.set_input_count(labeler_inputs.inputs_size());
+  if (absl::GetFlag(FLAGS_output_events)) {
+    run.set_events_filename(
+        wfa_virtual_people::GetOutputFilename(kOutputEventsFilename));
+  }
+  std::optional<wfa_virtual_people::ModelApplierCheckpoint> resumed;
+  if (absl::GetFlag(FLAGS_resume)) {
+    resumed = wfa_virtual_people::ReadResumeCheckpoint(output_dir, run);
+  }
 
-  wfa_virtual_people::LabelerOutputList labeler_outputs =
-      wfa_virtual_people::ApplyLabeler(*labeler, labeler_inputs);
+  std::unique_ptr<wfa_virtual_people::AsyncOutputStream> events_output;
+  if (absl::GetFlag(FLAGS_output_events)) {
+    events_output = resumed.has_value()
+                        ? wfa_virtual_people::ResumeOutputFile(
+                              output_dir, kOutputEventsFilename,
+                              resumed->events_size())
+                        : wfa_virtual_people::OpenOutputFile(
+                              output_dir, kOutputEventsFilename);
+  }
+  wfa_virtual_people::EventOutputFilter filter;
+  std::unique_ptr<wfa_virtual_people::ReportAggregator> aggregator =
+      wfa_virtual_people::CreateReportAggregatorFromFlags();
+  int first_input = 0;
+  if (resumed.has_value()) {
+    absl::Time replay_start = absl::Now();
+    absl::Status status = wfa_virtual_people::ReplayAggregationJournal(
+        output_dir, resumed->journal_size(), absl::GetFlag(FLAGS_io_uring),
+        *aggregator);
+    CHECK(status.ok()) << status;
+    first_input = resumed->labeled_inputs();
+    LOG(INFO) << "Resumed after " << first_input << " events, replaying the "
+              << "aggregation journal in " << absl::Now() - replay_start;
+  }
+  std::optional<wfa_virtual_people::Checkpointer> checkpointer;
+  const absl::Duration checkpoint_interval =
+      absl::GetFlag(FLAGS_checkpoint_interval);
+  if (checkpoint_interval > absl::ZeroDuration()) {
+    checkpointer.emplace(output_dir, checkpoint_interval, run, resumed,
+                         events_output.get());
+  }
+  std::optional<wfa_virtual_people::LabelingCostProfile> cost_profile;
+  if (absl::GetFlag(FLAGS_labeling_cost_profile)) {
+    cost_profile.emplace();
+  }
 
-  wfa_virtual_people::AggregatedReport report =
-      wfa_virtual_people::AggregateOutput(labeler_outputs);
+  absl::Time labeling_start = absl::Now();
+  wfa_virtual_people::ApplyLabeler(
+      *labeler, labeler_inputs, first_input, filter, *aggregator,
+      events_output.get(),
+      cost_profile.has_value() ? &*cost_profile : nullptr,
+      checkpointer.has_value() ? &*checkpointer : nullptr);
+  absl::Duration labeling_time = absl::Now() - labeling_start;
+  if (events_output != nullptr) {
+    wfa_virtual_people::CloseOutputFile(*events_output);
+  }
+  if (checkpointer.has_value()) {
+    checkpointer->Close();
+  }
+  const int labeled_count = labeler_inputs.inputs_size() - first_input;
+  LOG(INFO) << "Labeled and aggregated " << labeled_count << " events in "
+            << labeling_time << ", "
+            << labeled_count / absl::ToDoubleSeconds(labeling_time)
+            << " events per second.";
 
-  wfa_virtual_people::WriteOutput(absl::GetFlag(FLAGS_output_dir),
-                                  labeler_outputs, report);
+  wfa_virtual_people::WriteReport(output_dir, aggregator->GetReport());
+  if (cost_profile.has_value()) {
+    wfa_virtual_people::WriteLabelingCost(output_dir, *cost_profile);
+  }
+  // The outputs are complete, and a checkpoint left by this or an earlier run
+  // no longer matches them.
+  absl::Status status = wfa_virtual_people::RemoveCheckpoint(output_dir);
+  CHECK(status.ok()) << status;
 
   return 0;
 }
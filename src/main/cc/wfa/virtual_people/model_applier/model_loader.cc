@@ -0,0 +1,82 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/model_loader.h"
+
+#include <fcntl.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "common_cpp/protobuf_util/riegeli_io.h"
+#include "glog/logging.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/text_format.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/core/labeler/labeler.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+void ReadTextProtoFile(absl::string_view path,
+                       google::protobuf::Message& message) {
+  int fd = open(path.data(), O_RDONLY);
+  CHECK(fd > 0) << "Unable to open file: " << path;
+  google::protobuf::io::FileInputStream file_input(fd);
+  file_input.SetCloseOnDelete(true);
+  CHECK(google::protobuf::TextFormat::Parse(&file_input, &message))
+      << "Unable to parse textproto file: " << path;
+}
+
+std::unique_ptr<Labeler> GetLabeler(absl::string_view model_node_path,
+                                    absl::string_view model_nodes_path,
+                                    absl::string_view model_riegeli_path) {
+  if (!model_node_path.empty()) {
+    CompiledNode root;
+    ReadTextProtoFile(model_node_path, root);
+    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(root);
+    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
+                        << labeler.status();
+    return *std::move(labeler);
+  }
+  if (!model_nodes_path.empty()) {
+    CompiledNodeList node_list;
+    ReadTextProtoFile(model_nodes_path, node_list);
+    std::vector<CompiledNode> nodes(node_list.nodes().begin(),
+                                    node_list.nodes().end());
+    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(nodes);
+    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
+                        << labeler.status();
+    return *std::move(labeler);
+  }
+  if (!model_riegeli_path.empty()) {
+    std::vector<CompiledNode> nodes;
+    absl::Status read_status = wfa::ReadRiegeliFile(model_riegeli_path, nodes);
+    CHECK(read_status.ok())
+        << "ReadRiegeliFile failed with status: " << read_status;
+    absl::StatusOr<std::unique_ptr<Labeler>> labeler = Labeler::Build(nodes);
+    CHECK(labeler.ok()) << "Creating Labeler failed with status: "
+                        << labeler.status();
+    return *std::move(labeler);
+  }
+  LOG(FATAL) << "None of [model_node_path, model_nodes_path, "
+                "model_riegeli_path] is set.";
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,43 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MODEL_LOADER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MODEL_LOADER_H_
+
+#include <memory>
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/message.h"
+#include "wfa/virtual_people/core/labeler/labeler.h"
+
+namespace wfa_virtual_people {
+
+// Read textproto from file
+void ReadTextProtoFile(absl::string_view path,
+                       google::protobuf::Message& message);
+
+// Create Labeler from the given model.
+// If model_node_path is set, the model is represented as the single root node,
+// in CompiledNode textproto.
+// If model_nodes_path is set, the model is represented as a list of nodes, in
+// CompiledNodeList textproto.
+// If model_riegeli_path is set, the model is represented as a list of nodes,
+// in Riegeli format.
+std::unique_ptr<Labeler> GetLabeler(absl::string_view model_node_path,
+                                    absl::string_view model_nodes_path,
+                                    absl::string_view model_riegeli_path);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_MODEL_LOADER_H_
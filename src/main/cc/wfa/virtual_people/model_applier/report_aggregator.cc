@@ -0,0 +1,376 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/sorted_pair_counter.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// Builds the reach, frequency_reach and sketch of a row from the frequency of
+// each of its virtual people.
+class RowBuilder {
+ public:
+  RowBuilder(const int frequency_cap,
+             const std::optional<LiquidLegionsSketchBuilder>& empty_sketch)
+      : reach_(0), frequency_reach_(frequency_cap, 0), sketch_(empty_sketch) {}
+
+  void Add(const int64_t virtual_person_id, const int64_t frequency) {
+    ++reach_;
+    if (!frequency_reach_.empty()) {
+      ++frequency_reach_[std::min<int64_t>(frequency,
+                                           frequency_reach_.size()) -
+                         1];
+    }
+    if (sketch_.has_value()) {
+      sketch_->Add(virtual_person_id);
+    }
+  }
+
+  void WriteTo(AggregatedReport::Row& row) {
+    row.set_reach(reach_);
+    if (!frequency_reach_.empty()) {
+      // The frequencies above the cap are counted at the cap, so accumulating
+      // from the cap down gives the reach at each frequency or more.
+      for (int i = static_cast<int>(frequency_reach_.size()) - 2; i >= 0;
+           --i) {
+        frequency_reach_[i] += frequency_reach_[i + 1];
+      }
+      row.mutable_frequency_reach()->Add(frequency_reach_.begin(),
+                                         frequency_reach_.end());
+    }
+    if (sketch_.has_value()) {
+      *row.mutable_sketch() = sketch_->ToProto();
+    }
+  }
+
+ private:
+  int64_t reach_;
+  std::vector<int64_t> frequency_reach_;
+  std::optional<LiquidLegionsSketchBuilder> sketch_;
+};
+
+// Returns the empty sketch that every row starts with, or nullopt if sketches
+// are not built. @for_each_total_id(fn) must call fn with each virtual person
+// id of the total row.
+// If the deep register is not set, it is the first inactive register of the
+// sketch of all virtual people. Then every register before it is activated by
+// some virtual person, and the deep registers are the ones that are rarely
+// activated.
+template <typename ForEachTotalId>
+std::optional<LiquidLegionsSketchBuilder> GetEmptySketch(
+    const ReportAggregatorOptions& options,
+    const ForEachTotalId& for_each_total_id) {
+  if (!options.sketch_config.has_value()) {
+    return std::nullopt;
+  }
+  const LiquidLegionsConfig& config = *options.sketch_config;
+  int32_t deep_register_begin = options.deep_register_begin;
+  if (deep_register_begin < 0) {
+    LiquidLegionsSketchBuilder universe(config, config.size);
+    for_each_total_id([&universe](const int64_t virtual_person_id) {
+      universe.Add(virtual_person_id);
+    });
+    deep_register_begin = universe.GetFirstInactiveRegister();
+    LOG(INFO) << "LiquidLegions registers from " << deep_register_begin
+              << " are deep.";
+  }
+  return LiquidLegionsSketchBuilder(config, deep_register_begin);
+}
+
+// Adds a row with the attrs parsed from @serialized_attrs to @report.
+AggregatedReport::Row& AddLabelRow(const std::string& serialized_attrs,
+                                   AggregatedReport& report) {
+  AggregatedReport::Row* row = report.add_rows();
+  CHECK(row->mutable_attrs()->ParseFromString(serialized_attrs))
+      << "Unable to parse string to PersonLabelAttributes: "
+      << serialized_attrs;
+  return *row;
+}
+
+// The largest frequency counted for each virtual person by the kHash engine.
+// Higher frequencies are counted as this value.
+constexpr int kMaxFrequency = ReportAggregator::kMaxFrequencyCap;
+
+// Represent a row in aggregated report.
+// @count represents the number of added virtual person.
+// If kCountFrequencies, @virtual_people maps each unique virtual person id to
+// the number of times it is added, up to kMaxFrequency. The map has 16 byte
+// slots, with the padding after the one byte counter. Otherwise
+// @virtual_people is the set of unique virtual person ids, with 8 byte slots,
+// and the frequencies are not counted.
+template <bool kCountFrequencies>
+class AggregatedRow {
+ public:
+  AggregatedRow() : count_(0) {}
+
+  // Calls @fn(virtual_person_id, frequency) for each unique virtual person.
+  // Without kCountFrequencies, the frequency is always 1.
+  template <typename Fn>
+  void ForEachVirtualPerson(const Fn& fn) const {
+    if constexpr (kCountFrequencies) {
+      for (const auto& [virtual_person_id, frequency] : virtual_people_) {
+        fn(virtual_person_id, frequency);
+      }
+    } else {
+      for (const int64_t virtual_person_id : virtual_people_) {
+        fn(virtual_person_id, 1);
+      }
+    }
+  }
+
+  void AddVirtualPeople(const int64_t virtual_person_id) {
+    ++count_;
+    if constexpr (kCountFrequencies) {
+      uint8_t& frequency = virtual_people_[virtual_person_id];
+      if (frequency < kMaxFrequency) {
+        ++frequency;
+      }
+    } else {
+      virtual_people_.insert(virtual_person_id);
+    }
+  }
+
+  // Sets the counts of @row, and the optional fields set by @frequency_cap and
+  // @empty_sketch.
+  void WriteTo(const int frequency_cap,
+               const std::optional<LiquidLegionsSketchBuilder>& empty_sketch,
+               AggregatedReport::Row& row) const {
+    row.set_impressions(count_);
+    RowBuilder builder(frequency_cap, empty_sketch);
+    ForEachVirtualPerson(
+        [&builder](const int64_t virtual_person_id, const int frequency) {
+          builder.Add(virtual_person_id, frequency);
+        });
+    builder.WriteTo(row);
+  }
+
+ private:
+  int64_t count_;
+  std::conditional_t<kCountFrequencies, absl::flat_hash_map<int64_t, uint8_t>,
+                     absl::flat_hash_set<int64_t>>
+      virtual_people_;
+};
+
+// The frequencies are only counted with a positive frequency_cap, so that
+// the rows without frequencies take half the memory.
+template <bool kCountFrequencies>
+class HashReportAggregator : public ReportAggregator {
+ public:
+  explicit HashReportAggregator(const ReportAggregatorOptions& options)
+      : options_(options) {}
+
+  void Add(const LabelerOutput& output) override {
+    for (const VirtualPersonActivity& person : output.people()) {
+      if (person.has_label()) {
+        label_rows_[person.label().SerializeAsString()].AddVirtualPeople(
+            person.virtual_person_id());
+      }
+      total_.AddVirtualPeople(person.virtual_person_id());
+    }
+  }
+
+  AggregatedReport GetReport() override {
+    const std::optional<LiquidLegionsSketchBuilder> empty_sketch =
+        GetEmptySketch(options_, [this](const auto& fn) {
+          total_.ForEachVirtualPerson(
+              [&fn](const int64_t virtual_person_id, const int frequency) {
+                fn(virtual_person_id);
+              });
+        });
+    AggregatedReport report;
+    if (options_.frequency_cap > 0) {
+      report.set_frequency_cap(options_.frequency_cap);
+    }
+    total_.WriteTo(options_.frequency_cap, empty_sketch, *report.add_rows());
+    for (const auto& label_row : label_rows_) {
+      label_row.second.WriteTo(options_.frequency_cap, empty_sketch,
+                               AddLabelRow(label_row.first, report));
+    }
+    return report;
+  }
+
+ private:
+  ReportAggregatorOptions options_;
+  // The aggregated counts and virtual person frequencies for all virtual
+  // people.
+  AggregatedRow<kCountFrequencies> total_;
+  // Map from PersonLabelAttributes to count and virtual person frequencies.
+  // Key is the serialized string of PersonLabelAttributes.
+  absl::flat_hash_map<std::string, AggregatedRow<kCountFrequencies>>
+      label_rows_;
+};
+
+class SortReportAggregator : public ReportAggregator {
+ public:
+  explicit SortReportAggregator(const ReportAggregatorOptions& options)
+      : options_(options), impressions_(1, 0) {}
+
+  void Add(const LabelerOutput& output) override {
+    for (const VirtualPersonActivity& person : output.people()) {
+      uint32_t key = kUnlabeledKey;
+      if (person.has_label()) {
+        auto [it, inserted] = label_keys_.try_emplace(
+            person.label().SerializeAsString(), impressions_.size());
+        if (inserted) {
+          labels_.push_back(it->first);
+          impressions_.push_back(0);
+        }
+        key = it->second;
+      }
+      pairs_.Add(key, person.virtual_person_id());
+      ++impressions_[key];
+    }
+  }
+
+  AggregatedReport GetReport() override {
+    pairs_.Sort(options_.threads);
+    const std::optional<LiquidLegionsSketchBuilder> empty_sketch =
+        GetEmptySketch(options_, [this](const auto& fn) {
+          ForEachVirtualPerson(
+              [&fn](const int64_t virtual_person_id, const int64_t frequency) {
+                fn(virtual_person_id);
+              });
+        });
+
+    // The pairs of each virtual person are consecutive, so the rows of all
+    // the labels are built in one scan, and the total row from the sum of the
+    // counts of each virtual person.
+    std::vector<RowBuilder> builders(
+        labels_.size() + 1, RowBuilder(options_.frequency_cap, empty_sketch));
+    ForEachVirtualPerson(
+        [&builders](const int64_t virtual_person_id, const int64_t frequency) {
+          builders[kTotalRow].Add(virtual_person_id, frequency);
+        },
+        [&builders](const uint32_t key, const int64_t virtual_person_id,
+                    const int64_t count) {
+          if (key != kUnlabeledKey) {
+            builders[key].Add(virtual_person_id, count);
+          }
+        });
+
+    AggregatedReport report;
+    if (options_.frequency_cap > 0) {
+      report.set_frequency_cap(options_.frequency_cap);
+    }
+    AggregatedReport::Row& total_row = *report.add_rows();
+    total_row.set_impressions(pairs_.size());
+    builders[kTotalRow].WriteTo(total_row);
+    for (size_t i = 0; i < labels_.size(); ++i) {
+      const uint32_t key = i + 1;
+      AggregatedReport::Row& row = AddLabelRow(labels_[i], report);
+      row.set_impressions(impressions_[key]);
+      builders[key].WriteTo(row);
+    }
+    return report;
+  }
+
+ private:
+  // The key of the people without label. The key of each label is its index
+  // in labels_ plus 1, which is also the index of its row in the report.
+  static constexpr uint32_t kUnlabeledKey = 0;
+  static constexpr uint32_t kTotalRow = 0;
+
+  // Calls @fn(virtual_person_id, frequency) for each virtual person, and
+  // @run_fn(key, virtual_person_id, count) for each of its pairs before that.
+  // Sort must be called after the last Add.
+  template <typename Fn, typename RunFn>
+  void ForEachVirtualPerson(const Fn& fn, const RunFn& run_fn) const {
+    int64_t current_id = 0;
+    int64_t frequency = 0;
+    pairs_.ForEachRun([&](const uint32_t key, const int64_t virtual_person_id,
+                          const int64_t count) {
+      if (frequency > 0 && virtual_person_id != current_id) {
+        fn(current_id, frequency);
+        frequency = 0;
+      }
+      current_id = virtual_person_id;
+      frequency += count;
+      run_fn(key, virtual_person_id, count);
+    });
+    if (frequency > 0) {
+      fn(current_id, frequency);
+    }
+  }
+
+  template <typename Fn>
+  void ForEachVirtualPerson(const Fn& fn) const {
+    ForEachVirtualPerson(fn, [](uint32_t, int64_t, int64_t) {});
+  }
+
+  ReportAggregatorOptions options_;
+  // Map from the serialized PersonLabelAttributes to the key of the label.
+  absl::flat_hash_map<std::string, uint32_t> label_keys_;
+  // The serialized PersonLabelAttributes of each label, in the order of keys.
+  std::vector<std::string> labels_;
+  // The impressions of each key.
+  std::vector<int64_t> impressions_;
+  SortedPairCounter pairs_;
+};
+
+}  // namespace
+
+absl::StatusOr<AggregationEngine> ParseAggregationEngine(
+    absl::string_view name) {
+  if (name == "hash") {
+    return AggregationEngine::kHash;
+  }
+  if (name == "sort") {
+    return AggregationEngine::kSort;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown aggregation engine: ", name));
+}
+
+absl::StatusOr<std::unique_ptr<ReportAggregator>> ReportAggregator::Create(
+    const ReportAggregatorOptions& options) {
+  if (options.frequency_cap < 0 || options.frequency_cap > kMaxFrequencyCap) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("frequency_cap must be in [0, ", kMaxFrequencyCap,
+                     "], got ", options.frequency_cap));
+  }
+  switch (options.engine) {
+    case AggregationEngine::kHash:
+      if (options.frequency_cap > 0) {
+        return std::make_unique<HashReportAggregator<true>>(options);
+      }
+      return std::make_unique<HashReportAggregator<false>>(options);
+    case AggregationEngine::kSort:
+      return std::make_unique<SortReportAggregator>(options);
+  }
+  return absl::InvalidArgumentError("Unknown aggregation engine.");
+}
+
+}  // namespace wfa_virtual_people
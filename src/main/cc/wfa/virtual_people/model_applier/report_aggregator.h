@@ -0,0 +1,92 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_REPORT_AGGREGATOR_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_REPORT_AGGREGATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+
+// The ways to aggregate the labeler outputs. All of them produce the same
+// report.
+enum class AggregationEngine {
+  // Keeps a hash map from each label to the hash map of the frequencies of its
+  // virtual people. The memory grows with the count of distinct label and
+  // virtual person pairs.
+  kHash,
+  // Appends each label and virtual person pair to a flat buffer, and counts
+  // the pairs with SortedPairCounter when the report is requested. The memory
+  // grows with the count of added pairs. The rows of all the labels are built
+  // at the same time, so with sketches there is one sketch per label in
+  // memory.
+  kSort,
+};
+
+// Returns the engine of @name, which is one of "hash" and "sort".
+absl::StatusOr<AggregationEngine> ParseAggregationEngine(
+    absl::string_view name);
+
+struct ReportAggregatorOptions {
+  AggregationEngine engine = AggregationEngine::kHash;
+  // If positive, the reach at each frequency from 1+ to frequency_cap+ is set
+  // in each row. Must be no more than ReportAggregator::kMaxFrequencyCap.
+  int frequency_cap = 0;
+  // If set, a LiquidLegions sketch of the virtual person ids is set in each
+  // row. The sketches are built by GetReport from the exact virtual people of
+  // each row, so they take no less memory than the exact reach.
+  std::optional<LiquidLegionsConfig> sketch_config;
+  // The registers of the sketches with index at least this value are deep. If
+  // negative, the first inactive register of the sketch of all the virtual
+  // people added is used, which differs between runs with different outputs.
+  // The sketches of such runs still merge, at the larger value.
+  int32_t deep_register_begin = -1;
+  // The count of threads sorting the pairs, for the kSort engine.
+  int threads = 1;
+};
+
+// Aggregates the labeler outputs to total impressions/reach, and
+// impressions/reach by label. The outputs are added one at a time, so they
+// need not be kept after labeling.
+// ReportAggregator is not thread-safe.
+class ReportAggregator {
+ public:
+  static constexpr int kMaxFrequencyCap = 255;
+
+  // Returns error status if @options are invalid.
+  static absl::StatusOr<std::unique_ptr<ReportAggregator>> Create(
+      const ReportAggregatorOptions& options);
+
+  virtual ~ReportAggregator() = default;
+
+  // Adds the virtual people of @output. The people without label only count
+  // in the total.
+  virtual void Add(const LabelerOutput& output) = 0;
+
+  // Returns the report of all the added outputs. The first row is the total of
+  // all virtual people, followed by one row per label.
+  virtual AggregatedReport GetReport() = 0;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_REPORT_AGGREGATOR_H_
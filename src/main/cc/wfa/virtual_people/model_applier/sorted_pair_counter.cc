@@ -0,0 +1,225 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/sorted_pair_counter.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The pairs are sorted as 96 bit integers, with the virtual person id in the
+// high bits, one byte at a time from the highest byte.
+constexpr int kDigitBits = 8;
+constexpr int kBucketCount = 1 << kDigitBits;
+constexpr int kIdDigitCount = 8;
+constexpr int kDigitCount = kIdDigitCount + 4;
+// Ranges of at most this many pairs are sorted with std::sort.
+constexpr size_t kComparisonSortSize = 64;
+// Below this many pairs per thread, starting the threads costs more than the
+// sorting they share.
+constexpr size_t kMinPairsPerThread = 1 << 16;
+
+using Histogram = std::array<size_t, kBucketCount>;
+
+// Calls @fn(range, begin, end) for @range_count consecutive ranges of
+// [0, @size), each in its own thread.
+void ParallelFor(const int range_count, const size_t size,
+                 const std::function<void(int, size_t, size_t)>& fn) {
+  if (range_count == 1) {
+    fn(0, 0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int i = 0; i < range_count; ++i) {
+    workers.emplace_back(fn, i, size * i / range_count,
+                         size * (i + 1) / range_count);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+}  // namespace
+
+size_t SortedPairCounter::GetDigit(const Pair& pair, const int digit) {
+  return digit < kIdDigitCount
+             ? (pair.virtual_person_id >>
+                ((kIdDigitCount - 1 - digit) * kDigitBits)) &
+                   (kBucketCount - 1)
+             : (pair.key >> ((kDigitCount - 1 - digit) * kDigitBits)) &
+                   (kBucketCount - 1);
+}
+
+bool SortedPairCounter::Less(const Pair& a, const Pair& b) {
+  return a.virtual_person_id != b.virtual_person_id
+             ? a.virtual_person_id < b.virtual_person_id
+             : a.key < b.key;
+}
+
+void SortedPairCounter::SortRange(Pair* const pairs, Pair* const buffer,
+                                  const size_t size, int digit) {
+  if (size <= kComparisonSortSize) {
+    std::sort(pairs, pairs + size, Less);
+    return;
+  }
+  Histogram counts;
+  // Skip the digits that are the same for all the pairs, e.g. the high bytes
+  // of small keys.
+  for (; digit < kDigitCount; ++digit) {
+    counts.fill(0);
+    for (size_t i = 0; i < size; ++i) {
+      ++counts[GetDigit(pairs[i], digit)];
+    }
+    if (*std::max_element(counts.begin(), counts.end()) < size) {
+      break;
+    }
+  }
+  if (digit == kDigitCount) {
+    return;
+  }
+  Histogram offsets;
+  size_t offset = 0;
+  for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+    offsets[bucket] = offset;
+    offset += counts[bucket];
+  }
+  for (size_t i = 0; i < size; ++i) {
+    buffer[offsets[GetDigit(pairs[i], digit)]++] = pairs[i];
+  }
+  std::memcpy(pairs, buffer, size * sizeof(Pair));
+  size_t begin = 0;
+  for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+    if (counts[bucket] > 1) {
+      SortRange(pairs + begin, buffer + begin, counts[bucket], digit + 1);
+    }
+    begin += counts[bucket];
+  }
+}
+
+std::vector<SortedPairCounter::Range> SortedPairCounter::PartitionRange(
+    const Range& range, const int threads, std::vector<Pair>& buffer) {
+  Pair* const pairs = pairs_.data() + range.begin;
+  const size_t size = range.end - range.begin;
+  const int range_count = static_cast<int>(std::clamp<size_t>(
+      size / kMinPairsPerThread, 1, static_cast<size_t>(threads)));
+  std::vector<Histogram> histograms(range_count);
+  int digit = range.digit;
+  Histogram counts;
+  for (; digit < kDigitCount; ++digit) {
+    ParallelFor(range_count, size,
+                [&](const int thread, const size_t begin, const size_t end) {
+                  Histogram& histogram = histograms[thread];
+                  histogram.fill(0);
+                  for (size_t i = begin; i < end; ++i) {
+                    ++histogram[GetDigit(pairs[i], digit)];
+                  }
+                });
+    counts.fill(0);
+    for (const Histogram& histogram : histograms) {
+      for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+        counts[bucket] += histogram[bucket];
+      }
+    }
+    if (*std::max_element(counts.begin(), counts.end()) < size) {
+      break;
+    }
+  }
+  if (digit == kDigitCount) {
+    return {};
+  }
+
+  // Each thread writes its pairs of each bucket after the ones of the
+  // previous threads, so the partition is stable.
+  size_t offset = 0;
+  for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+    for (Histogram& histogram : histograms) {
+      const size_t count = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += count;
+    }
+  }
+  Pair* const partitioned = buffer.data() + range.begin;
+  ParallelFor(range_count, size,
+              [&](const int thread, const size_t begin, const size_t end) {
+                Histogram& offsets = histograms[thread];
+                for (size_t i = begin; i < end; ++i) {
+                  partitioned[offsets[GetDigit(pairs[i], digit)]++] = pairs[i];
+                }
+              });
+  ParallelFor(range_count, size,
+              [&](const int thread, const size_t begin, const size_t end) {
+                std::memcpy(pairs + begin, partitioned + begin,
+                            (end - begin) * sizeof(Pair));
+              });
+
+  std::vector<Range> buckets;
+  size_t begin = range.begin;
+  for (int bucket = 0; bucket < kBucketCount; ++bucket) {
+    if (counts[bucket] > 1) {
+      buckets.push_back({begin, begin + counts[bucket], digit + 1});
+    }
+    begin += counts[bucket];
+  }
+  return buckets;
+}
+
+void SortedPairCounter::Sort(int threads) {
+  threads = std::max(threads, 1);
+  std::vector<Pair> buffer(pairs_.size());
+  // Partition the ranges larger than a share of a thread with all the
+  // threads, until the remaining ranges can be balanced among the threads.
+  const size_t max_task_size =
+      std::max(pairs_.size() / threads, kMinPairsPerThread);
+  std::vector<Range> ranges = {{0, pairs_.size(), 0}};
+  std::vector<Range> tasks;
+  while (!ranges.empty()) {
+    Range range = ranges.back();
+    ranges.pop_back();
+    if (threads > 1 && range.end - range.begin > max_task_size) {
+      for (const Range& bucket : PartitionRange(range, threads, buffer)) {
+        ranges.push_back(bucket);
+      }
+    } else {
+      tasks.push_back(range);
+    }
+  }
+
+  // The largest ranges first, so the threads finish at about the same time.
+  std::sort(tasks.begin(), tasks.end(), [](const Range& a, const Range& b) {
+    return a.end - a.begin > b.end - b.begin;
+  });
+  std::atomic<size_t> next_task = 0;
+  ParallelFor(std::min<int>(threads, tasks.size()), tasks.size(),
+              [&](int, size_t, size_t) {
+                for (size_t i = next_task++; i < tasks.size();
+                     i = next_task++) {
+                  const Range& task = tasks[i];
+                  SortRange(pairs_.data() + task.begin,
+                            buffer.data() + task.begin,
+                            task.end - task.begin, task.digit);
+                }
+              });
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,107 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_SORTED_PAIR_COUNTER_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_SORTED_PAIR_COUNTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wfa_virtual_people {
+
+// SortedPairCounter counts the occurrences of each distinct pair of key and
+// virtual person id. The pairs are appended to a flat buffer, and counted by
+// sorting the buffer with a parallel MSD radix sort, then scanning the runs
+// of equal pairs. The first partitions of the radix sort soon split the pairs
+// into buckets that fit in the cache, where the rest of the sort is done.
+// Compared to hash sets of ids, adding a pair only writes to the end of the
+// buffer, and the memory does not depend on the count of distinct pairs: each
+// pair takes 16 bytes, and 32 bytes while sorting.
+//
+// Example:
+//   SortedPairCounter counter;
+//   counter.Add(key, virtual_person_id);
+//   ...
+//   counter.Sort(threads);
+//   counter.ForEachRun([](uint32_t key, int64_t virtual_person_id,
+//                         int64_t count) { ... });
+class SortedPairCounter {
+ public:
+  void Add(const uint32_t key, const int64_t virtual_person_id) {
+    pairs_.push_back({static_cast<uint64_t>(virtual_person_id), key});
+  }
+
+  size_t size() const { return pairs_.size(); }
+
+  // Sorts the pairs by virtual person id as unsigned integer, then by key, on
+  // @threads threads. So the pairs of each virtual person are consecutive.
+  void Sort(int threads);
+
+  // Calls @callback(key, virtual_person_id, count) for each distinct pair, in
+  // the sorted order, where count is the occurrences of the pair. Sort must be
+  // called after the last Add.
+  template <typename Callback>
+  void ForEachRun(const Callback& callback) const {
+    size_t begin = 0;
+    while (begin < pairs_.size()) {
+      size_t end = begin + 1;
+      while (end < pairs_.size() && pairs_[end] == pairs_[begin]) {
+        ++end;
+      }
+      callback(pairs_[begin].key,
+               static_cast<int64_t>(pairs_[begin].virtual_person_id),
+               static_cast<int64_t>(end - begin));
+      begin = end;
+    }
+  }
+
+ private:
+  struct Pair {
+    uint64_t virtual_person_id;
+    uint32_t key;
+
+    bool operator==(const Pair& other) const {
+      return virtual_person_id == other.virtual_person_id && key == other.key;
+    }
+  };
+
+  // The pairs in [begin, end) of pairs_ that are equal before digit, and
+  // remain to be sorted from digit.
+  struct Range {
+    size_t begin;
+    size_t end;
+    int digit;
+  };
+
+  // Returns byte @digit of @pair as a 96 bit integer, from the highest byte.
+  static size_t GetDigit(const Pair& pair, int digit);
+  static bool Less(const Pair& a, const Pair& b);
+
+  // Sorts the @size pairs from @pairs by MSD radix sort from @digit, using
+  // the same count of pairs from @buffer.
+  static void SortRange(Pair* pairs, Pair* buffer, size_t size, int digit);
+
+  // Partitions @range by its first digit that is not the same for all its
+  // pairs, on @threads threads, using the same range of @buffer. Returns the
+  // buckets of more than one pair.
+  std::vector<Range> PartitionRange(const Range& range, int threads,
+                                    std::vector<Pair>& buffer);
+
+  std::vector<Pair> pairs_;
+};
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_MODEL_APPLIER_SORTED_PAIR_COUNTER_H_
@@ -0,0 +1,258 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/panel_simulation/panel_error_simulator.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+using MetricEstimates = std::array<double, kPanelMetricCount>;
+
+// Calls @fn(begin, end) for consecutive ranges of [0, @size), each in its own
+// thread. The count of ranges is @threads, or less when @size is small.
+void ParallelFor(const int threads, const size_t size,
+                 const std::function<void(size_t, size_t)>& fn) {
+  int range_count = static_cast<int>(
+      std::max<size_t>(1, std::min<size_t>(threads, size)));
+  if (range_count == 1) {
+    fn(0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int i = 0; i < range_count; ++i) {
+    workers.emplace_back(fn, size * i / range_count,
+                         size * (i + 1) / range_count);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void CheckOptions(const PanelErrorSimulationOptions& options) {
+  const PanelCampaign& campaign = options.campaign;
+  CHECK(campaign.reach_rate > 0.0 && campaign.reach_rate <= 1.0)
+      << "reach_rate must be in (0, 1].";
+  CHECK(campaign.average_frequency >= 1.0)
+      << "average_frequency must be at least 1.";
+  CHECK(campaign.on_target_rate > 0.0 && campaign.on_target_rate <= 1.0)
+      << "on_target_rate must be in (0, 1].";
+  CHECK(options.off_target_panel_ratio > 0.0)
+      << "off_target_panel_ratio must be positive.";
+  CHECK(campaign.reach_rate * (1.0 - campaign.on_target_rate) <=
+        campaign.on_target_rate * options.off_target_panel_ratio)
+      << "The off target reach is more than the panelists outside the "
+         "bucket. Increase off_target_panel_ratio.";
+  CHECK(!options.panel_sizes.empty()) << "panel_sizes must not be empty.";
+  for (const int32_t panel_size : options.panel_sizes) {
+    CHECK(panel_size > 0) << "panel_sizes must be positive.";
+  }
+  CHECK(options.replicates > 0) << "replicates must be positive.";
+}
+
+double GetTrueValue(const PanelCampaign& campaign, const PanelMetric metric) {
+  switch (metric) {
+    case PanelMetric::kReach:
+      return campaign.reach_rate;
+    case PanelMetric::kImpressions:
+      return campaign.reach_rate * campaign.average_frequency;
+    case PanelMetric::kAverageFrequency:
+      return campaign.average_frequency;
+    case PanelMetric::kOnTargetPercentage:
+      return campaign.on_target_rate;
+  }
+  LOG(FATAL) << "Unknown metric.";
+}
+
+// Samples one panel of @panel_size panelists in the bucket, and returns the
+// estimates of the metrics, indexed by PanelMetric.
+MetricEstimates SampleReplicate(const PanelErrorSimulationOptions& options,
+                                const int32_t panel_size,
+                                RandomGenerator& random_generator) {
+  const PanelCampaign& campaign = options.campaign;
+  const int32_t reached = GetBinomial(random_generator, panel_size,
+                                      campaign.reach_rate);
+  // The frequency is 1 plus the count of failures before the first success,
+  // with success chance 1 / average_frequency.
+  int64_t impressions = reached;
+  if (campaign.average_frequency > 1.0) {
+    const double log_failure_chance =
+        log1p(-1.0 / campaign.average_frequency);
+    for (int32_t i = 0; i < reached; ++i) {
+      impressions += static_cast<int64_t>(
+          floor(log1p(-random_generator.GetDouble(0.0, 1.0)) /
+                log_failure_chance));
+    }
+  }
+  // The off target panelists are reached so that the expected off target
+  // reach is reach_rate * panel_size * (1 - on_target_rate) / on_target_rate.
+  const int32_t off_target_panel_size = static_cast<int32_t>(
+      lround(panel_size * options.off_target_panel_ratio));
+  const double off_target_reach_rate =
+      campaign.reach_rate * (1.0 - campaign.on_target_rate) /
+      (campaign.on_target_rate * options.off_target_panel_ratio);
+  const int32_t off_target_reached = GetBinomial(
+      random_generator, off_target_panel_size,
+      std::min(off_target_reach_rate, 1.0));
+
+  MetricEstimates estimates;
+  estimates[static_cast<int>(PanelMetric::kReach)] =
+      static_cast<double>(reached) / panel_size;
+  estimates[static_cast<int>(PanelMetric::kImpressions)] =
+      static_cast<double>(impressions) / panel_size;
+  estimates[static_cast<int>(PanelMetric::kAverageFrequency)] =
+      reached > 0 ? static_cast<double>(impressions) / reached : 0.0;
+  estimates[static_cast<int>(PanelMetric::kOnTargetPercentage)] =
+      reached > 0
+          ? static_cast<double>(reached) / (reached + off_target_reached)
+          : 0.0;
+  return estimates;
+}
+
+// Returns the error of the estimates of @metric in @replicates.
+PanelErrorPoint GetErrorPoint(const PanelCampaign& campaign,
+                              const PanelMetric metric,
+                              const int32_t panel_size,
+                              absl::Span<const MetricEstimates> replicates) {
+  const double true_value = GetTrueValue(campaign, metric);
+  const int index = static_cast<int>(metric);
+  double sum = 0.0;
+  std::vector<double> relative_errors;
+  relative_errors.reserve(replicates.size());
+  for (const MetricEstimates& estimates : replicates) {
+    sum += estimates[index];
+    relative_errors.push_back(fabs(estimates[index] - true_value) /
+                              true_value);
+  }
+  const double mean = sum / replicates.size();
+  double squared_deviation = 0.0;
+  for (const MetricEstimates& estimates : replicates) {
+    squared_deviation += (estimates[index] - mean) * (estimates[index] - mean);
+  }
+  const size_t percentile_index =
+      static_cast<size_t>(ceil(0.95 * relative_errors.size())) - 1;
+  std::nth_element(relative_errors.begin(),
+                   relative_errors.begin() + percentile_index,
+                   relative_errors.end());
+  return {
+      .metric = metric,
+      .panel_size = panel_size,
+      .true_value = true_value,
+      .mean = mean,
+      .relative_stddev =
+          sqrt(squared_deviation / replicates.size()) / true_value,
+      .relative_error_95 = relative_errors[percentile_index]};
+}
+
+}  // namespace
+
+absl::string_view GetPanelMetricName(const PanelMetric metric) {
+  switch (metric) {
+    case PanelMetric::kReach:
+      return "reach";
+    case PanelMetric::kImpressions:
+      return "impressions";
+    case PanelMetric::kAverageFrequency:
+      return "average_frequency";
+    case PanelMetric::kOnTargetPercentage:
+      return "on_target_percentage";
+  }
+  LOG(FATAL) << "Unknown metric.";
+}
+
+int32_t GetBinomial(RandomGenerator& random_generator, const int32_t trials,
+                    const double rate) {
+  CHECK(rate >= 0.0 && rate <= 1.0) << "rate must be between 0 and 1.";
+  if (rate == 0.0 || trials <= 0) {
+    return 0;
+  }
+  if (rate > 0.5) {
+    return trials - GetBinomial(random_generator, trials, 1.0 - rate);
+  }
+  // The gap before each success is the count of failures before it, which is
+  // floor(log(u) / log(1 - rate)) for u uniform in (0, 1].
+  const double log_failure_chance = log1p(-rate);
+  int32_t successes = 0;
+  double position = -1.0;
+  while (true) {
+    position +=
+        floor(log1p(-random_generator.GetDouble(0.0, 1.0)) /
+              log_failure_chance) +
+        1.0;
+    if (position >= trials) {
+      return successes;
+    }
+    ++successes;
+  }
+}
+
+std::vector<PanelErrorPoint> SimulatePanelError(
+    const PanelErrorSimulationOptions& options) {
+  CheckOptions(options);
+  const size_t size_count = options.panel_sizes.size();
+  const size_t replicates = options.replicates;
+  // The estimates of replicate r of panel size i are at i * replicates + r.
+  std::vector<MetricEstimates> estimates(size_count * replicates);
+  ParallelFor(std::max(options.threads, 1), estimates.size(),
+              [&](const size_t begin, const size_t end) {
+                for (size_t task = begin; task < end; ++task) {
+                  RandomGenerator random_generator(options.seed, task);
+                  estimates[task] = SampleReplicate(
+                      options, options.panel_sizes[task / replicates],
+                      random_generator);
+                }
+              });
+
+  std::vector<PanelErrorPoint> points;
+  points.reserve(size_count * kPanelMetricCount);
+  for (size_t i = 0; i < size_count; ++i) {
+    absl::Span<const MetricEstimates> size_estimates =
+        absl::MakeConstSpan(estimates).subspan(i * replicates, replicates);
+    for (int metric = 0; metric < kPanelMetricCount; ++metric) {
+      points.push_back(GetErrorPoint(
+          options.campaign, static_cast<PanelMetric>(metric),
+          options.panel_sizes[i], size_estimates));
+    }
+  }
+  return points;
+}
+
+std::string PanelErrorToCsv(const std::vector<PanelErrorPoint>& points) {
+  std::string output =
+      "metric,panel_size,true_value,mean,relative_stddev,relative_error_95\n";
+  for (const PanelErrorPoint& point : points) {
+    absl::StrAppendFormat(&output, "%s,%d,%.10g,%.10g,%.10g,%.10g\n",
+                          GetPanelMetricName(point.metric), point.panel_size,
+                          point.true_value, point.mean, point.relative_stddev,
+                          point.relative_error_95);
+  }
+  return output;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,105 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_PANEL_SIMULATION_PANEL_ERROR_SIMULATOR_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_PANEL_SIMULATION_PANEL_ERROR_SIMULATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+// The metrics measured on the panelists of a demographic bucket.
+enum class PanelMetric {
+  // The fraction of the bucket reached by the campaign.
+  kReach = 0,
+  // The impressions per person of the bucket.
+  kImpressions = 1,
+  // The impressions per reached person of the bucket.
+  kAverageFrequency = 2,
+  // The fraction of the campaign reach that is in the bucket, which is called
+  // OTP or precision in notebooks/Panel_size_implication_for_error.ipynb.
+  kOnTargetPercentage = 3,
+};
+
+constexpr int kPanelMetricCount = 4;
+
+absl::string_view GetPanelMetricName(PanelMetric metric);
+
+// The true values of the campaign, which are estimated from the panel.
+struct PanelCampaign {
+  // The fraction of the people of the bucket reached by the campaign.
+  double reach_rate = 0.5;
+  // The average frequency of the reached people. The frequency of each reached
+  // person is 1 plus a geometric variable.
+  double average_frequency = 3.0;
+  // The fraction of the campaign reach that is in the bucket.
+  double on_target_rate = 0.8;
+};
+
+struct PanelErrorSimulationOptions {
+  PanelCampaign campaign;
+  // The counts of panelists in the bucket to simulate.
+  std::vector<int32_t> panel_sizes;
+  // The count of panelists outside the bucket, as a multiple of the count of
+  // panelists in the bucket. The off target reach of the campaign is spread
+  // over them.
+  double off_target_panel_ratio = 10.0;
+  // The count of panels sampled for each panel size.
+  int replicates = 1000;
+  int threads = 1;
+  uint64_t seed = 0;
+};
+
+// The error of one metric at one panel size.
+struct PanelErrorPoint {
+  PanelMetric metric;
+  int32_t panel_size;
+  double true_value;
+  // The mean of the estimates over the replicates.
+  double mean;
+  // The standard deviation of the estimates, divided by true_value.
+  double relative_stddev;
+  // The 95th percentile of |estimate - true_value| / true_value.
+  double relative_error_95;
+};
+
+// Returns the counts of successes of @trials independent trials, each with
+// chance @rate. Only draws about min(@rate, 1 - @rate) * @trials values, by
+// drawing the geometric gaps between the successes.
+int32_t GetBinomial(RandomGenerator& random_generator, int32_t trials,
+                    double rate);
+
+// Samples the panel of each size in @options.panel_sizes @options.replicates
+// times, estimates the metrics of the campaign on each panel, and returns the
+// errors of the estimates, ordered by panel size and then by metric.
+//
+// Each replicate draws from its own stream of RandomGenerator, indexed by the
+// panel size and the replicate, so the results only depend on @options.seed,
+// not on @options.threads. The replicates are split across @options.threads
+// threads.
+std::vector<PanelErrorPoint> SimulatePanelError(
+    const PanelErrorSimulationOptions& options);
+
+// Returns the errors in CSV, with a header line
+//   metric,panel_size,true_value,mean,relative_stddev,relative_error_95
+std::string PanelErrorToCsv(const std::vector<PanelErrorPoint>& points);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_PANEL_SIMULATION_PANEL_ERROR_SIMULATOR_H_
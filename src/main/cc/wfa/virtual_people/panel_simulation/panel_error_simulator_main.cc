@@ -0,0 +1,110 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This is a tool to simulate the error of the metrics measured on a panel, by
+// the size of the panel, following
+// notebooks/Panel_size_implication_for_error.ipynb. For each panel size, the
+// panel is sampled --replicates times, and the error of the estimates of each
+// metric is written in CSV as
+//   <metric>,<panel size>,<true value>,<mean>,<relative stddev>,
+//   <95th percentile of relative error>
+//
+// Example usage:
+// bazel build -c opt \
+// //src/main/cc/wfa/virtual_people/panel_simulation:panel_error_simulator_main
+// bazel-bin/src/main/cc/wfa/virtual_people/panel_simulation/panel_error_simulator_main \
+// --panel_sizes=100,200,500,1000 --on_target_rate=0.8 --replicates=10000 \
+// --threads=8 --output_path=/tmp/panel_error.csv
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/panel_simulation/panel_error_simulator.h"
+
+ABSL_FLAG(std::string, panel_sizes, "100,200,300,400,500,600,700,800,900,1000",
+          "Comma separated counts of panelists in the bucket to simulate.");
+ABSL_FLAG(double, reach_rate, 0.5,
+          "The fraction of the bucket reached by the campaign.");
+ABSL_FLAG(double, average_frequency, 3.0,
+          "The average frequency of the reached people.");
+ABSL_FLAG(double, on_target_rate, 0.8,
+          "The fraction of the campaign reach that is in the bucket.");
+ABSL_FLAG(double, off_target_panel_ratio, 10.0,
+          "The count of panelists outside the bucket, as a multiple of the "
+          "count of panelists in the bucket.");
+ABSL_FLAG(uint32_t, replicates, 1000,
+          "The count of panels sampled for each panel size.");
+ABSL_FLAG(uint32_t, threads, 1, "The count of threads to run the replicates.");
+ABSL_FLAG(uint64_t, seed, 1, "The seed of the random generator.");
+ABSL_FLAG(std::string, output_path, "",
+          "Path to write the errors. Writes to stdout if not set.");
+
+namespace wfa_virtual_people {
+
+std::vector<int32_t> ParsePanelSizes(absl::string_view panel_sizes) {
+  std::vector<int32_t> output;
+  for (absl::string_view field :
+       absl::StrSplit(panel_sizes, ',', absl::SkipWhitespace())) {
+    int32_t panel_size;
+    CHECK(absl::SimpleAtoi(field, &panel_size))
+        << "Invalid panel size: " << field;
+    output.push_back(panel_size);
+  }
+  return output;
+}
+
+}  // namespace wfa_virtual_people
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  wfa_virtual_people::PanelErrorSimulationOptions options = {
+      .campaign = {.reach_rate = absl::GetFlag(FLAGS_reach_rate),
+                   .average_frequency = absl::GetFlag(FLAGS_average_frequency),
+                   .on_target_rate = absl::GetFlag(FLAGS_on_target_rate)},
+      .panel_sizes =
+          wfa_virtual_people::ParsePanelSizes(absl::GetFlag(FLAGS_panel_sizes)),
+      .off_target_panel_ratio = absl::GetFlag(FLAGS_off_target_panel_ratio),
+      .replicates = static_cast<int>(absl::GetFlag(FLAGS_replicates)),
+      .threads = static_cast<int>(absl::GetFlag(FLAGS_threads)),
+      .seed = absl::GetFlag(FLAGS_seed)};
+
+  absl::Time start = absl::Now();
+  std::vector<wfa_virtual_people::PanelErrorPoint> points =
+      wfa_virtual_people::SimulatePanelError(options);
+  LOG(INFO) << "Simulated " << options.replicates << " replicates of "
+            << options.panel_sizes.size() << " panel sizes in "
+            << absl::FormatDuration(absl::Now() - start);
+
+  std::string output_path = absl::GetFlag(FLAGS_output_path);
+  if (output_path.empty()) {
+    std::cout << wfa_virtual_people::PanelErrorToCsv(points);
+  } else {
+    std::ofstream output(output_path);
+    CHECK(output.is_open()) << "Unable to open file: " << output_path;
+    output << wfa_virtual_people::PanelErrorToCsv(points);
+  }
+  return 0;
+}
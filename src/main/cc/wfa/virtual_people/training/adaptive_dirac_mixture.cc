@@ -0,0 +1,564 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/training/adaptive_dirac_mixture.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+namespace {
+
+// The max count of iterations of the Lawson-Hanson method, as a multiple of
+// the count of variables. Same as scipy.optimize.nnls.
+constexpr int kNnlsIterationsPerVariable = 3;
+
+// The observations are processed in blocks of this size, which is also the
+// smallest task given to a thread. The blocks do not depend on the count of
+// threads, so the fit is the same for any count of threads.
+constexpr size_t kObservationsPerBlock = 256;
+
+double Dot(absl::Span<const double> a, absl::Span<const double> b) {
+  double output = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    output += a[i] * b[i];
+  }
+  return output;
+}
+
+// Reduces the @rows * @cols @matrix, in column-major order, to the upper
+// triangular R of its QR decomposition in place, by Householder reflections.
+// R is in the first min(@rows, @cols) rows, and the other values are 0.
+void Triangularize(const size_t rows, const size_t cols,
+                   std::vector<double>& matrix) {
+  for (size_t j = 0; j < std::min(rows, cols); ++j) {
+    double* column = &matrix[j * rows];
+    double below = 0.0;
+    for (size_t i = j + 1; i < rows; ++i) {
+      below += column[i] * column[i];
+    }
+    if (below == 0.0) continue;
+    // The reflection maps the column to (alpha, 0, ..., 0), with the sign of
+    // alpha opposite to column[j] to avoid cancellation. The vector of the
+    // reflection is the column with column[j] - alpha.
+    double norm = sqrt(column[j] * column[j] + below);
+    double alpha = column[j] > 0.0 ? -norm : norm;
+    double head = column[j] - alpha;
+    double vector_norm = head * head + below;
+    for (size_t l = j + 1; l < cols; ++l) {
+      double* other = &matrix[l * rows];
+      double product = head * other[j];
+      for (size_t i = j + 1; i < rows; ++i) {
+        product += column[i] * other[i];
+      }
+      double scale = 2.0 * product / vector_norm;
+      other[j] -= scale * head;
+      for (size_t i = j + 1; i < rows; ++i) {
+        other[i] -= scale * column[i];
+      }
+    }
+    column[j] = alpha;
+    std::fill(column + j + 1, column + rows, 0.0);
+  }
+}
+
+// Solves the least squares A[P] z[P] = @b by QR decomposition, where A[P] are
+// the @columns with @passive set. The output is 0 for the other indexes.
+// Returns nullopt if A[P] is rank deficient.
+std::optional<std::vector<double>> SolvePassiveSet(
+    const std::vector<std::vector<double>>& columns,
+    const std::vector<double>& b, const std::vector<bool>& passive) {
+  size_t rows = b.size();
+  std::vector<size_t> indexes;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    if (passive[i]) indexes.push_back(i);
+  }
+  size_t p = indexes.size();
+  if (p > rows) return std::nullopt;
+  // A[P] followed by b, in column-major order.
+  std::vector<double> matrix;
+  matrix.reserve((p + 1) * rows);
+  double max_norm = 0.0;
+  for (size_t i : indexes) {
+    matrix.insert(matrix.end(), columns[i].begin(), columns[i].end());
+    max_norm = std::max(max_norm, sqrt(Dot(columns[i], columns[i])));
+  }
+  matrix.insert(matrix.end(), b.begin(), b.end());
+  Triangularize(rows, p + 1, matrix);
+
+  // Backward substitution for R z = Q^T b, which is the top of the last
+  // column.
+  const double* qtb = &matrix[p * rows];
+  std::vector<double> z(p);
+  for (size_t i = p; i-- > 0;) {
+    double diagonal = matrix[i * rows + i];
+    if (fabs(diagonal) <= 1e-12 * max_norm) return std::nullopt;
+    double sum = qtb[i];
+    for (size_t l = i + 1; l < p; ++l) {
+      sum -= matrix[l * rows + i] * z[l];
+    }
+    z[i] = sum / diagonal;
+  }
+  std::vector<double> output(columns.size(), 0.0);
+  for (size_t i = 0; i < p; ++i) {
+    output[indexes[i]] = z[i];
+  }
+  return output;
+}
+
+// A fixed set of threads, which run the ranges of ParallelFor. The threads
+// are kept for the whole training, instead of being started at each step.
+class WorkerPool {
+ public:
+  // The calling thread is one of the @threads.
+  explicit WorkerPool(const int threads) : threads_(std::max(threads, 1)) {
+    for (int i = 1; i < threads_; ++i) {
+      workers_.emplace_back(&WorkerPool::Work, this);
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Calls @fn(begin, end) for consecutive ranges of [0, @size), and returns
+  // when all the calls are done. The count of ranges is the count of
+  // threads, or @size when it is smaller.
+  void ParallelFor(const size_t size,
+                   const std::function<void(size_t, size_t)>& fn) {
+    size_t range_count = std::min<size_t>(threads_, size);
+    if (range_count <= 1) {
+      if (size > 0) fn(0, size);
+      return;
+    }
+    {
+      absl::MutexLock lock(&mutex_);
+      fn_ = &fn;
+      for (size_t i = 1; i < range_count; ++i) {
+        tasks_.push_back({size * i / range_count,
+                          size * (i + 1) / range_count});
+      }
+      pending_ = range_count - 1;
+    }
+    fn(0, size / range_count);
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(this, &WorkerPool::IsDone));
+    fn_ = nullptr;
+  }
+
+ private:
+  struct Task {
+    size_t begin;
+    size_t end;
+  };
+
+  bool HasTaskOrStopping() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !tasks_.empty() || stopping_;
+  }
+
+  bool IsDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return pending_ == 0;
+  }
+
+  void Work() {
+    while (true) {
+      Task task;
+      const std::function<void(size_t, size_t)>* fn;
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(this, &WorkerPool::HasTaskOrStopping));
+        if (tasks_.empty()) return;
+        task = tasks_.back();
+        tasks_.pop_back();
+        fn = fn_;
+      }
+      (*fn)(task.begin, task.end);
+      absl::MutexLock lock(&mutex_);
+      --pending_;
+    }
+  }
+
+  const int threads_;
+  std::vector<std::thread> workers_;
+  absl::Mutex mutex_;
+  const std::function<void(size_t, size_t)>* fn_ ABSL_GUARDED_BY(mutex_) =
+      nullptr;
+  std::vector<Task> tasks_ ABSL_GUARDED_BY(mutex_);
+  size_t pending_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+};
+
+// The deltas of a mixture being fitted, with the reach curve of each delta
+// over the observations.
+class MixtureState {
+ public:
+  MixtureState(const ReachObservations& observations, const int threads)
+      : observations_(observations),
+        block_count_((observations.size() + kObservationsPerBlock - 1) /
+                     kObservationsPerBlock),
+        pool_(threads) {}
+
+  const std::vector<std::vector<double>>& deltas() const { return deltas_; }
+
+  // Adds @new_deltas, and computes their reach curves.
+  void AddDeltas(const std::vector<std::vector<double>>& new_deltas);
+
+  // Fits the alphas of all the deltas by non-negative least squares.
+  std::vector<double> FitAlphas();
+
+  // Only keeps the deltas with positive @alphas. Returns the kept alphas.
+  std::vector<double> KeepPositive(const std::vector<double>& alphas);
+
+ private:
+  // Returns the R of the QR decomposition of the reach curves followed by the
+  // targets, of the observations in @block, in column-major order.
+  std::vector<double> TriangularizeBlock(size_t block) const;
+
+  const ReachObservations& observations_;
+  const size_t block_count_;
+  WorkerPool pool_;
+  std::vector<std::vector<double>> deltas_;
+  // The reach curve of each delta, which is 1 - exp(-delta . signal) for each
+  // observation.
+  std::vector<std::vector<double>> curves_;
+};
+
+void MixtureState::AddDeltas(
+    const std::vector<std::vector<double>>& new_deltas) {
+  size_t old_count = deltas_.size();
+  size_t size = observations_.size();
+  for (const std::vector<double>& delta : new_deltas) {
+    deltas_.push_back(delta);
+    curves_.emplace_back(size);
+  }
+  pool_.ParallelFor(block_count_, [&](const size_t begin, const size_t end) {
+    size_t end_row = std::min(end * kObservationsPerBlock, size);
+    for (size_t i = 0; i < new_deltas.size(); ++i) {
+      std::vector<double>& curve = curves_[old_count + i];
+      for (size_t row = begin * kObservationsPerBlock; row < end_row; ++row) {
+        curve[row] = 1.0 - exp(-Dot(new_deltas[i], observations_.signal(row)));
+      }
+    }
+  });
+}
+
+std::vector<double> MixtureState::TriangularizeBlock(const size_t block) const {
+  size_t cols = curves_.size() + 1;
+  size_t begin = block * kObservationsPerBlock;
+  size_t end = std::min(begin + kObservationsPerBlock, observations_.size());
+  size_t rows = end - begin;
+  std::vector<double> matrix;
+  matrix.reserve(rows * cols);
+  for (const std::vector<double>& curve : curves_) {
+    matrix.insert(matrix.end(), curve.begin() + begin, curve.begin() + end);
+  }
+  matrix.insert(matrix.end(), observations_.targets.begin() + begin,
+                observations_.targets.begin() + end);
+  Triangularize(rows, cols, matrix);
+  // Only keeps the top cols rows, which hold R.
+  std::vector<double> output(cols * cols, 0.0);
+  for (size_t j = 0; j < cols; ++j) {
+    for (size_t i = 0; i <= j && i < rows; ++i) {
+      output[j * cols + i] = matrix[j * rows + i];
+    }
+  }
+  return output;
+}
+
+// The least squares on the reach curves are reduced to an equivalent one on
+// the R of their QR decomposition, which is only k * k for k deltas, so the
+// Lawson-Hanson method does not go through the observations at each
+// iteration. As in TSQR, each block is decomposed separately, then the Rs of
+// pairs of blocks are stacked and decomposed again, until only one is left.
+std::vector<double> MixtureState::FitAlphas() {
+  size_t k = curves_.size();
+  size_t cols = k + 1;
+  std::vector<std::vector<double>> triangles(block_count_);
+  pool_.ParallelFor(block_count_, [&](const size_t begin, const size_t end) {
+    for (size_t block = begin; block < end; ++block) {
+      triangles[block] = TriangularizeBlock(block);
+    }
+  });
+  while (triangles.size() > 1) {
+    std::vector<std::vector<double>> merged((triangles.size() + 1) / 2);
+    pool_.ParallelFor(merged.size(), [&](const size_t begin,
+                                         const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        if (2 * i + 1 == triangles.size()) {
+          merged[i] = std::move(triangles[2 * i]);
+          continue;
+        }
+        const std::vector<double>& top = triangles[2 * i];
+        const std::vector<double>& bottom = triangles[2 * i + 1];
+        std::vector<double> matrix(2 * cols * cols);
+        for (size_t j = 0; j < cols; ++j) {
+          std::copy_n(&top[j * cols], cols, &matrix[2 * j * cols]);
+          std::copy_n(&bottom[j * cols], cols, &matrix[(2 * j + 1) * cols]);
+        }
+        Triangularize(2 * cols, cols, matrix);
+        merged[i].resize(cols * cols);
+        for (size_t j = 0; j < cols; ++j) {
+          std::copy_n(&matrix[2 * j * cols], cols, &merged[i][j * cols]);
+        }
+      }
+    });
+    triangles = std::move(merged);
+  }
+  const std::vector<double>& triangle = triangles.front();
+  std::vector<std::vector<double>> columns;
+  columns.reserve(k);
+  for (size_t j = 0; j < k; ++j) {
+    columns.emplace_back(&triangle[j * cols], &triangle[j * cols] + k);
+  }
+  std::vector<double> qtb(&triangle[k * cols], &triangle[k * cols] + k);
+  return SolveNonNegativeLeastSquares(columns, qtb);
+}
+
+std::vector<double> MixtureState::KeepPositive(
+    const std::vector<double>& alphas) {
+  std::vector<double> kept_alphas;
+  std::vector<std::vector<double>> deltas;
+  std::vector<std::vector<double>> curves;
+  for (size_t i = 0; i < alphas.size(); ++i) {
+    if (alphas[i] > 0.0) {
+      kept_alphas.push_back(alphas[i]);
+      deltas.push_back(std::move(deltas_[i]));
+      curves.push_back(std::move(curves_[i]));
+    }
+  }
+  deltas_ = std::move(deltas);
+  curves_ = std::move(curves);
+  return kept_alphas;
+}
+
+void CheckObservations(const ReachObservations& observations) {
+  CHECK(observations.dimension > 0) << "dimension must be positive.";
+  CHECK(observations.size() > 0) << "No observation.";
+  CHECK(observations.signals.size() ==
+        observations.size() * observations.dimension)
+      << "The size of signals does not match the count of observations.";
+}
+
+}  // namespace
+
+double DiracMixture::Predict(absl::Span<const double> signal) const {
+  double output = 0.0;
+  for (size_t i = 0; i < alphas.size(); ++i) {
+    output += alphas[i] * (1.0 - exp(-Dot(deltas[i], signal)));
+  }
+  return output;
+}
+
+std::string DiracMixture::ToCsv() const {
+  std::string output;
+  for (size_t i = 0; i < alphas.size(); ++i) {
+    absl::StrAppend(&output, absl::StrFormat("%.10g", alphas[i]));
+    for (double activity : deltas[i]) {
+      absl::StrAppend(&output, absl::StrFormat(",%.10g", activity));
+    }
+    output.push_back('\n');
+  }
+  return output;
+}
+
+ReachObservations GetSyntheticObservations(const DiracMixture& mixture,
+                                           const int count,
+                                           RandomGenerator& random_generator) {
+  CHECK(!mixture.deltas.empty()) << "The mixture is empty.";
+  ReachObservations observations;
+  observations.dimension = mixture.deltas.front().size();
+  observations.signals.reserve(count * observations.dimension);
+  observations.targets.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < observations.dimension; ++j) {
+      observations.signals.push_back(random_generator.GetDouble(0.0, 1.0));
+    }
+    observations.targets.push_back(mixture.Predict(observations.signal(i)));
+  }
+  return observations;
+}
+
+std::vector<double> SolveNonNegativeLeastSquares(
+    const std::vector<std::vector<double>>& columns,
+    const std::vector<double>& b) {
+  size_t k = columns.size();
+  for (const std::vector<double>& column : columns) {
+    CHECK(column.size() == b.size())
+        << "The size of a column does not match b.";
+  }
+  std::vector<double> x(k, 0.0);
+  std::vector<bool> passive(k, false);
+  // The indexes which cannot be added to the passive set until x changes.
+  std::vector<bool> rejected(k, false);
+
+  std::vector<double> residual(b.size());
+  int max_iterations = kNnlsIterationsPerVariable * std::max<size_t>(k, 1);
+  for (int iteration = 0; iteration < max_iterations;) {
+    // The negative gradient of the objective, A^T (b - A x). Adding index t
+    // to the passive set decreases the objective when gradient[t] is
+    // positive.
+    residual = b;
+    for (size_t j = 0; j < k; ++j) {
+      if (x[j] == 0.0) continue;
+      for (size_t row = 0; row < b.size(); ++row) {
+        residual[row] -= columns[j][row] * x[j];
+      }
+    }
+    size_t best = k;
+    double best_gradient = 0.0;
+    for (size_t i = 0; i < k; ++i) {
+      if (passive[i] || rejected[i]) continue;
+      double gradient = Dot(columns[i], residual);
+      if (gradient > best_gradient) {
+        best = i;
+        best_gradient = gradient;
+      }
+    }
+    if (best == k) break;
+    passive[best] = true;
+
+    // As in Lawson-Hanson, the new index is rejected when its column is
+    // linearly dependent on the passive set, or when its solution is not
+    // positive, which only happens by rounding errors when its gradient is
+    // tiny.
+    std::optional<std::vector<double>> z =
+        SolvePassiveSet(columns, b, passive);
+    if (!z.has_value() || (*z)[best] <= 0.0) {
+      passive[best] = false;
+      rejected[best] = true;
+      continue;
+    }
+    ++iteration;
+    std::fill(rejected.begin(), rejected.end(), false);
+
+    // Moves x toward the unconstrained solution on the passive set, and drops
+    // the indexes that reach 0 on the way, until the solution is positive.
+    while (true) {
+      double step = 1.0;
+      size_t blocking = k;
+      for (size_t i = 0; i < k; ++i) {
+        if (passive[i] && (*z)[i] <= 0.0) {
+          double ratio = x[i] / (x[i] - (*z)[i]);
+          if (ratio < step) {
+            step = ratio;
+            blocking = i;
+          }
+        }
+      }
+      for (size_t i = 0; i < k; ++i) {
+        x[i] += step * ((*z)[i] - x[i]);
+      }
+      if (blocking == k) break;
+      x[blocking] = 0.0;
+      passive[blocking] = false;
+      for (size_t i = 0; i < k; ++i) {
+        if (passive[i] && x[i] <= 0.0) {
+          passive[i] = false;
+          x[i] = 0.0;
+        }
+      }
+      // Removing indexes from a passive set of full rank keeps its rank
+      // full.
+      z = SolvePassiveSet(columns, b, passive);
+      CHECK(z.has_value()) << "The passive set is rank deficient.";
+    }
+  }
+  for (size_t i = 0; i < k; ++i) {
+    if (!passive[i]) x[i] = 0.0;
+  }
+  return x;
+}
+
+std::vector<double> FitAlphas(const std::vector<std::vector<double>>& deltas,
+                              const ReachObservations& observations) {
+  CheckObservations(observations);
+  MixtureState state(observations, /*threads=*/1);
+  state.AddDeltas(deltas);
+  return state.FitAlphas();
+}
+
+DiracMixture FitAdaptiveDiracMixture(
+    const ReachObservations& observations,
+    const AdaptiveDiracMixtureOptions& options,
+    RandomGenerator& random_generator) {
+  CheckObservations(observations);
+  MixtureState state(observations, options.threads);
+  if (options.initial_deltas.empty()) {
+    state.AddDeltas({std::vector<double>(observations.dimension, 1.0)});
+  } else {
+    state.AddDeltas(options.initial_deltas);
+  }
+  std::vector<double> alphas(state.deltas().size(),
+                             1.0 / state.deltas().size());
+
+  std::vector<std::vector<double>> new_deltas;
+  for (int step = 0; step < options.max_steps; ++step) {
+    // Samples the new deltas from the Gaussian mixture around the existing
+    // deltas, and drops the ones with non-positive activity.
+    ActivitySampler sampler(alphas);
+    new_deltas.clear();
+    for (int i = 0; i < options.new_deltas_per_step; ++i) {
+      std::vector<double> delta =
+          state.deltas()[sampler.Sample(random_generator)];
+      bool is_positive = true;
+      for (double& activity : delta) {
+        activity += random_generator.GetGaussian(0.0, options.new_deltas_sigma);
+        is_positive = is_positive && activity > 0.0;
+      }
+      if (is_positive) {
+        new_deltas.push_back(std::move(delta));
+      }
+    }
+    state.AddDeltas(new_deltas);
+
+    std::vector<double> fitted = state.FitAlphas();
+    // All the alphas are 0 only when the targets are 0. The deltas are kept
+    // so that the next step can sample from them.
+    if (std::any_of(fitted.begin(), fitted.end(),
+                    [](const double alpha) { return alpha > 0.0; })) {
+      alphas = state.KeepPositive(fitted);
+    } else {
+      alphas.assign(state.deltas().size(), 1.0 / state.deltas().size());
+    }
+  }
+
+  DiracMixture mixture;
+  mixture.deltas = state.deltas();
+  mixture.alphas = state.FitAlphas();
+  return mixture;
+}
+
+}  // namespace wfa_virtual_people
@@ -0,0 +1,121 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_TRAINING_ADAPTIVE_DIRAC_MIXTURE_H_
+#define SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_TRAINING_ADAPTIVE_DIRAC_MIXTURE_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+
+// A Dirac mixture predicts the reach of people from the reach of ids in each
+// id space, as
+//   sum_j alphas[j] * (1 - exp(-deltas[j] . signal))
+// where signal[k] is the reach in id space k. Both the reach of ids and of
+// people are divided by the population.
+struct DiracMixture {
+  std::vector<double> alphas;
+  // The activity of each delta in each id space.
+  std::vector<std::vector<double>> deltas;
+
+  // Returns the predicted reach of people for @signal, whose size must be the
+  // same as each of the deltas.
+  double Predict(absl::Span<const double> signal) const;
+
+  // Returns one line for each delta, as comma separated
+  //   <alpha>,<activity in id space 0>,<activity in id space 1>,...
+  std::string ToCsv() const;
+};
+
+// The observed reach, e.g. of each campaign.
+struct ReachObservations {
+  // The count of id spaces.
+  int dimension = 0;
+  // The reach of ids in each id space, dimension values for each observation.
+  std::vector<double> signals;
+  // The reach of people of each observation.
+  std::vector<double> targets;
+
+  size_t size() const { return targets.size(); }
+  absl::Span<const double> signal(size_t index) const {
+    return absl::MakeConstSpan(signals).subspan(index * dimension, dimension);
+  }
+};
+
+// Returns @count observations with the signals drawn uniformly from [0, 1) in
+// each id space, and the targets predicted by @mixture. This is the synthetic
+// data used in notebooks/Adaptive_Dirac_Mixture_Training.ipynb to test the
+// training.
+ReachObservations GetSyntheticObservations(const DiracMixture& mixture,
+                                           int count,
+                                           RandomGenerator& random_generator);
+
+// Returns the non-negative x minimizing |A x - @b|, using the Lawson-Hanson
+// active set method, where the least squares on the passive set are solved by
+// QR decomposition of A, as in scipy.optimize.nnls. @columns are the columns
+// of A, each with the same size as @b.
+std::vector<double> SolveNonNegativeLeastSquares(
+    const std::vector<std::vector<double>>& columns,
+    const std::vector<double>& b);
+
+// Returns the non-negative alphas of @deltas which fit @observations best in
+// least squares.
+std::vector<double> FitAlphas(const std::vector<std::vector<double>>& deltas,
+                              const ReachObservations& observations);
+
+struct AdaptiveDiracMixtureOptions {
+  // The count of new deltas sampled around the existing deltas at each step.
+  int new_deltas_per_step = 10;
+  // The standard deviation of the Gaussian noise added to each new delta.
+  double new_deltas_sigma = 0.01;
+  int max_steps = 1000;
+  // The count of threads used to compute the reach curves of the new deltas,
+  // and the QR decomposition of the reach curves.
+  int threads = 1;
+  // The deltas to start from. When empty, starts from one delta with activity
+  // 1 in each id space.
+  std::vector<std::vector<double>> initial_deltas;
+};
+
+// Fits a Dirac mixture to @observations with the Adaptive Dirac Mixture
+// training, which is Algorithm 4 in "Measuring Cross-Device Online Audiences",
+// following notebooks/Adaptive_Dirac_Mixture_Training.ipynb. At each step, new
+// deltas are sampled from a Gaussian mixture around the existing deltas,
+// weighted by their alphas, and the alphas of all the deltas are fitted by
+// non-negative least squares. The deltas with zero alpha are dropped.
+//
+// Unlike the notebook, which computes the reach curves of all the deltas again
+// at each step, the reach curves of the kept deltas are kept between steps, so
+// each step only computes the reach curves of the new deltas. The least
+// squares on the reach curves are reduced to a k * k triangular system for k
+// deltas by QR decomposition of blocks of observations, which is as accurate
+// as solving on the reach curves. This work is split by blocks among
+// @options.threads threads, which are started once for the whole training.
+// The blocks do not depend on the count of threads, so the output is the same
+// for any count of threads.
+//
+// CHECK-fails if @observations is empty, or the size of the signals does not
+// match @observations.dimension.
+DiracMixture FitAdaptiveDiracMixture(
+    const ReachObservations& observations,
+    const AdaptiveDiracMixtureOptions& options,
+    RandomGenerator& random_generator);
+
+}  // namespace wfa_virtual_people
+
+#endif  // SRC_MAIN_CC_WFA_VIRTUAL_PEOPLE_TRAINING_ADAPTIVE_DIRAC_MIXTURE_H_
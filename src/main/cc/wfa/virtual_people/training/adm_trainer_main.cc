@@ -0,0 +1,172 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This is a tool to fit an Adaptive Dirac Mixture to reach observations, and
+// write the alphas and deltas in CSV, one line for each delta as
+//   <alpha>,<activity in id space 0>,<activity in id space 1>,...
+//
+// The input is a CSV file with one line for each observation, e.g. a campaign,
+// as
+//   <id reach in id space 0>,<id reach in id space 1>,...,<people reach>
+// Empty lines and lines starting with '#' are skipped. All the reaches are
+// divided by --population.
+//
+// Example usage:
+// bazel build -c opt //src/main/cc/wfa/virtual_people/training:adm_trainer_main
+// bazel-bin/src/main/cc/wfa/virtual_people/training/adm_trainer_main \
+// --input_path=/tmp/adm/observations.csv --population=4000 \
+// --output_path=/tmp/adm/mixture.csv --threads=8
+//
+// To fit 1000 synthetic observations from the 2 deltas of the notebook
+// bazel-bin/src/main/cc/wfa/virtual_people/training/adm_trainer_main \
+// --synthetic_observations=1000
+
+#include <math.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+#include "wfa/virtual_people/training/adaptive_dirac_mixture.h"
+
+ABSL_FLAG(std::string, input_path, "",
+          "Path to the CSV file of the reach observations. Exactly one of "
+          "[input_path, synthetic_observations] must be set.");
+ABSL_FLAG(uint32_t, synthetic_observations, 0,
+          "If positive, fits this count of synthetic observations from a "
+          "mixture of 2 deltas (1.5, 0.5) and (0.5, 1.5) with alpha 0.5 each, "
+          "instead of reading input_path.");
+ABSL_FLAG(double, population, 1.0,
+          "The reaches in the input are divided by this value.");
+ABSL_FLAG(std::string, output_path, "",
+          "Path to write the fitted mixture. Writes to stdout if not set.");
+ABSL_FLAG(uint32_t, new_deltas_per_step, 10,
+          "The count of new deltas sampled at each step.");
+ABSL_FLAG(double, new_deltas_sigma, 0.01,
+          "The standard deviation of the noise added to the new deltas.");
+ABSL_FLAG(uint32_t, max_steps, 1000, "The count of training steps.");
+ABSL_FLAG(uint32_t, threads, 1,
+          "The count of threads used to evaluate the new deltas and to fit "
+          "the alphas.");
+ABSL_FLAG(uint32_t, seed, 1, "The seed of the random generator.");
+
+namespace wfa_virtual_people {
+
+ReachObservations ReadObservations(absl::string_view path,
+                                   const double population) {
+  CHECK(population > 0.0) << "population must be positive.";
+  std::ifstream input{std::string(path)};
+  CHECK(input.is_open()) << "Unable to open file: " << path;
+  ReachObservations observations;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(input, line)) {
+    ++line_number;
+    absl::string_view content = absl::StripAsciiWhitespace(line);
+    if (content.empty() || absl::StartsWith(content, "#")) {
+      continue;
+    }
+    std::vector<absl::string_view> fields = absl::StrSplit(content, ',');
+    CHECK(fields.size() >= 2)
+        << "Expect at least 2 fields at line " << line_number;
+    if (observations.dimension == 0) {
+      observations.dimension = fields.size() - 1;
+    }
+    CHECK(fields.size() == observations.dimension + 1)
+        << "Expect " << observations.dimension + 1 << " fields at line "
+        << line_number;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      double value;
+      CHECK(absl::SimpleAtod(absl::StripAsciiWhitespace(fields[i]), &value))
+          << "Invalid number at line " << line_number << ": " << fields[i];
+      if (i + 1 < fields.size()) {
+        observations.signals.push_back(value / population);
+      } else {
+        observations.targets.push_back(value / population);
+      }
+    }
+  }
+  return observations;
+}
+
+}  // namespace wfa_virtual_people
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  std::string input_path = absl::GetFlag(FLAGS_input_path);
+  uint32_t synthetic_observations = absl::GetFlag(FLAGS_synthetic_observations);
+  CHECK(input_path.empty() != (synthetic_observations == 0))
+      << "Exactly one of [input_path, synthetic_observations] must be set.";
+
+  wfa_virtual_people::RandomGenerator random_generator(
+      absl::GetFlag(FLAGS_seed));
+  wfa_virtual_people::ReachObservations observations;
+  if (synthetic_observations > 0) {
+    wfa_virtual_people::DiracMixture underlying = {
+        .alphas = {0.5, 0.5}, .deltas = {{1.5, 0.5}, {0.5, 1.5}}};
+    observations = wfa_virtual_people::GetSyntheticObservations(
+        underlying, synthetic_observations, random_generator);
+  } else {
+    observations = wfa_virtual_people::ReadObservations(
+        input_path, absl::GetFlag(FLAGS_population));
+  }
+  LOG(INFO) << "Fitting " << observations.size() << " observations in "
+            << observations.dimension << " id spaces.";
+
+  wfa_virtual_people::AdaptiveDiracMixtureOptions options;
+  options.new_deltas_per_step =
+      static_cast<int>(absl::GetFlag(FLAGS_new_deltas_per_step));
+  options.new_deltas_sigma = absl::GetFlag(FLAGS_new_deltas_sigma);
+  options.max_steps = static_cast<int>(absl::GetFlag(FLAGS_max_steps));
+  options.threads = static_cast<int>(absl::GetFlag(FLAGS_threads));
+  absl::Time start = absl::Now();
+  wfa_virtual_people::DiracMixture mixture =
+      wfa_virtual_people::FitAdaptiveDiracMixture(observations, options,
+                                                  random_generator);
+  absl::Duration elapsed = absl::Now() - start;
+
+  double squared_error = 0.0;
+  for (size_t i = 0; i < observations.size(); ++i) {
+    double error =
+        mixture.Predict(observations.signal(i)) - observations.targets[i];
+    squared_error += error * error;
+  }
+  LOG(INFO) << "Fitted " << mixture.alphas.size() << " deltas in "
+            << absl::FormatDuration(elapsed) << ", root mean squared error "
+            << sqrt(squared_error / observations.size());
+
+  std::string output_path = absl::GetFlag(FLAGS_output_path);
+  if (output_path.empty()) {
+    std::cout << mixture.ToCsv();
+  } else {
+    std::ofstream output(output_path);
+    CHECK(output.is_open()) << "Unable to open file: " << output_path;
+    output << mixture.ToCsv();
+  }
+  return 0;
+}
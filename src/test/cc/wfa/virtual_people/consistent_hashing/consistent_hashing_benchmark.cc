@@ -0,0 +1,75 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "src/farmhash.h"
+#include "wfa/virtual_people/consistent_hashing/consistent_hashing.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// The count of fingerprints hashed by each call of HashBatch.
+constexpr int kBatchSize = 4096;
+
+// Returns a uniform distribution of @choice_count choices.
+std::unique_ptr<ConsistentHashing> BuildUniform(const int choice_count) {
+  std::vector<DistributionChoice> distribution;
+  for (int i = 0; i < choice_count; ++i) {
+    distribution.push_back({.choice_id = i, .probability = 1.0});
+  }
+  return *ConsistentHashing::Build(distribution);
+}
+
+std::vector<uint64_t> GetFingerprints(const int count) {
+  std::vector<uint64_t> fingerprints;
+  fingerprints.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    fingerprints.push_back(util::Fingerprint64(absl::StrCat("user-", i)));
+  }
+  return fingerprints;
+}
+
+// The argument is the count of choices.
+void BM_Hash(benchmark::State& state) {
+  std::unique_ptr<ConsistentHashing> hashing = BuildUniform(state.range(0));
+  std::vector<uint64_t> fingerprints = GetFingerprints(kBatchSize);
+  size_t index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hashing->Hash(fingerprints[index]));
+    index = (index + 1) % fingerprints.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Hash)->Arg(2)->Arg(10)->Arg(100);
+
+// The argument is the count of choices.
+void BM_HashBatch(benchmark::State& state) {
+  std::unique_ptr<ConsistentHashing> hashing = BuildUniform(state.range(0));
+  std::vector<uint64_t> fingerprints = GetFingerprints(kBatchSize);
+  std::vector<int32_t> output(kBatchSize);
+  for (auto _ : state) {
+    hashing->HashBatch(fingerprints, absl::MakeSpan(output));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_HashBatch)->Arg(2)->Arg(10)->Arg(100);
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,206 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/consistent_hashing/consistent_hashing.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/farmhash.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::Gt;
+using ::testing::Lt;
+
+constexpr int kIdCount = 100000;
+
+// Returns the fingerprints of kIdCount distinct ids.
+std::vector<uint64_t> GetFingerprints() {
+  std::vector<uint64_t> fingerprints;
+  fingerprints.reserve(kIdCount);
+  for (int i = 0; i < kIdCount; ++i) {
+    fingerprints.push_back(util::Fingerprint64(absl::StrCat("user-", i)));
+  }
+  return fingerprints;
+}
+
+std::unique_ptr<ConsistentHashing> BuildOrDie(
+    const std::vector<DistributionChoice>& distribution) {
+  absl::StatusOr<std::unique_ptr<ConsistentHashing>> hashing =
+      ConsistentHashing::Build(distribution);
+  EXPECT_TRUE(hashing.ok()) << hashing.status();
+  return *std::move(hashing);
+}
+
+// Returns the count of fingerprints that get different choices from
+// @hashing_1 and @hashing_2.
+int GetSwapCount(const ConsistentHashing& hashing_1,
+                 const ConsistentHashing& hashing_2,
+                 const std::vector<uint64_t>& fingerprints) {
+  int swap_count = 0;
+  for (uint64_t fingerprint : fingerprints) {
+    if (hashing_1.Hash(fingerprint) != hashing_2.Hash(fingerprint)) {
+      ++swap_count;
+    }
+  }
+  return swap_count;
+}
+
+TEST(ConsistentHashingTest, InvalidDistribution) {
+  EXPECT_EQ(ConsistentHashing::Build({}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ConsistentHashing::Build({{0, 0.5}, {0, 0.5}}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ConsistentHashing::Build({{0, 1.5}, {1, -0.5}}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ConsistentHashing::Build({{0, 0.0}, {1, 0.0}}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+// The first sanity check in the notebook.
+TEST(ConsistentHashingTest, FollowsDistribution) {
+  std::unique_ptr<ConsistentHashing> hashing =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  absl::flat_hash_map<int32_t, int> counts;
+  for (uint64_t fingerprint : GetFingerprints()) {
+    ++counts[hashing->Hash(fingerprint)];
+  }
+  EXPECT_EQ(counts.size(), 4);
+  EXPECT_THAT(static_cast<double>(counts[0]) / kIdCount,
+              DoubleNear(0.4, 0.01));
+  for (int32_t choice_id : {1, 2, 3}) {
+    EXPECT_THAT(static_cast<double>(counts[choice_id]) / kIdCount,
+                DoubleNear(0.2, 0.01));
+  }
+}
+
+TEST(ConsistentHashingTest, ProbabilitiesAreNormalized) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{0, 4.0}, {1, 2.0}, {2, 2.0}, {3, 2.0}});
+  EXPECT_EQ(GetSwapCount(*hashing_1, *hashing_2, GetFingerprints()), 0);
+}
+
+TEST(ConsistentHashingTest, ZeroProbabilityIsNeverSelected) {
+  std::unique_ptr<ConsistentHashing> hashing =
+      BuildOrDie({{0, 0.5}, {1, 0.0}, {2, 0.5}});
+  for (uint64_t fingerprint : GetFingerprints()) {
+    EXPECT_NE(hashing->Hash(fingerprint), 1);
+  }
+}
+
+TEST(ConsistentHashingTest, IndependentOfChoiceOrder) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{3, 0.2}, {1, 0.2}, {0, 0.4}, {2, 0.2}});
+  EXPECT_EQ(GetSwapCount(*hashing_1, *hashing_2, GetFingerprints()), 0);
+}
+
+// The second sanity check in the notebook, which moves 0.2 of the probability
+// from choice 0 to choice 3, with the fingerprint hash. At least 20% of the
+// ids must change, and the exponential race moves the ids of the other
+// choices only slightly.
+TEST(ConsistentHashingTest, DistributionChangeSwapsFewIds) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{0, 0.2}, {1, 0.2}, {2, 0.2}, {3, 0.4}});
+  double swap_ratio =
+      static_cast<double>(
+          GetSwapCount(*hashing_1, *hashing_2, GetFingerprints())) /
+      kIdCount;
+  EXPECT_THAT(swap_ratio, Gt(0.2));
+  EXPECT_THAT(swap_ratio, Lt(0.3));
+}
+
+TEST(ConsistentHashingTest, SmallDistributionChangeSwapsFewIds) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{0, 0.39}, {1, 0.2}, {2, 0.2}, {3, 0.21}});
+  double swap_ratio =
+      static_cast<double>(
+          GetSwapCount(*hashing_1, *hashing_2, GetFingerprints())) /
+      kIdCount;
+  EXPECT_THAT(swap_ratio, Lt(0.02));
+}
+
+// The second sanity check in the notebook, with the string hash of the
+// notebook on the ids "0" to "9999". The notebook reports 2746 swaps, with
+// farmhash.hash64 of pyfarmhash, which is Fingerprint64 for keys up to 32
+// bytes.
+TEST(ConsistentHashingTest, HashStringMatchesNotebook) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{0, 0.2}, {1, 0.2}, {2, 0.2}, {3, 0.4}});
+  int swap_count = 0;
+  for (int i = 0; i < 10000; ++i) {
+    const std::string id = absl::StrCat(i);
+    if (hashing_1->Hash(id) != hashing_2->Hash(id)) {
+      ++swap_count;
+    }
+  }
+  EXPECT_EQ(swap_count, 2746);
+}
+
+TEST(ConsistentHashingTest, HashStringFollowsDistribution) {
+  std::unique_ptr<ConsistentHashing> hashing_1 =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}});
+  std::unique_ptr<ConsistentHashing> hashing_2 =
+      BuildOrDie({{3, 0.2}, {1, 0.2}, {0, 0.4}, {2, 0.2}});
+  absl::flat_hash_map<int32_t, int> counts;
+  for (int i = 0; i < kIdCount; ++i) {
+    const std::string id = absl::StrCat("user-", i);
+    const int32_t choice_id = hashing_1->Hash(id);
+    // Independent of the order of the choices.
+    EXPECT_EQ(hashing_2->Hash(id), choice_id);
+    ++counts[choice_id];
+  }
+  EXPECT_THAT(static_cast<double>(counts[0]) / kIdCount,
+              DoubleNear(0.4, 0.01));
+  for (int32_t choice_id : {1, 2, 3}) {
+    EXPECT_THAT(static_cast<double>(counts[choice_id]) / kIdCount,
+                DoubleNear(0.2, 0.01));
+  }
+}
+
+TEST(ConsistentHashingTest, HashBatchSameAsHash) {
+  std::unique_ptr<ConsistentHashing> hashing =
+      BuildOrDie({{0, 0.4}, {1, 0.2}, {2, 0.2}, {3, 0.2}, {7, 0.0}});
+  std::vector<uint64_t> fingerprints = GetFingerprints();
+  // Not a multiple of the block size.
+  fingerprints.resize(1000);
+  std::vector<int32_t> output(fingerprints.size());
+  hashing->HashBatch(fingerprints, absl::MakeSpan(output));
+  for (size_t i = 0; i < fingerprints.size(); ++i) {
+    EXPECT_EQ(output[i], hashing->Hash(fingerprints[i]));
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,215 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/corpus/corpus_compiler.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+
+std::string GetTestPath(absl::string_view name) {
+  return absl::StrCat(testing::TempDir(), "/", name);
+}
+
+void WriteFile(const std::string& path, absl::string_view content) {
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  output << content;
+}
+
+std::vector<std::string> ReadRecords(const std::string& path) {
+  absl::StatusOr<std::unique_ptr<IndexedRecordReader>> reader =
+      IndexedRecordReader::Open(path);
+  EXPECT_TRUE(reader.ok()) << reader.status();
+  std::vector<std::string> records;
+  for (size_t i = 0; reader.ok() && i < (*reader)->size(); ++i) {
+    absl::StatusOr<std::string> record = (*reader)->Read(i);
+    EXPECT_TRUE(record.ok()) << record.status();
+    records.push_back(*record);
+  }
+  return records;
+}
+
+TEST(CorpusCompilerTest, ParseCorpusInputType) {
+  EXPECT_EQ(*ParseCorpusInputType("labeler_event"),
+            CorpusInputType::kLabelerEvent);
+  EXPECT_EQ(*ParseCorpusInputType("data_provider_event"),
+            CorpusInputType::kDataProviderEvent);
+  EXPECT_EQ(*ParseCorpusInputType("labeler_input_list"),
+            CorpusInputType::kLabelerInputList);
+  EXPECT_EQ(ParseCorpusInputType("labeler_output").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(CorpusCompilerTest, SplitTopLevelFields) {
+  absl::StatusOr<std::vector<absl::string_view>> chunks = SplitTopLevelFields(
+      "# comment { with brackets\n"
+      "inputs { event_id: \"a}\\\"\" }\n"
+      "inputs < event_id: 'b{' >\n"
+      "scalar: 1 inputs: { }\n"
+      "[ext.name] { a: [1, 2] }\n"
+      "inputs [{ }, { }]\n"
+      "trailing: 2  # comment\n");
+  ASSERT_TRUE(chunks.ok()) << chunks.status();
+  EXPECT_THAT(*chunks,
+              ElementsAre("inputs { event_id: \"a}\\\"\" }",
+                          "inputs < event_id: 'b{' >", "scalar: 1 inputs: { }",
+                          "[ext.name] { a: [1, 2] }", "inputs [{ }, { }]",
+                          "trailing: 2"));
+
+  EXPECT_TRUE(SplitTopLevelFields("")->empty());
+  EXPECT_EQ(SplitTopLevelFields("inputs { }}").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SplitTopLevelFields("inputs { ").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SplitTopLevelFields("inputs { event_id: \"a }").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(CorpusCompilerTest, ParseLabelerInputList) {
+  LabelerInputList inputs;
+  for (int i = 0; i < 1000; ++i) {
+    LabelerInput* input = inputs.add_inputs();
+    // Brackets and quotes in strings do not split the inputs.
+    input->mutable_event_id()->set_id(absl::StrCat("event-{\"'", i, "'}"));
+    input->set_timestamp_usec(1000000 + i);
+  }
+  std::string textproto;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &textproto));
+  // Also in the single-line format.
+  std::string short_textproto;
+  google::protobuf::TextFormat::Printer printer;
+  printer.SetSingleLineMode(true);
+  ASSERT_TRUE(printer.PrintToString(inputs, &short_textproto));
+
+  for (const std::string& text : {textproto, short_textproto}) {
+    LabelerInputList serial;
+    ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(text, &serial));
+    for (const int threads : {1, 3, 8}) {
+      LabelerInputList output;
+      absl::Status status = ParseLabelerInputList(text, threads, output);
+      ASSERT_TRUE(status.ok()) << status;
+      EXPECT_EQ(output.SerializeAsString(), serial.SerializeAsString())
+          << "threads: " << threads;
+    }
+  }
+
+  LabelerInputList output;
+  EXPECT_EQ(ParseLabelerInputList("inputs { unknown: 1 }", 2, output).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ParseLabelerInputList("inputs { ", 2, output).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(CorpusCompilerTest, CompileLabelerInputList) {
+  LabelerInputList inputs;
+  for (int i = 0; i < 100; ++i) {
+    LabelerInput* input = inputs.add_inputs();
+    input->mutable_event_id()->set_id(absl::StrCat("event-", i, "}"));
+    input->mutable_profile_info()->mutable_email_user_info()->set_user_id(
+        absl::StrCat("email-", i));
+  }
+  std::string textproto;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &textproto));
+  std::string input_path = GetTestPath("inputs.textproto");
+  WriteFile(input_path, textproto);
+  // The same list is compiled twice from 2 files.
+  std::vector<std::string> input_paths = {input_path, input_path};
+
+  std::string expected_path = GetTestPath("inputs_1.idx");
+  ASSERT_TRUE(CompileCorpus(input_paths, CorpusInputType::kLabelerInputList,
+                            expected_path, 1)
+                  .ok());
+  std::vector<std::string> records = ReadRecords(expected_path);
+  ASSERT_EQ(records.size(), 200);
+  for (size_t i = 0; i < records.size(); ++i) {
+    LabelerInput input;
+    ASSERT_TRUE(input.ParseFromString(records[i]));
+    EXPECT_EQ(input.SerializeAsString(),
+              inputs.inputs(i % 100).SerializeAsString());
+  }
+
+  // The output does not depend on the count of threads.
+  for (const int threads : {2, 8}) {
+    std::string path = GetTestPath(absl::StrCat("inputs_", threads, ".idx"));
+    ASSERT_TRUE(CompileCorpus(input_paths, CorpusInputType::kLabelerInputList,
+                              path, threads)
+                    .ok());
+    EXPECT_EQ(ReadRecords(path), records);
+  }
+}
+
+TEST(CorpusCompilerTest, CompileDataProviderEvents) {
+  std::vector<std::string> input_paths;
+  std::vector<DataProviderEvent> events(3);
+  for (int i = 0; i < 3; ++i) {
+    events[i].mutable_log_event()->mutable_labeler_input()->set_user_agent(
+        absl::StrCat("agent-", i));
+    std::string textproto;
+    ASSERT_TRUE(
+        google::protobuf::TextFormat::PrintToString(events[i], &textproto));
+    input_paths.push_back(GetTestPath(absl::StrCat("event_", i, ".textproto")));
+    WriteFile(input_paths.back(), textproto);
+  }
+  std::string output_path = GetTestPath("events.idx");
+  ASSERT_TRUE(CompileCorpus(input_paths, CorpusInputType::kDataProviderEvent,
+                            output_path, 2)
+                  .ok());
+  EXPECT_THAT(ReadRecords(output_path),
+              ElementsAre(events[0].SerializeAsString(),
+                          events[1].SerializeAsString(),
+                          events[2].SerializeAsString()));
+}
+
+TEST(CorpusCompilerTest, InvalidInput) {
+  std::string output_path = GetTestPath("invalid.idx");
+  EXPECT_EQ(CompileCorpus({GetTestPath("missing.textproto")},
+                          CorpusInputType::kLabelerEvent, output_path, 1)
+                .code(),
+            absl::StatusCode::kNotFound);
+
+  std::string input_path = GetTestPath("invalid.textproto");
+  WriteFile(input_path,
+            "inputs { user_agent: \"a\" }\ninputs { unknown: 1 }\n");
+  absl::Status status = CompileCorpus(
+      {input_path}, CorpusInputType::kLabelerInputList, output_path, 2);
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("at byte 27"));
+
+  WriteFile(input_path, "inputs { user_agent: \"a\" ");
+  EXPECT_EQ(CompileCorpus({input_path}, CorpusInputType::kLabelerInputList,
+                          output_path, 1)
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
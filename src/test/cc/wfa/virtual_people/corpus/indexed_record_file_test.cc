@@ -0,0 +1,132 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/event.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+std::string GetTestPath(absl::string_view name) {
+  return absl::StrCat(testing::TempDir(), "/", name);
+}
+
+void WriteRecords(const std::string& path,
+                  const std::vector<std::string>& records) {
+  absl::StatusOr<std::unique_ptr<IndexedRecordWriter>> writer =
+      IndexedRecordWriter::Open(path);
+  ASSERT_TRUE(writer.ok()) << writer.status();
+  for (const std::string& record : records) {
+    ASSERT_TRUE((*writer)->Write(record).ok());
+  }
+  ASSERT_TRUE((*writer)->Close().ok());
+}
+
+TEST(IndexedRecordFileTest, WriteAndRead) {
+  std::string path = GetTestPath("write_and_read.idx");
+  // Large records are written across several flushes.
+  std::vector<std::string> records = {"a", "", "bc", std::string(3 << 20, 'x'),
+                                      std::string(1, '\0'), "last"};
+  WriteRecords(path, records);
+
+  absl::StatusOr<std::unique_ptr<IndexedRecordReader>> reader =
+      IndexedRecordReader::Open(path);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  ASSERT_EQ((*reader)->size(), records.size());
+  // Reads out of order.
+  for (size_t i = records.size(); i > 0; --i) {
+    absl::StatusOr<std::string> record = (*reader)->Read(i - 1);
+    ASSERT_TRUE(record.ok()) << record.status();
+    EXPECT_EQ(*record, records[i - 1]);
+  }
+  EXPECT_EQ((*reader)->Read(records.size()).status().code(),
+            absl::StatusCode::kOutOfRange);
+}
+
+TEST(IndexedRecordFileTest, NoRecords) {
+  std::string path = GetTestPath("no_records.idx");
+  WriteRecords(path, {});
+  absl::StatusOr<std::unique_ptr<IndexedRecordReader>> reader =
+      IndexedRecordReader::Open(path);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  EXPECT_EQ((*reader)->size(), 0);
+}
+
+TEST(IndexedRecordFileTest, ReadMessage) {
+  std::string path = GetTestPath("read_message.idx");
+  DataProviderEvent event;
+  event.mutable_log_event()->mutable_labeler_input()->set_user_agent("agent");
+  WriteRecords(path, {event.SerializeAsString(), "\xff"});
+
+  absl::StatusOr<std::unique_ptr<IndexedRecordReader>> reader =
+      IndexedRecordReader::Open(path);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  DataProviderEvent output;
+  ASSERT_TRUE((*reader)->ReadMessage(0, output).ok());
+  EXPECT_EQ(output.log_event().labeler_input().user_agent(), "agent");
+  EXPECT_EQ((*reader)->ReadMessage(1, output).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(IndexedRecordFileTest, InvalidFiles) {
+  EXPECT_EQ(IndexedRecordReader::Open(GetTestPath("missing.idx"))
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+
+  std::string path = GetTestPath("invalid.idx");
+  WriteRecords(path, {"a", "b"});
+  std::string content;
+  {
+    std::ifstream input(path, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+  }
+  // Truncated, or with a corrupted index.
+  for (const std::string& invalid :
+       {std::string("VPRIDX01"), content.substr(1),
+        content.substr(0, content.size() - 1),
+        std::string(content).replace(10, 1, "\x7f")}) {
+    {
+      std::ofstream output(path, std::ios::binary | std::ios::trunc);
+      output << invalid;
+    }
+    EXPECT_EQ(IndexedRecordReader::Open(path).status().code(),
+              absl::StatusCode::kInvalidArgument);
+  }
+}
+
+TEST(IndexedRecordFileTest, WriteAfterClose) {
+  absl::StatusOr<std::unique_ptr<IndexedRecordWriter>> writer =
+      IndexedRecordWriter::Open(GetTestPath("closed.idx"));
+  ASSERT_TRUE(writer.ok()) << writer.status();
+  ASSERT_TRUE((*writer)->Close().ok());
+  EXPECT_EQ((*writer)->Write("a").code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ((*writer)->Close().code(), absl::StatusCode::kFailedPrecondition);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
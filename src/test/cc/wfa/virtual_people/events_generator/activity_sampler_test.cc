@@ -0,0 +1,153 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::ElementsAre;
+using ::testing::Lt;
+
+constexpr int kSampleNumber = 100000;
+
+// Returns the observed frequency of each index.
+std::vector<double> GetFrequencies(const ActivitySampler& sampler,
+                                   RandomGenerator& random_generator) {
+  std::vector<double> frequencies(sampler.size(), 0.0);
+  for (int i = 0; i < kSampleNumber; ++i) {
+    uint32_t index = sampler.Sample(random_generator);
+    EXPECT_THAT(index, Lt(sampler.size()));
+    frequencies[index] += 1.0 / kSampleNumber;
+  }
+  return frequencies;
+}
+
+TEST(ActivitySamplerTest, ParseUniform) {
+  absl::StatusOr<ActivityDistribution> distribution =
+      ParseActivityDistribution("uniform");
+  ASSERT_TRUE(distribution.ok()) << distribution.status();
+  EXPECT_EQ(distribution->type, ActivityDistributionType::kUniform);
+}
+
+TEST(ActivitySamplerTest, ParseZipf) {
+  absl::StatusOr<ActivityDistribution> distribution =
+      ParseActivityDistribution("zipf:1.5");
+  ASSERT_TRUE(distribution.ok()) << distribution.status();
+  EXPECT_EQ(distribution->type, ActivityDistributionType::kZipf);
+  EXPECT_EQ(distribution->zipf_exponent, 1.5);
+}
+
+TEST(ActivitySamplerTest, ParseLogNormal) {
+  absl::StatusOr<ActivityDistribution> distribution =
+      ParseActivityDistribution("log_normal:2");
+  ASSERT_TRUE(distribution.ok()) << distribution.status();
+  EXPECT_EQ(distribution->type, ActivityDistributionType::kLogNormal);
+  EXPECT_EQ(distribution->log_normal_sigma, 2.0);
+}
+
+TEST(ActivitySamplerTest, ParseEmpirical) {
+  absl::StatusOr<ActivityDistribution> distribution =
+      ParseActivityDistribution("empirical:3,0,1");
+  ASSERT_TRUE(distribution.ok()) << distribution.status();
+  EXPECT_EQ(distribution->type, ActivityDistributionType::kEmpirical);
+  EXPECT_THAT(distribution->empirical_histogram, ElementsAre(3.0, 0.0, 1.0));
+}
+
+TEST(ActivitySamplerTest, ParseInvalid) {
+  EXPECT_FALSE(ParseActivityDistribution("").ok());
+  EXPECT_FALSE(ParseActivityDistribution("uniform:1").ok());
+  EXPECT_FALSE(ParseActivityDistribution("zipf").ok());
+  EXPECT_FALSE(ParseActivityDistribution("zipf:-1").ok());
+  EXPECT_FALSE(ParseActivityDistribution("zipf:abc").ok());
+  EXPECT_FALSE(ParseActivityDistribution("empirical:0,0").ok());
+  EXPECT_FALSE(ParseActivityDistribution("pareto:1").ok());
+}
+
+TEST(ActivitySamplerTest, EmpiricalWeightsByRank) {
+  RandomGenerator random_generator(1);
+  ActivityDistribution distribution = {
+      .type = ActivityDistributionType::kEmpirical,
+      .empirical_histogram = {3.0, 1.0}};
+  EXPECT_THAT(GetActivityWeights(distribution, 4, random_generator),
+              ElementsAre(3.0, 3.0, 1.0, 1.0));
+}
+
+TEST(ActivitySamplerTest, EmpiricalWeightsWithFewerEntriesThanBuckets) {
+  RandomGenerator random_generator(1);
+  // The positive buckets are not at the start of any of the entries.
+  ActivityDistribution distribution = {
+      .type = ActivityDistributionType::kEmpirical,
+      .empirical_histogram = {0.0, 4.0, 0.0, 0.0, 0.0, 2.0, 0.0, 0.0}};
+  EXPECT_THAT(GetActivityWeights(distribution, 2, random_generator),
+              ElementsAre(1.0, 0.5));
+  EXPECT_THAT(GetActivityWeights(distribution, 3, random_generator),
+              ElementsAre(1.5, 0.25, 0.5));
+
+  ActivitySampler sampler(distribution, 2, random_generator);
+  EXPECT_THAT(GetFrequencies(sampler, random_generator),
+              ElementsAre(DoubleNear(2.0 / 3, 0.01),
+                          DoubleNear(1.0 / 3, 0.01)));
+}
+
+TEST(ActivitySamplerTest, UniformFrequencies) {
+  RandomGenerator random_generator(1);
+  ActivitySampler sampler(ActivityDistribution(), 4, random_generator);
+  EXPECT_THAT(GetFrequencies(sampler, random_generator),
+              ElementsAre(DoubleNear(0.25, 0.01), DoubleNear(0.25, 0.01),
+                          DoubleNear(0.25, 0.01), DoubleNear(0.25, 0.01)));
+}
+
+TEST(ActivitySamplerTest, WeightedFrequencies) {
+  RandomGenerator random_generator(1);
+  ActivitySampler sampler({5.0, 0.0, 2.0, 1.0});
+  EXPECT_THAT(GetFrequencies(sampler, random_generator),
+              ElementsAre(DoubleNear(0.625, 0.01), 0.0, DoubleNear(0.25, 0.01),
+                          DoubleNear(0.125, 0.01)));
+}
+
+TEST(ActivitySamplerTest, ZipfFrequencies) {
+  RandomGenerator random_generator(1);
+  ActivityDistribution distribution = {
+      .type = ActivityDistributionType::kZipf, .zipf_exponent = 2.0};
+  ActivitySampler sampler(distribution, 3, random_generator);
+  // The weights are 1, 1/4, 1/9.
+  double total = 1.0 + 1.0 / 4 + 1.0 / 9;
+  EXPECT_THAT(GetFrequencies(sampler, random_generator),
+              ElementsAre(DoubleNear(1.0 / total, 0.01),
+                          DoubleNear(1.0 / 4 / total, 0.01),
+                          DoubleNear(1.0 / 9 / total, 0.01)));
+}
+
+TEST(ActivitySamplerTest, LogNormalWeightsArePositive) {
+  RandomGenerator random_generator(1);
+  ActivityDistribution distribution = {
+      .type = ActivityDistributionType::kLogNormal, .log_normal_sigma = 1.0};
+  std::vector<double> weights =
+      GetActivityWeights(distribution, 100, random_generator);
+  for (double weight : weights) {
+    EXPECT_GT(weight, 0.0);
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,179 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/arrival_rate.h"
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::ElementsAre;
+using ::testing::Ge;
+using ::testing::Le;
+
+// 3600 * 1000 * 1000
+constexpr uint64_t kMicrosecPerHour = 3600000000;
+
+// 2021-01-04 00:00:00 UTC, which is a Monday.
+constexpr uint64_t kMondayTimestampUsec = 1609718400000000;
+
+constexpr int kSampleNumber = 100000;
+
+// Returns the count of arrival times in each hour after @start_timestamp_usec.
+std::vector<int> GetHourlyCounts(const ArrivalRateCurve& curve,
+                                 const uint64_t start_timestamp_usec,
+                                 const int hours) {
+  RandomGenerator random_generator(1);
+  OrderedArrivalStream stream(curve, kSampleNumber);
+  std::vector<int> counts(hours, 0);
+  uint64_t previous = 0;
+  while (stream.remaining() > 0) {
+    uint64_t timestamp_usec = stream.Next(random_generator);
+    EXPECT_THAT(timestamp_usec, Ge(previous));
+    previous = timestamp_usec;
+    uint64_t hour = (timestamp_usec - start_timestamp_usec) / kMicrosecPerHour;
+    if (hour < counts.size()) {
+      ++counts[hour];
+    }
+  }
+  return counts;
+}
+
+TEST(ArrivalRateTest, ParseArrivalWeights) {
+  absl::StatusOr<std::vector<double>> weights =
+      ParseArrivalWeights("1,0,2.5", 3);
+  ASSERT_TRUE(weights.ok()) << weights.status();
+  EXPECT_THAT(*weights, ElementsAre(1.0, 0.0, 2.5));
+
+  weights = ParseArrivalWeights("", 3);
+  ASSERT_TRUE(weights.ok()) << weights.status();
+  EXPECT_TRUE(weights->empty());
+
+  EXPECT_FALSE(ParseArrivalWeights("1,2", 3).ok());
+  EXPECT_FALSE(ParseArrivalWeights("1,-2,3", 3).ok());
+  EXPECT_FALSE(ParseArrivalWeights("1,a,3", 3).ok());
+}
+
+TEST(ArrivalRateTest, ParseArrivalBursts) {
+  uint64_t current_timestamp_usec = 100 * kMicrosecPerHour;
+  absl::StatusOr<std::vector<ArrivalBurst>> bursts =
+      ParseArrivalBursts("10:2:5,200:1:0", current_timestamp_usec);
+  ASSERT_TRUE(bursts.ok()) << bursts.status();
+  ASSERT_EQ(bursts->size(), 2);
+  EXPECT_EQ((*bursts)[0].start_timestamp_usec, 90 * kMicrosecPerHour);
+  EXPECT_EQ((*bursts)[0].end_timestamp_usec, 92 * kMicrosecPerHour);
+  EXPECT_EQ((*bursts)[0].multiplier, 5.0);
+  // The start is clamped to 0.
+  EXPECT_EQ((*bursts)[1].start_timestamp_usec, 0);
+  EXPECT_EQ((*bursts)[1].end_timestamp_usec, kMicrosecPerHour);
+  EXPECT_EQ((*bursts)[1].multiplier, 0.0);
+
+  EXPECT_FALSE(ParseArrivalBursts("10:2", current_timestamp_usec).ok());
+  EXPECT_FALSE(ParseArrivalBursts("10:2:-1", current_timestamp_usec).ok());
+}
+
+TEST(ArrivalRateTest, FlatCurve) {
+  ArrivalRateCurve curve(ArrivalRateOptions(), 1000, 2000);
+  EXPECT_EQ(curve.GetTimestampUsec(0.0), 1000);
+  EXPECT_EQ(curve.GetTimestampUsec(0.5), 1500);
+  EXPECT_EQ(curve.GetTimestampUsec(1.0), 2000);
+}
+
+TEST(ArrivalRateTest, DiurnalCurve) {
+  // Only the first 2 hours of each day have arrivals, and the second hour has
+  // 3 times the rate of the first one.
+  ArrivalRateOptions options;
+  options.hourly_weights.resize(kHoursPerDay, 0.0);
+  options.hourly_weights[0] = 1.0;
+  options.hourly_weights[1] = 3.0;
+  ArrivalRateCurve curve(options, kMondayTimestampUsec,
+                         kMondayTimestampUsec + 2 * 24 * kMicrosecPerHour);
+
+  EXPECT_EQ(curve.GetTimestampUsec(0.125),
+            kMondayTimestampUsec + kMicrosecPerHour);
+  // The quantile between the 2 days is mapped to the start of the next hour
+  // with arrivals.
+  EXPECT_EQ(curve.GetTimestampUsec(0.5),
+            kMondayTimestampUsec + 24 * kMicrosecPerHour);
+  EXPECT_EQ(curve.GetTimestampUsec(0.625),
+            kMondayTimestampUsec + 25 * kMicrosecPerHour);
+
+  std::vector<int> counts = GetHourlyCounts(curve, kMondayTimestampUsec, 48);
+  for (int hour = 0; hour < 48; ++hour) {
+    if (hour % 24 == 0) {
+      EXPECT_THAT(counts[hour] / static_cast<double>(kSampleNumber),
+                  DoubleNear(0.125, 0.01));
+    } else if (hour % 24 == 1) {
+      EXPECT_THAT(counts[hour] / static_cast<double>(kSampleNumber),
+                  DoubleNear(0.375, 0.01));
+    } else {
+      EXPECT_EQ(counts[hour], 0);
+    }
+  }
+}
+
+TEST(ArrivalRateTest, WeeklyCurve) {
+  // Only Sunday has arrivals.
+  ArrivalRateOptions options;
+  options.daily_weights = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+  ArrivalRateCurve curve(options, kMondayTimestampUsec,
+                         kMondayTimestampUsec + 7 * 24 * kMicrosecPerHour);
+  EXPECT_EQ(curve.GetTimestampUsec(0.0),
+            kMondayTimestampUsec + 6 * 24 * kMicrosecPerHour);
+  EXPECT_EQ(curve.GetTimestampUsec(0.5),
+            kMondayTimestampUsec + 6 * 24 * kMicrosecPerHour +
+                12 * kMicrosecPerHour);
+}
+
+TEST(ArrivalRateTest, BurstCurve) {
+  // The second hour has 8 times the rate of the other 2 hours.
+  ArrivalRateOptions options;
+  options.bursts.push_back(
+      {.start_timestamp_usec = kMondayTimestampUsec + kMicrosecPerHour,
+       .end_timestamp_usec = kMondayTimestampUsec + 2 * kMicrosecPerHour,
+       .multiplier = 8.0});
+  ArrivalRateCurve curve(options, kMondayTimestampUsec,
+                         kMondayTimestampUsec + 3 * kMicrosecPerHour);
+  std::vector<int> counts = GetHourlyCounts(curve, kMondayTimestampUsec, 3);
+  EXPECT_THAT(counts[0] / static_cast<double>(kSampleNumber),
+              DoubleNear(0.1, 0.01));
+  EXPECT_THAT(counts[1] / static_cast<double>(kSampleNumber),
+              DoubleNear(0.8, 0.01));
+  EXPECT_THAT(counts[2] / static_cast<double>(kSampleNumber),
+              DoubleNear(0.1, 0.01));
+}
+
+TEST(ArrivalRateTest, StreamIsOrderedAndInRange) {
+  ArrivalRateCurve curve(ArrivalRateOptions(), 1000, 2000);
+  RandomGenerator random_generator(1);
+  OrderedArrivalStream stream(curve, 1000);
+  uint64_t previous = 0;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t timestamp_usec = stream.Next(random_generator);
+    EXPECT_THAT(timestamp_usec, Ge(previous));
+    EXPECT_THAT(timestamp_usec, Le(2000));
+    previous = timestamp_usec;
+  }
+  EXPECT_EQ(stream.remaining(), 0);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,74 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/event_id_encoder.h"
+
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::Lt;
+using ::testing::MatchesRegex;
+using ::testing::Ne;
+
+constexpr int kRepeatNumber = 100000;
+
+TEST(EventIdEncoderTest, EncodeIsInjective) {
+  RandomGenerator random_generator(1);
+  EventIdEncoder encoder(random_generator);
+  absl::flat_hash_set<uint64_t> ids;
+  for (uint64_t ordinal = 0; ordinal < kRepeatNumber; ++ordinal) {
+    uint64_t id = encoder.Encode(ordinal);
+    EXPECT_THAT(id, Lt(EventIdEncoder::kMaxOrdinal));
+    EXPECT_TRUE(ids.insert(id).second) << "Duplicate id of " << ordinal;
+  }
+  // The largest ordinals are also mapped to distinct ids in range.
+  for (uint64_t ordinal = EventIdEncoder::kMaxOrdinal - kRepeatNumber;
+       ordinal < EventIdEncoder::kMaxOrdinal; ++ordinal) {
+    uint64_t id = encoder.Encode(ordinal);
+    EXPECT_THAT(id, Lt(EventIdEncoder::kMaxOrdinal));
+    EXPECT_TRUE(ids.insert(id).second) << "Duplicate id of " << ordinal;
+  }
+}
+
+TEST(EventIdEncoderTest, AppendIdHas16Digits) {
+  RandomGenerator random_generator(1);
+  EventIdEncoder encoder(random_generator);
+  for (uint64_t ordinal = 0; ordinal < 1000; ++ordinal) {
+    std::string id = "prefix";
+    encoder.AppendId(ordinal, id);
+    EXPECT_THAT(id, MatchesRegex("prefix[0-9]{16}"));
+    EXPECT_EQ(std::stoull(id.substr(6)), encoder.Encode(ordinal));
+  }
+}
+
+TEST(EventIdEncoderTest, SameSeedSameIds) {
+  RandomGenerator random_generator_1(1);
+  RandomGenerator random_generator_2(1);
+  RandomGenerator random_generator_3(2);
+  EventIdEncoder encoder_1(random_generator_1);
+  EventIdEncoder encoder_2(random_generator_2);
+  EventIdEncoder encoder_3(random_generator_3);
+  EXPECT_EQ(encoder_1.Encode(12345), encoder_2.Encode(12345));
+  EXPECT_THAT(encoder_1.Encode(12345), Ne(encoder_3.Encode(12345)));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,166 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/events_generator/events_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// 2021-07-21 05:58:20 UTC.
+constexpr uint64_t kCurrentTimestamp = 1626847100000000;
+
+// The count of event ids in the generator used by the GetEvent benchmarks. The
+// generator is built again, outside of the timing, when all the event ids are
+// used.
+constexpr uint32_t kTotalEvents = 100000;
+
+// The count of events generated by each call of GetEvents.
+constexpr uint32_t kBatchSize = 1000;
+
+struct EventOptionsMix {
+  const char* name;
+  EventOptions options;
+};
+
+// The option mixes used by the GetEvent benchmarks. The argument of the
+// benchmarks is the index in this list.
+const EventOptionsMix kEventOptionsMixes[] = {
+    {"default",
+     {.unknown_device_ratio = 0.5,
+      .total_countries = 10,
+      .regions_per_country = 10,
+      .cities_per_region = 10,
+      .email_events_ratio = 0.5,
+      .phone_events_ratio = 0.5,
+      .proprietary_id_space_1_events_ratio = 0.5,
+      .profile_version_days = 1}},
+    {"no_user_ids",
+     {.unknown_device_ratio = 0.5,
+      .total_countries = 10,
+      .regions_per_country = 10,
+      .cities_per_region = 10,
+      .email_events_ratio = 0.0,
+      .phone_events_ratio = 0.0,
+      .proprietary_id_space_1_events_ratio = 0.0,
+      .profile_version_days = 1}},
+    {"all_user_ids",
+     {.unknown_device_ratio = 0.5,
+      .total_countries = 10,
+      .regions_per_country = 10,
+      .cities_per_region = 10,
+      .email_events_ratio = 1.0,
+      .phone_events_ratio = 1.0,
+      .proprietary_id_space_1_events_ratio = 1.0,
+      .profile_version_days = kMaxProfileVersionDays}},
+    {"large_geo",
+     {.unknown_device_ratio = 0.5,
+      .total_countries = 900,
+      .regions_per_country = 1000,
+      .cities_per_region = 1000,
+      .email_events_ratio = 0.5,
+      .phone_events_ratio = 0.5,
+      .proprietary_id_space_1_events_ratio = 0.5,
+      .profile_version_days = 1}},
+};
+
+EventsGeneratorOptions GetEventsGeneratorOptions(const uint32_t total_events,
+                                                 const uint32_t users_count) {
+  EventsGeneratorOptions options = {
+      .current_timestamp = kCurrentTimestamp,
+      .total_publishers = 10,
+      .total_events = total_events,
+      .unknown_device_count = users_count,
+      .email_users_count = users_count,
+      .phone_users_count = users_count,
+      .proprietary_id_space_1_users_count = users_count};
+  return options;
+}
+
+void ApplyEventOptionsMixes(benchmark::internal::Benchmark* benchmark) {
+  for (size_t i = 0; i < std::size(kEventOptionsMixes); ++i) {
+    benchmark->Arg(i);
+  }
+}
+
+// The arguments are the count of event ids, and the count of entries in each
+// of the unknown device, email, phone and proprietary_id_space_1 pools.
+void BM_BuildPools(benchmark::State& state) {
+  EventsGeneratorOptions options =
+      GetEventsGeneratorOptions(state.range(0), state.range(1));
+  uint32_t seed = 0;
+  for (auto _ : state) {
+    EventsGenerator generator(options, ++seed);
+    benchmark::DoNotOptimize(&generator);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          (state.range(0) + 4 * state.range(1)));
+}
+BENCHMARK(BM_BuildPools)
+    ->Args({10000, 1000})
+    ->Args({100000, 10000})
+    ->Args({1000000, 10000})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_GetEvent(benchmark::State& state) {
+  const EventOptionsMix& mix = kEventOptionsMixes[state.range(0)];
+  state.SetLabel(mix.name);
+  EventsGeneratorOptions options =
+      GetEventsGeneratorOptions(kTotalEvents, 10000);
+  uint32_t seed = 1;
+  auto generator = std::make_unique<EventsGenerator>(options, seed);
+  uint32_t remaining = kTotalEvents;
+  for (auto _ : state) {
+    if (remaining == 0) {
+      state.PauseTiming();
+      generator = std::make_unique<EventsGenerator>(options, ++seed);
+      remaining = kTotalEvents;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(generator->GetEvent(mix.options));
+    --remaining;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetEvent)->Apply(ApplyEventOptionsMixes);
+
+void BM_GetEvents(benchmark::State& state) {
+  const EventOptionsMix& mix = kEventOptionsMixes[state.range(0)];
+  state.SetLabel(mix.name);
+  EventsGeneratorOptions options =
+      GetEventsGeneratorOptions(kTotalEvents, 10000);
+  uint32_t seed = 1;
+  auto generator = std::make_unique<EventsGenerator>(options, seed);
+  uint32_t remaining = kTotalEvents;
+  for (auto _ : state) {
+    if (remaining < kBatchSize) {
+      state.PauseTiming();
+      generator = std::make_unique<EventsGenerator>(options, ++seed);
+      remaining = kTotalEvents;
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(generator->GetEvents(kBatchSize, mix.options));
+    remaining -= kBatchSize;
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_GetEvents)->Apply(ApplyEventOptionsMixes);
+
+}  // namespace
+}  // namespace wfa_virtual_people
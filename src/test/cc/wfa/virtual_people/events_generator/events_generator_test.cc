@@ -14,13 +14,18 @@
 
 #include "wfa/virtual_people/events_generator/events_generator.h"
 
+#include <algorithm>
 #include <regex>
 #include <string>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "src/farmhash.h"
 #include "wfa/virtual_people/common/event.pb.h"
 
 namespace wfa_virtual_people {
@@ -35,8 +40,8 @@ using ::testing::Matcher;
 using ::testing::MatchesRegex;
 using ::testing::Property;
 
-// 24 * 3600 * 1000
-constexpr uint64_t kMicrosecPerDay = 86400000;
+// 24 * 3600 * 1000 * 1000
+constexpr uint64_t kMicrosecPerDay = 86400000000;
 
 MATCHER_P2(IsBetween, low, high, "") {
   return ExplainMatchResult(AllOf(Ge(low), Le(high)), arg, result_listener);
@@ -167,5 +172,398 @@ TEST(EventsGeneratorTest, SanityCheck) {
   }
 }
 
+TEST(EventsGeneratorTest, GetEventAtSetsTimestamp) {
+  uint64_t current_timestamp = 1626847100000000;
+  uint32_t total_countries = 10;
+  uint32_t regions_per_country = 10;
+  uint32_t cities_per_region = 10;
+
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = current_timestamp,
+      .total_publishers = 10,
+      .total_events = 100,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = total_countries,
+                                .regions_per_country = regions_per_country,
+                                .cities_per_region = cities_per_region,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  for (uint64_t i = 0; i < 100; i++) {
+    uint64_t timestamp_usec = current_timestamp - 1000 + i;
+    DataProviderEvent event =
+        generator.GetEventAt(timestamp_usec, event_options);
+    SCOPED_TRACE(
+        absl::StrCat("Index: ", i, "\n", "Event: ", event.DebugString()));
+    const LabelerInput& labeler_input = event.log_event().labeler_input();
+    EXPECT_EQ(labeler_input.timestamp_usec(), timestamp_usec);
+    EXPECT_THAT(labeler_input.event_id().id(), IsValidId());
+    EXPECT_THAT(labeler_input.user_agent(), IsValidUserAgent());
+    EXPECT_THAT(
+        labeler_input.geo(),
+        IsValidGeo(total_countries, regions_per_country, cities_per_region));
+    EXPECT_THAT(labeler_input.profile_info(),
+                IsValidProfileInfo(total_countries, regions_per_country,
+                                   cities_per_region));
+  }
+}
+
+TEST(EventsGeneratorTest, GetEventsSanityCheck) {
+  uint64_t current_timestamp = 1626847100000000;
+  uint32_t total_events = 1000;
+  uint32_t total_countries = 10;
+  uint32_t regions_per_country = 10;
+  uint32_t cities_per_region = 10;
+
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = current_timestamp,
+      .total_publishers = 10,
+      .total_events = total_events,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = total_countries,
+                                .regions_per_country = regions_per_country,
+                                .cities_per_region = cities_per_region,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  std::vector<DataProviderEvent> events =
+      generator.GetEvents(total_events, event_options);
+  ASSERT_EQ(events.size(), total_events);
+  for (int i = 0; i < total_events; i++) {
+    const DataProviderEvent& event = events[i];
+    SCOPED_TRACE(
+        absl::StrCat("Index: ", i, "\n", "Event: ", event.DebugString()));
+    const LabelerInput& labeler_input = event.log_event().labeler_input();
+    EXPECT_THAT(labeler_input.event_id().publisher(), IsValidPublisher());
+    EXPECT_THAT(labeler_input.event_id().id(), IsValidId());
+    EXPECT_THAT(labeler_input.timestamp_usec(),
+                IsValidTimestampUsec(current_timestamp));
+    EXPECT_THAT(labeler_input.user_agent(), IsValidUserAgent());
+    EXPECT_THAT(
+        labeler_input.geo(),
+        IsValidGeo(total_countries, regions_per_country, cities_per_region));
+    EXPECT_THAT(labeler_input.profile_info(),
+                IsValidProfileInfo(total_countries, regions_per_country,
+                                   cities_per_region));
+  }
+}
+
+TEST(EventsGeneratorTest, AppendLabelerInputsSameAsGetEvents) {
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = 10,
+      .total_events = 1000,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options, /*seed=*/42);
+  std::vector<DataProviderEvent> events =
+      generator.GetEvents(500, event_options);
+  EventsGenerator appending_generator(events_generator_options, /*seed=*/42);
+  google::protobuf::RepeatedPtrField<LabelerInput> labeler_inputs;
+  // Appends after an existing element.
+  labeler_inputs.Add();
+  appending_generator.AppendLabelerInputs(500, event_options, labeler_inputs);
+
+  ASSERT_EQ(labeler_inputs.size(), events.size() + 1);
+  for (size_t i = 0; i < events.size(); ++i) {
+    SCOPED_TRACE(absl::StrCat("Index: ", i));
+    EXPECT_EQ(labeler_inputs[i + 1].SerializeAsString(),
+              events[i].log_event().labeler_input().SerializeAsString());
+  }
+}
+
+TEST(GenerationPlanTest, PrecomputedValues) {
+  EventOptions event_options = {.unknown_device_ratio = 1.0,
+                                .total_countries = 10,
+                                .regions_per_country = 20,
+                                .cities_per_region = 30,
+                                .email_events_ratio = 0.0,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 2};
+  GenerationPlan plan(event_options, absl::CivilDay(2021, 3, 1));
+  EXPECT_TRUE(plan.IsCompiledFrom(event_options));
+  EXPECT_EQ(plan.max_country_id(), 109);
+  EXPECT_EQ(plan.max_region_suffix(), 19);
+  EXPECT_EQ(plan.max_city_suffix(), 29);
+  EXPECT_EQ(plan.unknown_device_threshold(),
+            RandomGenerator::GetBoolThreshold(1.0));
+  EXPECT_EQ(plan.email_threshold(), 0);
+  EXPECT_EQ(plan.profile_version(0), "2021-03-01");
+  EXPECT_EQ(plan.profile_version(1), "2021-02-28");
+  EXPECT_EQ(plan.profile_version(2), "2021-02-27");
+  EXPECT_EQ(plan.profile_version_timestamp_usec(0), 1614556800000000);
+
+  event_options.phone_events_ratio = 0.6;
+  EXPECT_FALSE(plan.IsCompiledFrom(event_options));
+}
+
+TEST(EventsGeneratorTest, SkewedPublisherActivity) {
+  uint32_t total_publishers = 10;
+  uint32_t total_events = 1000;
+
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = total_publishers,
+      .total_events = total_events,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100,
+      .publisher_activity = {.type = ActivityDistributionType::kZipf,
+                             .zipf_exponent = 2.0},
+      .unknown_device_activity = {.type = ActivityDistributionType::kZipf,
+                                  .zipf_exponent = 1.0},
+      .user_activity = {.type = ActivityDistributionType::kZipf,
+                        .zipf_exponent = 1.0}};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  absl::flat_hash_map<std::string, int> publisher_counts;
+  for (int i = 0; i < total_events; i++) {
+    DataProviderEvent event = generator.GetEvent(event_options);
+    const LabelerInput& labeler_input = event.log_event().labeler_input();
+    ++publisher_counts[labeler_input.event_id().publisher()];
+  }
+  int max_count = 0;
+  for (const auto& [publisher, count] : publisher_counts) {
+    max_count = std::max(max_count, count);
+  }
+  // With zipf exponent 2, the most active publisher has more than 60% of the
+  // events.
+  EXPECT_GT(max_count, total_events * 0.6);
+}
+
+TEST(EventsGeneratorTest, StreamingEventIds) {
+  uint32_t total_publishers = 10;
+  // More events than total_events, which is ignored when streaming.
+  uint32_t event_count = 5000;
+
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = total_publishers,
+      .total_events = 1,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100,
+      .streaming_event_ids = true};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  absl::flat_hash_map<std::string, int> publisher_counts;
+  absl::flat_hash_set<std::string> ids;
+  std::vector<DataProviderEvent> events =
+      generator.GetEvents(event_count / 2, event_options);
+  for (int i = event_count / 2; i < event_count; i++) {
+    events.push_back(generator.GetEvent(event_options));
+  }
+  for (const DataProviderEvent& event : events) {
+    const EventId& event_id = event.log_event().labeler_input().event_id();
+    EXPECT_THAT(event_id.publisher(), IsValidPublisher());
+    EXPECT_THAT(event_id.id(), IsValidId());
+    EXPECT_TRUE(ids.insert(event_id.id()).second)
+        << "Duplicate id: " << event_id.id();
+    ++publisher_counts[event_id.publisher()];
+  }
+  // The publishers are assigned in round-robin.
+  EXPECT_EQ(publisher_counts.size(), total_publishers);
+  for (const auto& [publisher, count] : publisher_counts) {
+    EXPECT_EQ(count, event_count / total_publishers);
+  }
+}
+
+TEST(EventsGeneratorTest, StreamingEventIdsWithSkewedPublisherActivity) {
+  uint32_t event_count = 1000;
+
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = 10,
+      .total_events = 1,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100,
+      .publisher_activity = {.type = ActivityDistributionType::kZipf,
+                             .zipf_exponent = 2.0},
+      .streaming_event_ids = true};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 0.5,
+                                .phone_events_ratio = 0.5,
+                                .proprietary_id_space_1_events_ratio = 0.5,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  absl::flat_hash_map<std::string, int> publisher_counts;
+  for (int i = 0; i < event_count; i++) {
+    DataProviderEvent event = generator.GetEvent(event_options);
+    const EventId& event_id = event.log_event().labeler_input().event_id();
+    ++publisher_counts[event_id.publisher()];
+  }
+  int max_count = 0;
+  for (const auto& [publisher, count] : publisher_counts) {
+    max_count = std::max(max_count, count);
+  }
+  // With zipf exponent 2, the most active publisher has about 65% of the
+  // events.
+  EXPECT_GT(max_count, event_count * 0.55);
+}
+
+TEST(EventsGeneratorTest, UserInfoDecidedByUserIdAndProfileVersion) {
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = 1,
+      .total_events = 200,
+      .unknown_device_count = 1,
+      .email_users_count = 1,
+      .phone_users_count = 1,
+      .proprietary_id_space_1_users_count = 1};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 1.0,
+                                .phone_events_ratio = 0.0,
+                                .proprietary_id_space_1_events_ratio = 0.0,
+                                .profile_version_days = 0};
+
+  EventsGenerator generator(events_generator_options, 1);
+  DataProviderEvent first_event = generator.GetEvent(event_options);
+  const UserInfo& first_user_info =
+      first_event.log_event().labeler_input().profile_info().email_user_info();
+  for (int i = 0; i < 99; i++) {
+    DataProviderEvent event = generator.GetEvent(event_options);
+    const UserInfo& user_info =
+        event.log_event().labeler_input().profile_info().email_user_info();
+    EXPECT_EQ(user_info.SerializeAsString(),
+              first_user_info.SerializeAsString());
+  }
+
+  // After the geo options change, the UserInfo is the same as the one from a
+  // new generator.
+  event_options.total_countries = 900;
+  event_options.regions_per_country = 1000;
+  event_options.cities_per_region = 1000;
+  EventsGenerator new_generator(events_generator_options, 1);
+  DataProviderEvent new_event = new_generator.GetEvent(event_options);
+  const UserInfo& new_user_info =
+      new_event.log_event().labeler_input().profile_info().email_user_info();
+  for (int i = 0; i < 100; i++) {
+    DataProviderEvent event = generator.GetEvent(event_options);
+    const UserInfo& user_info =
+        event.log_event().labeler_input().profile_info().email_user_info();
+    EXPECT_EQ(user_info.SerializeAsString(), new_user_info.SerializeAsString());
+  }
+}
+
+void ExpectFingerprintsSet(const DataProviderEvent& event) {
+  const LabelerInput& labeler_input = event.log_event().labeler_input();
+  EXPECT_EQ(labeler_input.event_id().id_fingerprint(),
+            util::Fingerprint64(labeler_input.event_id().id()));
+  const ProfileInfo& profile_info = labeler_input.profile_info();
+  EXPECT_EQ(profile_info.email_user_info().user_id_fingerprint(),
+            util::Fingerprint64(profile_info.email_user_info().user_id()));
+  EXPECT_EQ(profile_info.phone_user_info().user_id_fingerprint(),
+            util::Fingerprint64(profile_info.phone_user_info().user_id()));
+  EXPECT_EQ(
+      profile_info.proprietary_id_space_1_user_info().user_id_fingerprint(),
+      util::Fingerprint64(
+          profile_info.proprietary_id_space_1_user_info().user_id()));
+}
+
+TEST(EventsGeneratorTest, Fingerprints) {
+  EventsGeneratorOptions events_generator_options = {
+      .current_timestamp = 1626847100000000,
+      .total_publishers = 10,
+      .total_events = 200,
+      .unknown_device_count = 100,
+      .email_users_count = 100,
+      .phone_users_count = 100,
+      .proprietary_id_space_1_users_count = 100,
+      .set_fingerprints = true};
+
+  EventOptions event_options = {.unknown_device_ratio = 0.5,
+                                .total_countries = 10,
+                                .regions_per_country = 10,
+                                .cities_per_region = 10,
+                                .email_events_ratio = 1.0,
+                                .phone_events_ratio = 1.0,
+                                .proprietary_id_space_1_events_ratio = 1.0,
+                                .profile_version_days = 1};
+
+  EventsGenerator generator(events_generator_options);
+  for (int i = 0; i < 100; i++) {
+    ExpectFingerprintsSet(generator.GetEvent(event_options));
+  }
+  for (const DataProviderEvent& event :
+       generator.GetEvents(100, event_options)) {
+    ExpectFingerprintsSet(event);
+  }
+
+  events_generator_options.streaming_event_ids = true;
+  EventsGenerator streaming_generator(events_generator_options);
+  for (int i = 0; i < 100; i++) {
+    ExpectFingerprintsSet(streaming_generator.GetEvent(event_options));
+  }
+
+  // The fingerprints are not set by default.
+  events_generator_options.set_fingerprints = false;
+  EventsGenerator default_generator(events_generator_options);
+  DataProviderEvent event = default_generator.GetEvent(event_options);
+  const LabelerInput& labeler_input = event.log_event().labeler_input();
+  EXPECT_FALSE(labeler_input.event_id().has_id_fingerprint());
+  EXPECT_FALSE(
+      labeler_input.profile_info().email_user_info().has_user_id_fingerprint());
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
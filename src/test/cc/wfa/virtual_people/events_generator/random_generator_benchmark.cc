@@ -0,0 +1,270 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/civil_time.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "wfa/virtual_people/events_generator/activity_sampler.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// 2021-07-21 05:58:20 UTC.
+constexpr uint64_t kCurrentTimestamp = 1626847100000000;
+
+// The count of values generated by each call of the batch methods.
+constexpr int kBatchSize = 1024;
+
+// Returns @count distinct seeds, like the ones used by BuildUserInfo.
+std::vector<std::string> GetSeeds(const int count) {
+  std::vector<std::string> seeds;
+  seeds.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    seeds.push_back(absl::StrCat("user-", i, "-demo-2021-07-21"));
+  }
+  return seeds;
+}
+
+void BM_GetBool(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetBool(0.3));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetBool);
+
+void BM_GetBoolWithThreshold(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  uint64_t threshold = RandomGenerator::GetBoolThreshold(0.3);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetBoolWithThreshold(threshold));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetBoolWithThreshold);
+
+void BM_GetBools(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  bool output[kBatchSize];
+  for (auto _ : state) {
+    random_generator.GetBools(0.3, absl::MakeSpan(output));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_GetBools);
+
+// The argument is the length of the string.
+void BM_GetDigits(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetDigits(state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetDigits)->Arg(4)->Arg(10)->Arg(16);
+
+// The argument is the length of the string.
+void BM_AppendDigitsBatch(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::string output;
+  for (auto _ : state) {
+    output.clear();
+    random_generator.AppendDigitsBatch(state.range(0), kBatchSize, output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_AppendDigitsBatch)->Arg(4)->Arg(10)->Arg(16);
+
+// The argument is the length of the string.
+void BM_GetLowerLetters(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetLowerLetters(state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetLowerLetters)->Arg(4)->Arg(10)->Arg(16);
+
+void BM_GetLowerLettersInRange(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetLowerLetters(1, 10));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetLowerLettersInRange);
+
+// The argument is the length of the string.
+void BM_AppendLowerLettersBatch(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::string output;
+  for (auto _ : state) {
+    output.clear();
+    random_generator.AppendLowerLettersBatch(state.range(0), kBatchSize,
+                                             output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_AppendLowerLettersBatch)->Arg(4)->Arg(10)->Arg(16);
+
+// The argument is the max value.
+void BM_GetInteger(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetInteger(0, state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetInteger)->Arg(99)->Arg(999999);
+
+// The argument is the max value.
+void BM_GetIntegers(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<int32_t> output(kBatchSize);
+  for (auto _ : state) {
+    random_generator.GetIntegers(0, state.range(0), absl::MakeSpan(output));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_GetIntegers)->Arg(99)->Arg(999999);
+
+void BM_GetTimestampUsecInNDays(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        random_generator.GetTimestampUsecInNDays(kCurrentTimestamp, 30));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTimestampUsecInNDays);
+
+void BM_GetTimestampsUsecInNDays(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<uint64_t> output(kBatchSize);
+  for (auto _ : state) {
+    random_generator.GetTimestampsUsecInNDays(kCurrentTimestamp, 30,
+                                              absl::MakeSpan(output));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_GetTimestampsUsecInNDays);
+
+void BM_GetDateInNDays(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  absl::CivilDay current_date(2021, 7, 21);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetDateInNDays(current_date, 30));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetDateInNDays);
+
+void BM_GetGaussian(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetGaussian(5.0, 2.0));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetGaussian);
+
+void BM_GetDouble(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetDouble(0.0, 1.0));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetDouble);
+
+void BM_GetTimestampUsecInNDaysWithSeed(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<std::string> seeds = GetSeeds(kBatchSize);
+  size_t index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random_generator.GetTimestampUsecInNDaysWithSeed(
+        kCurrentTimestamp, 100, seeds[index]));
+    index = (index + 1) % seeds.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTimestampUsecInNDaysWithSeed);
+
+void BM_GetIntegerWithSeed(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<std::string> seeds = GetSeeds(kBatchSize);
+  size_t index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        random_generator.GetIntegerWithSeed(0, 120, seeds[index]));
+    index = (index + 1) % seeds.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetIntegerWithSeed);
+
+void BM_GetDoubleWithSeed(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<std::string> seeds = GetSeeds(kBatchSize);
+  size_t index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        random_generator.GetDoubleWithSeed(0.0, 1.0, seeds[index]));
+    index = (index + 1) % seeds.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetDoubleWithSeed);
+
+void BM_GetIntegersWithSeeds(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  std::vector<std::string> seeds = GetSeeds(kBatchSize);
+  std::vector<absl::string_view> seed_views(seeds.begin(), seeds.end());
+  std::vector<int32_t> output(kBatchSize);
+  for (auto _ : state) {
+    random_generator.GetIntegersWithSeeds(0, 120, seed_views,
+                                          absl::MakeSpan(output));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK(BM_GetIntegersWithSeeds);
+
+// The argument is the size of the pool.
+void BM_ActivitySamplerZipf(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  ActivityDistribution distribution = {
+      .type = ActivityDistributionType::kZipf, .zipf_exponent = 1.0};
+  ActivitySampler sampler(distribution, state.range(0), random_generator);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.Sample(random_generator));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ActivitySamplerZipf)->Arg(1000)->Arg(100000);
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -14,7 +14,11 @@
 
 #include "wfa/virtual_people/events_generator/random_generator.h"
 
+#include <limits>
 #include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -23,8 +27,12 @@ namespace wfa_virtual_people {
 namespace {
 
 using ::testing::AllOf;
+using ::testing::Contains;
+using ::testing::Each;
 using ::testing::Ge;
+using ::testing::Gt;
 using ::testing::Le;
+using ::testing::Lt;
 using ::testing::MatchesRegex;
 
 constexpr int kRepeatNumber = 1000;
@@ -53,6 +61,51 @@ TEST(RandomGeneratorTest, GetLowerLettersLengthRangeSanityCheck) {
   }
 }
 
+TEST(RandomGeneratorTest, AppendDigitsSanityCheck) {
+  RandomGenerator generator;
+  for (int i = 0; i < kRepeatNumber; i++) {
+    std::string output = "prefix";
+    generator.AppendDigits(16, output);
+    EXPECT_THAT(output, MatchesRegex("prefix[0-9]{16}"));
+  }
+}
+
+TEST(RandomGeneratorTest, AppendLowerLettersSanityCheck) {
+  RandomGenerator generator;
+  for (int i = 0; i < kRepeatNumber; i++) {
+    std::string output = "prefix";
+    generator.AppendLowerLetters(10, output);
+    generator.AppendLowerLetters(5, 10, output);
+    EXPECT_THAT(output, MatchesRegex("prefix[a-z]{15,20}"));
+  }
+}
+
+TEST(RandomGeneratorTest, AppendDigitsBatchSameAsAppendDigits) {
+  RandomGenerator batch_generator(1);
+  RandomGenerator generator(1);
+  std::string batch_output = "prefix";
+  batch_generator.AppendDigitsBatch(16, kRepeatNumber, batch_output);
+  std::string output = "prefix";
+  for (int i = 0; i < kRepeatNumber; i++) {
+    generator.AppendDigits(16, output);
+  }
+  EXPECT_EQ(batch_output, output);
+  EXPECT_THAT(batch_output, MatchesRegex("prefix[0-9]{16000}"));
+}
+
+TEST(RandomGeneratorTest, AppendLowerLettersBatchSameAsAppendLowerLetters) {
+  RandomGenerator batch_generator(1);
+  RandomGenerator generator(1);
+  std::string batch_output = "prefix";
+  batch_generator.AppendLowerLettersBatch(10, kRepeatNumber, batch_output);
+  std::string output = "prefix";
+  for (int i = 0; i < kRepeatNumber; i++) {
+    generator.AppendLowerLetters(10, output);
+  }
+  EXPECT_EQ(batch_output, output);
+  EXPECT_THAT(batch_output, MatchesRegex("prefix[a-z]{10000}"));
+}
+
 TEST(RandomGeneratorTest, GetIntegerSanityCheck) {
   RandomGenerator generator;
   for (int i = 0; i < kRepeatNumber; i++) {
@@ -65,7 +118,7 @@ TEST(RandomGeneratorTest, GetTimestampUsecInNDaysSanityCheck) {
   RandomGenerator generator;
   for (int i = 0; i < kRepeatNumber; i++) {
     uint64_t output = generator.GetTimestampUsecInNDays(1626847100000000, 30);
-    EXPECT_THAT(output, AllOf(Ge(1626847100000000 - (uint64_t)30 * 86400000),
+    EXPECT_THAT(output, AllOf(Ge(1626847100000000 - (uint64_t)30 * 86400000000),
                               Le(1626847100000000)));
   }
 }
@@ -80,12 +133,27 @@ TEST(RandomGeneratorTest, GetDateInNDaysSanityCheck) {
   }
 }
 
+// EventsGenerator draws the days ago of the profile version with GetInteger,
+// which must give the same days as GetDateInNDays.
+TEST(RandomGeneratorTest, GetIntegerSameAsGetDateInNDays) {
+  absl::CivilDay current_day(2021, 9, 20);
+  for (uint32_t n : {0, 1, 30, 10000}) {
+    RandomGenerator generator_1(1);
+    RandomGenerator generator_2(1);
+    for (int i = 0; i < kRepeatNumber; i++) {
+      EXPECT_EQ(generator_1.GetInteger(0, n),
+                current_day - generator_2.GetDateInNDays(current_day, n))
+          << n;
+    }
+  }
+}
+
 TEST(RandomGeneratorTest, GetTimestampUsecInNDaysWithSeedSanityCheck) {
   RandomGenerator generator;
   for (int i = 0; i < kRepeatNumber; i++) {
     uint64_t output = generator.GetTimestampUsecInNDaysWithSeed(
         1626847100000000, 30, std::to_string(i));
-    EXPECT_THAT(output, AllOf(Ge(1626847100000000 - (uint64_t)30 * 86400000),
+    EXPECT_THAT(output, AllOf(Ge(1626847100000000 - (uint64_t)30 * 86400000000),
                               Le(1626847100000000)));
   }
 }
@@ -132,5 +200,114 @@ TEST(RandomGeneratorTest, GetDoubleWithSeedDeterministicCheck) {
   }
 }
 
+TEST(RandomGeneratorTest, StreamDeterministicCheck) {
+  RandomGenerator generator(1, 2);
+  RandomGenerator same_generator(1, 2);
+  RandomGenerator other_stream_generator(1, 3);
+  RandomGenerator other_seed_generator(2, 2);
+  int other_stream_same_count = 0;
+  int other_seed_same_count = 0;
+  for (int i = 0; i < kRepeatNumber; i++) {
+    int32_t value = generator.GetInteger(0, 1000000);
+    EXPECT_EQ(value, same_generator.GetInteger(0, 1000000));
+    if (value == other_stream_generator.GetInteger(0, 1000000)) {
+      ++other_stream_same_count;
+    }
+    if (value == other_seed_generator.GetInteger(0, 1000000)) {
+      ++other_seed_same_count;
+    }
+  }
+  EXPECT_THAT(other_stream_same_count, Le(5));
+  EXPECT_THAT(other_seed_same_count, Le(5));
+}
+
+TEST(RandomGeneratorTest, GetBoolWithThresholdSanityCheck) {
+  RandomGenerator generator;
+  uint64_t always_false = RandomGenerator::GetBoolThreshold(0.0);
+  uint64_t always_true = RandomGenerator::GetBoolThreshold(1.0);
+  uint64_t half = RandomGenerator::GetBoolThreshold(0.5);
+  int true_count = 0;
+  for (int i = 0; i < kRepeatNumber; i++) {
+    EXPECT_FALSE(generator.GetBoolWithThreshold(always_false));
+    EXPECT_TRUE(generator.GetBoolWithThreshold(always_true));
+    if (generator.GetBoolWithThreshold(half)) ++true_count;
+  }
+  EXPECT_THAT(true_count, AllOf(Ge(400), Le(600)));
+}
+
+TEST(RandomGeneratorTest, GetBoolWithThresholdSameAsGetBool) {
+  for (double true_chance : {0.0, 0.001, 0.1, 1.0 / 3, 0.5, 0.75, 1.0}) {
+    RandomGenerator generator_1(1);
+    RandomGenerator generator_2(1);
+    uint64_t threshold = RandomGenerator::GetBoolThreshold(true_chance);
+    for (int i = 0; i < kRepeatNumber; i++) {
+      EXPECT_EQ(generator_1.GetBoolWithThreshold(threshold),
+                generator_2.GetBool(true_chance))
+          << true_chance;
+    }
+  }
+}
+
+TEST(RandomGeneratorTest, GetBoolsSanityCheck) {
+  RandomGenerator generator;
+  bool output[kRepeatNumber];
+  generator.GetBools(0.0, absl::MakeSpan(output));
+  EXPECT_THAT(output, Each(false));
+  generator.GetBools(1.0, absl::MakeSpan(output));
+  EXPECT_THAT(output, Each(true));
+  generator.GetBools(0.5, absl::MakeSpan(output));
+  int true_count = 0;
+  for (bool value : output) {
+    if (value) ++true_count;
+  }
+  EXPECT_THAT(true_count, AllOf(Ge(400), Le(600)));
+}
+
+TEST(RandomGeneratorTest, GetIntegersSanityCheck) {
+  RandomGenerator generator;
+  std::vector<int32_t> output(kRepeatNumber);
+  generator.GetIntegers(-10, 20, absl::MakeSpan(output));
+  EXPECT_THAT(output, Each(AllOf(Ge(-10), Le(20))));
+  // Every value in a small range is generated.
+  generator.GetIntegers(0, 3, absl::MakeSpan(output));
+  for (int32_t value = 0; value <= 3; ++value) {
+    EXPECT_THAT(output, Contains(value));
+  }
+  // The full range of int32_t, which has both negative and positive values.
+  generator.GetIntegers(std::numeric_limits<int32_t>::min(),
+                        std::numeric_limits<int32_t>::max(),
+                        absl::MakeSpan(output));
+  EXPECT_THAT(output, Contains(Lt(0)));
+  EXPECT_THAT(output, Contains(Gt(0)));
+}
+
+TEST(RandomGeneratorTest, GetTimestampsUsecInNDaysSanityCheck) {
+  RandomGenerator generator;
+  std::vector<uint64_t> output(kRepeatNumber);
+  generator.GetTimestampsUsecInNDays(1626847100000000, 30,
+                                     absl::MakeSpan(output));
+  EXPECT_THAT(output,
+              Each(AllOf(Ge(1626847100000000 - (uint64_t)30 * 86400000000),
+                         Le(1626847100000000))));
+  // The timestamps are spread over the days, not only the last ones.
+  EXPECT_THAT(output,
+              Contains(Lt(1626847100000000 - (uint64_t)15 * 86400000000)));
+}
+
+TEST(RandomGeneratorTest, GetIntegersWithSeedsSameAsGetIntegerWithSeed) {
+  RandomGenerator generator;
+  std::vector<std::string> seed_strings;
+  for (int i = 0; i < kRepeatNumber; i++) {
+    seed_strings.push_back(std::to_string(i));
+  }
+  std::vector<absl::string_view> seeds(seed_strings.begin(),
+                                       seed_strings.end());
+  std::vector<int32_t> output(kRepeatNumber);
+  generator.GetIntegersWithSeeds(10, 20, seeds, absl::MakeSpan(output));
+  for (int i = 0; i < kRepeatNumber; i++) {
+    EXPECT_EQ(output[i], generator.GetIntegerWithSeed(10, 20, seeds[i]));
+  }
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
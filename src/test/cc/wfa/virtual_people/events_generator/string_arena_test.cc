@@ -0,0 +1,60 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/events_generator/string_arena.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+TEST(StringArenaTest, Empty) {
+  StringArena arena;
+  EXPECT_TRUE(arena.empty());
+  EXPECT_EQ(arena.size(), 0);
+  EXPECT_EQ(arena.byte_size(), 0);
+}
+
+TEST(StringArenaTest, AppendAndGet) {
+  std::vector<std::string> values = {"a", "", "bcd", "",
+                                     "efghijklmnopqrstuvwxyz"};
+  StringArena arena;
+  arena.Reserve(values.size(), 10);
+  for (const std::string& value : values) {
+    arena.Append(value);
+  }
+  EXPECT_FALSE(arena.empty());
+  ASSERT_EQ(arena.size(), values.size());
+  EXPECT_EQ(arena.byte_size(), 26);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(arena[i], values[i]);
+  }
+}
+
+TEST(StringArenaTest, AppendCopiesValue) {
+  StringArena arena;
+  std::string value = "abc";
+  arena.Append(value);
+  value[0] = 'x';
+  arena.Append(value);
+  EXPECT_EQ(arena[0], "abc");
+  EXPECT_EQ(arena[1], "xbc");
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -14,12 +14,20 @@
 
 #include <fcntl.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 #include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/corpus/corpus_compiler.h"
+#include "wfa/virtual_people/corpus/indexed_record_file.h"
 
 namespace wfa_virtual_people {
 namespace {
@@ -56,5 +64,37 @@ TEST(LabelerEventsExampleTest, LoadEvents) {
   }
 }
 
+// The events compiled to an indexed record file are read back the same as
+// the textproto.
+TEST(LabelerEventsExampleTest, CompiledEventsRoundTrip) {
+  std::vector<std::string> input_paths;
+  for (const char* filename : kTestFiles) {
+    input_paths.push_back(
+        absl::StrCat(GetTestSrcDir(), kTestRelativeDir, filename));
+  }
+  std::string output_path =
+      absl::StrCat(testing::TempDir(), "/labeler_events.idx");
+  absl::Status status = CompileCorpus(
+      input_paths, CorpusInputType::kLabelerEvent, output_path, 4);
+  ASSERT_TRUE(status.ok()) << status;
+
+  absl::StatusOr<std::unique_ptr<IndexedRecordReader>> reader =
+      IndexedRecordReader::Open(output_path);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  ASSERT_EQ((*reader)->size(), input_paths.size());
+  for (size_t i = 0; i < input_paths.size(); ++i) {
+    int fd = open(input_paths[i].c_str(), O_RDONLY);
+    ASSERT_GT(fd, 0);
+    google::protobuf::io::FileInputStream file_input(fd);
+    file_input.SetCloseOnDelete(true);
+    LabelerEvent expected;
+    ASSERT_TRUE(google::protobuf::TextFormat::Parse(&file_input, &expected));
+    LabelerEvent event;
+    ASSERT_TRUE((*reader)->ReadMessage(i, event).ok());
+    EXPECT_EQ(event.SerializeAsString(), expected.SerializeAsString())
+        << kTestFiles[i];
+  }
+}
+
 }  // namespace
 }  // namespace wfa_virtual_people
@@ -0,0 +1,113 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/load_tester/latency_histogram.h"
+
+#include <limits>
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::HasSubstr;
+
+TEST(LatencyHistogramTest, Empty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.count(), 0);
+  EXPECT_EQ(histogram.Percentile(99.0), absl::ZeroDuration());
+  EXPECT_EQ(histogram.mean(), absl::ZeroDuration());
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+  LatencyHistogram histogram;
+  for (int i = 1; i <= 10; ++i) {
+    histogram.Record(absl::Nanoseconds(i));
+  }
+  EXPECT_EQ(histogram.count(), 10);
+  EXPECT_EQ(histogram.min(), absl::Nanoseconds(1));
+  EXPECT_EQ(histogram.max(), absl::Nanoseconds(10));
+  EXPECT_EQ(histogram.Percentile(0.0), absl::Nanoseconds(1));
+  EXPECT_EQ(histogram.Percentile(50.0), absl::Nanoseconds(5));
+  EXPECT_EQ(histogram.Percentile(90.0), absl::Nanoseconds(9));
+  EXPECT_EQ(histogram.Percentile(100.0), absl::Nanoseconds(10));
+  EXPECT_EQ(histogram.mean(), absl::Nanoseconds(5.5));
+}
+
+TEST(LatencyHistogramTest, RelativeErrorIsBounded) {
+  LatencyHistogram histogram;
+  for (int i = 1; i <= 1000; ++i) {
+    histogram.Record(absl::Microseconds(i));
+  }
+  for (double percentile : {10.0, 50.0, 90.0, 99.0, 99.9}) {
+    double expected = percentile * 10.0;
+    double actual =
+        absl::ToDoubleMicroseconds(histogram.Percentile(percentile));
+    EXPECT_GE(actual, expected) << percentile;
+    EXPECT_LE(actual,
+              expected * (1.0 + 1.0 / LatencyHistogram::kSubBucketCount))
+        << percentile;
+  }
+  EXPECT_EQ(histogram.Percentile(100.0), absl::Milliseconds(1));
+}
+
+TEST(LatencyHistogramTest, NegativeLatencyIsZero) {
+  LatencyHistogram histogram;
+  histogram.Record(absl::Seconds(-1));
+  EXPECT_EQ(histogram.count(), 1);
+  EXPECT_EQ(histogram.max(), absl::ZeroDuration());
+}
+
+TEST(LatencyHistogramTest, LargeLatency) {
+  LatencyHistogram histogram;
+  histogram.Record(absl::Hours(1000));
+  EXPECT_EQ(histogram.Percentile(50.0), absl::Hours(1000));
+}
+
+TEST(LatencyHistogramTest, LargestLatency) {
+  // The latency is saturated to the largest int64_t nanoseconds, which is in
+  // the last bucket.
+  LatencyHistogram histogram;
+  histogram.Record(absl::InfiniteDuration());
+  absl::Duration largest =
+      absl::Nanoseconds(std::numeric_limits<int64_t>::max());
+  EXPECT_EQ(histogram.max(), largest);
+  EXPECT_EQ(histogram.Percentile(100.0), largest);
+}
+
+TEST(LatencyHistogramTest, Merge) {
+  LatencyHistogram histogram_1;
+  LatencyHistogram histogram_2;
+  histogram_1.Record(absl::Nanoseconds(3));
+  histogram_2.Record(absl::Nanoseconds(1));
+  histogram_2.Record(absl::Nanoseconds(8));
+  histogram_1.Merge(histogram_2);
+  EXPECT_EQ(histogram_1.count(), 3);
+  EXPECT_EQ(histogram_1.min(), absl::Nanoseconds(1));
+  EXPECT_EQ(histogram_1.max(), absl::Nanoseconds(8));
+  EXPECT_EQ(histogram_1.Percentile(50.0), absl::Nanoseconds(3));
+}
+
+TEST(LatencyHistogramTest, ToStringHasBuckets) {
+  LatencyHistogram histogram;
+  histogram.Record(absl::Nanoseconds(3));
+  histogram.Record(absl::Nanoseconds(3));
+  EXPECT_THAT(histogram.ToString(), HasSubstr("count: 2"));
+  EXPECT_THAT(histogram.ToString(), HasSubstr("3ns 3ns 2 100\n"));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
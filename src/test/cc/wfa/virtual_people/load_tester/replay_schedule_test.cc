@@ -0,0 +1,99 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/load_tester/replay_schedule.h"
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+TEST(ReplayScheduleTest, ParseReplayPhases) {
+  absl::StatusOr<std::vector<ReplayPhase>> phases =
+      ParseReplayPhases("100:10,100-500:2.5");
+  ASSERT_TRUE(phases.ok()) << phases.status();
+  ASSERT_EQ(phases->size(), 2);
+  EXPECT_EQ((*phases)[0].start_qps, 100.0);
+  EXPECT_EQ((*phases)[0].end_qps, 100.0);
+  EXPECT_EQ((*phases)[0].duration, absl::Seconds(10));
+  EXPECT_EQ((*phases)[1].start_qps, 100.0);
+  EXPECT_EQ((*phases)[1].end_qps, 500.0);
+  EXPECT_EQ((*phases)[1].duration, absl::Milliseconds(2500));
+}
+
+TEST(ReplayScheduleTest, ParseInvalidReplayPhases) {
+  EXPECT_FALSE(ParseReplayPhases("").ok());
+  EXPECT_FALSE(ParseReplayPhases("100").ok());
+  EXPECT_FALSE(ParseReplayPhases("100:0").ok());
+  EXPECT_FALSE(ParseReplayPhases("-100:10").ok());
+  EXPECT_FALSE(ParseReplayPhases("1-2-3:10").ok());
+  EXPECT_FALSE(ParseReplayPhases("abc:10").ok());
+}
+
+TEST(ReplayScheduleTest, FixedRate) {
+  ReplaySchedule schedule(
+      {{.start_qps = 10, .end_qps = 10, .duration = absl::Seconds(2)}});
+  EXPECT_EQ(schedule.total_requests(), 20);
+  EXPECT_EQ(schedule.GetPhaseRequests(0), 20);
+  EXPECT_EQ(schedule.GetIntendedSendTime(0), absl::ZeroDuration());
+  EXPECT_EQ(schedule.GetIntendedSendTime(1), absl::Milliseconds(100));
+  EXPECT_EQ(schedule.GetIntendedSendTime(19), absl::Milliseconds(1900));
+}
+
+TEST(ReplayScheduleTest, RampingRate) {
+  // The count of requests sent t seconds into the phase is t^2.
+  ReplaySchedule schedule(
+      {{.start_qps = 0, .end_qps = 20, .duration = absl::Seconds(10)}});
+  EXPECT_EQ(schedule.total_requests(), 100);
+  EXPECT_EQ(schedule.GetIntendedSendTime(0), absl::ZeroDuration());
+  EXPECT_EQ(schedule.GetIntendedSendTime(1), absl::Seconds(1));
+  EXPECT_EQ(schedule.GetIntendedSendTime(4), absl::Seconds(2));
+  EXPECT_EQ(schedule.GetIntendedSendTime(81), absl::Seconds(9));
+}
+
+TEST(ReplayScheduleTest, DecreasingRateIsOrdered) {
+  ReplaySchedule schedule(
+      {{.start_qps = 20, .end_qps = 0, .duration = absl::Seconds(10)}});
+  EXPECT_EQ(schedule.total_requests(), 100);
+  absl::Duration previous = absl::ZeroDuration();
+  for (uint64_t i = 0; i < schedule.total_requests(); ++i) {
+    absl::Duration send_time = schedule.GetIntendedSendTime(i);
+    EXPECT_GE(send_time, previous);
+    EXPECT_LE(send_time, absl::Seconds(10));
+    previous = send_time;
+  }
+}
+
+TEST(ReplayScheduleTest, MultiplePhases) {
+  ReplaySchedule schedule(
+      {{.start_qps = 10, .end_qps = 10, .duration = absl::Seconds(1)},
+       {.start_qps = 0, .end_qps = 0, .duration = absl::Seconds(5)},
+       {.start_qps = 100, .end_qps = 100, .duration = absl::Seconds(1)}});
+  EXPECT_EQ(schedule.total_requests(), 110);
+  EXPECT_EQ(schedule.GetPhaseRequests(1), 0);
+  EXPECT_EQ(schedule.GetPhaseStart(2), absl::Seconds(6));
+  EXPECT_EQ(schedule.GetPhaseIndex(9), 0);
+  // The phase with no request is skipped.
+  EXPECT_EQ(schedule.GetPhaseIndex(10), 2);
+  EXPECT_EQ(schedule.GetIntendedSendTime(10), absl::Seconds(6));
+  EXPECT_EQ(schedule.GetIntendedSendTime(11), absl::Milliseconds(6010));
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
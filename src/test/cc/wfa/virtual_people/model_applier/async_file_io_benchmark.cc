@@ -0,0 +1,117 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+constexpr int kFileSize = 256 << 20;
+constexpr int kBlockSize = 4 << 20;
+
+// The file read by the benchmarks, written once. The reads are mostly served
+// from the page cache, so these measure the overhead of the reader over the
+// memory bandwidth, not the disk.
+const std::string& GetInputPath() {
+  static const std::string* const kPath = []() {
+    auto* path = new std::string(
+        std::filesystem::temp_directory_path() / "async_file_io_benchmark");
+    std::ofstream output(*path, std::ios::binary);
+    const std::string block(kBlockSize, 'x');
+    for (int i = 0; i < kFileSize / kBlockSize; ++i) {
+      output << block;
+    }
+    return path;
+  }();
+  return *kPath;
+}
+
+// Touches one byte per page of every chunk, like a parser would.
+void Consume(google::protobuf::io::ZeroCopyInputStream& input) {
+  const void* data;
+  int size;
+  while (input.Next(&data, &size)) {
+    for (int i = 0; i < size; i += 4096) {
+      benchmark::DoNotOptimize(static_cast<const char*>(data)[i]);
+    }
+  }
+}
+
+void BM_FileInputStream(benchmark::State& state) {
+  const std::string& path = GetInputPath();
+  for (auto _ : state) {
+    int fd = open(path.c_str(), O_RDONLY);
+    google::protobuf::io::FileInputStream input(fd);
+    input.SetCloseOnDelete(true);
+    Consume(input);
+  }
+  state.SetBytesProcessed(state.iterations() * kFileSize);
+}
+BENCHMARK(BM_FileInputStream)->Unit(benchmark::kMillisecond);
+
+// The first argument is the queue depth, and the second is whether to use
+// io_uring.
+void BM_AsyncFileInputStream(benchmark::State& state) {
+  const std::string& path = GetInputPath();
+  for (auto _ : state) {
+    std::unique_ptr<AsyncFileInputStream> input =
+        *AsyncFileInputStream::Open(path, kBlockSize, state.range(0),
+                                    state.range(1));
+    Consume(*input);
+  }
+  state.SetBytesProcessed(state.iterations() * kFileSize);
+}
+BENCHMARK(BM_AsyncFileInputStream)
+    ->ArgsProduct({{1, 4, 16}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// The argument is whether to use io_uring.
+void BM_AsyncFileOutputStream(benchmark::State& state) {
+  const std::string path = std::filesystem::temp_directory_path() /
+                           "async_file_io_benchmark_output";
+  for (auto _ : state) {
+    int fd =
+        open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    std::unique_ptr<AsyncFileOutputStream> output =
+        *AsyncFileOutputStream::Create(fd, kBlockSize, 4, state.range(0));
+    for (int64_t written = 0; written < kFileSize;) {
+      void* data;
+      int size;
+      output->Next(&data, &size);
+      for (int i = 0; i < size; i += 4096) {
+        static_cast<char*>(data)[i] = 'x';
+      }
+      written += size;
+    }
+    benchmark::DoNotOptimize(output->Close());
+  }
+  unlink(path.c_str());
+  state.SetBytesProcessed(state.iterations() * kFileSize);
+}
+BENCHMARK(BM_AsyncFileOutputStream)->Arg(0)->Arg(1)->Unit(
+    benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,340 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/async_file_io.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "google/protobuf/text_format.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+constexpr int kBlockSize = 4096;
+constexpr int kQueueDepth = 3;
+
+// The parameter is whether to use io_uring.
+class AsyncFileIoTest : public ::testing::TestWithParam<bool> {
+ protected:
+  std::string GetPath(absl::string_view name) const {
+    return absl::StrCat(::testing::TempDir(), "/", name, "_", GetParam());
+  }
+};
+
+// Returns @size bytes, which differ between the blocks.
+std::string GetContent(const int size) {
+  std::string content;
+  for (int i = 0; i < size; ++i) {
+    content.push_back(static_cast<char>((i * 7 + i / kBlockSize) % 251));
+  }
+  return content;
+}
+
+void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream output(path, std::ios::binary);
+  output << content;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  std::stringstream content;
+  content << input.rdbuf();
+  return content.str();
+}
+
+// Sets the soft limit of @resource to @limit until destroyed.
+class ScopedSoftLimit {
+ public:
+  ScopedSoftLimit(const int resource, const rlim_t limit)
+      : resource_(resource) {
+    getrlimit(resource_, &original_);
+    struct rlimit lowered = original_;
+    lowered.rlim_cur = limit;
+    setrlimit(resource_, &lowered);
+  }
+  ~ScopedSoftLimit() { setrlimit(resource_, &original_); }
+
+ private:
+  const int resource_;
+  struct rlimit original_;
+};
+
+TEST_P(AsyncFileIoTest, ReadFile) {
+  // More blocks than the queue depth, and a partial last block.
+  const std::string content = GetContent(10 * kBlockSize + 123);
+  const std::string path = GetPath("read");
+  WriteFile(path, content);
+
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(path, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(input.ok()) << input.status();
+  std::string read;
+  const void* data;
+  int size;
+  while ((*input)->Next(&data, &size)) {
+    EXPECT_LE(size, kBlockSize);
+    read.append(static_cast<const char*>(data), size);
+  }
+  EXPECT_TRUE((*input)->status().ok()) << (*input)->status();
+  EXPECT_EQ((*input)->ByteCount(), content.size());
+  EXPECT_EQ(read, content);
+}
+
+TEST_P(AsyncFileIoTest, BackUpAndSkip) {
+  const std::string content = GetContent(3 * kBlockSize);
+  const std::string path = GetPath("backup");
+  WriteFile(path, content);
+
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(path, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(input.ok()) << input.status();
+  const void* data;
+  int size;
+  ASSERT_TRUE((*input)->Next(&data, &size));
+  (*input)->BackUp(100);
+  EXPECT_EQ((*input)->ByteCount(), kBlockSize - 100);
+  ASSERT_TRUE((*input)->Next(&data, &size));
+  EXPECT_EQ(size, 100);
+  EXPECT_EQ(std::string(static_cast<const char*>(data), size),
+            content.substr(kBlockSize - 100, 100));
+
+  ASSERT_TRUE((*input)->Skip(kBlockSize + 10));
+  ASSERT_TRUE((*input)->Next(&data, &size));
+  EXPECT_EQ(std::string(static_cast<const char*>(data), size),
+            content.substr(2 * kBlockSize + 10));
+  EXPECT_FALSE((*input)->Skip(1));
+}
+
+TEST_P(AsyncFileIoTest, ParseTextProto) {
+  LabelerInputList inputs;
+  for (int i = 0; i < 1000; ++i) {
+    LabelerInput* input = inputs.add_inputs();
+    input->mutable_event_id()->set_id(absl::StrCat("event-", i));
+    input->set_timestamp_usec(1000000 + i);
+  }
+  std::string textproto;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &textproto));
+  const std::string path = GetPath("textproto");
+  WriteFile(path, textproto);
+
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(path, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(input.ok()) << input.status();
+  LabelerInputList parsed;
+  ASSERT_TRUE(google::protobuf::TextFormat::Parse(input->get(), &parsed));
+  EXPECT_EQ(parsed.SerializeAsString(), inputs.SerializeAsString());
+}
+
+TEST_P(AsyncFileIoTest, ReadEmptyFile) {
+  const std::string path = GetPath("empty");
+  WriteFile(path, "");
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(path, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(input.ok()) << input.status();
+  const void* data;
+  int size;
+  EXPECT_FALSE((*input)->Next(&data, &size));
+  EXPECT_TRUE((*input)->status().ok());
+}
+
+TEST_P(AsyncFileIoTest, OpenMissingFile) {
+  EXPECT_EQ(AsyncFileInputStream::Open(GetPath("missing"), kBlockSize,
+                                       kQueueDepth, GetParam())
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_P(AsyncFileIoTest, WriteFile) {
+  const std::string content = GetContent(10 * kBlockSize + 123);
+  const std::string path = GetPath("write");
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+  absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>> output =
+      AsyncFileOutputStream::Create(fd, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  // Write in chunks not aligned to the blocks.
+  for (size_t begin = 0; begin < content.size();) {
+    void* data;
+    int size;
+    ASSERT_TRUE((*output)->Next(&data, &size));
+    const int copied = std::min<size_t>({static_cast<size_t>(size), 1000,
+                                         content.size() - begin});
+    std::memcpy(data, content.data() + begin, copied);
+    (*output)->BackUp(size - copied);
+    begin += copied;
+  }
+  EXPECT_EQ((*output)->ByteCount(), content.size());
+  absl::Status status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_EQ((*output)->Close().code(), absl::StatusCode::kFailedPrecondition);
+
+  EXPECT_EQ(ReadFile(path), content);
+}
+
+TEST_P(AsyncFileIoTest, WriteFileFromOffsetWithFlush) {
+  const std::string content = GetContent(3 * kBlockSize + 456);
+  const std::string path = GetPath("write_from_offset");
+  WriteFile(path, "header");
+  int fd = open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>> output =
+      AsyncFileOutputStream::Create(fd, kBlockSize, kQueueDepth, GetParam(),
+                                    /*offset=*/6);
+  ASSERT_TRUE(output.ok()) << output.status();
+  for (size_t begin = 0; begin < content.size();) {
+    void* data;
+    int size;
+    ASSERT_TRUE((*output)->Next(&data, &size));
+    const int copied = std::min<size_t>({static_cast<size_t>(size), 1000,
+                                         content.size() - begin});
+    std::memcpy(data, content.data() + begin, copied);
+    (*output)->BackUp(size - copied);
+    begin += copied;
+    // A flush in the middle of a block is durable, and writing continues
+    // after it.
+    if (begin == 2000) {
+      absl::Status status = (*output)->Flush();
+      ASSERT_TRUE(status.ok()) << status;
+      EXPECT_EQ(ReadFile(path),
+                absl::StrCat("header", content.substr(0, 2000)));
+    }
+  }
+  EXPECT_EQ((*output)->ByteCount(), content.size());
+  absl::Status status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_EQ((*output)->Flush().code(), absl::StatusCode::kFailedPrecondition);
+
+  EXPECT_EQ(ReadFile(path), absl::StrCat("header", content));
+}
+
+TEST_P(AsyncFileIoTest, WriteOverFileSizeLimit) {
+  // The writes over the limit are short or fail, which is an error of the
+  // stream, not silently truncated output.
+  const std::string content = GetContent(10 * kBlockSize);
+  const std::string path = GetPath("write_over_limit");
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+  absl::StatusOr<std::unique_ptr<AsyncFileOutputStream>> output =
+      AsyncFileOutputStream::Create(fd, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  absl::Status status;
+  {
+    sighandler_t original_handler = signal(SIGXFSZ, SIG_IGN);
+    ScopedSoftLimit file_size_limit(RLIMIT_FSIZE, 2 * kBlockSize + 100);
+    for (size_t begin = 0; begin < content.size();) {
+      void* data;
+      int size;
+      if (!(*output)->Next(&data, &size)) {
+        break;
+      }
+      std::memcpy(data, content.data() + begin, size);
+      begin += size;
+    }
+    status = (*output)->Close();
+    signal(SIGXFSZ, original_handler);
+  }
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(ReadFile(path), content.substr(0, 2 * kBlockSize + 100));
+}
+
+TEST_P(AsyncFileIoTest, ReadWithoutLockedMemory) {
+  // The buffers cannot be locked in memory, so they are not registered, and
+  // the reads fall back to unregistered buffers.
+  ScopedSoftLimit memlock_limit(RLIMIT_MEMLOCK, 0);
+  const std::string content = GetContent(10 * kBlockSize + 123);
+  const std::string path = GetPath("read_without_locked_memory");
+  WriteFile(path, content);
+
+  int fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  absl::StatusOr<std::unique_ptr<AsyncFileIo>> io =
+      AsyncFileIo::Create(fd, kQueueDepth, GetParam());
+  ASSERT_TRUE(io.ok()) << io.status();
+  std::string output(kBlockSize, '\0');
+  absl::Span<char> buffer = absl::MakeSpan(output);
+  absl::Status status =
+      (*io)->RegisterBuffers(absl::MakeConstSpan(&buffer, 1));
+  ASSERT_TRUE(status.ok()) << status;
+  // Root can lock memory over the limit.
+  if (geteuid() != 0) {
+    EXPECT_FALSE((*io)->UsesRegisteredBuffers());
+  }
+  ASSERT_TRUE((*io)->SubmitRead(0, buffer, kBlockSize, 0).ok());
+  absl::StatusOr<AsyncFileIo::Completion> completion = (*io)->Wait();
+  ASSERT_TRUE(completion.ok()) << completion.status();
+  EXPECT_EQ(completion->result, kBlockSize);
+  EXPECT_EQ(output, content.substr(kBlockSize, kBlockSize));
+  close(fd);
+
+  absl::StatusOr<std::unique_ptr<AsyncFileInputStream>> input =
+      AsyncFileInputStream::Open(path, kBlockSize, kQueueDepth, GetParam());
+  ASSERT_TRUE(input.ok()) << input.status();
+  std::string read;
+  const void* data;
+  int size;
+  while ((*input)->Next(&data, &size)) {
+    read.append(static_cast<const char*>(data), size);
+  }
+  EXPECT_TRUE((*input)->status().ok()) << (*input)->status();
+  EXPECT_EQ(read, content);
+}
+
+TEST_P(AsyncFileIoTest, QueueDepth) {
+  const std::string path = GetPath("queue_depth");
+  WriteFile(path, GetContent(kBlockSize));
+  int fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  absl::StatusOr<std::unique_ptr<AsyncFileIo>> io =
+      AsyncFileIo::Create(fd, /*queue_depth=*/1, GetParam());
+  ASSERT_TRUE(io.ok()) << io.status();
+  if (!GetParam()) {
+    EXPECT_FALSE((*io)->UsesIoUring());
+  }
+  EXPECT_EQ((*io)->Wait().status().code(),
+            absl::StatusCode::kFailedPrecondition);
+
+  std::string output(2 * kBlockSize, '\0');
+  ASSERT_TRUE((*io)->SubmitRead(7, absl::MakeSpan(output), 0, -1).ok());
+  EXPECT_EQ((*io)->SubmitRead(8, absl::MakeSpan(output), 0, -1).code(),
+            absl::StatusCode::kFailedPrecondition);
+  absl::StatusOr<AsyncFileIo::Completion> completion = (*io)->Wait();
+  ASSERT_TRUE(completion.ok()) << completion.status();
+  EXPECT_EQ(completion->tag, 7);
+  // The read is short at the end of the file.
+  EXPECT_EQ(completion->result, kBlockSize);
+  EXPECT_EQ(output.substr(0, kBlockSize), GetContent(kBlockSize));
+  close(fd);
+}
+
+INSTANTIATE_TEST_SUITE_P(IoUring, AsyncFileIoTest, ::testing::Bool());
+
+}  // namespace
+}  // namespace wfa_virtual_people
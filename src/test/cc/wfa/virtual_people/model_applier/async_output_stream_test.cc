@@ -0,0 +1,263 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/async_output_stream.h"
+
+#include <fcntl.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::Lt;
+
+// A list of inputs, which is several MiB in textproto.
+LabelerInputList GetInputs() {
+  LabelerInputList inputs;
+  for (int i = 0; i < 50000; ++i) {
+    LabelerInput* input = inputs.add_inputs();
+    input->mutable_event_id()->set_id(absl::StrCat("event-", i));
+    input->set_timestamp_usec(1000000 + i);
+    input->set_user_agent(absl::StrCat("Mozilla/5.0 agent ", i % 100));
+  }
+  return inputs;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream input(path);
+  std::stringstream content;
+  content << input.rdbuf();
+  return content.str();
+}
+
+std::string ReadGzipFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  google::protobuf::io::FileInputStream file_input(fd);
+  file_input.SetCloseOnDelete(true);
+  google::protobuf::io::GzipInputStream gzip_input(&file_input);
+  std::string content;
+  const void* data;
+  int size;
+  while (gzip_input.Next(&data, &size)) {
+    content.append(static_cast<const char*>(data), size);
+  }
+  return content;
+}
+
+// The parameter is whether to use io_uring.
+class AsyncOutputStreamTest : public ::testing::TestWithParam<bool> {};
+
+TEST(OutputCompressionTest, ParseOutputCompression) {
+  absl::StatusOr<OutputCompression> none = ParseOutputCompression("none");
+  ASSERT_TRUE(none.ok());
+  EXPECT_EQ(*none, OutputCompression::kNone);
+  EXPECT_EQ(GetOutputCompressionExtension(*none), "");
+  absl::StatusOr<OutputCompression> gzip = ParseOutputCompression("gzip");
+  ASSERT_TRUE(gzip.ok());
+  EXPECT_EQ(*gzip, OutputCompression::kGzip);
+  EXPECT_EQ(GetOutputCompressionExtension(*gzip), ".gz");
+  EXPECT_EQ(ParseOutputCompression("zip").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_P(AsyncOutputStreamTest, WriteUncompressed) {
+  LabelerInputList inputs = GetInputs();
+  std::string expected;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &expected));
+
+  std::string path = absl::StrCat(::testing::TempDir(), "/uncompressed_",
+                                  GetParam(), ".txt");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kNone,
+                              GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE((*output)->Write("# header\n"));
+  ASSERT_TRUE(google::protobuf::TextFormat::Print(inputs, output->get()));
+  EXPECT_EQ((*output)->ByteCount(), expected.size() + 9);
+  absl::Status status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+
+  EXPECT_EQ(ReadFile(path), absl::StrCat("# header\n", expected));
+}
+
+TEST_P(AsyncOutputStreamTest, WriteGzip) {
+  LabelerInputList inputs = GetInputs();
+  std::string expected;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &expected));
+
+  std::string path = absl::StrCat(::testing::TempDir(), "/compressed_",
+                                  GetParam(), ".txt.gz");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kGzip,
+                              GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE(google::protobuf::TextFormat::Print(inputs, output->get()));
+  absl::Status status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+
+  EXPECT_EQ(ReadGzipFile(path), expected);
+  // The textproto compresses several-fold.
+  EXPECT_THAT(ReadFile(path).size(), Lt(expected.size() / 4));
+}
+
+TEST_P(AsyncOutputStreamTest, WriteEmpty) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/empty.txt.gz");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kGzip,
+                              GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  EXPECT_TRUE((*output)->Close().ok());
+  EXPECT_EQ(ReadGzipFile(path), "");
+}
+
+TEST_P(AsyncOutputStreamTest, CloseTwice) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/close_twice.txt");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kNone,
+                              GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  EXPECT_TRUE((*output)->Close().ok());
+  EXPECT_EQ((*output)->Close().code(), absl::StatusCode::kFailedPrecondition);
+  EXPECT_FALSE((*output)->Write("data"));
+}
+
+TEST_P(AsyncOutputStreamTest, OpenInvalidPath) {
+  EXPECT_EQ(AsyncOutputStream::Open("/nonexistent/dir/output.txt",
+                                    OutputCompression::kNone, GetParam())
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+// Writes @inputs to @path, flushing after the first half, then writes the
+// same output with a stream resumed from the flushed size after the file is
+// extended with garbage, as if the first run had stopped after the flush.
+// Returns the file written without resuming in @expected_path.
+void WriteAndResume(const std::string& path, const std::string& expected_path,
+                    const OutputCompression compression,
+                    const bool use_io_uring) {
+  LabelerInputList inputs = GetInputs();
+  std::string text;
+  ASSERT_TRUE(google::protobuf::TextFormat::PrintToString(inputs, &text));
+  const std::string first = text.substr(0, text.size() / 2);
+  const std::string second = text.substr(text.size() / 2);
+
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(expected_path, compression, use_io_uring);
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE((*output)->Write(first));
+  absl::StatusOr<int64_t> size = (*output)->Flush();
+  ASSERT_TRUE(size.ok()) << size.status();
+  EXPECT_EQ(ReadFile(expected_path).size(), *size);
+  ASSERT_TRUE((*output)->Write(second));
+  absl::Status status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+
+  output = AsyncOutputStream::Open(path, compression, use_io_uring);
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE((*output)->Write(first));
+  ASSERT_TRUE((*output)->Flush().ok());
+  ASSERT_TRUE((*output)->Write("garbage from the stopped run"));
+  ASSERT_TRUE((*output)->Close().ok());
+
+  output = AsyncOutputStream::Resume(path, compression, use_io_uring, *size);
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE((*output)->Write(second));
+  status = (*output)->Close();
+  ASSERT_TRUE(status.ok()) << status;
+}
+
+TEST_P(AsyncOutputStreamTest, ResumeUncompressed) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/resume_",
+                                  GetParam(), ".txt");
+  std::string expected_path = absl::StrCat(
+      ::testing::TempDir(), "/resume_expected_", GetParam(), ".txt");
+  WriteAndResume(path, expected_path, OutputCompression::kNone, GetParam());
+
+  std::string text;
+  ASSERT_TRUE(
+      google::protobuf::TextFormat::PrintToString(GetInputs(), &text));
+  EXPECT_EQ(ReadFile(expected_path), text);
+  EXPECT_EQ(ReadFile(path), text);
+}
+
+TEST_P(AsyncOutputStreamTest, ResumeGzip) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/resume_",
+                                  GetParam(), ".txt.gz");
+  std::string expected_path = absl::StrCat(
+      ::testing::TempDir(), "/resume_expected_", GetParam(), ".txt.gz");
+  WriteAndResume(path, expected_path, OutputCompression::kGzip, GetParam());
+
+  std::string text;
+  ASSERT_TRUE(
+      google::protobuf::TextFormat::PrintToString(GetInputs(), &text));
+  // The flush ends a gzip member, so the file is the same as written
+  // without resuming.
+  EXPECT_EQ(ReadGzipFile(expected_path), text);
+  EXPECT_EQ(ReadFile(path), ReadFile(expected_path));
+}
+
+TEST_P(AsyncOutputStreamTest, FlushEmpty) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/flush_empty.txt.gz");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kGzip, GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  absl::StatusOr<int64_t> size = (*output)->Flush();
+  ASSERT_TRUE(size.ok()) << size.status();
+  EXPECT_EQ(*size, 0);
+  ASSERT_TRUE((*output)->Close().ok());
+  EXPECT_EQ((*output)->Flush().status().code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(ReadGzipFile(path), "");
+}
+
+TEST_P(AsyncOutputStreamTest, ResumeInvalidFile) {
+  std::string path = absl::StrCat(::testing::TempDir(), "/resume_short.txt");
+  absl::StatusOr<std::unique_ptr<AsyncOutputStream>> output =
+      AsyncOutputStream::Open(path, OutputCompression::kNone, GetParam());
+  ASSERT_TRUE(output.ok()) << output.status();
+  ASSERT_TRUE((*output)->Write("data"));
+  ASSERT_TRUE((*output)->Close().ok());
+
+  EXPECT_EQ(AsyncOutputStream::Resume(path, OutputCompression::kNone,
+                                      GetParam(), /*offset=*/5)
+                .status()
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(AsyncOutputStream::Resume("/nonexistent/dir/output.txt",
+                                      OutputCompression::kNone, GetParam(),
+                                      /*offset=*/0)
+                .status()
+                .code(),
+            absl::StatusCode::kNotFound);
+}
+
+INSTANTIATE_TEST_SUITE_P(IoUring, AsyncOutputStreamTest, ::testing::Bool());
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,207 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "wfa/virtual_people/model_applier/checkpoint.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/event.pb.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::google::protobuf::util::MessageDifferencer;
+
+// Returns an empty directory for the test @name.
+std::string GetDir(absl::string_view name) {
+  std::string dir = absl::StrCat(::testing::TempDir(), "/checkpoint_", name);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directory(dir);
+  return dir;
+}
+
+// Returns the output of event @i, with one or two people, labeled by gender
+// except for some.
+LabelerOutput GetOutput(const int i) {
+  LabelerOutput output;
+  for (int j = 0; j <= i % 2; ++j) {
+    VirtualPersonActivity* person = output.add_people();
+    person->set_virtual_person_id((i * 7 + j) % 100);
+    if (i % 5 != 0) {
+      person->mutable_label()->mutable_demo()->set_gender(
+          i % 3 == 0 ? GENDER_FEMALE : GENDER_MALE);
+    }
+  }
+  // Not kept in the journal.
+  output.set_serialized_debug_trace("trace");
+  return output;
+}
+
+// The sort engine adds the label rows in a deterministic order, so the
+// reports of the same outputs are equal.
+std::unique_ptr<ReportAggregator> CreateAggregator() {
+  ReportAggregatorOptions options;
+  options.engine = AggregationEngine::kSort;
+  options.frequency_cap = 3;
+  absl::StatusOr<std::unique_ptr<ReportAggregator>> aggregator =
+      ReportAggregator::Create(options);
+  EXPECT_TRUE(aggregator.ok()) << aggregator.status();
+  return *std::move(aggregator);
+}
+
+// Returns the report of the outputs of the events in [0, @count).
+AggregatedReport GetExpectedReport(const int count) {
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator();
+  for (int i = 0; i < count; ++i) {
+    aggregator->Add(GetOutput(i));
+  }
+  return aggregator->GetReport();
+}
+
+// Returns the report of replaying the first @size bytes of the journal in
+// @dir.
+AggregatedReport Replay(const std::string& dir, const int64_t size) {
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator();
+  absl::Status status =
+      ReplayAggregationJournal(dir, size, /*use_io_uring=*/true, *aggregator);
+  EXPECT_TRUE(status.ok()) << status;
+  return aggregator->GetReport();
+}
+
+TEST(CheckpointTest, WriteAndReadCheckpoint) {
+  const std::string dir = GetDir("write_and_read");
+  EXPECT_EQ(ReadCheckpoint(dir).status().code(), absl::StatusCode::kNotFound);
+
+  ModelApplierCheckpoint checkpoint;
+  checkpoint.set_input_path("/tmp/input.textproto");
+  checkpoint.set_input_count(100);
+  checkpoint.set_labeled_inputs(10);
+  checkpoint.set_events_filename("output_events.txt");
+  checkpoint.set_events_size(1000);
+  checkpoint.set_journal_size(200);
+  ASSERT_TRUE(WriteCheckpoint(dir, checkpoint).ok());
+  absl::StatusOr<ModelApplierCheckpoint> read = ReadCheckpoint(dir);
+  ASSERT_TRUE(read.ok()) << read.status();
+  EXPECT_TRUE(MessageDifferencer::Equals(*read, checkpoint));
+
+  // A later checkpoint replaces the previous one.
+  checkpoint.set_labeled_inputs(20);
+  checkpoint.set_events_size(2000);
+  checkpoint.set_journal_size(400);
+  ASSERT_TRUE(WriteCheckpoint(dir, checkpoint).ok());
+  read = ReadCheckpoint(dir);
+  ASSERT_TRUE(read.ok()) << read.status();
+  EXPECT_TRUE(MessageDifferencer::Equals(*read, checkpoint));
+
+  ASSERT_TRUE(RemoveCheckpoint(dir).ok());
+  EXPECT_EQ(ReadCheckpoint(dir).status().code(), absl::StatusCode::kNotFound);
+  // Removing again is a no-op.
+  EXPECT_TRUE(RemoveCheckpoint(dir).ok());
+  EXPECT_TRUE(std::filesystem::is_empty(dir));
+}
+
+TEST(CheckpointTest, ReadCorruptCheckpoint) {
+  const std::string dir = GetDir("corrupt");
+  ModelApplierCheckpoint checkpoint;
+  checkpoint.set_input_count(100);
+  ASSERT_TRUE(WriteCheckpoint(dir, checkpoint).ok());
+  std::filesystem::resize_file(absl::StrCat(dir, "/checkpoint.textproto"), 5);
+  EXPECT_EQ(ReadCheckpoint(dir).status().code(), absl::StatusCode::kDataLoss);
+}
+
+TEST(CheckpointTest, ReplayJournal) {
+  const std::string dir = GetDir("replay");
+  absl::StatusOr<std::unique_ptr<AggregationJournal>> journal =
+      AggregationJournal::Open(dir, /*use_io_uring=*/true);
+  ASSERT_TRUE(journal.ok()) << journal.status();
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE((*journal)->Add(GetOutput(i)));
+  }
+  absl::StatusOr<int64_t> size = (*journal)->Flush();
+  ASSERT_TRUE(size.ok()) << size.status();
+  for (int i = 1000; i < 1500; ++i) {
+    ASSERT_TRUE((*journal)->Add(GetOutput(i)));
+  }
+  absl::StatusOr<int64_t> full_size = (*journal)->Flush();
+  ASSERT_TRUE(full_size.ok()) << full_size.status();
+  ASSERT_TRUE((*journal)->Close().ok());
+
+  EXPECT_TRUE(MessageDifferencer::Equals(Replay(dir, *size),
+                                         GetExpectedReport(1000)));
+  EXPECT_TRUE(MessageDifferencer::Equals(Replay(dir, *full_size),
+                                         GetExpectedReport(1500)));
+  EXPECT_TRUE(
+      MessageDifferencer::Equals(Replay(dir, 0), GetExpectedReport(0)));
+}
+
+TEST(CheckpointTest, ResumeJournal) {
+  const std::string dir = GetDir("resume");
+  absl::StatusOr<std::unique_ptr<AggregationJournal>> journal =
+      AggregationJournal::Open(dir, /*use_io_uring=*/true);
+  ASSERT_TRUE(journal.ok()) << journal.status();
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE((*journal)->Add(GetOutput(i)));
+  }
+  absl::StatusOr<int64_t> size = (*journal)->Flush();
+  ASSERT_TRUE(size.ok()) << size.status();
+  // Appended after the checkpoint by a run that stopped.
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE((*journal)->Add(GetOutput(i)));
+  }
+  ASSERT_TRUE((*journal)->Close().ok());
+
+  journal = AggregationJournal::Resume(dir, /*use_io_uring=*/true, *size);
+  ASSERT_TRUE(journal.ok()) << journal.status();
+  for (int i = 1000; i < 1500; ++i) {
+    ASSERT_TRUE((*journal)->Add(GetOutput(i)));
+  }
+  absl::StatusOr<int64_t> full_size = (*journal)->Flush();
+  ASSERT_TRUE(full_size.ok()) << full_size.status();
+  ASSERT_TRUE((*journal)->Close().ok());
+
+  EXPECT_TRUE(MessageDifferencer::Equals(Replay(dir, *full_size),
+                                         GetExpectedReport(1500)));
+}
+
+TEST(CheckpointTest, ReplayShortJournal) {
+  const std::string dir = GetDir("short");
+  absl::StatusOr<std::unique_ptr<AggregationJournal>> journal =
+      AggregationJournal::Open(dir, /*use_io_uring=*/true);
+  ASSERT_TRUE(journal.ok()) << journal.status();
+  ASSERT_TRUE((*journal)->Add(GetOutput(1)));
+  absl::StatusOr<int64_t> size = (*journal)->Flush();
+  ASSERT_TRUE(size.ok()) << size.status();
+  ASSERT_TRUE((*journal)->Close().ok());
+
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator();
+  EXPECT_EQ(
+      ReplayAggregationJournal(dir, *size + 1, true, *aggregator).code(),
+      absl::StatusCode::kDataLoss);
+  EXPECT_FALSE(AggregationJournal::Resume(dir, true, *size + 1).ok());
+  EXPECT_FALSE(ReplayAggregationJournal(GetDir("missing"), 0, true,
+                                        *aggregator)
+                   .ok());
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,137 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/labeling_cost_profile.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/event.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::StartsWith;
+
+constexpr char kHeader[] =
+    "dimension,value,events,total_ms,cost_share,mean_us,p50_us,p90_us,"
+    "p99_us,max_us";
+
+LabelerInput MakeInput(const std::string& publisher, const int country_id,
+                       const bool email, const bool phone) {
+  LabelerInput input;
+  input.mutable_event_id()->set_publisher(publisher);
+  input.mutable_geo()->set_country_id(country_id);
+  if (email) {
+    input.mutable_profile_info()->mutable_email_user_info();
+  }
+  if (phone) {
+    input.mutable_profile_info()->mutable_phone_user_info();
+  }
+  return input;
+}
+
+// Returns the first 5 columns of each line of @csv, which do not depend on the
+// bucket widths of the histograms.
+std::vector<std::string> GetRowPrefixes(const std::string& csv) {
+  std::vector<std::string> prefixes;
+  for (absl::string_view line : absl::StrSplit(csv, '\n', absl::SkipEmpty())) {
+    std::vector<absl::string_view> columns = absl::StrSplit(line, ',');
+    prefixes.push_back(
+        absl::StrJoin(columns.begin(), columns.begin() + 5, ","));
+  }
+  return prefixes;
+}
+
+TEST(LabelingCostProfileTest, EmptyProfile) {
+  LabelingCostProfile profile;
+  EXPECT_EQ(profile.count(), 0);
+  EXPECT_THAT(GetRowPrefixes(profile.ToCsv()),
+              ElementsAre(StartsWith("dimension,value,events"),
+                          "all,all,0,0,0"));
+}
+
+TEST(LabelingCostProfileTest, SlicesByInputFeatures) {
+  LabelingCostProfile profile;
+  profile.Record(MakeInput("p1", 1, true, false), absl::Milliseconds(1));
+  profile.Record(MakeInput("p1", 2, true, true), absl::Milliseconds(3));
+  profile.Record(MakeInput("p2", 1, false, false), absl::Milliseconds(4));
+  EXPECT_EQ(profile.count(), 3);
+
+  std::string csv = profile.ToCsv();
+  EXPECT_THAT(csv, StartsWith(absl::StrCat(kHeader, "\n")));
+  EXPECT_THAT(GetRowPrefixes(csv),
+              ElementsAre(StartsWith("dimension,"), "all,all,3,8,1",
+                          "user_info,none,1,4,0.5",
+                          "user_info,email+phone,1,3,0.375",
+                          "user_info,email,1,1,0.125",
+                          "publisher,p1,2,4,0.5", "publisher,p2,1,4,0.5",
+                          "country,1,2,5,0.625", "country,2,1,3,0.375"));
+}
+
+TEST(LabelingCostProfileTest, ReportsPercentiles) {
+  LabelingCostProfile profile;
+  for (int i = 0; i < 99; ++i) {
+    profile.Record(MakeInput("p1", 1, false, false), absl::Microseconds(10));
+  }
+  profile.Record(MakeInput("p1", 1, false, false), absl::Microseconds(1000));
+
+  std::vector<std::string> lines =
+      absl::StrSplit(profile.ToCsv(), '\n', absl::SkipEmpty());
+  ASSERT_GE(lines.size(), 2);
+  std::vector<std::string> columns = absl::StrSplit(lines[1], ',');
+  ASSERT_EQ(columns.size(), 10);
+  // mean_us
+  EXPECT_EQ(columns[5], "19.9");
+  // p50_us and p90_us are within the bucket width of 10us.
+  EXPECT_NEAR(std::stod(columns[6]), 10, 10.0 / 32);
+  EXPECT_NEAR(std::stod(columns[7]), 10, 10.0 / 32);
+  // max_us
+  EXPECT_EQ(columns[9], "1000");
+}
+
+TEST(LabelingCostProfileTest, Merge) {
+  LabelingCostProfile profile1;
+  profile1.Record(MakeInput("p1", 1, true, false), absl::Milliseconds(1));
+  LabelingCostProfile profile2;
+  profile2.Record(MakeInput("p1", 1, true, false), absl::Milliseconds(2));
+  profile2.Record(MakeInput("p2", 2, false, true), absl::Milliseconds(5));
+
+  profile1.Merge(profile2);
+  EXPECT_EQ(profile1.count(), 3);
+  EXPECT_THAT(GetRowPrefixes(profile1.ToCsv()),
+              ElementsAre(StartsWith("dimension,"), "all,all,3,8,1",
+                          "user_info,phone,1,5,0.625",
+                          "user_info,email,2,3,0.375",
+                          "publisher,p2,1,5,0.625", "publisher,p1,2,3,0.375",
+                          "country,2,1,5,0.625", "country,1,2,3,0.375"));
+}
+
+TEST(LabelingCostProfileTest, EscapesPublisher) {
+  LabelingCostProfile profile;
+  profile.Record(MakeInput("a,\"b\"", 1, false, false), absl::Milliseconds(1));
+  EXPECT_NE(profile.ToCsv().find("\npublisher,\"a,\"\"b\"\"\",1,1,1,"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,240 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::Gt;
+using ::testing::Lt;
+
+LiquidLegionsConfig GetConfig() {
+  LiquidLegionsConfig config;
+  config.decay_rate = 20.0;
+  config.size = 10000;
+  config.random_seed = 1;
+  return config;
+}
+
+TEST(LiquidLegionsSketchTest, RegistersDecay) {
+  LiquidLegionsConfig config = GetConfig();
+  std::vector<int64_t> counts(config.size, 0);
+  for (int64_t id = 0; id < 1000000; ++id) {
+    int32_t index = GetLiquidLegionsRegister(config, id);
+    ASSERT_GE(index, 0);
+    ASSERT_LT(index, config.size);
+    ++counts[index];
+  }
+  // The chance of the first tenth of the registers is
+  //   (1 - exp(-2)) / (1 - exp(-20)) = 0.8647.
+  int64_t first_tenth = 0;
+  for (int32_t i = 0; i < config.size / 10; ++i) {
+    first_tenth += counts[i];
+  }
+  EXPECT_THAT(first_tenth / 1000000.0, DoubleNear(0.8647, 0.002));
+  // The registers at the end are rarely activated.
+  EXPECT_THAT(counts[config.size - 1], Lt(5));
+}
+
+TEST(LiquidLegionsSketchTest, RegisterDependsOnSeed) {
+  LiquidLegionsConfig config = GetConfig();
+  LiquidLegionsConfig other_config = GetConfig();
+  other_config.random_seed = 2;
+  int same_count = 0;
+  for (int64_t id = 0; id < 1000; ++id) {
+    if (GetLiquidLegionsRegister(config, id) ==
+        GetLiquidLegionsRegister(other_config, id)) {
+      ++same_count;
+    }
+  }
+  EXPECT_THAT(same_count, Lt(100));
+}
+
+TEST(LiquidLegionsSketchTest, EstimateCardinality) {
+  LiquidLegionsConfig config = GetConfig();
+  EXPECT_EQ(EstimateLiquidLegionsCardinality(config, 0), 0.0);
+  EXPECT_TRUE(std::isinf(EstimateLiquidLegionsCardinality(config, 10000)));
+
+  for (const int64_t cardinality : {1000, 30000, 200000}) {
+    LiquidLegionsSketchBuilder builder(config, config.size);
+    for (int64_t id = 0; id < cardinality; ++id) {
+      builder.Add(id);
+    }
+    double estimate = EstimateLiquidLegionsCardinality(
+        config, builder.GetActiveRegisterCount());
+    // The relative standard error is about 0.035 for 10000 registers.
+    EXPECT_THAT(estimate, DoubleNear(cardinality, 0.1 * cardinality))
+        << "cardinality: " << cardinality;
+  }
+}
+
+TEST(LiquidLegionsSketchTest, DeepRegistersKeepIds) {
+  LiquidLegionsConfig config = GetConfig();
+  LiquidLegionsSketchBuilder universe(config, config.size);
+  for (int64_t id = 0; id < 100000; ++id) {
+    universe.Add(id);
+  }
+  int32_t deep_register_begin = universe.GetFirstInactiveRegister();
+  EXPECT_THAT(deep_register_begin, Gt(0));
+  EXPECT_THAT(deep_register_begin, Lt(config.size));
+
+  LiquidLegionsSketchBuilder builder(config, deep_register_begin);
+  for (int64_t id = 0; id < 100000; ++id) {
+    // Every id is added twice, and kept once.
+    builder.Add(id);
+    builder.Add(id);
+  }
+  LiquidLegionsSketch sketch = builder.ToProto();
+  EXPECT_EQ(sketch.decay_rate(), config.decay_rate);
+  EXPECT_EQ(sketch.size(), config.size);
+  EXPECT_EQ(sketch.random_seed(), config.random_seed);
+  EXPECT_EQ(sketch.deep_register_begin(), deep_register_begin);
+  // All the registers before deep_register_begin are active.
+  EXPECT_EQ(sketch.shallow_registers_size(), deep_register_begin);
+  EXPECT_EQ(sketch.shallow_registers_size() + sketch.deep_registers_size(),
+            builder.GetActiveRegisterCount());
+  EXPECT_EQ(builder.GetActiveRegisterCount(),
+            universe.GetActiveRegisterCount());
+
+  int64_t deep_id_count = 0;
+  int32_t previous_index = -1;
+  for (const LiquidLegionsSketch::DeepRegister& deep :
+       sketch.deep_registers()) {
+    EXPECT_THAT(deep.index(), Gt(previous_index));
+    previous_index = deep.index();
+    int64_t previous_id = -1;
+    for (const int64_t id : deep.virtual_person_ids()) {
+      EXPECT_EQ(GetLiquidLegionsRegister(config, id), deep.index());
+      EXPECT_THAT(id, Gt(previous_id));
+      previous_id = id;
+      ++deep_id_count;
+    }
+  }
+  // The deep registers keep a small fraction of the ids.
+  EXPECT_THAT(deep_id_count, Gt(0));
+  EXPECT_THAT(deep_id_count, Lt(10000));
+}
+
+TEST(LiquidLegionsSketchTest, MergeIsUnion) {
+  LiquidLegionsConfig config = GetConfig();
+  LiquidLegionsSketchBuilder all(config, 5000);
+  LiquidLegionsSketchBuilder first(config, 5000);
+  LiquidLegionsSketchBuilder second(config, 5000);
+  for (int64_t id = 0; id < 20000; ++id) {
+    all.Add(id);
+    // The halves overlap.
+    if (id < 12000) {
+      first.Add(id);
+    }
+    if (id >= 8000) {
+      second.Add(id);
+    }
+  }
+  LiquidLegionsSketchBuilder merged_builders = first;
+  merged_builders.Merge(second);
+  EXPECT_EQ(merged_builders.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+
+  LiquidLegionsSketchBuilder merged_protos = first;
+  EXPECT_TRUE(merged_protos.Merge(second.ToProto()).ok());
+  EXPECT_EQ(merged_protos.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+}
+
+TEST(LiquidLegionsSketchTest, MergeDifferentDeepRegisterBegin) {
+  LiquidLegionsConfig config = GetConfig();
+  LiquidLegionsSketchBuilder all(config, 6000);
+  LiquidLegionsSketchBuilder first(config, 5000);
+  LiquidLegionsSketchBuilder second(config, 6000);
+  for (int64_t id = 0; id < 20000; ++id) {
+    all.Add(id);
+    if (id < 12000) {
+      first.Add(id);
+    }
+    if (id >= 8000) {
+      second.Add(id);
+    }
+  }
+  // The registers in [5000, 6000) of the first sketch become shallow, in
+  // either order of merging.
+  LiquidLegionsSketchBuilder merged_builders = first;
+  merged_builders.Merge(second);
+  EXPECT_EQ(merged_builders.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+  merged_builders = second;
+  merged_builders.Merge(first);
+  EXPECT_EQ(merged_builders.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+
+  LiquidLegionsSketchBuilder merged_protos = first;
+  EXPECT_TRUE(merged_protos.Merge(second.ToProto()).ok());
+  EXPECT_EQ(merged_protos.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+  merged_protos = second;
+  EXPECT_TRUE(merged_protos.Merge(first.ToProto()).ok());
+  EXPECT_EQ(merged_protos.ToProto().SerializeAsString(),
+            all.ToProto().SerializeAsString());
+}
+
+TEST(LiquidLegionsSketchTest, MergeInvalidSketch) {
+  LiquidLegionsConfig config = GetConfig();
+  LiquidLegionsSketchBuilder builder(config, 5000);
+
+  LiquidLegionsConfig other_config = GetConfig();
+  other_config.random_seed = 2;
+  EXPECT_EQ(builder.Merge(LiquidLegionsSketchBuilder(other_config, 5000)
+                              .ToProto())
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  LiquidLegionsSketch sketch = builder.ToProto();
+  sketch.set_deep_register_begin(config.size + 1);
+  EXPECT_EQ(builder.Merge(sketch).code(), absl::StatusCode::kInvalidArgument);
+
+  sketch = builder.ToProto();
+  sketch.add_shallow_registers(5000);
+  EXPECT_EQ(builder.Merge(sketch).code(), absl::StatusCode::kInvalidArgument);
+
+  sketch = builder.ToProto();
+  sketch.add_deep_registers()->set_index(10000);
+  EXPECT_EQ(builder.Merge(sketch).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(LiquidLegionsSketchTest, FirstInactiveRegister) {
+  LiquidLegionsConfig config = GetConfig();
+  // A slow decay, so that all the registers are activated.
+  config.decay_rate = 2.0;
+  config.size = 100;
+  LiquidLegionsSketchBuilder builder(config, config.size);
+  EXPECT_EQ(builder.GetFirstInactiveRegister(), 0);
+  for (int64_t id = 0; id < 1000000; ++id) {
+    builder.Add(id);
+  }
+  EXPECT_EQ(builder.GetActiveRegisterCount(), config.size);
+  EXPECT_EQ(builder.GetFirstInactiveRegister(), config.size);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,111 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/message_projection.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/model.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+constexpr char kOutput[] = R"pb(
+  people {
+    virtual_person_id: 1
+    label { demo { gender: GENDER_MALE age { min_age: 18 max_age: 24 } } }
+  }
+  people { virtual_person_id: 2 }
+  serialized_debug_trace: "trace"
+)pb";
+
+LabelerOutput ParseOutput(const std::string& textproto) {
+  LabelerOutput output;
+  EXPECT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(textproto, &output));
+  return output;
+}
+
+// Returns @kOutput projected to @paths.
+LabelerOutput Project(const std::vector<std::string>& paths) {
+  absl::StatusOr<MessageProjection> projection =
+      MessageProjection::Create(*LabelerOutput::descriptor(), paths);
+  EXPECT_TRUE(projection.ok()) << projection.status();
+  LabelerOutput output = ParseOutput(kOutput);
+  projection->Apply(output);
+  return output;
+}
+
+void ExpectEquals(const LabelerOutput& actual, const std::string& expected) {
+  EXPECT_TRUE(google::protobuf::util::MessageDifferencer::Equals(
+      actual, ParseOutput(expected)))
+      << actual.DebugString();
+}
+
+TEST(MessageProjectionTest, TopLevelField) {
+  ExpectEquals(Project({"serialized_debug_trace"}),
+               R"pb(serialized_debug_trace: "trace")pb");
+}
+
+TEST(MessageProjectionTest, ThroughRepeatedField) {
+  ExpectEquals(Project({"people.virtual_person_id"}), R"pb(
+                 people { virtual_person_id: 1 }
+                 people { virtual_person_id: 2 }
+               )pb");
+}
+
+TEST(MessageProjectionTest, NestedFields) {
+  ExpectEquals(Project({"people.label.demo.gender", "serialized_debug_trace"}),
+               R"pb(
+                 people { label { demo { gender: GENDER_MALE } } }
+                 people {}
+                 serialized_debug_trace: "trace"
+               )pb");
+}
+
+TEST(MessageProjectionTest, WholeFieldContainsSubfields) {
+  LabelerOutput expected = ParseOutput(kOutput);
+  expected.clear_serialized_debug_trace();
+  ExpectEquals(Project({"people.virtual_person_id", "people"}),
+               expected.DebugString());
+  ExpectEquals(Project({"people", "people.virtual_person_id"}),
+               expected.DebugString());
+}
+
+TEST(MessageProjectionTest, NoPaths) {
+  ExpectEquals(Project({}), "");
+}
+
+TEST(MessageProjectionTest, InvalidPaths) {
+  EXPECT_EQ(MessageProjection::Create(*LabelerOutput::descriptor(),
+                                      {"people.unknown"})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(MessageProjection::Create(*LabelerOutput::descriptor(),
+                                      {"serialized_debug_trace.size"})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,85 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "src/farmhash.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+constexpr int kEventCount = 1 << 21;
+// The labels are the combinations of gender and age bucket.
+constexpr int kAgeBucketCount = 8;
+
+// Aggregates kEventCount events of one labeled virtual person each, drawn from
+// @people virtual people, and builds the report. Each virtual person has one
+// of 2 * kAgeBucketCount labels.
+void Aggregate(benchmark::State& state, const AggregationEngine engine,
+               const int64_t people, const int threads) {
+  std::vector<int64_t> virtual_person_ids(kEventCount);
+  for (int i = 0; i < kEventCount; ++i) {
+    virtual_person_ids[i] =
+        static_cast<int64_t>(util::Fingerprint64(absl::StrCat(i % people)));
+  }
+  ReportAggregatorOptions options;
+  options.engine = engine;
+  options.threads = threads;
+  LabelerOutput output;
+  VirtualPersonActivity* person = output.add_people();
+  DemoBucket* demo = person->mutable_label()->mutable_demo();
+
+  for (auto _ : state) {
+    std::unique_ptr<ReportAggregator> aggregator =
+        *ReportAggregator::Create(options);
+    for (const int64_t virtual_person_id : virtual_person_ids) {
+      const uint64_t label = static_cast<uint64_t>(virtual_person_id) >> 60;
+      person->set_virtual_person_id(virtual_person_id);
+      demo->set_gender(label % 2 == 0 ? GENDER_MALE : GENDER_FEMALE);
+      demo->mutable_age()->set_min_age(18 + label / 2 % kAgeBucketCount);
+      aggregator->Add(output);
+    }
+    AggregatedReport report = aggregator->GetReport();
+    benchmark::DoNotOptimize(report);
+  }
+  state.SetItemsProcessed(state.iterations() * kEventCount);
+}
+
+// The argument is the count of virtual people.
+void BM_HashAggregation(benchmark::State& state) {
+  Aggregate(state, AggregationEngine::kHash, state.range(0), 1);
+}
+BENCHMARK(BM_HashAggregation)
+    ->RangeMultiplier(32)
+    ->Range(1 << 10, 1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+// The first argument is the count of virtual people, and the second is the
+// count of sorting threads.
+void BM_SortAggregation(benchmark::State& state) {
+  Aggregate(state, AggregationEngine::kSort, state.range(0), state.range(1));
+}
+BENCHMARK(BM_SortAggregation)
+    ->ArgsProduct({{1 << 10, 1 << 15, 1 << 20}, {1, 4}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,311 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/report_aggregator.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/common/model.pb.h"
+#include "wfa/virtual_people/model_applier/liquid_legions_sketch.h"
+#include "wfa/virtual_people/model_applier/model_applier.pb.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::google::protobuf::util::MessageDifferencer;
+using ::testing::ElementsAre;
+
+// Adds a person with @virtual_person_id to @output, with gender @gender if it
+// is not GENDER_INVALID.
+void AddPerson(const int64_t virtual_person_id, const Gender gender,
+               LabelerOutput& output) {
+  VirtualPersonActivity* person = output.add_people();
+  person->set_virtual_person_id(virtual_person_id);
+  if (gender != GENDER_INVALID) {
+    person->mutable_label()->mutable_demo()->set_gender(gender);
+  }
+}
+
+std::unique_ptr<ReportAggregator> CreateAggregator(
+    const ReportAggregatorOptions& options) {
+  absl::StatusOr<std::unique_ptr<ReportAggregator>> aggregator =
+      ReportAggregator::Create(options);
+  EXPECT_TRUE(aggregator.ok()) << aggregator.status();
+  return *std::move(aggregator);
+}
+
+// Returns the rows of @report after the total row, keyed by the serialized
+// attrs, as the order of the label rows is not specified.
+absl::flat_hash_map<std::string, AggregatedReport::Row> GetLabelRows(
+    const AggregatedReport& report) {
+  absl::flat_hash_map<std::string, AggregatedReport::Row> rows;
+  for (int i = 1; i < report.rows_size(); ++i) {
+    rows[report.rows(i).attrs().SerializeAsString()] = report.rows(i);
+  }
+  return rows;
+}
+
+std::string GetGenderKey(const Gender gender) {
+  PersonLabelAttributes attrs;
+  attrs.mutable_demo()->set_gender(gender);
+  return attrs.SerializeAsString();
+}
+
+TEST(ReportAggregatorTest, ParseAggregationEngine) {
+  EXPECT_EQ(*ParseAggregationEngine("hash"), AggregationEngine::kHash);
+  EXPECT_EQ(*ParseAggregationEngine("sort"), AggregationEngine::kSort);
+  EXPECT_EQ(ParseAggregationEngine("tree").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ReportAggregatorTest, InvalidFrequencyCap) {
+  ReportAggregatorOptions options;
+  options.frequency_cap = -1;
+  EXPECT_EQ(ReportAggregator::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.frequency_cap = ReportAggregator::kMaxFrequencyCap + 1;
+  EXPECT_EQ(ReportAggregator::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+class ReportAggregatorEngineTest
+    : public ::testing::TestWithParam<AggregationEngine> {
+ protected:
+  ReportAggregatorOptions GetOptions() const {
+    ReportAggregatorOptions options;
+    options.engine = GetParam();
+    options.threads = 2;
+    return options;
+  }
+};
+
+TEST_P(ReportAggregatorEngineTest, EmptyReport) {
+  ReportAggregatorOptions options = GetOptions();
+  options.frequency_cap = 2;
+  AggregatedReport report = CreateAggregator(options)->GetReport();
+
+  AggregatedReport expected;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      R"pb(
+        rows { impressions: 0 reach: 0 frequency_reach: 0 frequency_reach: 0 }
+        frequency_cap: 2
+      )pb",
+      &expected));
+  EXPECT_TRUE(MessageDifferencer::Equals(report, expected))
+      << report.DebugString();
+}
+
+TEST_P(ReportAggregatorEngineTest, CountsImpressionsReachAndFrequency) {
+  ReportAggregatorOptions options = GetOptions();
+  options.frequency_cap = 3;
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator(options);
+
+  LabelerOutput output;
+  AddPerson(1, GENDER_MALE, output);
+  AddPerson(1, GENDER_MALE, output);
+  AddPerson(2, GENDER_FEMALE, output);
+  aggregator->Add(output);
+  output.Clear();
+  // Virtual person 1 is reached 4 times, which is counted at the cap.
+  AddPerson(1, GENDER_MALE, output);
+  AddPerson(1, GENDER_MALE, output);
+  // The people without label only count in the total.
+  AddPerson(3, GENDER_INVALID, output);
+  AddPerson(2, GENDER_FEMALE, output);
+  aggregator->Add(output);
+
+  AggregatedReport report = aggregator->GetReport();
+  EXPECT_EQ(report.frequency_cap(), 3);
+  ASSERT_EQ(report.rows_size(), 3);
+  EXPECT_FALSE(report.rows(0).has_attrs());
+  EXPECT_EQ(report.rows(0).impressions(), 7);
+  EXPECT_EQ(report.rows(0).reach(), 3);
+  EXPECT_THAT(report.rows(0).frequency_reach(), ElementsAre(3, 2, 1));
+
+  absl::flat_hash_map<std::string, AggregatedReport::Row> rows =
+      GetLabelRows(report);
+  const AggregatedReport::Row& male = rows[GetGenderKey(GENDER_MALE)];
+  EXPECT_EQ(male.impressions(), 4);
+  EXPECT_EQ(male.reach(), 1);
+  EXPECT_THAT(male.frequency_reach(), ElementsAre(1, 1, 1));
+  const AggregatedReport::Row& female = rows[GetGenderKey(GENDER_FEMALE)];
+  EXPECT_EQ(female.impressions(), 2);
+  EXPECT_EQ(female.reach(), 1);
+  EXPECT_THAT(female.frequency_reach(), ElementsAre(1, 1, 0));
+}
+
+TEST_P(ReportAggregatorEngineTest, FrequencySaturatesAtMaxFrequencyCap) {
+  ReportAggregatorOptions options = GetOptions();
+  options.frequency_cap = ReportAggregator::kMaxFrequencyCap;
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator(options);
+  // Virtual person 1 is reached 300 times, more than the largest frequency
+  // counted, 2 is reached 255 times, and 3 is reached 254 times.
+  for (int i = 0; i < 300; ++i) {
+    LabelerOutput output;
+    AddPerson(1, GENDER_MALE, output);
+    if (i < 255) {
+      AddPerson(2, GENDER_MALE, output);
+    }
+    if (i < 254) {
+      AddPerson(3, GENDER_MALE, output);
+    }
+    aggregator->Add(output);
+  }
+
+  AggregatedReport report = aggregator->GetReport();
+  EXPECT_EQ(report.frequency_cap(), ReportAggregator::kMaxFrequencyCap);
+  ASSERT_EQ(report.rows_size(), 2);
+  for (const AggregatedReport::Row& row : report.rows()) {
+    EXPECT_EQ(row.impressions(), 300 + 255 + 254);
+    EXPECT_EQ(row.reach(), 3);
+    ASSERT_EQ(row.frequency_reach_size(), ReportAggregator::kMaxFrequencyCap);
+    for (int i = 0; i < 254; ++i) {
+      EXPECT_EQ(row.frequency_reach(i), 3);
+    }
+    EXPECT_EQ(row.frequency_reach(254), 2);
+  }
+}
+
+TEST_P(ReportAggregatorEngineTest, FrequencyAboveCapCountsAtCap) {
+  ReportAggregatorOptions options = GetOptions();
+  options.frequency_cap = 2;
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator(options);
+  // The frequencies are 1, 2, 3 and 10 for virtual people 1, 2, 3 and 4.
+  for (int i = 0; i < 10; ++i) {
+    LabelerOutput output;
+    for (int64_t id = 1; id <= 4; ++id) {
+      if (i < (id == 4 ? 10 : id)) {
+        AddPerson(id, GENDER_FEMALE, output);
+      }
+    }
+    aggregator->Add(output);
+  }
+
+  AggregatedReport report = aggregator->GetReport();
+  ASSERT_EQ(report.rows_size(), 2);
+  for (const AggregatedReport::Row& row : report.rows()) {
+    EXPECT_EQ(row.impressions(), 16);
+    EXPECT_EQ(row.reach(), 4);
+    EXPECT_THAT(row.frequency_reach(), ElementsAre(4, 3));
+  }
+}
+
+TEST_P(ReportAggregatorEngineTest, NoFrequencyOrSketchByDefault) {
+  std::unique_ptr<ReportAggregator> aggregator =
+      CreateAggregator(GetOptions());
+  LabelerOutput output;
+  AddPerson(1, GENDER_MALE, output);
+  aggregator->Add(output);
+
+  AggregatedReport report = aggregator->GetReport();
+  EXPECT_FALSE(report.has_frequency_cap());
+  ASSERT_EQ(report.rows_size(), 2);
+  for (const AggregatedReport::Row& row : report.rows()) {
+    EXPECT_EQ(row.impressions(), 1);
+    EXPECT_EQ(row.reach(), 1);
+    EXPECT_EQ(row.frequency_reach_size(), 0);
+    EXPECT_FALSE(row.has_sketch());
+  }
+}
+
+TEST_P(ReportAggregatorEngineTest, SameReportAsHashEngine) {
+  ReportAggregatorOptions options = GetOptions();
+  options.frequency_cap = 5;
+  LiquidLegionsConfig config;
+  config.size = 1000;
+  options.sketch_config = config;
+  std::unique_ptr<ReportAggregator> aggregator = CreateAggregator(options);
+  options.engine = AggregationEngine::kHash;
+  std::unique_ptr<ReportAggregator> expected_aggregator =
+      CreateAggregator(options);
+
+  // Enough pairs for the sort engine to sort on several threads.
+  std::mt19937_64 random(1);
+  for (int i = 0; i < 1 << 17; ++i) {
+    LabelerOutput output;
+    for (int j = 0; j < 2; ++j) {
+      AddPerson(random() % 20000 - 10000, static_cast<Gender>(random() % 3),
+                output);
+    }
+    aggregator->Add(output);
+    expected_aggregator->Add(output);
+  }
+
+  AggregatedReport report = aggregator->GetReport();
+  AggregatedReport expected = expected_aggregator->GetReport();
+  ASSERT_EQ(report.rows_size(), 3);
+  ASSERT_EQ(expected.rows_size(), 3);
+  EXPECT_EQ(report.frequency_cap(), expected.frequency_cap());
+  EXPECT_TRUE(MessageDifferencer::Equals(report.rows(0), expected.rows(0)));
+  absl::flat_hash_map<std::string, AggregatedReport::Row> rows =
+      GetLabelRows(report);
+  for (const auto& [attrs, expected_row] : GetLabelRows(expected)) {
+    EXPECT_TRUE(MessageDifferencer::Equals(rows[attrs], expected_row))
+        << expected_row.attrs().DebugString();
+  }
+}
+
+TEST_P(ReportAggregatorEngineTest, SketchesOfDisjointRunsMerge) {
+  ReportAggregatorOptions options = GetOptions();
+  LiquidLegionsConfig config;
+  config.size = 1000;
+  options.sketch_config = config;
+  // Two runs with disjoint virtual people, e.g. of two publishers, each
+  // choosing the deep registers from their own virtual people.
+  std::unique_ptr<ReportAggregator> first = CreateAggregator(options);
+  std::unique_ptr<ReportAggregator> second = CreateAggregator(options);
+  for (int64_t id = 0; id < 21000; ++id) {
+    LabelerOutput output;
+    AddPerson(id, GENDER_MALE, output);
+    if (id < 1000) {
+      first->Add(output);
+    } else {
+      second->Add(output);
+    }
+  }
+  const LiquidLegionsSketch first_sketch = first->GetReport().rows(0).sketch();
+  const LiquidLegionsSketch second_sketch =
+      second->GetReport().rows(0).sketch();
+  ASSERT_LT(first_sketch.deep_register_begin(),
+            second_sketch.deep_register_begin());
+
+  LiquidLegionsSketchBuilder merged(config,
+                                    first_sketch.deep_register_begin());
+  ASSERT_TRUE(merged.Merge(first_sketch).ok());
+  ASSERT_TRUE(merged.Merge(second_sketch).ok());
+  LiquidLegionsSketchBuilder expected(config,
+                                      second_sketch.deep_register_begin());
+  for (int64_t id = 0; id < 21000; ++id) {
+    expected.Add(id);
+  }
+  EXPECT_TRUE(MessageDifferencer::Equals(merged.ToProto(),
+                                         expected.ToProto()));
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, ReportAggregatorEngineTest,
+                         ::testing::Values(AggregationEngine::kHash,
+                                           AggregationEngine::kSort));
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,122 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/model_applier/sorted_pair_counter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// The key, virtual person id and count of a run.
+using PairRun = std::tuple<uint32_t, int64_t, int64_t>;
+
+std::vector<PairRun> GetRuns(const SortedPairCounter& counter) {
+  std::vector<PairRun> runs;
+  counter.ForEachRun([&runs](const uint32_t key,
+                             const int64_t virtual_person_id,
+                             const int64_t count) {
+    runs.emplace_back(key, virtual_person_id, count);
+  });
+  return runs;
+}
+
+TEST(SortedPairCounterTest, Empty) {
+  SortedPairCounter counter;
+  counter.Sort(4);
+  EXPECT_EQ(counter.size(), 0);
+  EXPECT_THAT(GetRuns(counter), IsEmpty());
+}
+
+TEST(SortedPairCounterTest, CountsPairsSortedByIdThenKey) {
+  SortedPairCounter counter;
+  counter.Add(2, 5);
+  counter.Add(0, 7);
+  counter.Add(2, 5);
+  counter.Add(0, -1);
+  counter.Add(1, 5);
+  counter.Add(0, 7);
+  counter.Add(0, 7);
+  counter.Add(0x10000, 3);
+  counter.Sort(1);
+
+  EXPECT_EQ(counter.size(), 8);
+  // The ids are ordered as unsigned integers, so -1 is the last.
+  EXPECT_THAT(GetRuns(counter),
+              ElementsAre(PairRun(0x10000, 3, 1), PairRun(1, 5, 1),
+                          PairRun(2, 5, 2), PairRun(0, 7, 3),
+                          PairRun(0, -1, 1)));
+}
+
+TEST(SortedPairCounterTest, AddAfterSort) {
+  SortedPairCounter counter;
+  counter.Add(1, 1);
+  counter.Add(0, 2);
+  counter.Sort(1);
+  counter.Add(0, 2);
+  counter.Add(0, 1);
+  counter.Sort(1);
+
+  EXPECT_THAT(GetRuns(counter),
+              ElementsAre(PairRun(0, 1, 1), PairRun(1, 1, 1),
+                          PairRun(0, 2, 2)));
+}
+
+class SortedPairCounterThreadsTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(SortedPairCounterThreadsTest, MatchesSortedPairs) {
+  // Enough pairs for every thread to sort a range of its own, with repeated
+  // pairs, and keys and ids spread over all the bytes.
+  std::mt19937_64 random(GetParam());
+  std::vector<std::pair<uint64_t, uint32_t>> pairs;
+  SortedPairCounter counter;
+  for (int i = 0; i < 1 << 19; ++i) {
+    uint32_t key = random() % 3 == 0 ? random() : random() % 16;
+    uint64_t virtual_person_id =
+        random() % 2 == 0 ? random() : random() % 1000;
+    counter.Add(key, static_cast<int64_t>(virtual_person_id));
+    pairs.emplace_back(virtual_person_id, key);
+  }
+  counter.Sort(GetParam());
+
+  std::sort(pairs.begin(), pairs.end());
+  std::vector<PairRun> expected;
+  for (const auto& [virtual_person_id, key] : pairs) {
+    if (!expected.empty() && std::get<0>(expected.back()) == key &&
+        std::get<1>(expected.back()) ==
+            static_cast<int64_t>(virtual_person_id)) {
+      ++std::get<2>(expected.back());
+    } else {
+      expected.emplace_back(key, static_cast<int64_t>(virtual_person_id), 1);
+    }
+  }
+  EXPECT_EQ(GetRuns(counter), expected);
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, SortedPairCounterThreadsTest,
+                         ::testing::Values(1, 2, 3, 8));
+
+}  // namespace
+}  // namespace wfa_virtual_people
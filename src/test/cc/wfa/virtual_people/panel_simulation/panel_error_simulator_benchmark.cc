@@ -0,0 +1,42 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "wfa/virtual_people/panel_simulation/panel_error_simulator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// Simulates the 10 panel sizes of the notebook, from 100 to 1000, with
+// state.range(0) replicates each, in state.range(1) threads.
+void BM_SimulatePanelError(benchmark::State& state) {
+  PanelErrorSimulationOptions options = {
+      .panel_sizes = {100, 200, 300, 400, 500, 600, 700, 800, 900, 1000},
+      .replicates = static_cast<int>(state.range(0)),
+      .threads = static_cast<int>(state.range(1)),
+      .seed = 1};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SimulatePanelError(options));
+  }
+  state.SetItemsProcessed(state.iterations() * options.replicates *
+                          options.panel_sizes.size());
+}
+BENCHMARK(BM_SimulatePanelError)
+    ->ArgsProduct({{1000, 10000}, {1, 4}})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace wfa_virtual_people
@@ -0,0 +1,179 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/panel_simulation/panel_error_simulator.h"
+
+#include <math.h>
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+
+constexpr int kReplicates = 4000;
+
+// Returns the point of @metric for the panel size at @size_index of the
+// options. The points are ordered by panel size and then by metric.
+const PanelErrorPoint& GetPoint(const std::vector<PanelErrorPoint>& points,
+                                const int size_index,
+                                const PanelMetric metric) {
+  return points[size_index * kPanelMetricCount + static_cast<int>(metric)];
+}
+
+TEST(PanelErrorSimulatorTest, GetBinomial) {
+  RandomGenerator random_generator(1);
+  EXPECT_EQ(GetBinomial(random_generator, 100, 0.0), 0);
+  EXPECT_EQ(GetBinomial(random_generator, 100, 1.0), 100);
+  EXPECT_EQ(GetBinomial(random_generator, 0, 0.5), 0);
+  for (const double rate : {0.01, 0.3, 0.5, 0.9}) {
+    double sum = 0.0;
+    double squared_sum = 0.0;
+    for (int i = 0; i < kReplicates; ++i) {
+      int32_t value = GetBinomial(random_generator, 1000, rate);
+      ASSERT_GE(value, 0);
+      ASSERT_LE(value, 1000);
+      sum += value;
+      squared_sum += static_cast<double>(value) * value;
+    }
+    double mean = sum / kReplicates;
+    double variance = squared_sum / kReplicates - mean * mean;
+    double expected_variance = 1000 * rate * (1.0 - rate);
+    EXPECT_THAT(mean, DoubleNear(1000 * rate, 0.05 * 1000 * rate))
+        << "rate: " << rate;
+    EXPECT_THAT(variance, DoubleNear(expected_variance,
+                                     0.1 * expected_variance))
+        << "rate: " << rate;
+  }
+}
+
+TEST(PanelErrorSimulatorTest, ReachAndFrequencyErrors) {
+  PanelErrorSimulationOptions options = {
+      .campaign = {.reach_rate = 0.5,
+                   .average_frequency = 3.0,
+                   .on_target_rate = 0.8},
+      .panel_sizes = {100, 400},
+      .replicates = kReplicates,
+      .seed = 1};
+  std::vector<PanelErrorPoint> points = SimulatePanelError(options);
+  ASSERT_EQ(points.size(), 2 * kPanelMetricCount);
+
+  for (int size_index = 0; size_index < 2; ++size_index) {
+    const int32_t panel_size = options.panel_sizes[size_index];
+    const PanelErrorPoint& reach =
+        GetPoint(points, size_index, PanelMetric::kReach);
+    EXPECT_EQ(reach.panel_size, panel_size);
+    EXPECT_EQ(reach.true_value, 0.5);
+    EXPECT_THAT(reach.mean, DoubleNear(0.5, 0.01));
+    // The reach is binomial, with relative stddev sqrt((1 - r) / (r * N)).
+    double expected_stddev = sqrt(0.5 / (0.5 * panel_size));
+    EXPECT_THAT(reach.relative_stddev,
+                DoubleNear(expected_stddev, 0.05 * expected_stddev));
+    // The relative errors of the reach are multiples of 1 / (r * N).
+    EXPECT_THAT(reach.relative_error_95,
+                DoubleNear(1.96 * expected_stddev,
+                           0.15 * expected_stddev + 1.0 / (0.5 * panel_size)));
+
+    const PanelErrorPoint& impressions =
+        GetPoint(points, size_index, PanelMetric::kImpressions);
+    EXPECT_EQ(impressions.true_value, 1.5);
+    EXPECT_THAT(impressions.mean, DoubleNear(1.5, 0.03));
+
+    const PanelErrorPoint& frequency =
+        GetPoint(points, size_index, PanelMetric::kAverageFrequency);
+    EXPECT_EQ(frequency.true_value, 3.0);
+    EXPECT_THAT(frequency.mean, DoubleNear(3.0, 0.03));
+    // The frequency of each reached person has variance
+    // (1 - q) / q^2 = 6 for q = 1 / 3, and about r * N people are reached.
+    double expected_frequency_stddev = sqrt(6.0 / (0.5 * panel_size)) / 3.0;
+    EXPECT_THAT(frequency.relative_stddev,
+                DoubleNear(expected_frequency_stddev,
+                           0.1 * expected_frequency_stddev));
+  }
+  // The error is proportional to 1 / sqrt(N).
+  EXPECT_THAT(GetPoint(points, 0, PanelMetric::kReach).relative_stddev /
+                  GetPoint(points, 1, PanelMetric::kReach).relative_stddev,
+              DoubleNear(2.0, 0.15));
+}
+
+TEST(PanelErrorSimulatorTest, OnTargetPercentageError) {
+  PanelErrorSimulationOptions options = {
+      .campaign = {.reach_rate = 1.0,
+                   .average_frequency = 1.0,
+                   .on_target_rate = 0.8},
+      .panel_sizes = {500},
+      .off_target_panel_ratio = 10.0,
+      .replicates = kReplicates,
+      .seed = 2};
+  std::vector<PanelErrorPoint> points = SimulatePanelError(options);
+  const PanelErrorPoint& otp =
+      GetPoint(points, 0, PanelMetric::kOnTargetPercentage);
+  EXPECT_EQ(otp.true_value, 0.8);
+  EXPECT_THAT(otp.mean, DoubleNear(0.8, 0.002));
+  // All the panelists in the bucket are reached, and the off target reach is
+  // binomial with chance q = 0.2 / (0.8 * 10) over 5000 panelists. By the
+  // delta method, the relative stddev is sqrt(p * (1 - p) * (1 - q) / N).
+  double expected_stddev = sqrt(0.8 * 0.2 * (1.0 - 0.025) / 500);
+  EXPECT_THAT(otp.relative_stddev,
+              DoubleNear(expected_stddev, 0.1 * expected_stddev));
+  // The reach and frequency of the bucket are exact.
+  EXPECT_EQ(GetPoint(points, 0, PanelMetric::kReach).relative_stddev, 0.0);
+  EXPECT_EQ(
+      GetPoint(points, 0, PanelMetric::kAverageFrequency).relative_stddev,
+      0.0);
+}
+
+TEST(PanelErrorSimulatorTest, SameResultsWithAnyThreadCount) {
+  PanelErrorSimulationOptions options = {.panel_sizes = {50, 100, 200},
+                                         .replicates = 100,
+                                         .threads = 1,
+                                         .seed = 3};
+  std::string expected = PanelErrorToCsv(SimulatePanelError(options));
+  for (const int threads : {2, 3, 8}) {
+    options.threads = threads;
+    EXPECT_EQ(PanelErrorToCsv(SimulatePanelError(options)), expected)
+        << "threads: " << threads;
+  }
+  options.seed = 4;
+  EXPECT_NE(PanelErrorToCsv(SimulatePanelError(options)), expected);
+}
+
+TEST(PanelErrorSimulatorTest, PanelErrorToCsv) {
+  std::vector<PanelErrorPoint> points = {
+      {.metric = PanelMetric::kReach,
+       .panel_size = 100,
+       .true_value = 0.5,
+       .mean = 0.51,
+       .relative_stddev = 0.1,
+       .relative_error_95 = 0.2},
+      {.metric = PanelMetric::kOnTargetPercentage,
+       .panel_size = 200,
+       .true_value = 0.8,
+       .mean = 0.79,
+       .relative_stddev = 0.02,
+       .relative_error_95 = 0.04}};
+  EXPECT_EQ(PanelErrorToCsv(points),
+            "metric,panel_size,true_value,mean,relative_stddev,"
+            "relative_error_95\n"
+            "reach,100,0.5,0.51,0.1,0.2\n"
+            "on_target_percentage,200,0.8,0.79,0.02,0.04\n");
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people
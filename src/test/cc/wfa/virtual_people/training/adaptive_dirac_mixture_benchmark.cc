@@ -0,0 +1,77 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+#include "wfa/virtual_people/training/adaptive_dirac_mixture.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+// The count of training steps in each iteration of the benchmark.
+constexpr int kSteps = 50;
+
+// The 9 underlying deltas of the notebook.
+DiracMixture GetUnderlyingMixture() {
+  DiracMixture mixture;
+  mixture.deltas = {{1.5, 1.5}, {0.5, 1.5}, {0.4, 0.6},
+                    {0.6, 0.4}, {0.8, 0.2}, {1.0, 0.2},
+                    {1.2, 0.2}, {1.4, 0.4}, {1.6, 0.6}};
+  mixture.alphas.assign(mixture.deltas.size(), 1.0 / 9);
+  return mixture;
+}
+
+// The first argument is the count of observations, and the second is the
+// count of threads.
+void BM_FitAdaptiveDiracMixture(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  ReachObservations observations = GetSyntheticObservations(
+      GetUnderlyingMixture(), state.range(0), random_generator);
+  AdaptiveDiracMixtureOptions options;
+  options.max_steps = kSteps;
+  options.threads = static_cast<int>(state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        FitAdaptiveDiracMixture(observations, options, random_generator));
+  }
+  state.SetItemsProcessed(state.iterations() * kSteps);
+}
+BENCHMARK(BM_FitAdaptiveDiracMixture)
+    ->Args({1000, 1})
+    ->Args({100000, 1})
+    ->Args({100000, 4})
+    ->Args({100000, 16})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// The argument is the count of deltas.
+void BM_FitAlphas(benchmark::State& state) {
+  RandomGenerator random_generator(1);
+  ReachObservations observations = GetSyntheticObservations(
+      GetUnderlyingMixture(), 10000, random_generator);
+  std::vector<std::vector<double>> deltas;
+  for (int i = 0; i < state.range(0); ++i) {
+    deltas.push_back({random_generator.GetDouble(0.1, 2.0),
+                      random_generator.GetDouble(0.1, 2.0)});
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(FitAlphas(deltas, observations));
+  }
+}
+BENCHMARK(BM_FitAlphas)->Arg(10)->Arg(50)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace wfa_virtual_people
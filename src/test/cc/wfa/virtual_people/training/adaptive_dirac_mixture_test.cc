@@ -0,0 +1,200 @@
+// Copyright 2021 The Cross-Media Measurement Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "wfa/virtual_people/training/adaptive_dirac_mixture.h"
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "wfa/virtual_people/events_generator/random_generator.h"
+
+namespace wfa_virtual_people {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::ElementsAre;
+using ::testing::Lt;
+
+// Returns the root mean squared error of the prediction of @mixture.
+double GetRootMeanSquaredError(const DiracMixture& mixture,
+                               const ReachObservations& observations) {
+  double sum = 0.0;
+  for (size_t i = 0; i < observations.size(); ++i) {
+    double error =
+        mixture.Predict(observations.signal(i)) - observations.targets[i];
+    sum += error * error;
+  }
+  return sqrt(sum / observations.size());
+}
+
+// Returns the sum of the alphas of the deltas within @radius of @center.
+double GetAlphaNear(const DiracMixture& mixture,
+                    const std::vector<double>& center, const double radius) {
+  double output = 0.0;
+  for (size_t i = 0; i < mixture.deltas.size(); ++i) {
+    double distance = 0.0;
+    for (size_t j = 0; j < center.size(); ++j) {
+      double diff = mixture.deltas[i][j] - center[j];
+      distance += diff * diff;
+    }
+    if (sqrt(distance) <= radius) {
+      output += mixture.alphas[i];
+    }
+  }
+  return output;
+}
+
+// Returns the distance from @center to the mean of the deltas within @radius
+// of @center, weighted by their alphas.
+double GetDistanceToMeanNear(const DiracMixture& mixture,
+                             const std::vector<double>& center,
+                             const double radius) {
+  std::vector<double> mean(center.size(), 0.0);
+  double total_alpha = 0.0;
+  for (size_t i = 0; i < mixture.deltas.size(); ++i) {
+    double distance = 0.0;
+    for (size_t j = 0; j < center.size(); ++j) {
+      double diff = mixture.deltas[i][j] - center[j];
+      distance += diff * diff;
+    }
+    if (sqrt(distance) <= radius) {
+      total_alpha += mixture.alphas[i];
+      for (size_t j = 0; j < center.size(); ++j) {
+        mean[j] += mixture.alphas[i] * mixture.deltas[i][j];
+      }
+    }
+  }
+  double distance = 0.0;
+  for (size_t j = 0; j < center.size(); ++j) {
+    double diff = mean[j] / total_alpha - center[j];
+    distance += diff * diff;
+  }
+  return sqrt(distance);
+}
+
+TEST(AdaptiveDiracMixtureTest, PredictAndToCsv) {
+  DiracMixture mixture = {.alphas = {0.25, 0.75},
+                          .deltas = {{1.0, 0.0}, {0.5, 2.0}}};
+  EXPECT_THAT(mixture.Predict({1.0, 1.0}),
+              DoubleNear(0.25 * (1 - exp(-1.0)) + 0.75 * (1 - exp(-2.5)),
+                         1e-12));
+  EXPECT_EQ(mixture.ToCsv(), "0.25,1,0\n0.75,0.5,2\n");
+}
+
+TEST(AdaptiveDiracMixtureTest, SolveNonNegativeLeastSquares) {
+  // The columns of A are (1, 0, 1) and (0, 1, 1).
+  std::vector<std::vector<double>> columns = {{1.0, 0.0, 1.0},
+                                              {0.0, 1.0, 1.0}};
+  // Unconstrained solution is non-negative.
+  EXPECT_THAT(SolveNonNegativeLeastSquares(columns, {1.0, 1.0, 2.0}),
+              ElementsAre(DoubleNear(1.0, 1e-9), DoubleNear(1.0, 1e-9)));
+  // Unconstrained solution is (2, -1).
+  EXPECT_THAT(SolveNonNegativeLeastSquares(columns, {3.0, 0.0, 0.0}),
+              ElementsAre(DoubleNear(1.5, 1e-9), DoubleNear(0.0, 1e-9)));
+  EXPECT_THAT(SolveNonNegativeLeastSquares({{1.0, 0.0}, {0.0, 1.0}},
+                                           {-1.0, -1.0}),
+              ElementsAre(0.0, 0.0));
+}
+
+TEST(AdaptiveDiracMixtureTest, SolveNonNegativeLeastSquaresDependentColumns) {
+  // The second column is the same as the first, so only one of them is used.
+  std::vector<double> x = SolveNonNegativeLeastSquares(
+      {{1.0, 0.0, 1.0}, {1.0, 0.0, 1.0}, {0.0, 1.0, 1.0}}, {1.0, 1.0, 2.0});
+  EXPECT_THAT(x[0] + x[1], DoubleNear(1.0, 1e-9));
+  EXPECT_THAT(x[2], DoubleNear(1.0, 1e-9));
+}
+
+// Same as "Fitting coefficients for the pre-specified deltas" in the notebook.
+TEST(AdaptiveDiracMixtureTest, FitAlphas) {
+  RandomGenerator random_generator(1);
+  DiracMixture mixture = {.alphas = {0.2, 0.8},
+                          .deltas = {{1.5, 0.5}, {0.5, 1.5}}};
+  ReachObservations observations =
+      GetSyntheticObservations(mixture, 1000, random_generator);
+  EXPECT_THAT(FitAlphas(mixture.deltas, observations),
+              ElementsAre(DoubleNear(0.2, 1e-6), DoubleNear(0.8, 1e-6)));
+}
+
+// Same as the toy example of "Adaptive Dirac Mixture Fitting Function" in the
+// notebook, where the fitted deltas are close to the 2 underlying deltas, each
+// with total alpha close to 0.5. The deltas very close to each other fit the
+// observations equally well up to the rounding errors, so the alpha of each
+// underlying delta is split among several fitted deltas, as in the notebook.
+// The mean of those is within 0.001 of the underlying delta.
+TEST(AdaptiveDiracMixtureTest, FitTwoDeltas) {
+  RandomGenerator random_generator(1);
+  DiracMixture underlying = {.alphas = {0.5, 0.5},
+                             .deltas = {{1.5, 0.5}, {0.5, 1.5}}};
+  ReachObservations observations =
+      GetSyntheticObservations(underlying, 1000, random_generator);
+
+  AdaptiveDiracMixtureOptions options;
+  options.max_steps = 300;
+  DiracMixture fitted =
+      FitAdaptiveDiracMixture(observations, options, random_generator);
+
+  EXPECT_THAT(GetRootMeanSquaredError(fitted, observations), Lt(1e-5));
+  for (const std::vector<double>& delta : underlying.deltas) {
+    EXPECT_THAT(GetAlphaNear(fitted, delta, 0.01), DoubleNear(0.5, 0.02));
+    EXPECT_THAT(GetDistanceToMeanNear(fitted, delta, 0.01), Lt(0.001));
+  }
+}
+
+// Same as the example of "Creating an animation of ADM search" in the
+// notebook, with 9 underlying deltas, using multiple threads. The observations
+// are split into more blocks than threads, so that all the threads are used,
+// and the fit is the same as with one thread. The 2 deltas far from the others
+// are recovered. The other 7 deltas have close reach curves, so they cannot be
+// told apart with this many observations, and only their total alpha is
+// checked.
+TEST(AdaptiveDiracMixtureTest, FitNineDeltasWithThreads) {
+  RandomGenerator random_generator(1);
+  DiracMixture underlying;
+  underlying.deltas = {{1.5, 1.5}, {0.5, 1.5}, {0.4, 0.6},
+                       {0.6, 0.4}, {0.8, 0.2}, {1.0, 0.2},
+                       {1.2, 0.2}, {1.4, 0.4}, {1.6, 0.6}};
+  underlying.alphas.assign(underlying.deltas.size(), 1.0 / 9);
+  ReachObservations observations =
+      GetSyntheticObservations(underlying, 2000, random_generator);
+
+  AdaptiveDiracMixtureOptions options;
+  RandomGenerator serial_random_generator(2);
+  DiracMixture serial = FitAdaptiveDiracMixture(observations, options,
+                                                serial_random_generator);
+  options.threads = 4;
+  RandomGenerator threaded_random_generator(2);
+  DiracMixture threaded = FitAdaptiveDiracMixture(observations, options,
+                                                  threaded_random_generator);
+
+  EXPECT_EQ(threaded.alphas, serial.alphas);
+  EXPECT_EQ(threaded.deltas, serial.deltas);
+  EXPECT_THAT(GetRootMeanSquaredError(threaded, observations), Lt(1e-4));
+  double total_alpha = 0.0;
+  for (double alpha : threaded.alphas) {
+    total_alpha += alpha;
+  }
+  EXPECT_THAT(total_alpha, DoubleNear(1.0, 0.01));
+  for (const std::vector<double>& delta : {underlying.deltas[0],
+                                           underlying.deltas[1]}) {
+    EXPECT_THAT(GetAlphaNear(threaded, delta, 0.1), DoubleNear(1.0 / 9, 0.01));
+    EXPECT_THAT(GetDistanceToMeanNear(threaded, delta, 0.1), Lt(0.01));
+  }
+}
+
+}  // namespace
+}  // namespace wfa_virtual_people